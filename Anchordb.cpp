@@ -0,0 +1,241 @@
+#include "Anchordb.h"
+#include "Msg20.h"
+#include "SafeBuf.h"
+#include "Conf.h"
+#include "Mem.h"
+#include "hash.h"
+#include "Errno.h"
+#include "Log.h"
+
+Anchordb g_anchordb;
+
+// . fixed part of the record data
+// . followed by the ubuf, linkText, surroundingText, rssItem, note,
+//   vector1 and vector2 data in that order
+struct AnchordbRecHeader {
+	uint8_t  m_version;
+	uint8_t  m_flags;
+	char     m_siteRank;
+	uint8_t  m_language;
+	uint16_t m_country;
+	int32_t  m_ip;
+	int32_t  m_firstIp;
+	int32_t  m_midDomHash;
+	int32_t  m_siteNumInlinks;
+	int32_t  m_firstIndexedDate;
+	int32_t  m_lastSpidered;
+	int32_t  m_numOutlinks;
+	// . hash of the sorted tag pair vector
+	// . Msg25::isDup() requires the vectors to be 100% similar, so a hash
+	//   is as good as the whole vector
+	uint32_t m_tagPairHash;
+	int32_t  size_ubuf;
+	int32_t  size_linkText;
+	int32_t  size_surroundingText;
+	int32_t  size_rssItem;
+	int32_t  size_note;
+	int32_t  size_vector1;
+	int32_t  size_vector2;
+} __attribute__((packed));
+
+#define ANCHORDB_ISLINKSPAM  0x01
+#define ANCHORDB_ISPERMALINK 0x02
+
+void Anchordb::reset() {
+	m_rdb.reset();
+}
+
+bool Anchordb::init() {
+	int64_t maxTreeMem = g_conf.m_anchordbMaxTreeMem;
+	// . what's max # of tree nodes?
+	// . key+dataPtr+dataSize+left+right+parent
+	// . assume 300 bytes of data per record on average
+	int32_t maxTreeNodes = maxTreeMem / (sizeof(key224_t) + 16 + 300);
+
+	// init the rdb
+	return m_rdb.init("anchordb",
+			  -1,        // variable data size
+			  6,         // min files to merge
+			  maxTreeMem,
+			  maxTreeNodes,
+			  false,     // use half keys
+			  sizeof(key224_t),
+			  false);    // useIndexFile
+}
+
+bool Anchordb::serialize(const Msg20Reply *reply, SafeBuf *sb) {
+	AnchordbRecHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+
+	hdr.m_version          = ANCHORDB_VERSION;
+	hdr.m_flags            = 0;
+	if (reply->m_isLinkSpam)  hdr.m_flags |= ANCHORDB_ISLINKSPAM;
+	if (reply->m_isPermalink) hdr.m_flags |= ANCHORDB_ISPERMALINK;
+	hdr.m_siteRank         = reply->m_siteRank;
+	hdr.m_language         = reply->m_language;
+	hdr.m_country          = reply->m_country;
+	hdr.m_ip               = reply->m_ip;
+	hdr.m_firstIp          = reply->m_firstIp;
+	hdr.m_midDomHash       = reply->m_midDomHash;
+	hdr.m_siteNumInlinks   = reply->m_siteNumInlinks;
+	hdr.m_firstIndexedDate = reply->m_firstIndexedDate;
+	hdr.m_lastSpidered     = reply->m_lastSpidered;
+	hdr.m_numOutlinks      = reply->m_numOutlinks;
+
+	// the vector is 0-terminated, do not hash that
+	if (reply->ptr_vector3 && reply->size_vector3 > 4) {
+		hdr.m_tagPairHash = hash32((const char *)reply->ptr_vector3, reply->size_vector3 - 4);
+		// 0 means no vector
+		if (hdr.m_tagPairHash == 0) hdr.m_tagPairHash = 1;
+	}
+
+	hdr.size_ubuf            = reply->ptr_ubuf            ? reply->size_ubuf            : 0;
+	hdr.size_linkText        = reply->ptr_linkText        ? reply->size_linkText        : 0;
+	hdr.size_surroundingText = reply->ptr_surroundingText ? reply->size_surroundingText : 0;
+	hdr.size_rssItem         = reply->ptr_rssItem         ? reply->size_rssItem         : 0;
+	hdr.size_note            = reply->ptr_note            ? reply->size_note            : 0;
+	hdr.size_vector1         = reply->ptr_vector1         ? reply->size_vector1         : 0;
+	hdr.size_vector2         = reply->ptr_vector2         ? reply->size_vector2         : 0;
+
+	int32_t need = sizeof(hdr) + hdr.size_ubuf + hdr.size_linkText + hdr.size_surroundingText +
+	               hdr.size_rssItem + hdr.size_note + hdr.size_vector1 + hdr.size_vector2;
+	if (!sb->reserve(need, "anchrec")) {
+		return false;
+	}
+
+	sb->safeMemcpy(&hdr, sizeof(hdr));
+	sb->safeMemcpy(reply->ptr_ubuf, hdr.size_ubuf);
+	sb->safeMemcpy(reply->ptr_linkText, hdr.size_linkText);
+	sb->safeMemcpy(reply->ptr_surroundingText, hdr.size_surroundingText);
+	sb->safeMemcpy(reply->ptr_rssItem, hdr.size_rssItem);
+	sb->safeMemcpy(reply->ptr_note, hdr.size_note);
+	sb->safeMemcpy(reply->ptr_vector1, hdr.size_vector1);
+	sb->safeMemcpy(reply->ptr_vector2, hdr.size_vector2);
+	return true;
+}
+
+// a string field must be empty or \0 terminated
+static bool isTerminated(const char *p, int32_t size) {
+	return size == 0 || p[size - 1] == '\0';
+}
+
+Msg20Reply *Anchordb::makeMsg20Reply(const char *data, int32_t dataSize, int64_t docId, int32_t *replySize) {
+	AnchordbRecHeader hdr;
+	if (dataSize < (int32_t)sizeof(hdr)) {
+		g_errno = ECORRUPTDATA;
+		return NULL;
+	}
+	memcpy(&hdr, data, sizeof(hdr));
+
+	// we only know this version
+	if (hdr.m_version != ANCHORDB_VERSION) {
+		g_errno = ECORRUPTDATA;
+		return NULL;
+	}
+
+	if (hdr.size_ubuf < 0 || hdr.size_linkText < 0 || hdr.size_surroundingText < 0 || hdr.size_rssItem < 0 ||
+	    hdr.size_note < 0 || hdr.size_vector1 < 0 || hdr.size_vector2 < 0) {
+		g_errno = ECORRUPTDATA;
+		return NULL;
+	}
+
+	int64_t stringSize = (int64_t)hdr.size_ubuf + hdr.size_linkText + hdr.size_surroundingText +
+	                     hdr.size_rssItem + hdr.size_note + hdr.size_vector1 + hdr.size_vector2;
+	if ((int64_t)sizeof(hdr) + stringSize != dataSize) {
+		g_errno = ECORRUPTDATA;
+		return NULL;
+	}
+
+	// the tag pair hash becomes a vector of one component, plus the 0
+	int32_t vector3Size = hdr.m_tagPairHash ? 8 : 0;
+
+	// freed by Msg20::freeReply() when set as its m_r with this m_replyMaxSize
+	int32_t size = sizeof(Msg20Reply) + stringSize + vector3Size;
+	char *buf = (char *)mmalloc(size, "Msg20b");
+	if (!buf) {
+		return NULL;
+	}
+
+	Msg20Reply *reply = (Msg20Reply *)buf;
+	reply->reset();
+
+	reply->m_docId            = docId;
+	reply->m_isLinkSpam       = (hdr.m_flags & ANCHORDB_ISLINKSPAM) ? 1 : 0;
+	reply->m_isPermalink      = (hdr.m_flags & ANCHORDB_ISPERMALINK) ? 1 : 0;
+	reply->m_siteRank         = hdr.m_siteRank;
+	reply->m_language         = hdr.m_language;
+	reply->m_country          = hdr.m_country;
+	reply->m_ip               = hdr.m_ip;
+	reply->m_firstIp          = hdr.m_firstIp;
+	reply->m_midDomHash       = hdr.m_midDomHash;
+	reply->m_siteNumInlinks   = hdr.m_siteNumInlinks;
+	reply->m_firstIndexedDate = hdr.m_firstIndexedDate;
+	reply->m_firstSpidered    = hdr.m_firstIndexedDate;
+	reply->m_lastSpidered     = hdr.m_lastSpidered;
+	reply->m_numOutlinks      = hdr.m_numOutlinks;
+
+	const char *src = data + sizeof(hdr);
+	char *dst = buf + sizeof(Msg20Reply);
+
+	reply->size_ubuf = hdr.size_ubuf;
+	reply->ptr_ubuf = hdr.size_ubuf ? dst : NULL;
+	memcpy(dst, src, hdr.size_ubuf);
+	dst += hdr.size_ubuf;
+	src += hdr.size_ubuf;
+
+	reply->size_linkText = hdr.size_linkText;
+	reply->ptr_linkText = hdr.size_linkText ? dst : NULL;
+	memcpy(dst, src, hdr.size_linkText);
+	dst += hdr.size_linkText;
+	src += hdr.size_linkText;
+
+	reply->size_surroundingText = hdr.size_surroundingText;
+	reply->ptr_surroundingText = hdr.size_surroundingText ? dst : NULL;
+	memcpy(dst, src, hdr.size_surroundingText);
+	dst += hdr.size_surroundingText;
+	src += hdr.size_surroundingText;
+
+	reply->size_rssItem = hdr.size_rssItem;
+	reply->ptr_rssItem = hdr.size_rssItem ? dst : NULL;
+	memcpy(dst, src, hdr.size_rssItem);
+	dst += hdr.size_rssItem;
+	src += hdr.size_rssItem;
+
+	reply->size_note = hdr.size_note;
+	reply->ptr_note = hdr.size_note ? dst : NULL;
+	memcpy(dst, src, hdr.size_note);
+	dst += hdr.size_note;
+	src += hdr.size_note;
+
+	reply->size_vector1 = hdr.size_vector1;
+	reply->ptr_vector1 = hdr.size_vector1 ? (int32_t *)dst : NULL;
+	memcpy(dst, src, hdr.size_vector1);
+	dst += hdr.size_vector1;
+	src += hdr.size_vector1;
+
+	reply->size_vector2 = hdr.size_vector2;
+	reply->ptr_vector2 = hdr.size_vector2 ? (int32_t *)dst : NULL;
+	memcpy(dst, src, hdr.size_vector2);
+	dst += hdr.size_vector2;
+	src += hdr.size_vector2;
+
+	if (vector3Size) {
+		((uint32_t *)dst)[0] = hdr.m_tagPairHash;
+		((uint32_t *)dst)[1] = 0;
+		reply->ptr_vector3 = (int32_t *)dst;
+		reply->size_vector3 = vector3Size;
+	}
+
+	if (!isTerminated(reply->ptr_ubuf, reply->size_ubuf) ||
+	    !isTerminated(reply->ptr_linkText, reply->size_linkText) ||
+	    !isTerminated(reply->ptr_surroundingText, reply->size_surroundingText) ||
+	    !isTerminated(reply->ptr_rssItem, reply->size_rssItem) ||
+	    !isTerminated(reply->ptr_note, reply->size_note)) {
+		mfree(buf, size, "Msg20b");
+		g_errno = ECORRUPTDATA;
+		return NULL;
+	}
+
+	*replySize = size;
+	return reply;
+}
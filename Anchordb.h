@@ -0,0 +1,50 @@
+// Anchordb - stores the anchor text of outlinks
+
+// . one record per linkdb "url" key, added when the linker is indexed
+// . the key is the linkdb "url" key with the discovery and lost dates
+//   cleared (see Linkdb::makeKey_uk()), so it is sharded like linkdb and
+//   sorts just before the linkdb key of the same link
+// . the data is what Msg25 used to get from a Msg20 link text request to
+//   the linker: anchor text, surrounding text, rss item, dedup vectors and
+//   the linker's siterank/ips
+// . lets Msg25 build the LinkInfo of a url from a single range read instead
+//   of fetching the titlerec of every linker
+
+#ifndef GB_ANCHORDB_H
+#define GB_ANCHORDB_H
+
+#include "Rdb.h"
+#include "types.h"
+
+class Msg20Reply;
+class SafeBuf;
+
+#define ANCHORDB_VERSION 1
+
+class Anchordb {
+public:
+	void reset();
+
+	bool init();
+
+	Rdb *getRdb() { return &m_rdb; }
+
+	// . store the link text fields of "reply" as anchordb record data
+	// . returns false and sets g_errno on error
+	static bool serialize(const Msg20Reply *reply, SafeBuf *sb);
+
+	// . make an mmalloc'd Msg20Reply from anchordb record data, the
+	//   strings are stored right after it
+	// . it is allocated like a Msg20 reply of *replySize bytes so
+	//   Msg20::freeReply() can free it
+	// . docId is not stored in the data, it is in the key
+	// . returns NULL and sets g_errno on error
+	static Msg20Reply *makeMsg20Reply(const char *data, int32_t dataSize, int64_t docId, int32_t *replySize);
+
+private:
+	Rdb m_rdb;
+};
+
+extern class Anchordb g_anchordb;
+
+#endif // GB_ANCHORDB_H
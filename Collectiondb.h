@@ -79,12 +79,11 @@ class Collectiondb  {
 	// returns false if blocked, true otherwise.
 	bool resetColl2(collnum_t oldCollnum, collnum_t newCollnum);
 
-
-private:
 	// after main.cpp loads all rdb trees it calls this to remove
 	// bogus collnums from the trees i guess
 	bool cleanTrees();
 
+private:
 	bool registerCollRec(CollectionRec *cr);
 
 	bool growRecPtrBuf(collnum_t collnum);
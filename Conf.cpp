@@ -54,6 +54,9 @@ Conf::Conf ( ) {
 	memset(m_dnsIps, 0, sizeof(m_dnsIps));
 	memset(m_dnsPorts, 0, sizeof(m_dnsPorts));
 	m_dnsCacheMaxAge = 0;
+	m_dnsCacheMinTtl = 0;
+	m_dnsNegativeCacheMaxAge = 0;
+	m_dnsMaxPrefetches = 0;
 	m_dnsCacheSize = 0;
 	m_dnsMaxCacheMem = 0;
 	m_clusterdbQuickCacheMem = 0;
@@ -82,13 +85,20 @@ Conf::Conf ( ) {
 	m_urlClassificationTimeout = 0;
 
 	m_mergeBufSize = 0;
+	m_mergeMaxMBPerSec = 0;
+	m_mergeNumPartitions = 1;
+	m_mergePartitionsMaxMem = 0;
 	m_doledbNukeInterval = 86400;
+	m_spiderFrontierEnabled = false;
 	m_posdbMaxLostPositivesPercentage = 0;
 	m_posdbFileCacheSize = 0;
 	m_posdbMaxTreeMem = 0;
 	m_tagdbMaxLostPositivesPercentage = 0;
 	m_tagdbFileCacheSize = 0;
 	m_tagdbMaxTreeMem = 0;
+	m_tagRecCacheSize = 0;
+	m_tagRecCacheMaxAge = 0;
+	m_tagRecCacheVolatileMaxAge = 0;
 	m_mergespaceLockDirectory[0] = '\0';
 	m_mergespaceMinLockFiles = 0;
 	m_mergespaceDirectory[0] = '\0';
@@ -105,6 +115,13 @@ Conf::Conf ( ) {
 	m_linkdbMaxLostPositivesPercentage = 0;
 	m_linkdbMaxTreeMem = 0;
 	m_linkdbMinFilesToMerge = 0;
+	m_useAnchordb = false;
+	m_anchordbMaxLostPositivesPercentage = 0;
+	m_anchordbMaxTreeMem = 0;
+	m_useSimhashdb = false;
+	m_simhashDupMaxDistance = 0;
+	m_simhashdbMaxLostPositivesPercentage = 0;
+	m_simhashdbMaxTreeMem = 0;
 	m_maxCpuThreads = 0;
 	m_maxIOThreads = 0;
 	m_maxExternalThreads = 0;
@@ -120,6 +137,8 @@ Conf::Conf ( ) {
 	max_docid_splits = 0;
 	m_msg40_msg39_timeout = 0;
 	m_msg3a_msg39_network_overhead = 0;
+	m_queryAdmissionControl = false;
+	m_queryDegradePercent = 0;
 	m_useHighFrequencyTermCache = false;
 	m_spideringEnabled = false;
 	m_injectionsEnabled = false;
@@ -132,11 +151,17 @@ Conf::Conf ( ) {
 	m_isLive = false;
 	m_maxTotalSpiders = 0;
 	m_spiderFilterableMaxWordCount = 0;
+	m_docConverterWorkers = 0;
+	m_docConverterTimeout = 0;
+	m_docConverterMaxMem = 0;
+	m_docConverterMaxConversions = 0;
+	m_thumbnailMaxPixels = 0;
 	m_spiderDeadHostCheckInterval = 0;
 	m_spiderUrlCacheMaxAge = 0;
 	m_spiderUrlCacheSize = 0;
 	m_indexdbMaxIndexListAge = 0;
 	m_udpMaxSockets = 0;
+	m_udpIoThreads = 0;
 	m_httpMaxSockets = 0;
 	m_httpsMaxSockets = 0;
 	m_httpMaxSendBufSize = 0;
@@ -162,6 +187,7 @@ Conf::Conf ( ) {
 	m_flushWrites = false;
 	m_verifyWrites = false;
 	m_verifyTagRec = false;
+	m_verifyPosdbPairScores = false;
 	m_corruptRetries = 0;
 	m_sqliteSynchronous = 1;
 	m_docDeleteDelayMs = 0;
@@ -177,6 +203,7 @@ Conf::Conf ( ) {
 	m_stableSummaryCacheMaxAge = 0;
 	m_unstableSummaryCacheSize = 0;
 	m_unstableSummaryCacheMaxAge = 0;
+	m_storePassageIndex = false;
 	m_useShotgun = false;
 	m_testMem = false;
 	m_doConsistencyTesting = false;
@@ -307,6 +334,10 @@ Conf::Conf ( ) {
 	memset(m_redirect, 0, sizeof(m_redirect));
 	m_useCompressionProxy = false;
 	m_gzipDownloads = false;
+	m_httpKeepAlive = false;
+	m_httpKeepAliveIdleTimeout = 4000;
+	m_httpKeepAliveMaxPerIp = 2;
+	m_httpKeepAliveMaxRequests = 100;
 	m_useTmpCluster = false;
 	m_allowScale = true;
 	m_bypassValidation = false;
@@ -90,6 +90,9 @@ class Conf {
 
 	int64_t m_dnsCacheSize;
 	int64_t m_dnsCacheMaxAge;
+	int64_t m_dnsCacheMinTtl;
+	int64_t m_dnsNegativeCacheMaxAge;
+	int32_t m_dnsMaxPrefetches;
 
 	int32_t  m_dnsMaxCacheMem;
 	
@@ -125,8 +128,12 @@ class Conf {
 	
 	// used to limit all rdb's to one merge per machine at a time
 	int32_t  m_mergeBufSize;
+	int32_t  m_mergeMaxMBPerSec;
+	int32_t  m_mergeNumPartitions;
+	int32_t  m_mergePartitionsMaxMem;
 
 	int32_t m_doledbNukeInterval;
+	bool m_spiderFrontierEnabled;
 	
 	// rdb settings
 
@@ -139,6 +146,9 @@ class Conf {
 	int32_t m_tagdbMaxLostPositivesPercentage;
 	int64_t m_tagdbFileCacheSize;
 	int32_t  m_tagdbMaxTreeMem;
+	int64_t m_tagRecCacheSize;
+	int64_t m_tagRecCacheMaxAge;
+	int64_t m_tagRecCacheVolatileMaxAge;
 
 	char m_mergespaceLockDirectory[1024];
 	int32_t m_mergespaceMinLockFiles;
@@ -165,6 +175,17 @@ class Conf {
 	int32_t  m_linkdbMaxTreeMem;
 	int32_t  m_linkdbMinFilesToMerge;
 
+	// anchordb for storing the anchor text of outlinks
+	bool     m_useAnchordb;
+	int32_t m_anchordbMaxLostPositivesPercentage;
+	int32_t  m_anchordbMaxTreeMem;
+
+	// simhashdb for near-duplicate removal of search results
+	bool     m_useSimhashdb;
+	int32_t  m_simhashDupMaxDistance;
+	int32_t  m_simhashdbMaxLostPositivesPercentage;
+	int32_t  m_simhashdbMaxTreeMem;
+
 	// are we doing a command line thing like 'gb 0 dump s ....' in
 	// which case we do not want to log certain things
 	bool m_doingCommandLine;
@@ -192,6 +213,8 @@ class Conf {
 	int32_t  max_docid_splits; //maximum number of DocId splits using Msg40
 	int64_t  m_msg40_msg39_timeout; //timeout for entire get-docid-list phase, in milliseconds.
 	int64_t  m_msg3a_msg39_network_overhead; //additional latency/overhead of sending reqeust+response over network.
+	bool     m_queryAdmissionControl;  //shed/degrade queries predicted to miss their deadline
+	int32_t  m_queryDegradePercent;    //degrade when the prediction is above this percentage of the deadline
 
 	bool	m_useHighFrequencyTermCache;
 
@@ -214,6 +237,14 @@ class Conf {
 
 	int32_t m_spiderFilterableMaxWordCount;
 
+	// document converter worker pool (gbconvert.sh)
+	int32_t m_docConverterWorkers;
+	int32_t m_docConverterTimeout;
+	int32_t m_docConverterMaxMem;
+	int32_t m_docConverterMaxConversions;
+
+	int32_t m_thumbnailMaxPixels;
+
 	int32_t m_spiderDeadHostCheckInterval;
 
 	int64_t m_spiderUrlCacheMaxAge;
@@ -223,6 +254,7 @@ class Conf {
 	int32_t  m_indexdbMaxIndexListAge;
 
 	int32_t m_udpMaxSockets;
+	int32_t m_udpIoThreads;
 
 	// TODO: parse these out!!!!
 	int32_t  m_httpMaxSockets;
@@ -274,6 +306,9 @@ class Conf {
 	// verify tagrec while indexing
 	bool m_verifyTagRec;
 
+	// compare the vectorized posdb pair scores with the scalar ones
+	bool m_verifyPosdbPairScores;
+
 	bool m_spiderHostToQueryHostFallbackAllowed;
 	bool m_queryHostToSpiderHostFallbackAllowed;
 
@@ -301,6 +336,8 @@ class Conf {
 	int64_t m_unstableSummaryCacheSize;
 	int64_t m_unstableSummaryCacheMaxAge;
 
+	bool   m_storePassageIndex;
+
 	bool   m_useShotgun;
 	bool   m_testMem;
 	bool   m_doConsistencyTesting;
@@ -470,6 +507,12 @@ class Conf {
 	bool m_useCompressionProxy;
 	bool m_gzipDownloads;
 
+	// persistent connections for spider downloads
+	bool    m_httpKeepAlive;
+	int32_t m_httpKeepAliveIdleTimeout;
+	int32_t m_httpKeepAliveMaxPerIp;
+	int32_t m_httpKeepAliveMaxRequests;
+
 	// used by proxy to make proxy point to the temp cluster while
 	// the original cluster is updated
 	bool m_useTmpCluster;
@@ -0,0 +1,593 @@
+#include "DocConverterPool.h"
+#include "ScopedLock.h"
+#include "SafeBuf.h"
+#include "HttpMime.h"
+#include "Conf.h"
+#include "Pages.h"
+#include "Hostdb.h"
+#include "Log.h"
+#include "fctypes.h"
+#include "Errno.h"
+#include <spawn.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <string.h>
+#include <errno.h>
+
+extern char **environ;
+
+
+DocConverterPool g_docConverterPool;
+
+#define CONVERTER_MAGIC 0x67626376  //"gbcv"
+
+// . sent to the worker, followed by m_contentLen bytes of content
+struct ConvertRequest {
+	uint32_t m_magic;
+	uint8_t  m_contentType;
+	uint8_t  m_reserved[3];
+	uint32_t m_maxMemMB;
+	uint32_t m_contentLen;
+} __attribute__((packed));
+
+// . sent back by the worker, followed by m_outputLen bytes of output
+struct ConvertReply {
+	uint32_t m_magic;
+	int32_t  m_exitStatus;       //-1 if gbconvert.sh did not exit normally
+	uint32_t m_outputLen;
+} __attribute__((packed));
+
+
+struct DocConverterPool::Worker {
+	pid_t   m_pid;
+	int     m_toFd;             //worker's stdin
+	int     m_fromFd;           //worker's stdout
+	bool    m_busy;
+	int32_t m_numConversions;
+};
+
+
+// . blocking read/write used by the worker
+static bool readFully(int fd, void *buf, size_t len) {
+	char *p = (char *)buf;
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool writeFully(int fd, const void *buf, size_t len) {
+	const char *p = (const char *)buf;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+// . read/write used by the pool, gives up at deadline
+static bool readFully(int fd, void *buf, size_t len, int64_t deadline) {
+	char *p = (char *)buf;
+	while (len > 0) {
+		int64_t left = deadline - gettimeofdayInMilliseconds();
+		if (left <= 0) {
+			errno = ETIMEDOUT;
+			return false;
+		}
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int rc = poll(&pfd, 1, (int)left);
+		if (rc < 0 && errno == EINTR) {
+			continue;
+		}
+		if (rc <= 0) {
+			if (rc == 0) errno = ETIMEDOUT;
+			return false;
+		}
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+			continue;
+		}
+		if (n <= 0) {
+			if (n == 0) errno = EPIPE;
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool writeFully(int fd, const void *buf, size_t len, int64_t deadline) {
+	const char *p = (const char *)buf;
+	while (len > 0) {
+		int64_t left = deadline - gettimeofdayInMilliseconds();
+		if (left <= 0) {
+			errno = ETIMEDOUT;
+			return false;
+		}
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
+		int rc = poll(&pfd, 1, (int)left);
+		if (rc < 0 && errno == EINTR) {
+			continue;
+		}
+		if (rc <= 0) {
+			if (rc == 0) errno = ETIMEDOUT;
+			return false;
+		}
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+
+DocConverterPool::DocConverterPool()
+  : m_workers()
+  , m_mtx()
+  , m_numUnavailable(0)
+  , m_numWorkerStarts(0) {
+	memset(m_stats, 0, sizeof(m_stats));
+}
+
+
+DocConverterPool::~DocConverterPool() {
+	reset();
+	for (auto w : m_workers) {
+		delete w;
+	}
+}
+
+
+void DocConverterPool::reset() {
+	ScopedLock sl(m_mtx);
+	for (auto w : m_workers) {
+		// busy workers are owned by a filter thread, it will stop them
+		if (w->m_busy) {
+			continue;
+		}
+		stopWorker(w);
+	}
+}
+
+
+bool DocConverterPool::startWorker(Worker *w) {
+	int toPipe[2];
+	int fromPipe[2];
+	if (pipe2(toPipe, O_CLOEXEC) != 0) {
+		log(LOG_WARN, "gbfilter: pipe2() failed: %s", mstrerror(errno));
+		return false;
+	}
+	if (pipe2(fromPipe, O_CLOEXEC) != 0) {
+		log(LOG_WARN, "gbfilter: pipe2() failed: %s", mstrerror(errno));
+		close(toPipe[0]);
+		close(toPipe[1]);
+		return false;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, toPipe[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, fromPipe[1], STDOUT_FILENO);
+
+	// . own process group so a timed out conversion can be killed with
+	//   the converter processes it started
+	// . do not inherit the signal mask of the filter thread
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setpgroup(&attr, 0);
+	sigset_t mask;
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+
+	char dir[sizeof(g_hostdb.m_dir)];
+	strcpy(dir, g_hostdb.m_dir);
+	char arg0[] = "gb";
+	char arg1[] = "convertworker";
+	char *argv[] = { arg0, arg1, dir, NULL };
+
+	pid_t pid;
+	int rc = posix_spawn(&pid, "/proc/self/exe", &actions, &attr, argv, environ);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	close(toPipe[0]);
+	close(fromPipe[1]);
+
+	if (rc != 0) {
+		log(LOG_WARN, "gbfilter: Could not start converter worker: %s", mstrerror(rc));
+		close(toPipe[1]);
+		close(fromPipe[0]);
+		return false;
+	}
+
+	w->m_pid = pid;
+	w->m_toFd = toPipe[1];
+	w->m_fromFd = fromPipe[0];
+	w->m_numConversions = 0;
+	m_numWorkerStarts++;
+
+	log(LOG_INFO, "gbfilter: Started converter worker pid=%d", (int)pid);
+	return true;
+}
+
+
+void DocConverterPool::stopWorker(Worker *w) {
+	if (w->m_pid <= 0) {
+		return;
+	}
+
+	close(w->m_toFd);
+	close(w->m_fromFd);
+
+	// kill the worker and whatever converter it is running
+	kill(-w->m_pid, SIGKILL);
+	kill(w->m_pid, SIGKILL);
+	while (waitpid(w->m_pid, NULL, 0) < 0 && errno == EINTR)
+		;
+
+	w->m_pid = -1;
+	w->m_toFd = -1;
+	w->m_fromFd = -1;
+	w->m_numConversions = 0;
+}
+
+
+// . returns an idle worker, starting one if needed
+// . returns NULL if all are busy or none could be started
+DocConverterPool::Worker *DocConverterPool::getWorker() {
+	ScopedLock sl(m_mtx);
+
+	int32_t maxWorkers = g_conf.m_docConverterWorkers;
+
+	int32_t numBusy = 0;
+	for (auto w : m_workers) {
+		if (w->m_busy) {
+			numBusy++;
+		}
+	}
+
+	for (auto w : m_workers) {
+		if (w->m_busy || w->m_pid <= 0) {
+			continue;
+		}
+
+		// worker exited (or was killed by the oom killer) while idle
+		if (waitpid(w->m_pid, NULL, WNOHANG) != 0) {
+			close(w->m_toFd);
+			close(w->m_fromFd);
+			w->m_pid = -1;
+			w->m_toFd = -1;
+			w->m_fromFd = -1;
+			continue;
+		}
+
+		// pool was shrunk
+		if (numBusy >= maxWorkers) {
+			stopWorker(w);
+			continue;
+		}
+
+		w->m_busy = true;
+		return w;
+	}
+
+	if (numBusy >= maxWorkers) {
+		m_numUnavailable++;
+		return NULL;
+	}
+
+	// reuse a stopped slot or make a new one
+	Worker *w = NULL;
+	for (auto stopped : m_workers) {
+		if (!stopped->m_busy && stopped->m_pid <= 0) {
+			w = stopped;
+			break;
+		}
+	}
+	if (!w) {
+		w = new Worker;
+		w->m_pid = -1;
+		w->m_toFd = -1;
+		w->m_fromFd = -1;
+		w->m_busy = false;
+		w->m_numConversions = 0;
+		m_workers.push_back(w);
+	}
+
+	if (!startWorker(w)) {
+		m_numUnavailable++;
+		return NULL;
+	}
+
+	w->m_busy = true;
+	return w;
+}
+
+
+void DocConverterPool::returnWorker(Worker *w, bool restart) {
+	ScopedLock sl(m_mtx);
+
+	w->m_numConversions++;
+	if (g_conf.m_docConverterMaxConversions > 0 && w->m_numConversions >= g_conf.m_docConverterMaxConversions) {
+		restart = true;
+	}
+
+	// . a fresh one is started the next time it is needed
+	if (restart) {
+		stopWorker(w);
+	}
+
+	w->m_busy = false;
+}
+
+
+bool DocConverterPool::convert(uint8_t contentType, const char *content, size_t contentLen, std::string *output, int *exitStatus) {
+	if (g_conf.m_docConverterWorkers <= 0 || contentLen > UINT32_MAX) {
+		return false;
+	}
+
+	Worker *w = getWorker();
+	if (!w) {
+		return false;
+	}
+
+	int64_t start = gettimeofdayInMilliseconds();
+	int64_t deadline = start + g_conf.m_docConverterTimeout;
+
+	ConvertRequest request;
+	memset(&request, 0, sizeof(request));
+	request.m_magic = CONVERTER_MAGIC;
+	request.m_contentType = contentType;
+	request.m_maxMemMB = g_conf.m_docConverterMaxMem > 0 ? g_conf.m_docConverterMaxMem : 0;
+	request.m_contentLen = (uint32_t)contentLen;
+
+	ConvertReply reply;
+	bool ok = writeFully(w->m_toFd, &request, sizeof(request), deadline) &&
+	          writeFully(w->m_toFd, content, contentLen, deadline) &&
+	          readFully(w->m_fromFd, &reply, sizeof(reply), deadline) &&
+	          reply.m_magic == CONVERTER_MAGIC;
+
+	if (ok) {
+		output->resize(reply.m_outputLen);
+		ok = readFully(w->m_fromFd, &((*output)[0]), reply.m_outputLen, deadline);
+	}
+
+	bool timedOut = !ok && errno == ETIMEDOUT;
+	if (!ok) {
+		log(LOG_WARN, "gbfilter: Converter worker pid=%d failed converting %s: %s",
+		    (int)w->m_pid, g_contentTypeStrings[contentType], timedOut ? "timed out" : mstrerror(errno));
+		output->clear();
+		*exitStatus = -1;
+	} else {
+		*exitStatus = reply.m_exitStatus;
+	}
+
+	returnWorker(w, !ok);
+
+	int64_t took = gettimeofdayInMilliseconds() - start;
+	logDebug(g_conf.m_logDebugSpider, "gbfilter: converted %s in %" PRId64" ms exitStatus=%d", g_contentTypeStrings[contentType], took, *exitStatus);
+
+	ScopedLock sl(m_mtx);
+	ContentTypeStats *stats = &m_stats[contentType % (sizeof(m_stats) / sizeof(m_stats[0]))];
+	stats->m_numConversions++;
+	if (*exitStatus != 0) {
+		stats->m_numFailed++;
+	}
+	if (timedOut) {
+		stats->m_numTimedOut++;
+	}
+	stats->m_totalMs += took;
+	if (took > stats->m_maxMs) {
+		stats->m_maxMs = took;
+	}
+
+	return true;
+}
+
+
+void DocConverterPool::printStats(SafeBuf *sb) {
+	ScopedLock sl(m_mtx);
+
+	int32_t numRunning = 0;
+	int32_t numBusy = 0;
+	for (auto w : m_workers) {
+		if (w->m_pid > 0) numRunning++;
+		if (w->m_busy) numBusy++;
+	}
+
+	sb->safePrintf("<table %s>"
+	               "<tr class=hdrow><td colspan=6><center><b>Document Converter</b> "
+	               "(%" PRId32" workers, %" PRId32" busy, %" PRId64" started, %" PRId64" unavailable)"
+	               "</center></td></tr>\n"
+	               "<tr class=poo>"
+	               "<td><b>content type</b></td>"
+	               "<td><b>conversions</b></td>"
+	               "<td><b>failed</b></td>"
+	               "<td><b>timed out</b></td>"
+	               "<td><b>avg (ms)</b></td>"
+	               "<td><b>max (ms)</b></td>"
+	               "</tr>\n",
+	               TABLE_STYLE, numRunning, numBusy, m_numWorkerStarts, m_numUnavailable);
+
+	for (int i = 0; i < (int)(sizeof(m_stats) / sizeof(m_stats[0])); i++) {
+		const ContentTypeStats &stats = m_stats[i];
+		if (stats.m_numConversions == 0) {
+			continue;
+		}
+		sb->safePrintf("<tr class=poo>"
+		               "<td>%s</td>"
+		               "<td>%" PRId64"</td>"
+		               "<td>%" PRId64"</td>"
+		               "<td>%" PRId64"</td>"
+		               "<td>%" PRId64"</td>"
+		               "<td>%" PRId64"</td>"
+		               "</tr>\n",
+		               g_contentTypeStrings[i],
+		               stats.m_numConversions,
+		               stats.m_numFailed,
+		               stats.m_numTimedOut,
+		               stats.m_totalMs / stats.m_numConversions,
+		               stats.m_maxMs);
+	}
+
+	sb->safePrintf("</table><br><br>\n");
+}
+
+
+// . runs in the worker process, single threaded
+// . converts one document at a time until stdin is closed
+int DocConverterPool::runWorker(const char *dir) {
+	// . gb opens most of its fds without close-on-exec so we inherited its
+	//   sockets and data files. close them so neither we nor the converters
+	//   keep them open
+	if (syscall(SYS_close_range, 3, ~0U, 0) != 0) {
+		struct rlimit rl;
+		int maxFd = (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) ? (int)rl.rlim_cur : 65536;
+		for (int fd = 3; fd < maxFd; fd++) {
+			close(fd);
+		}
+	}
+
+	char script[1024];
+	snprintf(script, sizeof(script), "%sgbconvert.sh", dir);
+
+	static char buf[65536];
+
+	for (;;) {
+		ConvertRequest request;
+		if (!readFully(STDIN_FILENO, &request, sizeof(request))) {
+			// gb went away
+			return 0;
+		}
+		if (request.m_magic != CONVERTER_MAGIC || request.m_contentType > CT_WARC) {
+			fprintf(stderr, "convertworker: bad request\n");
+			return 1;
+		}
+
+		// not close-on-exec, gbconvert.sh opens them as /proc/self/fd/N
+		int inFd = memfd_create("gbconvert.in", 0);
+		int outFd = memfd_create("gbconvert.out", 0);
+		if (inFd < 0 || outFd < 0) {
+			fprintf(stderr, "convertworker: memfd_create failed: %s\n", strerror(errno));
+			return 1;
+		}
+
+		for (uint32_t left = request.m_contentLen; left > 0; ) {
+			size_t n = left < sizeof(buf) ? left : sizeof(buf);
+			if (!readFully(STDIN_FILENO, buf, n)) {
+				return 0;
+			}
+			if (!writeFully(inFd, buf, n)) {
+				fprintf(stderr, "convertworker: write to memfd failed: %s\n", strerror(errno));
+				return 1;
+			}
+			left -= n;
+		}
+
+		char inPath[64];
+		char outPath[64];
+		snprintf(inPath, sizeof(inPath), "/proc/self/fd/%d", inFd);
+		snprintf(outPath, sizeof(outPath), "/proc/self/fd/%d", outFd);
+
+		int exitStatus = -1;
+		pid_t pid = fork();
+		if (pid == 0) {
+			// child, the converter gets the memory limit
+			if (request.m_maxMemMB > 0) {
+				struct rlimit rl;
+				rl.rlim_cur = rl.rlim_max = (rlim_t)request.m_maxMemMB * 1024 * 1024;
+				setrlimit(RLIMIT_AS, &rl);
+			}
+			signal(SIGPIPE, SIG_DFL);
+			// stdin/stdout are the pipes to gb, keep the converter off them
+			int nullFd = open("/dev/null", O_RDONLY);
+			if (nullFd >= 0) {
+				dup2(nullFd, STDIN_FILENO);
+				close(nullFd);
+			}
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+			execl(script, script, g_contentTypeStrings[request.m_contentType], inPath, outPath, (char *)NULL);
+			_exit(127);
+		} else if (pid > 0) {
+			int status;
+			while (waitpid(pid, &status, 0) < 0) {
+				if (errno != EINTR) {
+					status = -1;
+					break;
+				}
+			}
+			if (status != -1 && WIFEXITED(status)) {
+				exitStatus = WEXITSTATUS(status);
+			}
+		} else {
+			fprintf(stderr, "convertworker: fork failed: %s\n", strerror(errno));
+		}
+
+		struct stat st;
+		uint32_t outputLen = 0;
+		if (exitStatus == 0 && fstat(outFd, &st) == 0) {
+			outputLen = st.st_size > (off_t)UINT32_MAX ? UINT32_MAX : (uint32_t)st.st_size;
+		}
+
+		ConvertReply reply;
+		reply.m_magic = CONVERTER_MAGIC;
+		reply.m_exitStatus = exitStatus;
+		reply.m_outputLen = outputLen;
+		if (!writeFully(STDOUT_FILENO, &reply, sizeof(reply))) {
+			return 0;
+		}
+
+		for (uint32_t offset = 0; offset < outputLen; ) {
+			size_t n = outputLen - offset < sizeof(buf) ? outputLen - offset : sizeof(buf);
+			ssize_t r = pread(outFd, buf, n, offset);
+			if (r <= 0) {
+				// promised bytes must be sent
+				memset(buf, 0, n);
+				r = n;
+			}
+			if (!writeFully(STDOUT_FILENO, buf, r)) {
+				return 0;
+			}
+			offset += r;
+		}
+
+		close(inFd);
+		close(outFd);
+	}
+}
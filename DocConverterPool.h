@@ -0,0 +1,72 @@
+#ifndef GB_DOCCONVERTERPOOL_H
+#define GB_DOCCONVERTERPOOL_H
+
+#include "GbMutex.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+class SafeBuf;
+
+
+// . pool of long-lived "gb convertworker" processes running gbconvert.sh
+// . the document is sent to a worker over a pipe with a small length-prefixed
+//   header, the worker hands it to gbconvert.sh through a memfd and sends the
+//   output back the same way. so no temporary files and no fork of the big gb
+//   process per document
+// . workers are started on demand up to g_conf.m_docConverterWorkers, killed
+//   and restarted on timeout or error and restarted after
+//   g_conf.m_docConverterMaxConversions conversions
+// . convert() is called from the spider filter threads and blocks
+class DocConverterPool {
+	DocConverterPool(const DocConverterPool&);
+	DocConverterPool& operator=(const DocConverterPool&);
+public:
+	DocConverterPool();
+	~DocConverterPool();
+
+	// . returns false if no worker could be used, the caller should run
+	//   gbconvert.sh itself then
+	// . otherwise *exitStatus is the exit status of gbconvert.sh, or -1 if
+	//   it timed out or the worker died, and *output has the converted document
+	bool convert(uint8_t contentType, const char *content, size_t contentLen, std::string *output, int *exitStatus);
+
+	// kill all workers
+	void reset();
+
+	// conversion latency by content type, for the stats page
+	void printStats(SafeBuf *sb);
+
+	// main() of "gb convertworker <dir>"
+	static int runWorker(const char *dir);
+
+private:
+	struct Worker;
+
+	struct ContentTypeStats {
+		int64_t m_numConversions;
+		int64_t m_numFailed;
+		int64_t m_numTimedOut;
+		int64_t m_totalMs;
+		int64_t m_maxMs;
+	};
+
+	Worker *getWorker();
+	void returnWorker(Worker *w, bool restart);
+	bool startWorker(Worker *w);
+	static void stopWorker(Worker *w);
+
+	std::vector<Worker*> m_workers;
+	GbMutex m_mtx;
+
+	// indexed by content type (CT_*)
+	ContentTypeStats m_stats[32];
+	int64_t m_numUnavailable;
+	int64_t m_numWorkerStarts;
+};
+
+extern DocConverterPool g_docConverterPool;
+
+#endif // GB_DOCCONVERTERPOOL_H
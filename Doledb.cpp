@@ -71,6 +71,8 @@ void nukeDoledb ( collnum_t collnum ) {
 
 	SpiderColl *sc = g_spiderCache.getSpiderCollIffNonNull(collnum);
 	if ( sc ) {
+		// the doled urls may be in the frontier instead
+		sc->getFrontier()->clear();
 		// . make sure to nuke m_doledbIpTable as well
 		sc->clearDoledbIpTable();
 		// need to recompute this!
@@ -126,6 +128,8 @@ void nukeAllDoledbs() {
 
 			SpiderColl *sc = g_spiderCache.getSpiderCollIffNonNull(collnum);
 			if ( sc ) {
+				// the doled urls may be in the frontier instead
+				sc->getFrontier()->clear();
 				// . make sure to nuke m_doledbIpTable as well
 				sc->clearDoledbIpTable();
 				// need to recompute this!
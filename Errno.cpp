@@ -311,6 +311,8 @@ const char *mstrerror ( int errnum ) {
 				return "Doc blocked by shlib (content)";
 			case ENOFIRSTIPFOUND:
 				return "No 'firstip' tag record found";
+			case EQUERYSHED:
+				return "Query shed, host overloaded";
 		}
 	}
 
@@ -497,6 +499,8 @@ static const char* s_errname[] {
 	STRINGIFY( EDOCBLOCKEDSHLIBURL ),
 	STRINGIFY( EBANNEDCRAWL ),
 	STRINGIFY( EDOCBLOCKEDSHLIBCONTENT ),
+	STRINGIFY( ENOFIRSTIPFOUND ),
+	STRINGIFY( EQUERYSHED ),
 };
 
 #undef STRINGIFY
@@ -199,6 +199,7 @@ enum {
 	EBANNEDCRAWL,      // we are apparently banned/blacklisted by the Webserver/IDS/
 	EDOCBLOCKEDSHLIBCONTENT,
 	ENOFIRSTIPFOUND,       //didn't find a firstip tag record for url/site
+	EQUERYSHED,            //query rejected by admission control, host overloaded
 };
 
 #endif // GB_ERRNO_H
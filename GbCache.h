@@ -7,8 +7,8 @@
 #include "fctypes.h"
 #include <inttypes.h>
 #include <unordered_map>
-#include <deque>
-#include <algorithm>
+#include <list>
+#include <iterator>
 #include <sstream>
 
 template <typename TKey, typename TData>
@@ -60,26 +60,39 @@ public:
 			logTrace(m_log_trace, "inserting key='%s' to %s", getKeyStr(key).c_str(), m_log_cache_name);
 		}
 
-		CacheItem item(data);
-
 		auto map_it = m_map.find(key);
-		if (map_it == m_map.end()) {
-			m_map.insert(std::make_pair(key, item));
-		} else {
-			map_it->second = item;
-			auto queue_it = std::find(m_queue.begin(), m_queue.end(), key);
-			if (queue_it != m_queue.end()) {
-				m_queue.erase(queue_it);
-			}
+		if (map_it != m_map.end()) {
+			m_queue.erase(map_it->second.m_queue_it);
+			m_map.erase(map_it);
 		}
 
 		m_queue.push_back(key);
+		m_map.insert(std::make_pair(key, CacheItem(data, std::prev(m_queue.end()))));
 
 		if (m_queue.size() > m_max_item) {
 			purge_step(true);
 		}
 	}
 
+	void remove(const TKey &key) {
+		ScopedLock sl(m_mtx);
+
+		auto map_it = m_map.find(key);
+		if (map_it == m_map.end()) {
+			return;
+		}
+
+		logTrace(m_log_trace, "removing key='%s' from %s", getKeyStr(key).c_str(), m_log_cache_name);
+
+		m_queue.erase(map_it->second.m_queue_it);
+		m_map.erase(map_it);
+	}
+
+	size_t size() {
+		ScopedLock sl(m_mtx);
+		return m_map.size();
+	}
+
 	bool lookup(const TKey &key, TData *data) {
 		ScopedLock sl(m_mtx);
 
@@ -106,13 +119,15 @@ private:
 	GbCache& operator=(const GbCache&);
 
 	struct CacheItem {
-		CacheItem(const TData &data)
+		CacheItem(const TData &data, typename std::list<TKey>::iterator queue_it)
 			: m_timestamp(gettimeofdayInMilliseconds())
-			, m_data(data) {
+			, m_data(data)
+			, m_queue_it(queue_it) {
 		}
 
 		int64_t m_timestamp;
 		TData m_data;
+		typename std::list<TKey>::iterator m_queue_it; //position in m_queue
 	};
 
 	bool expired(const CacheItem &item) const {
@@ -149,7 +164,7 @@ private:
 	}
 
 	GbMutex m_mtx;
-	std::deque<TKey> m_queue;                       //queue of items to expire, ordered by epiration time
+	std::list<TKey> m_queue;                        //queue of items to expire, ordered by epiration time
 	std::unordered_map<TKey,CacheItem> m_map;       //cached items
 
 	int64_t m_max_age;                              //max item age (expiry) in msecs
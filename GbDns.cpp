@@ -14,6 +14,9 @@
 #include <vector>
 #include <string>
 #include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
 
 static ares_channel s_channel;
 static pthread_t s_thread;
@@ -37,6 +40,15 @@ static GbMutex s_callbackQueueMtx;
 static GbThreadQueue s_requestQueue;
 static GbCache<std::string, GbDns::DnsResponse> s_cache;
 
+// . A record lookups in progress by hostname, with the requests for the same
+//   hostname that wait for it
+// . also protects cache inserts/lookups of A records so a request either
+//   finds the response in the cache or waits for the lookup
+static std::unordered_map<std::string, std::vector<struct DnsItem*>> s_inFlight;
+static GbMutex s_inFlightMtx;
+
+static std::atomic<int32_t> s_numPrefetching(0);
+
 static void a_callback(void *arg, int status, int timeouts, unsigned char *abuf, int alen);
 static void ns_callback(void *arg, int status, int timeouts, unsigned char *abuf, int alen);
 
@@ -144,7 +156,8 @@ struct DnsItem {
 		, m_hostname(hostname, hostnameLen)
 		, m_callback(callback)
 		, m_state(state)
-		, m_response() {
+		, m_response()
+		, m_ttl(-1) {
 	}
 
 	RequestType m_reqType;
@@ -153,6 +166,9 @@ struct DnsItem {
 	void *m_state;
 
 	GbDns::DnsResponse m_response;
+
+	// ttl of the response in seconds, -1 if unknown
+	int32_t m_ttl;
 };
 
 static void processRequest(void *item) {
@@ -232,7 +248,9 @@ bool GbDns::initializeSettings(bool reload) {
 		pthread_cond_signal(&s_pauseCond);
 	}
 
-	s_cache.configure(g_conf.m_dnsCacheMaxAge*1000, g_conf.m_dnsCacheSize, g_conf.m_logTraceDnsCache, "dns cache");
+	// each record has its own expiry time, see getExpireTime()
+	int64_t maxAge = std::max(g_conf.m_dnsCacheMaxAge, g_conf.m_dnsNegativeCacheMaxAge);
+	s_cache.configure(maxAge*1000, g_conf.m_dnsCacheSize, g_conf.m_logTraceDnsCache, "dns cache");
 
 	log(LOG_INFO, "dns: Done initializing settings");
 	return true;
@@ -310,7 +328,8 @@ void GbDns::finalize() {
 GbDns::DnsResponse::DnsResponse()
 	: m_ips()
 	, m_nameservers()
-	, m_errno(0) {
+	, m_errno(0)
+	, m_expireTime(0) {
 }
 
 static int convert_ares_errorno(int ares_errno) {
@@ -382,10 +401,51 @@ static int convert_ares_errorno(int ares_errno) {
 	return 0;
 }
 
+// . the ttl of the response limited by min ttl / max age settings
+// . lookups that failed with a timeout etc. are cached for the min ttl
+static int64_t getExpireTime(const DnsItem *item) {
+	int64_t ttl = item->m_ttl;
+	int64_t maxAge = (item->m_response.m_errno == EDNSNOTFOUND) ? g_conf.m_dnsNegativeCacheMaxAge : g_conf.m_dnsCacheMaxAge;
+	if (ttl > maxAge) {
+		ttl = maxAge;
+	}
+	if (ttl < g_conf.m_dnsCacheMinTtl) {
+		ttl = g_conf.m_dnsCacheMinTtl;
+	}
+	return gettimeofdayInMilliseconds() + ttl * 1000;
+}
+
+// must hold s_inFlightMtx
+static bool lookupCache(const std::string &hostname, GbDns::DnsResponse *response) {
+	GbDns::DnsResponse cached;
+	if (!s_cache.lookup(hostname, &cached)) {
+		return false;
+	}
+
+	if (cached.m_expireTime < gettimeofdayInMilliseconds()) {
+		logTrace(g_conf.m_logTraceDnsCache, "ttl of hostname='%s' expired", hostname.c_str());
+		return false;
+	}
+
+	*response = cached;
+	return true;
+}
+
 static void addToCallbackQueue(DnsItem *item) {
+	std::vector<DnsItem*> waiting;
+
 	// add to cache
 	if (item->m_reqType == DnsItem::request_type_a) {
+		item->m_response.m_expireTime = getExpireTime(item);
+
+		ScopedLock sl(s_inFlightMtx);
 		s_cache.insert(item->m_hostname, item->m_response);
+
+		auto it = s_inFlight.find(item->m_hostname);
+		if (it != s_inFlight.end()) {
+			waiting.swap(it->second);
+			s_inFlight.erase(it);
+		}
 	} else if (item->m_reqType == DnsItem::request_type_ns) {
 		if (!item->m_response.m_nameservers.empty()) {
 			GbDns::DnsResponse response;
@@ -397,11 +457,93 @@ static void addToCallbackQueue(DnsItem *item) {
 		}
 	}
 
+	for (auto waitingItem : waiting) {
+		waitingItem->m_response = item->m_response;
+	}
+
 	ScopedLock sl(s_callbackQueueMtx);
+	for (auto waitingItem : waiting) {
+		logTrace(g_conf.m_logTraceDns, "adding to callback queue item=%p (waited for item=%p)", waitingItem, item);
+		s_callbackQueue.push(waitingItem);
+	}
+
+	// prefetch. only the cache wanted it
+	if (!item->m_callback) {
+		logTrace(g_conf.m_logTraceDns, "prefetched hostname='%s'", item->m_hostname.c_str());
+		delete item;
+		--s_numPrefetching;
+		return;
+	}
+
 	logTrace(g_conf.m_logTraceDns, "adding to callback queue item=%p", item);
 	s_callbackQueue.push(item);
 }
 
+// . negative ttl of a NXDOMAIN/NODATA response (RFC 2308), the smaller of
+//   the ttl and the minimum field of the SOA record in the authority section
+// . returns -1 if there is no SOA record
+static int32_t getNegativeTtl(const unsigned char *abuf, int alen) {
+	if (alen < HFIXEDSZ) {
+		return -1;
+	}
+
+	int qdcount = (abuf[4] << 8) | abuf[5];
+	int ancount = (abuf[6] << 8) | abuf[7];
+	int nscount = (abuf[8] << 8) | abuf[9];
+
+	const unsigned char *p = abuf + HFIXEDSZ;
+	const unsigned char *end = abuf + alen;
+
+	// skip question and answer sections
+	for (int i = 0; i < qdcount + ancount + nscount; ++i) {
+		char *name = nullptr;
+		long len = 0;
+		if (ares_expand_name(p, abuf, alen, &name, &len) != ARES_SUCCESS) {
+			return -1;
+		}
+		ares_free_string(name);
+		p += len;
+
+		if (i < qdcount) {
+			p += QFIXEDSZ;
+			continue;
+		}
+
+		if (p + RRFIXEDSZ > end) {
+			return -1;
+		}
+
+		int type = (p[0] << 8) | p[1];
+		uint32_t ttl = ((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 8) | p[7];
+		int rdlen = (p[8] << 8) | p[9];
+		p += RRFIXEDSZ;
+		if (p + rdlen > end) {
+			return -1;
+		}
+
+		if (i >= qdcount + ancount && type == T_SOA) {
+			// mname & rname, then serial, refresh, retry, expire, minimum
+			const unsigned char *rdata = p;
+			for (int j = 0; j < 2; ++j) {
+				if (ares_expand_name(rdata, abuf, alen, &name, &len) != ARES_SUCCESS) {
+					return -1;
+				}
+				ares_free_string(name);
+				rdata += len;
+			}
+			if (rdata + 20 > p + rdlen) {
+				return -1;
+			}
+			uint32_t minimum = ((uint32_t)rdata[16] << 24) | ((uint32_t)rdata[17] << 16) | ((uint32_t)rdata[18] << 8) | rdata[19];
+			return (int32_t)std::min(std::min(ttl, minimum), (uint32_t)0x7fffffff);
+		}
+
+		p += rdlen;
+	}
+
+	return -1;
+}
+
 static void a_callback(void *arg, int status, int timeouts, unsigned char *abuf, int alen) {
 	logTrace(g_conf.m_logTraceDns, "BEGIN");
 
@@ -430,6 +572,11 @@ static void a_callback(void *arg, int status, int timeouts, unsigned char *abuf,
 			char ipbuf[16];
 			logTrace(g_conf.m_logTraceDns, "ip=%s ttl=%d", iptoa(addrttls[i].ipaddr.s_addr, ipbuf), addrttls[i].ttl);
 			item->m_response.m_ips.push_back(addrttls[i].ipaddr.s_addr);
+
+			// cache it for the shortest ttl
+			if (item->m_ttl < 0 || addrttls[i].ttl < item->m_ttl) {
+				item->m_ttl = addrttls[i].ttl;
+			}
 		}
 
 		for (int i = 0; host->h_aliases[i] != NULL; ++i) {
@@ -442,6 +589,11 @@ static void a_callback(void *arg, int status, int timeouts, unsigned char *abuf,
 		logTrace(g_conf.m_logTraceDns, "ares_error=%d(%s)", status, ares_strerror(status));
 
 		item->m_response.m_errno = convert_ares_errorno(status);
+
+		if (item->m_response.m_errno == EDNSNOTFOUND) {
+			item->m_ttl = getNegativeTtl(abuf, alen);
+			logTrace(g_conf.m_logTraceDns, "negative ttl=%d", item->m_ttl);
+		}
 	}
 
 	addToCallbackQueue(item);
@@ -482,12 +634,27 @@ bool GbDns::getARecord(const char *hostname, size_t hostnameLen, void (*callback
 		}
 	}
 
-	// check cache
-	if (s_cache.lookup(item->m_hostname, response)) {
-		delete item;
+	{
+		ScopedLock sl(s_inFlightMtx);
 
-		logTrace(g_conf.m_logTraceDns, "END. hostname found in cache");
-		return true;
+		// check cache
+		if (lookupCache(item->m_hostname, response)) {
+			delete item;
+
+			logTrace(g_conf.m_logTraceDns, "END. hostname found in cache");
+			return true;
+		}
+
+		// wait for the lookup of the same hostname already in progress
+		auto it = s_inFlight.find(item->m_hostname);
+		if (it != s_inFlight.end()) {
+			it->second.push_back(item);
+
+			logTrace(g_conf.m_logTraceDns, "END. waiting for lookup in progress");
+			return false;
+		}
+
+		s_inFlight[item->m_hostname];
 	}
 
 	s_requestQueue.addItem(item);
@@ -496,6 +663,45 @@ bool GbDns::getARecord(const char *hostname, size_t hostnameLen, void (*callback
 	return false;
 }
 
+void GbDns::prefetchARecord(const char *hostname, size_t hostnameLen) {
+	logTrace(g_conf.m_logTraceDns, "BEGIN hostname='%.*s'", static_cast<int>(hostnameLen), hostname);
+
+	if (s_numPrefetching >= g_conf.m_dnsMaxPrefetches) {
+		logTrace(g_conf.m_logTraceDns, "END. too many prefetches");
+		return;
+	}
+
+	DnsItem *item = new DnsItem(DnsItem::request_type_a, hostname, hostnameLen, nullptr, nullptr);
+
+	// hostname is ip
+	in_addr addr;
+	if (is_digit(item->m_hostname[0]) && inet_pton(AF_INET, item->m_hostname.c_str(), &addr) == 1) {
+		delete item;
+
+		logTrace(g_conf.m_logTraceDns, "END. hostname is IP addr");
+		return;
+	}
+
+	{
+		ScopedLock sl(s_inFlightMtx);
+
+		GbDns::DnsResponse response;
+		if (lookupCache(item->m_hostname, &response) || s_inFlight.find(item->m_hostname) != s_inFlight.end()) {
+			delete item;
+
+			logTrace(g_conf.m_logTraceDns, "END. hostname cached or being looked up");
+			return;
+		}
+
+		s_inFlight[item->m_hostname];
+	}
+
+	++s_numPrefetching;
+	s_requestQueue.addItem(item);
+
+	logTrace(g_conf.m_logTraceDns, "END");
+}
+
 static void ns_callback(void *arg, int status, int timeouts, unsigned char *abuf, int alen) {
 	logTrace(g_conf.m_logTraceDns, "BEGIN");
 	DnsItem *item = static_cast<DnsItem*>(arg);
@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <netinet/in.h>
+#include <inttypes.h>
 
 namespace GbDns {
 	struct DnsResponse {
@@ -12,6 +13,9 @@ namespace GbDns {
 		std::vector<in_addr_t> m_ips;
 		std::vector<std::string> m_nameservers;
 		int m_errno;
+
+		// when the cached response expires (ms)
+		int64_t m_expireTime;
 	};
 
 	bool initialize();
@@ -21,6 +25,11 @@ namespace GbDns {
 	void finalize();
 
 	bool getARecord(const char *hostname, size_t hostnameLen, void (*callback)(DnsResponse *response, void *state), void *state, GbDns::DnsResponse *response);
+
+	// . look up hostname into the cache ahead of time, no callback
+	// . skipped if it is cached or being looked up, or if there are
+	//   g_conf.m_dnsMaxPrefetches outstanding
+	void prefetchARecord(const char *hostname, size_t hostnameLen);
 	void getNSRecord(const char *hostname, size_t hostnameLen, void (*callback)(DnsResponse *response, void *state), void *state);
 
 	void makeCallbacks();
@@ -5,6 +5,7 @@
 #include "BitOperations.h"
 #include "Loop.h"
 #include "File.h"
+#include "MemoryMappedFile.h"
 #include "Conf.h"
 #include "Errno.h"
 #include "Sanity.h"
@@ -31,6 +32,7 @@ HashTableX::HashTableX () {
 	m_needsSave = false;
 	m_maxSlots = 0;
 	m_txtBufSize = 0;
+	m_mappedFile = NULL;
 	
 	reset();
 }
@@ -98,6 +100,11 @@ void HashTableX::reset ( ) {
 		mfree ( m_txtBuf , m_txtBufSize,"ftxtbuf");
 		m_txtBuf = NULL;
 	}
+	if ( m_mappedFile ) {
+		delete m_mappedFile;
+		m_mappedFile = NULL;
+		m_isWritable = true;
+	}
 }
 
 void HashTableX::clear ( ) {
@@ -479,6 +486,71 @@ bool HashTableX::load ( const char *dir, const char *filename, char **tbuf, int3
 }
 
 
+// . same file layout as load(): 16 byte header followed by the keys, vals
+//   and flags arrays, so the arrays can be used in place
+// . returns false and sets g_errno on error, true otherwise
+bool HashTableX::loadMapped ( const char *dir, const char *filename ) {
+	File f;
+	f.set ( dir , filename );
+	if ( ! f.doesExist() ) return false;
+
+	MemoryMappedFile *mmf = new MemoryMappedFile;
+	if ( ! mmf->open ( f.getFilename() , false ) || mmf->size() < 16 ) {
+		log(LOG_INFO,"htable: could not map %s, reading it instead",f.getFilename());
+		delete mmf;
+		return load ( dir , filename );
+	}
+
+	const char *p = mmf->start();
+	int32_t numSlots     = ((const int32_t *)p)[0];
+	int32_t numSlotsUsed = ((const int32_t *)p)[1];
+	int32_t ks           = ((const int32_t *)p)[2];
+	int32_t ds           = ((const int32_t *)p)[3];
+
+	if ( numSlots < 0 || numSlotsUsed < 0 || numSlotsUsed > numSlots ||
+	     ks <= 0 || ds < 0 ||
+	     (m_ks && m_ks != ks) || (m_ds && m_ds != ds) ) {
+		log(LOG_WARN, "htable: bogus saved hashtable file %s.",f.getFilename());
+		delete mmf;
+		g_errno = ECORRUPTDATA;
+		return false;
+	}
+
+	size_t need = 16 + (size_t)numSlots * (ks + ds + 1);
+	size_t valsOffset = 16 + (size_t)numSlots * ks;
+	size_t valAlign = ds >= 8 ? 8 : (ds >= 4 ? 4 : 1);
+	// the lookup code needs a power of 2 for the mask
+	if ( numSlots == 0 || ( numSlots & (numSlots - 1) ) != 0 ||
+	     mmf->size() < need || valsOffset % valAlign != 0 ) {
+		log(LOG_INFO,"htable: %s can't be used in place, reading it instead",f.getFilename());
+		delete mmf;
+		return load ( dir , filename );
+	}
+
+	reset();
+
+	m_ks = ks;
+	m_ds = ds;
+	m_mappedFile = mmf;
+	m_numSlots = numSlots;
+	m_numSlotsUsed = numSlotsUsed;
+	m_mask = numSlots - 1;
+	m_keys  = mmf->start() + 16;
+	m_vals  = m_keys + (size_t)numSlots * ks;
+	m_flags = m_vals + (size_t)numSlots * ds;
+	m_doFree = false;
+	m_isWritable = false;
+	m_needsSave = false;
+
+	// lookups are random
+	mmf->advise_random();
+
+	log(LOG_INFO,"admin: Mapped hashtablex from %s %" PRId32" slots, %zu bytes",
+	    f.getFilename(), numSlots, mmf->size());
+	return true;
+}
+
+
 bool HashTableX::save ( const char *dir , 
 			const char *filename , 
 			const char *tbuf, 
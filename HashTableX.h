@@ -12,6 +12,8 @@
 #include "hash.h"
 #include "Log.h"
 
+class MemoryMappedFile;
+
 
 class HashTableX {
 
@@ -279,6 +281,14 @@ class HashTableX {
 	bool save ( const char *dir, const char *filename , 
 		    const char  *tbuf = NULL , int32_t  tsize = 0);
 
+	// . like load() but maps a file written by save() read-only instead
+	//   of reading it into allocated memory. the pages are shared through
+	//   the page cache with other processes mapping the same file
+	// . the table is not writable afterwards. reset() unmaps it
+	// . falls back to load() if the file can't be mapped as-is
+	bool loadMapped ( const char *dir, const char *filename );
+	bool isMemoryMapped() const { return m_mappedFile != NULL; }
+
 	bool setTableSize ( int32_t numSlots , char *buf , int32_t bufSize );
 
 	// for debugging
@@ -286,7 +296,7 @@ class HashTableX {
 
 	bool isWritable() const { return m_isWritable; }
 	void disableWrites() { m_isWritable = false; }
-	void enableWrites() { m_isWritable = true; }
+	void enableWrites() { if ( ! m_mappedFile ) m_isWritable = true; }
 
 	int32_t getKeySize() const { return m_ks; }
 	int32_t getDataSize() const { return m_ds; }
@@ -332,6 +342,9 @@ private:
 	// in the table itself reference.
 	char *m_txtBuf;
 	int32_t  m_txtBufSize;
+
+	// non-NULL if m_keys/m_vals/m_flags point into a read-only mapping
+	MemoryMappedFile *m_mappedFile;
 };
 
 #endif // GB_HASHTABLEX_H
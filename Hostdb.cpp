@@ -1534,6 +1534,7 @@ uint32_t Hostdb::getShardNum(rdbid_t rdbId, const void *k) const {
 
 		case RDB_LINKDB:
 		case RDB2_LINKDB2:
+		case RDB_ANCHORDB:
 			// sharded by part of linkee sitehash32
 			return m_map [(*(uint16_t *)((char *)k + 26))>>3];
 
@@ -1556,7 +1557,9 @@ uint32_t Hostdb::getShardNum(rdbid_t rdbId, const void *k) const {
 		}
 
 		case RDB_CLUSTERDB:
-		case RDB2_CLUSTERDB2: {
+		case RDB2_CLUSTERDB2:
+		case RDB_SIMHASHDB: {
+			// simhashdb has the docid in the same bits
 			uint64_t d = Clusterdb::getDocId ( (const key96_t *)k );
 			return m_map [ ((d>>14)^(d>>7)) & (MAX_KSLOTS-1) ];
 		}
@@ -181,6 +181,9 @@ bool HttpRequest::copy(const HttpRequest *r) {
 // . fill in your own offset/size for partial GET requests
 // . returns false and sets g_errno on error
 // . NOTE: http 1.1 uses Keep-Alive by default (use Connection: close to not)
+// . we stay with HTTP/1.0 plus "Connection: keep-alive" if "keepAlive" is
+//   true, so the reply is never chunked and has a Content-Length: if the
+//   server keeps the connection open
 bool HttpRequest::set (char *url,int32_t offset,int32_t size,time_t ifModifiedSince,
 		       const char *userAgent, const char *proto, bool doPost,
 		       const char *cookieJar, const char *additionalHeader,
@@ -189,7 +192,10 @@ bool HttpRequest::set (char *url,int32_t offset,int32_t size,time_t ifModifiedSi
 		       // are we sending the request through an http proxy?
 		       // if so this will be non-zero
 		       int32_t proxyIp ,
-		       const char *proxyUsernamePwd ) {
+		       const char *proxyUsernamePwd ,
+		       // ask for a persistent connection? only for GETs of
+		       // the whole doc
+		       bool keepAlive ) {
 
 	m_reqBufValid = false;
 
@@ -368,7 +374,7 @@ bool HttpRequest::set (char *url,int32_t offset,int32_t size,time_t ifModifiedSi
 				 "Accept: */*\r\n"
 				 "Host: %s\r\n"
 				 "%s"
-				 "Connection: Close\r\n"
+				 "Connection: %s\r\n"
 				 "Accept-Language: %s\r\n"
 				 "%s"
 				 "%s",
@@ -378,6 +384,7 @@ bool HttpRequest::set (char *url,int32_t offset,int32_t size,time_t ifModifiedSi
 				 userAgent,
 				 host,
 				 ims,
+				 keepAlive ? "keep-alive" : "Close",
 				 acceptLanguages.c_str(),
 				 acceptEncoding,
 				 up);
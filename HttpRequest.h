@@ -47,7 +47,8 @@ class HttpRequest {
 		   const char *additionalHeader = NULL , // does not incl \r\n
 		   int32_t postContentLen = -1 , // for content-length of POST
 		   int32_t proxyIp = 0 ,
-		   const char *proxyUsernamePwdAuth = NULL );
+		   const char *proxyUsernamePwdAuth = NULL ,
+		   bool keepAlive = false );
 
 	// use this
 	SafeBuf m_reqBuf;
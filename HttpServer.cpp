@@ -136,7 +136,8 @@ bool HttpServer::getDoc ( char   *url      ,
 			  const char    *additionalHeader ,
 			  const char    *fullRequest ,
 			  const char    *postContent ,
-			  const char    *proxyUsernamePwdAuth ) {
+			  const char    *proxyUsernamePwdAuth ,
+			  bool     keepAlive ) {
 	// sanity
 	if ( ip == -1 ) {
 		log(LOG_WARN, "http: you probably didn't mean to set ip=-1 did you? try setting to 0.");
@@ -201,6 +202,11 @@ bool HttpServer::getDoc ( char   *url      ,
 	// send the actual encrypted http stuff.
 	bool useHttpTunnel = ( proxyIp && urlIsHttps );
 
+	// . only keep connections to the web server itself open
+	// . only whole-doc GETs ask for it, see HttpRequest::set()
+	if ( proxyIp || fullRequest || doPost || size != -1 || offset != 0 )
+		keepAlive = false;
+
 	int32_t  hostLen ;
 	int32_t  port = defPort;
 
@@ -216,7 +222,7 @@ bool HttpServer::getDoc ( char   *url      ,
 			       // say "GET http://www.xyz.com/" the full
 			       // url, not just a relative path.
 			       additionalHeader , pcLen , proxyIp ,
-			       proxyUsernamePwdAuth ) ) {
+			       proxyUsernamePwdAuth , keepAlive ) ) {
 			log(LOG_WARN, "http: http req error: %s",mstrerror(g_errno));
 			// TODO: ensure we close the socket on this error!
 			return true;
@@ -331,7 +337,7 @@ bool HttpServer::getDoc ( char   *url      ,
 	// . if using an http proxy, then ip should be valid here...
 	if ( ip ) {
 		if ( !tcp->sendMsg( host, hostLen, ip, port, req, reqSize, reqSize, reqSize, (void *)(intptr_t)n, gotDocWrapper,
-							timeout, maxTextDocLen, maxOtherDocLen, useHttpTunnel ) ) {
+							timeout, maxTextDocLen, maxOtherDocLen, useHttpTunnel, keepAlive ) ) {
 			return false;
 		}
 
@@ -378,6 +384,52 @@ bool HttpServer::gotDoc ( int32_t n, TcpSocket *s ) {
 
 }
 
+static void printKeepAliveRow ( SafeBuf *sb , const char *name , const TcpServer *tcp ) {
+	int64_t total = tcp->m_numKeepAliveNew + tcp->m_numKeepAliveReused;
+	sb->safePrintf("<tr class=poo>"
+	               "<td>%s</td>"
+	               "<td>%" PRId64"</td>"
+	               "<td>%" PRId64"</td>"
+	               "<td>%.1f%%</td>"
+	               "<td>%" PRId64"</td>"
+	               "<td>%" PRId64"</td>"
+	               "<td>%" PRId64"</td>"
+	               "<td>%" PRId64"</td>"
+	               "<td>%" PRId64" / %" PRId64"</td>"
+	               "</tr>\n",
+	               name,
+	               tcp->m_numKeepAliveNew,
+	               tcp->m_numKeepAliveReused,
+	               total ? 100.0 * tcp->m_numKeepAliveReused / total : 0.0,
+	               tcp->m_numKeepAlivePooled,
+	               tcp->m_numKeepAliveIdleClosed,
+	               tcp->m_numKeepAliveRemoteClosed,
+	               tcp->m_numKeepAliveResent,
+	               tcp->m_numSslResumed,
+	               tcp->m_numSslHandshakes);
+}
+
+void HttpServer::printKeepAliveStats ( SafeBuf *sb ) {
+	sb->safePrintf("<table %s>"
+	               "<tr class=hdrow><td colspan=9><center><b>Download Keep-Alive</b>"
+	               "</center></td></tr>\n"
+	               "<tr class=poo>"
+	               "<td><b>server</b></td>"
+	               "<td><b>new connections</b></td>"
+	               "<td><b>reused connections</b></td>"
+	               "<td><b>reuse ratio</b></td>"
+	               "<td><b>kept open</b></td>"
+	               "<td><b>idle closed</b></td>"
+	               "<td><b>closed by server</b></td>"
+	               "<td><b>resent</b></td>"
+	               "<td><b>tls resumed / handshakes</b></td>"
+	               "</tr>\n",
+	               TABLE_STYLE);
+	printKeepAliveRow ( sb , "http" , &m_tcp );
+	printKeepAliveRow ( sb , "https" , &m_ssltcp );
+	sb->safePrintf("</table><br><br>\n");
+}
+
 // . handle an incoming HTTP request
 static void requestHandlerWrapper(TcpSocket *s) {
 	g_httpServer.requestHandler ( s );
@@ -1610,6 +1662,26 @@ static int32_t getMsgPiece ( TcpSocket *s ) {
 	exit ( -1 );
 }
 
+// . true if the server keeps the connection open after this reply
+// . HTTP/1.1 replies do unless they say "Connection: close", HTTP/1.0
+//   replies only if they say "Connection: keep-alive"
+static bool isKeepAliveReply ( const char *mime , int32_t mimeLen ) {
+	if ( mimeLen < 8 || strncmp ( mime , "HTTP/1." , 7 ) != 0 ) return false;
+	bool keepAlive = ( mime[7] == '1' );
+	const char *pend = mime + mimeLen;
+	for ( const char *p = mime ; p + 12 < pend ; p++ ) {
+		if ( *p != '\n' ) continue;
+		if ( strncasecmp ( p + 1 , "Connection:" , 11 ) != 0 ) continue;
+		const char *v = p + 12;
+		while ( v < pend && is_wspace_a(*v) ) v++;
+		if ( v + 5 <= pend && strncasecmp ( v , "close" , 5 ) == 0 )
+			keepAlive = false;
+		else if ( v + 10 <= pend && strncasecmp ( v , "keep-alive" , 10 ) == 0 )
+			keepAlive = true;
+	}
+	return keepAlive;
+}
+
 // . we call this to try to figure out the size of the WHOLE HTTP msg
 //   being recvd so that we might pre-allocate memory for it
 // . it could be an HTTP request or reply
@@ -1812,6 +1884,18 @@ int32_t getMsgSize(const char *buf, int32_t bufSize, TcpSocket *s) {
 		break;
 	}
 
+	// . can the connection be re-used after this reply? we asked for it
+	//   in HttpRequest::set(), see TcpServer::recycleSocket()
+	// . 204 and 304 replies have no content. a keep-alive server will not
+	//   close the connection so do not wait for it
+	if ( s->m_keepAlive && ! isPost ) {
+		s->m_keepAliveReply = isKeepAliveReply ( buf , mimeSize );
+		if ( ! totalReplySize && s->m_keepAliveReply && mimeSize > 12 &&
+		     ( strncmp ( buf + 9 , "204" , 3 ) == 0 ||
+		       strncmp ( buf + 9 , "304" , 3 ) == 0 ) )
+			totalReplySize = mimeSize;
+	}
+
 	// all-or-nothing filter
 	if ( totalReplySize > max && allOrNothing ) {
 		log(LOG_INFO,
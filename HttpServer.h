@@ -82,7 +82,10 @@ class HttpServer {
 		      // specify your own mime and post data here...
 		      const char *fullRequest = NULL ,
 		      const char *postContent = NULL ,
-		      const char *proxyUsernamePwdAuth = NULL );
+		      const char *proxyUsernamePwdAuth = NULL ,
+		      // keep the connection open for the next download from
+		      // this ip. ignored for proxies and full requests
+		      bool keepAlive = false );
 
 	bool gotDoc ( int32_t n , TcpSocket *s );
 
@@ -137,6 +140,9 @@ class HttpServer {
 		return &m_ssltcp;
 	}
 
+	// connection re-use of downloads, for the stats page
+	void printKeepAliveStats ( SafeBuf *sb );
+
 	// we contain our own tcp server
 	TcpServer m_tcp;
 	TcpServer m_ssltcp;
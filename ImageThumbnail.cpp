@@ -0,0 +1,590 @@
+#include "ImageThumbnail.h"
+#include "SafeBuf.h"
+#include "Log.h"
+#include "Errno.h"
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#include <jerror.h>
+#include <png.h>
+
+
+// quality ppmtojpeg used by default
+#define THUMBNAIL_JPEG_QUALITY 75
+
+
+AreaResampler::AreaResampler(int32_t srcWidth, int32_t srcHeight, int32_t dstWidth, int32_t dstHeight, int32_t channels)
+  : m_srcWidth(srcWidth)
+  , m_srcHeight(srcHeight)
+  , m_dstWidth(dstWidth)
+  , m_dstHeight(dstHeight)
+  , m_channels(channels)
+  , m_srcRow(0)
+  , m_dstRow(0)
+  , m_acc(srcWidth * channels, 0)
+  , m_colStart(dstWidth)
+  , m_colCount(dstWidth)
+  , m_colWeights()
+  , m_colWeightStart(dstWidth)
+  , m_dst(dstWidth * dstHeight * channels, 0) {
+	// . in units of 1/(srcWidth*dstWidth) of the image width source column
+	//   i covers [i*dstWidth, (i+1)*dstWidth) and destination column x
+	//   covers [x*srcWidth, (x+1)*srcWidth), the weight of a source column
+	//   is the overlap
+	// . the weights of a destination column add up to srcWidth
+	for (int32_t x = 0; x < dstWidth; x++) {
+		int64_t start = (int64_t)x * srcWidth;
+		int64_t end = start + srcWidth;
+		int32_t first = start / dstWidth;
+		int32_t last = (end - 1) / dstWidth;
+		m_colStart[x] = first;
+		m_colCount[x] = last - first + 1;
+		m_colWeightStart[x] = m_colWeights.size();
+		for (int32_t i = first; i <= last; i++) {
+			int64_t a = (int64_t)i * dstWidth;
+			int64_t b = a + dstWidth;
+			if (a < start) a = start;
+			if (b > end) b = end;
+			m_colWeights.push_back((uint32_t)(b - a));
+		}
+	}
+}
+
+
+// . the hot loop, written so the compiler vectorizes it
+void AreaResampler::accumulate(const uint8_t *row, uint32_t weight) {
+	uint32_t * __restrict acc = &m_acc[0];
+	const uint8_t * __restrict src = row;
+	int32_t n = m_srcWidth * m_channels;
+	for (int32_t i = 0; i < n; i++) {
+		acc[i] += weight * src[i];
+	}
+}
+
+
+void AreaResampler::finishDstRow() {
+	if (m_dstRow >= m_dstHeight) {
+		return;
+	}
+
+	// vertical weights add up to srcHeight, horizontal to srcWidth
+	uint64_t total = (uint64_t)m_srcWidth * m_srcHeight;
+	uint8_t *dst = &m_dst[(int64_t)m_dstRow * m_dstWidth * m_channels];
+
+	for (int32_t x = 0; x < m_dstWidth; x++) {
+		const uint32_t *weights = &m_colWeights[m_colWeightStart[x]];
+		const uint32_t *acc = &m_acc[(int64_t)m_colStart[x] * m_channels];
+		int32_t count = m_colCount[x];
+		for (int32_t c = 0; c < m_channels; c++) {
+			uint64_t sum = 0;
+			for (int32_t i = 0; i < count; i++) {
+				sum += (uint64_t)weights[i] * acc[i * m_channels + c];
+			}
+			uint64_t v = (sum + total / 2) / total;
+			*dst++ = v > 255 ? 255 : (uint8_t)v;
+		}
+	}
+
+	memset(&m_acc[0], 0, m_acc.size() * sizeof(m_acc[0]));
+	m_dstRow++;
+}
+
+
+void AreaResampler::addRow(const uint8_t *row) {
+	if (m_srcRow >= m_srcHeight) {
+		return;
+	}
+
+	// same as for the columns, in units of 1/(srcHeight*dstHeight)
+	int64_t start = (int64_t)m_srcRow * m_dstHeight;
+	int64_t end = start + m_dstHeight;
+	while (start < end && m_dstRow < m_dstHeight) {
+		int64_t dstEnd = (int64_t)(m_dstRow + 1) * m_srcHeight;
+		int64_t take = (end < dstEnd ? end : dstEnd) - start;
+		accumulate(row, (uint32_t)take);
+		start += take;
+		if (start == dstEnd) {
+			finishDstRow();
+		}
+	}
+
+	m_srcRow++;
+}
+
+
+// fit width x height in a maxWidthHeight box, never enlarging
+static void getThumbnailSize(int32_t width, int32_t height, int32_t maxWidthHeight, int32_t *tw, int32_t *th) {
+	if (width <= maxWidthHeight && height <= maxWidthHeight) {
+		*tw = width;
+		*th = height;
+	} else if (width >= height) {
+		*tw = maxWidthHeight;
+		*th = ((int64_t)height * maxWidthHeight + width / 2) / width;
+	} else {
+		*th = maxWidthHeight;
+		*tw = ((int64_t)width * maxWidthHeight + height / 2) / height;
+	}
+	if (*tw < 1) *tw = 1;
+	if (*th < 1) *th = 1;
+}
+
+
+static bool isJpeg(const char *data, int32_t dataSize) {
+	return dataSize >= 3 && (uint8_t)data[0] == 0xFF && (uint8_t)data[1] == 0xD8 && (uint8_t)data[2] == 0xFF;
+}
+
+
+static bool isPng(const char *data, int32_t dataSize) {
+	return dataSize >= 8 && png_sig_cmp((png_bytep)const_cast<char*>(data), 0, 8) == 0;
+}
+
+
+bool canMakeThumbnail(const char *data, int32_t dataSize) {
+	return isJpeg(data, dataSize) || isPng(data, dataSize);
+}
+
+
+// . decoded and resized image
+struct ThumbnailPixels {
+	int32_t m_width;
+	int32_t m_height;
+	int32_t m_channels;           //1 (gray) or 3 (rgb)
+	AreaResampler *m_resampler;
+	bool    m_isOriginal;         //already small enough, nothing decoded
+};
+
+
+//
+// libjpeg glue
+//
+
+struct JpegErrorMgr {
+	struct jpeg_error_mgr m_pub;
+	jmp_buf m_jmp;
+};
+
+static void jpegErrorExit(j_common_ptr cinfo) {
+	char msg[JMSG_LENGTH_MAX];
+	(*cinfo->err->format_message)(cinfo, msg);
+	log(LOG_DEBUG, "image: libjpeg: %s", msg);
+
+	JpegErrorMgr *err = (JpegErrorMgr *)cinfo->err;
+	longjmp(err->m_jmp, 1);
+}
+
+static void jpegOutputMessage(j_common_ptr /*cinfo*/) {
+	// warnings about corrupt data etc. are not interesting
+}
+
+static void jpegInitSource(j_decompress_ptr /*cinfo*/) {
+}
+
+static boolean jpegFillInputBuffer(j_decompress_ptr cinfo) {
+	// truncated image, pretend it ended so we get what is there
+	static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+	cinfo->src->next_input_byte = eoi;
+	cinfo->src->bytes_in_buffer = 2;
+	return TRUE;
+}
+
+static void jpegSkipInputData(j_decompress_ptr cinfo, long numBytes) {
+	if (numBytes <= 0) {
+		return;
+	}
+	if ((size_t)numBytes > cinfo->src->bytes_in_buffer) {
+		jpegFillInputBuffer(cinfo);
+		return;
+	}
+	cinfo->src->next_input_byte += numBytes;
+	cinfo->src->bytes_in_buffer -= numBytes;
+}
+
+static void jpegTermSource(j_decompress_ptr /*cinfo*/) {
+}
+
+
+struct JpegDestination {
+	struct jpeg_destination_mgr m_pub;
+	SafeBuf *m_sb;
+	JOCTET   m_buf[16384];
+};
+
+static void jpegInitDestination(j_compress_ptr cinfo) {
+	JpegDestination *dest = (JpegDestination *)cinfo->dest;
+	dest->m_pub.next_output_byte = dest->m_buf;
+	dest->m_pub.free_in_buffer = sizeof(dest->m_buf);
+}
+
+static boolean jpegEmptyOutputBuffer(j_compress_ptr cinfo) {
+	JpegDestination *dest = (JpegDestination *)cinfo->dest;
+	if (!dest->m_sb->safeMemcpy((const char *)dest->m_buf, sizeof(dest->m_buf))) {
+		ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+	}
+	dest->m_pub.next_output_byte = dest->m_buf;
+	dest->m_pub.free_in_buffer = sizeof(dest->m_buf);
+	return TRUE;
+}
+
+static void jpegTermDestination(j_compress_ptr cinfo) {
+	JpegDestination *dest = (JpegDestination *)cinfo->dest;
+	size_t len = sizeof(dest->m_buf) - dest->m_pub.free_in_buffer;
+	if (!dest->m_sb->safeMemcpy((const char *)dest->m_buf, len)) {
+		ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+	}
+}
+
+
+static bool decodeJpeg(const char *data, int32_t dataSize, int32_t maxWidthHeight, int64_t maxPixels, ThumbnailPixels *pixels) {
+	struct jpeg_decompress_struct cinfo;
+	JpegErrorMgr err;
+	struct jpeg_source_mgr src;
+
+	// everything changed after the setjmp() lives in *pixels
+	pixels->m_resampler = NULL;
+	pixels->m_isOriginal = false;
+
+	cinfo.err = jpeg_std_error(&err.m_pub);
+	err.m_pub.error_exit = jpegErrorExit;
+	err.m_pub.output_message = jpegOutputMessage;
+
+	if (setjmp(err.m_jmp)) {
+		jpeg_destroy_decompress(&cinfo);
+		delete pixels->m_resampler;
+		pixels->m_resampler = NULL;
+		g_errno = EBADIMG;
+		return false;
+	}
+
+	jpeg_create_decompress(&cinfo);
+
+	src.next_input_byte = (const JOCTET *)data;
+	src.bytes_in_buffer = dataSize;
+	src.init_source = jpegInitSource;
+	src.fill_input_buffer = jpegFillInputBuffer;
+	src.skip_input_data = jpegSkipInputData;
+	src.resync_to_restart = jpeg_resync_to_restart;
+	src.term_source = jpegTermSource;
+	cinfo.src = &src;
+
+	jpeg_read_header(&cinfo, TRUE);
+
+	getThumbnailSize(cinfo.image_width, cinfo.image_height, maxWidthHeight, &pixels->m_width, &pixels->m_height);
+	if ((uint32_t)pixels->m_width == cinfo.image_width && (uint32_t)pixels->m_height == cinfo.image_height) {
+		jpeg_destroy_decompress(&cinfo);
+		pixels->m_isOriginal = true;
+		return true;
+	}
+
+	// . let the idct do most of the downscaling, but not below the
+	//   thumbnail size
+	for (int denom = 8; denom > 1; denom /= 2) {
+		if ((int64_t)(cinfo.image_width + denom - 1) / denom >= pixels->m_width &&
+		    (int64_t)(cinfo.image_height + denom - 1) / denom >= pixels->m_height) {
+			cinfo.scale_num = 1;
+			cinfo.scale_denom = denom;
+			break;
+		}
+	}
+
+	bool isCmyk = false;
+	if (cinfo.jpeg_color_space == JCS_GRAYSCALE) {
+		cinfo.out_color_space = JCS_GRAYSCALE;
+		pixels->m_channels = 1;
+	} else if (cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK) {
+		cinfo.out_color_space = JCS_CMYK;
+		pixels->m_channels = 3;
+		isCmyk = true;
+	} else {
+		cinfo.out_color_space = JCS_RGB;
+		pixels->m_channels = 3;
+	}
+
+	jpeg_calc_output_dimensions(&cinfo);
+	if ((int64_t)cinfo.output_width * cinfo.output_height > maxPixels) {
+		log(LOG_DEBUG, "image: Jpeg of %" PRIu32"x%" PRIu32" pixels is too big to decode",
+		    (uint32_t)cinfo.output_width, (uint32_t)cinfo.output_height);
+		jpeg_destroy_decompress(&cinfo);
+		g_errno = EBADIMG;
+		return false;
+	}
+
+	jpeg_start_decompress(&cinfo);
+
+	pixels->m_resampler = new AreaResampler(cinfo.output_width, cinfo.output_height,
+	                                        pixels->m_width, pixels->m_height, pixels->m_channels);
+
+	JSAMPARRAY row = (*cinfo.mem->alloc_sarray)((j_common_ptr)&cinfo, JPOOL_IMAGE,
+	                                            cinfo.output_width * cinfo.output_components, 1);
+	JSAMPARRAY rgb = (*cinfo.mem->alloc_sarray)((j_common_ptr)&cinfo, JPOOL_IMAGE,
+	                                            cinfo.output_width * 3, 1);
+
+	while (cinfo.output_scanline < cinfo.output_height) {
+		jpeg_read_scanlines(&cinfo, row, 1);
+		if (isCmyk) {
+			// adobe writes inverted cmyk
+			const JSAMPLE *s = row[0];
+			JSAMPLE *d = rgb[0];
+			for (JDIMENSION x = 0; x < cinfo.output_width; x++, s += 4, d += 3) {
+				d[0] = (s[0] * s[3] + 127) / 255;
+				d[1] = (s[1] * s[3] + 127) / 255;
+				d[2] = (s[2] * s[3] + 127) / 255;
+			}
+			pixels->m_resampler->addRow(rgb[0]);
+		} else {
+			pixels->m_resampler->addRow(row[0]);
+		}
+	}
+
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	return true;
+}
+
+
+//
+// libpng glue
+//
+
+struct PngReader {
+	const char *m_data;
+	int32_t     m_size;
+	int32_t     m_pos;
+};
+
+static void pngRead(png_structp png, png_bytep out, png_size_t len) {
+	PngReader *reader = (PngReader *)png_get_io_ptr(png);
+	if (len > (png_size_t)(reader->m_size - reader->m_pos)) {
+		png_error(png, "truncated");
+	}
+	memcpy(out, reader->m_data + reader->m_pos, len);
+	reader->m_pos += len;
+}
+
+static void pngError(png_structp png, png_const_charp msg) {
+	log(LOG_DEBUG, "image: libpng: %s", msg);
+	longjmp(png_jmpbuf(png), 1);
+}
+
+static void pngWarning(png_structp /*png*/, png_const_charp /*msg*/) {
+}
+
+
+// rgba over a white background
+static void compositeRow(const uint8_t *rgba, uint8_t *rgb, int32_t width) {
+	for (int32_t x = 0; x < width; x++, rgba += 4, rgb += 3) {
+		uint32_t a = rgba[3];
+		rgb[0] = (rgba[0] * a + 255 * (255 - a) + 127) / 255;
+		rgb[1] = (rgba[1] * a + 255 * (255 - a) + 127) / 255;
+		rgb[2] = (rgba[2] * a + 255 * (255 - a) + 127) / 255;
+	}
+}
+
+
+// the pixel buffers of decodePng(), freed on error
+struct PngBuffers {
+	uint8_t   *m_row;
+	uint8_t   *m_rgb;
+	uint8_t   *m_image;
+	png_bytep *m_rows;
+};
+
+
+static bool decodePng(const char *data, int32_t dataSize, int32_t maxWidthHeight, int64_t maxPixels, ThumbnailPixels *pixels) {
+	PngReader reader;
+	reader.m_data = data;
+	reader.m_size = dataSize;
+	reader.m_pos = 0;
+
+	// volatile since they are changed after the setjmp()
+	volatile PngBuffers bufs;
+	bufs.m_row = NULL;
+	bufs.m_rgb = NULL;
+	bufs.m_image = NULL;
+	bufs.m_rows = NULL;
+
+	pixels->m_resampler = NULL;
+	pixels->m_isOriginal = false;
+	pixels->m_channels = 3;
+
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, pngError, pngWarning);
+	if (!png) {
+		g_errno = ENOMEM;
+		return false;
+	}
+	png_infop info = png_create_info_struct(png);
+	if (!info) {
+		png_destroy_read_struct(&png, NULL, NULL);
+		g_errno = ENOMEM;
+		return false;
+	}
+
+	if (setjmp(png_jmpbuf(png))) {
+		png_destroy_read_struct(&png, &info, NULL);
+		delete pixels->m_resampler;
+		pixels->m_resampler = NULL;
+		delete[] bufs.m_row;
+		delete[] bufs.m_rgb;
+		delete[] bufs.m_image;
+		delete[] bufs.m_rows;
+		g_errno = EBADIMG;
+		return false;
+	}
+
+	png_set_read_fn(png, &reader, pngRead);
+	png_read_info(png, info);
+
+	png_uint_32 width = png_get_image_width(png, info);
+	png_uint_32 height = png_get_image_height(png, info);
+	int bitDepth = png_get_bit_depth(png, info);
+	int colorType = png_get_color_type(png, info);
+
+	if ((int64_t)width * height > maxPixels) {
+		log(LOG_DEBUG, "image: Png of %" PRIu32"x%" PRIu32" pixels is too big to decode", (uint32_t)width, (uint32_t)height);
+		png_destroy_read_struct(&png, &info, NULL);
+		g_errno = EBADIMG;
+		return false;
+	}
+
+	// always decode to 8 bit rgba
+	if (bitDepth == 16) {
+		png_set_strip_16(png);
+	}
+	if (colorType == PNG_COLOR_TYPE_PALETTE) {
+		png_set_palette_to_rgb(png);
+	}
+	if (colorType == PNG_COLOR_TYPE_GRAY && bitDepth < 8) {
+		png_set_expand_gray_1_2_4_to_8(png);
+	}
+	if (png_get_valid(png, info, PNG_INFO_tRNS)) {
+		png_set_tRNS_to_alpha(png);
+	}
+	if (colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA) {
+		png_set_gray_to_rgb(png);
+	}
+	if (!(colorType & PNG_COLOR_MASK_ALPHA) && !png_get_valid(png, info, PNG_INFO_tRNS)) {
+		png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+	}
+	int passes = png_set_interlace_handling(png);
+	png_read_update_info(png, info);
+
+	if (png_get_rowbytes(png, info) != (png_size_t)width * 4) {
+		png_error(png, "unexpected row size");
+	}
+
+	getThumbnailSize(width, height, maxWidthHeight, &pixels->m_width, &pixels->m_height);
+	pixels->m_resampler = new AreaResampler(width, height, pixels->m_width, pixels->m_height, 3);
+
+	bufs.m_rgb = new uint8_t[width * 3];
+
+	if (passes == 1) {
+		// not interlaced, resize while decoding
+		bufs.m_row = new uint8_t[width * 4];
+		for (png_uint_32 y = 0; y < height; y++) {
+			png_read_row(png, bufs.m_row, NULL);
+			compositeRow(bufs.m_row, bufs.m_rgb, width);
+			pixels->m_resampler->addRow(bufs.m_rgb);
+		}
+	} else {
+		// interlaced images need the whole image
+		bufs.m_image = new uint8_t[(size_t)width * 4 * height];
+		bufs.m_rows = new png_bytep[height];
+		for (png_uint_32 y = 0; y < height; y++) {
+			bufs.m_rows[y] = bufs.m_image + (size_t)y * width * 4;
+		}
+		png_read_image(png, bufs.m_rows);
+		for (png_uint_32 y = 0; y < height; y++) {
+			compositeRow(bufs.m_rows[y], bufs.m_rgb, width);
+			pixels->m_resampler->addRow(bufs.m_rgb);
+		}
+	}
+
+	png_destroy_read_struct(&png, &info, NULL);
+	delete[] bufs.m_row;
+	delete[] bufs.m_rgb;
+	delete[] bufs.m_image;
+	delete[] bufs.m_rows;
+	return true;
+}
+
+
+static bool encodeJpeg(const ThumbnailPixels *pixels, SafeBuf *out) {
+	struct jpeg_compress_struct cinfo;
+	JpegErrorMgr err;
+	JpegDestination dest;
+
+	cinfo.err = jpeg_std_error(&err.m_pub);
+	err.m_pub.error_exit = jpegErrorExit;
+	err.m_pub.output_message = jpegOutputMessage;
+
+	if (setjmp(err.m_jmp)) {
+		jpeg_destroy_compress(&cinfo);
+		g_errno = ENOMEM;
+		return false;
+	}
+
+	jpeg_create_compress(&cinfo);
+
+	dest.m_sb = out;
+	dest.m_pub.init_destination = jpegInitDestination;
+	dest.m_pub.empty_output_buffer = jpegEmptyOutputBuffer;
+	dest.m_pub.term_destination = jpegTermDestination;
+	cinfo.dest = &dest.m_pub;
+
+	cinfo.image_width = pixels->m_width;
+	cinfo.image_height = pixels->m_height;
+	cinfo.input_components = pixels->m_channels;
+	cinfo.in_color_space = pixels->m_channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, THUMBNAIL_JPEG_QUALITY, TRUE);
+
+	jpeg_start_compress(&cinfo, TRUE);
+
+	const uint8_t *image = pixels->m_resampler->getOutput();
+	int32_t stride = pixels->m_width * pixels->m_channels;
+	while (cinfo.next_scanline < cinfo.image_height) {
+		JSAMPROW row = (JSAMPROW)(image + (int64_t)cinfo.next_scanline * stride);
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	return true;
+}
+
+
+bool makeThumbnail(const char *data, int32_t dataSize, int32_t maxWidthHeight, int64_t maxPixels,
+                   SafeBuf *out, int32_t *thumbWidth, int32_t *thumbHeight) {
+	ThumbnailPixels pixels;
+	pixels.m_width = 0;
+	pixels.m_height = 0;
+	pixels.m_channels = 0;
+	pixels.m_resampler = NULL;
+	pixels.m_isOriginal = false;
+
+	bool status;
+	if (isJpeg(data, dataSize)) {
+		status = decodeJpeg(data, dataSize, maxWidthHeight, maxPixels, &pixels);
+	} else if (isPng(data, dataSize)) {
+		status = decodePng(data, dataSize, maxWidthHeight, maxPixels, &pixels);
+	} else {
+		g_errno = EBADIMG;
+		return false;
+	}
+
+	if (!status) {
+		return false;
+	}
+
+	*thumbWidth = pixels.m_width;
+	*thumbHeight = pixels.m_height;
+
+	// small jpeg, use as is
+	if (pixels.m_isOriginal) {
+		return out->safeMemcpy(data, dataSize);
+	}
+
+	status = encodeJpeg(&pixels, out);
+	delete pixels.m_resampler;
+	return status;
+}
@@ -0,0 +1,75 @@
+// in-process thumbnail generation for jpeg and png images
+
+// . decode -> area-averaging resize -> jpeg encode with libjpeg/libpng
+//   instead of a giftopnm/jpegtopnm | pnmscale | ppmtojpeg pipeline
+// . source rows are resized as they are decoded, so except for interlaced
+//   pngs memory use is proportional to the image width
+// . jpegs are decoded at 1/2, 1/4 or 1/8 scale by libjpeg when the
+//   thumbnail is small enough
+// . other formats still go through the pnm tools, see Images::thumbStart_r()
+
+#ifndef GB_IMAGETHUMBNAIL_H
+#define GB_IMAGETHUMBNAIL_H
+
+#include <inttypes.h>
+#include <vector>
+
+class SafeBuf;
+
+
+// . downscales with area averaging, each destination pixel is the average
+//   of the source area it covers (partially covered source pixels are
+//   weighted by the overlap)
+// . feed the source rows top to bottom with addRow()
+// . the destination is never larger than the source
+class AreaResampler {
+	AreaResampler(const AreaResampler&);
+	AreaResampler& operator=(const AreaResampler&);
+public:
+	AreaResampler(int32_t srcWidth, int32_t srcHeight, int32_t dstWidth, int32_t dstHeight, int32_t channels);
+
+	void addRow(const uint8_t *row);
+
+	// dstWidth*dstHeight*channels bytes, complete after srcHeight rows
+	const uint8_t *getOutput() const { return &m_dst[0]; }
+
+private:
+	void accumulate(const uint8_t *row, uint32_t weight);
+	void finishDstRow();
+
+	int32_t m_srcWidth;
+	int32_t m_srcHeight;
+	int32_t m_dstWidth;
+	int32_t m_dstHeight;
+	int32_t m_channels;
+
+	// source row being added and destination row being filled
+	int32_t m_srcRow;
+	int32_t m_dstRow;
+
+	// weighted sum of the source rows of the current destination row
+	std::vector<uint32_t> m_acc;
+
+	// for each destination column the first source column and the
+	// overlap of the source columns with it
+	std::vector<int32_t>  m_colStart;
+	std::vector<int32_t>  m_colCount;
+	std::vector<uint32_t> m_colWeights;
+	std::vector<int32_t>  m_colWeightStart;
+
+	std::vector<uint8_t> m_dst;
+};
+
+
+// true if makeThumbnail() can decode the image (jpeg or png)
+bool canMakeThumbnail(const char *data, int32_t dataSize);
+
+// . makes a jpeg thumbnail that fits in maxWidthHeight x maxWidthHeight
+// . images already small enough are only re-encoded, unless they are jpegs
+//   in which case the original is returned
+// . returns false and sets g_errno on error. EBADIMG if the image could
+//   not be decoded or has more than maxPixels decoded pixels
+bool makeThumbnail(const char *data, int32_t dataSize, int32_t maxWidthHeight, int64_t maxPixels,
+                   SafeBuf *out, int32_t *thumbWidth, int32_t *thumbHeight);
+
+#endif // GB_IMAGETHUMBNAIL_H
@@ -12,6 +12,7 @@
 #include "Posdb.h"
 #include "File.h"
 #include "Errno.h"
+#include "ImageThumbnail.h"
 #include <pthread.h>
 #include <fcntl.h>
 #include <arpa/inet.h>
@@ -867,6 +868,35 @@ void Images::thumbStart_r ( bool amThread ) {
 	
 	log( LOG_DEBUG, "image: thumbStart_r entered." );
 
+	// . jpegs and pngs are done in-process, no temp files or pnm tools
+	// . the thumbnail overwrites the original image in the reply buf
+	if ( canMakeThumbnail ( m_imgData, m_imgDataSize ) ) {
+		SafeBuf thumb;
+		if ( ! makeThumbnail ( m_imgData, m_imgDataSize, m_xysize, g_conf.m_thumbnailMaxPixels,
+				       &thumb, &m_tdx, &m_tdy ) ) {
+			m_errno = g_errno;
+			log( LOG_DEBUG, "image: Could not make thumbnail: %s", mstrerror(m_errno) );
+			return;
+		}
+
+		int32_t avail = m_imgReplyMaxLen - (m_imgData - m_imgReply);
+		if ( thumb.length() > avail ) {
+			log( LOG_DEBUG, "image: Image thumbnail larger than buffer! %" PRId32" > %" PRId32,
+			     thumb.length(), avail );
+			return;
+		}
+
+		memmove ( m_imgData, thumb.getBufStart(), thumb.length() );
+		m_thumbnailSize = thumb.length();
+		m_thumbnailValid = true;
+
+		int64_t stop = gettimeofdayInMilliseconds();
+		log( LOG_DEBUG, "image: Thumbnail size: %" PRId32" bytes.", m_thumbnailSize );
+		log( LOG_DEBUG, "image: Thumbnail dx=%" PRId32" dy=%" PRId32".", m_tdx,m_tdy );
+		log( LOG_DEBUG, "image: Thumbnail generated in-process in %" PRId64"ms.", stop-start );
+		return;
+	}
+
 	//DIR  *d;
 	//char  cmd[2500];
 	//sprintf( cmd, "%strash", g_hostdb.m_dir );
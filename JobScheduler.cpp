@@ -2,9 +2,15 @@
 #include "ScopedLock.h"
 #include "BigFile.h" //for FileState definition
 #include "Errno.h"
+#include "SamplingProfiler.h"
+#include "Metrics.h"
+#include "QueryAdmission.h"
 #include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
 #include <vector>
-#include <list>
+#include <deque>
+#include <atomic>
 #include <algorithm>
 #include <stdexcept>
 #include <assert.h>
@@ -38,6 +44,7 @@ struct JobEntry {
 	uint64_t          start_deadline;     //latest time when this job must be started
 	bool              is_io_write_job;    //valid for I/O jobs: mostly read or mostly write?
 	int               initial_priority;   //priority when queued
+	uint64_t          sequence;           //submission order within the pool, for FIFO among equal priorities
 	
 	//for statistics:
 	thread_type_t     thread_type;
@@ -49,114 +56,118 @@ struct JobEntry {
 };
 
 
+static bool job_entry_before(const JobEntry &a, const JobEntry &b) {
+	if(a.initial_priority!=b.initial_priority)
+		return a.initial_priority<b.initial_priority;
+	return a.sequence<b.sequence;
+}
 
 
-//a set of jobs, prioritized
-class JobQueue : public std::vector<JobEntry> {
-public:
-	pthread_cond_t cond_not_empty;
-	unsigned potential_worker_threads;
+typedef std::vector<std::pair<JobEntry,job_exit_t>> ExitSet;
+
+
+//A submitted job not yet picked up by a worker. Linked into the lock-free
+//submission stack of a pool
+struct SubmittedJob {
+	SubmittedJob *next;
+	JobEntry      e;
+};
+
 
-	JobQueue()
-	  : vector(),
-	    cond_not_empty PTHREAD_COND_INITIALIZER,
-	    potential_worker_threads(0)
+//The queue of one worker thread, sorted on priority and then submission
+//order. Only the owner and the occasional thief touch it so the mutex is
+//rarely contended.
+struct WorkerQueue {
+	pthread_mutex_t      mtx;
+	std::deque<JobEntry> queue;
+	bool                 is_running;
+	JobEntry             running_job;
+	
+	WorkerQueue()
+	  : mtx PTHREAD_MUTEX_INITIALIZER,
+	    queue(),
+	    is_running(false)
 	{
 	}
-	
-	~JobQueue() {
-		pthread_cond_destroy(&cond_not_empty);
+	~WorkerQueue() {
+		pthread_mutex_destroy(&mtx);
 	}
 	
-	void add(const JobEntry &e) {
-		push_back(e);
-		pthread_cond_signal(&cond_not_empty);
+	void insert(const JobEntry &e) {
+		queue.insert(std::upper_bound(queue.begin(),queue.end(),e,job_entry_before), e);
 	}
-	
-	JobEntry pop_top_priority();
-	
-	
 };
 
 
-JobEntry JobQueue::pop_top_priority()
-{
-	assert(!empty());
-	//todo: age old entries
-	std::vector<JobEntry>::iterator best_iter = begin();
-	std::vector<JobEntry>::iterator iter = best_iter;
-	++iter;
-	for( ; iter!=end(); ++iter)
-		if(iter->initial_priority<best_iter->initial_priority)
-			best_iter = iter;
-	JobEntry tmp = *best_iter;
-	erase(best_iter);
-	return tmp;
-}
-
-
-
-typedef std::vector<std::pair<JobEntry,job_exit_t>> ExitSet;
-typedef std::list<JobEntry> RunningSet;
-
+class JobPool;
 
 //parameters given to a pool thread
 struct PoolThreadParameters {
-	JobQueue          *job_queue;                 //queue to fetch jobs from
-	RunningSet        *running_set;               //set to store the job in while executing it
-	ExitSet           *exit_set;                  //set to store the finished job+exit-cause in
-	unsigned          *num_io_write_jobs_running; //global counter for scheduling
-	pthread_mutex_t   *mtx;                       //mutex covering above 3 containers
-	job_done_notify_t job_done_notify;            //notifycation callback whenever a job returns
-	bool              stop;
+	JobPool  *pool;
+	unsigned  worker;
+};
+
+
+//A set of worker threads and their jobs.
+//Submitting pushes onto a lock-free stack. A worker moves the submitted jobs
+//into its own priority-sorted deque and runs the best one. An idle worker
+//steals the best job and half of the rest from another worker's deque.
+//Sleeping workers are woken with a semaphore, and only if any are sleeping.
+class JobPool {
+public:
+	JobPool(const char *thread_name_prefix,
+	        unsigned num_threads,
+	        ExitSet *exit_set, pthread_mutex_t *exit_mtx,
+	        std::atomic<unsigned> *num_io_write_jobs_running,
+	        job_done_notify_t job_done_notify_);
+	~JobPool();
+	
+	unsigned potential_worker_threads() const { return workers.size(); }
+	
+	//lock-free, callable from any thread
+	void add(const JobEntry &e);
+	
+	void initiate_stop();
+	void join_all();
+	
+	unsigned num_queued() const { return num_queued_jobs.load(); }
+	
+	//move the queued jobs matching pred into the exit set
+	template<typename Pred> void cancel_queued_jobs(Pred pred, job_exit_t job_exit);
+	//call fn(job,is_running) for all queued and running jobs until it returns true
+	template<typename Fn> bool find_job(Fn fn);
+	
+	void worker_loop(unsigned worker);
+	
+private:
+	bool take_job(unsigned worker, JobEntry *e);
+	void run_job(unsigned worker, JobEntry &e);
+	void wait_for_work();
+	void move_submitted_jobs(SubmittedJob *list, WorkerQueue *wq);
+	void flush_submitted_jobs();
+	
+	std::atomic<SubmittedJob*> submitted;
+	std::atomic<uint64_t>      next_sequence;
+	std::atomic<unsigned>      num_queued_jobs;     //submitted or in a worker queue
+	std::atomic<unsigned>      num_sleeping;
+	sem_t                      wakeup_sem;
+	std::atomic<bool>          stop;
+	
+	std::vector<WorkerQueue*>         workers;
+	std::vector<PoolThreadParameters> ptp;
+	std::vector<pthread_t>            tid;
+	
+	ExitSet               *exit_set;
+	pthread_mutex_t       *exit_mtx;                  //covers the exit set
+	std::atomic<unsigned> *num_io_write_jobs_running; //global counter for scheduling
+	job_done_notify_t      job_done_notify;           //notifycation callback whenever a job returns
 };
 
 
 extern "C" {
 static void *job_pool_thread_function(void *pv) {
 	PoolThreadParameters *ptp= static_cast<PoolThreadParameters*>(pv);
-	pthread_mutex_lock(ptp->mtx);
-	while(!ptp->stop) {
-		if(ptp->job_queue->empty())
-			pthread_cond_wait(&ptp->job_queue->cond_not_empty,ptp->mtx);
-		if(ptp->stop)
-			break;
-		if(ptp->job_queue->empty()) //spurious wakeup
-			continue;
-		
-		//take the top-priority job and move it into the running set
-		RunningSet::iterator iter = ptp->running_set->insert(ptp->running_set->begin(),ptp->job_queue->pop_top_priority());
-		if(iter->is_io_job && iter->is_io_write_job)
-			++*(ptp->num_io_write_jobs_running);
-		pthread_mutex_unlock(ptp->mtx);
-		
-		job_exit_t job_exit;
-		uint64_t now = now_ms();
-		iter->start_time = now;
-		if(iter->start_deadline==0 || iter->start_deadline>now) {
-			// Clear g_errno so the thread/job starts with a clean slate
-			g_errno = 0;
-			iter->start_routine(iter->state);
-			iter->stop_time = now_ms();
-			job_exit = job_exit_normal;
-		} else {
-			job_exit = job_exit_deadline;
-		}
-		
-		pthread_mutex_lock(ptp->mtx);
-		if(iter->is_io_job && iter->is_io_write_job)
-			--*(ptp->num_io_write_jobs_running);
-		//copy+delete it into the exit queue
-		ptp->exit_set->push_back(std::make_pair(*iter,job_exit));
-		ptp->running_set->erase(iter);
-		pthread_mutex_unlock(ptp->mtx);
-		
-		(ptp->job_done_notify)();
-		
-		pthread_mutex_lock(ptp->mtx);
-	}
-	
-	pthread_mutex_unlock(ptp->mtx);
+	ptp->pool->worker_loop(ptp->worker);
 	return 0;
 }
 }
@@ -166,42 +177,33 @@ static void job_done_notify_noop() {
 }
 
 
-class ThreadPool {
-public:
-	ThreadPool(const char *thread_name_prefix,
-	           unsigned num_threads,
-	           JobQueue *job_queue, RunningSet *running_set, ExitSet *exit_set,
-		   unsigned *num_io_write_jobs_running,
-		   pthread_mutex_t *mtx,
-		   job_done_notify_t job_done_notify_);
-	void initiate_stop();
-	void join_all();
-	~ThreadPool();
-	
-private:
-	PoolThreadParameters ptp;
-	std::vector<pthread_t> tid;
-};
-
-
-ThreadPool::ThreadPool(const char *thread_name_prefix,
-                       unsigned num_threads,
-                       JobQueue *job_queue, RunningSet *running_set, ExitSet *exit_set,
-		       unsigned *num_io_write_jobs_running,
-		       pthread_mutex_t *mtx,
-                       job_done_notify_t job_done_notify_)
-  : tid(num_threads)
-{
-	job_queue->potential_worker_threads += num_threads;
-	ptp.job_queue = job_queue;
-	ptp.running_set = running_set;
-	ptp.exit_set = exit_set;
-	ptp.num_io_write_jobs_running = num_io_write_jobs_running;
-	ptp.mtx = mtx;
-	ptp.job_done_notify = job_done_notify_?job_done_notify_:job_done_notify_noop;
-	ptp.stop = false;
+JobPool::JobPool(const char *thread_name_prefix,
+                 unsigned num_threads,
+                 ExitSet *exit_set_, pthread_mutex_t *exit_mtx_,
+                 std::atomic<unsigned> *num_io_write_jobs_running_,
+                 job_done_notify_t job_done_notify_)
+  : submitted(NULL),
+    next_sequence(0),
+    num_queued_jobs(0),
+    num_sleeping(0),
+    stop(false),
+    workers(num_threads),
+    ptp(num_threads),
+    tid(num_threads),
+    exit_set(exit_set_),
+    exit_mtx(exit_mtx_),
+    num_io_write_jobs_running(num_io_write_jobs_running_),
+    job_done_notify(job_done_notify_?job_done_notify_:job_done_notify_noop)
+{
+	if(sem_init(&wakeup_sem,0,0)!=0)
+		throw std::runtime_error("sem_init() failed");
+	for(unsigned i=0; i<num_threads; i++) {
+		workers[i] = new WorkerQueue;
+		ptp[i].pool = this;
+		ptp[i].worker = i;
+	}
 	for(unsigned i=0; i<tid.size(); i++) {
-		int rc = pthread_create(&tid[i], NULL, job_pool_thread_function, &ptp);
+		int rc = pthread_create(&tid[i], NULL, job_pool_thread_function, &ptp[i]);
 		if(rc!=0)
 			throw std::runtime_error("pthread_create() failed");
 		char thread_name[16]; //hard limit
@@ -213,22 +215,207 @@ ThreadPool::ThreadPool(const char *thread_name_prefix,
 }
 
 
-void ThreadPool::initiate_stop()
+JobPool::~JobPool()
+{
+	join_all();
+	//cancelled or never started
+	SubmittedJob *list = submitted.exchange(NULL);
+	while(list) {
+		SubmittedJob *next = list->next;
+		delete list;
+		list = next;
+	}
+	for(auto wq : workers)
+		delete wq;
+	sem_destroy(&wakeup_sem);
+}
+
+
+void JobPool::add(const JobEntry &e)
 {
+	SubmittedJob *sj = new SubmittedJob;
+	sj->e = e;
+	sj->e.sequence = next_sequence.fetch_add(1,std::memory_order_relaxed);
+	//count the job before it is published so a worker or a cancel cannot
+	//decrement the counter first. Nothing can fail after this.
+	//Pairs with the sleeping check in wait_for_work() so that either the worker sees the job or we see the worker
+	num_queued_jobs.fetch_add(1);
+	sj->next = submitted.load(std::memory_order_relaxed);
+	while(!submitted.compare_exchange_weak(sj->next,sj,std::memory_order_release,std::memory_order_relaxed))
+		;
+	if(num_sleeping.load()>0)
+		sem_post(&wakeup_sem);
+}
+
+
+void JobPool::initiate_stop()
+{
+	stop = true;
 	for(unsigned i=0; i<tid.size(); i++)
-		ptp.stop = true;
+		sem_post(&wakeup_sem);
 }
 
-void ThreadPool::join_all()
+
+void JobPool::join_all()
 {
 	for(unsigned i=0; i<tid.size(); i++)
 		pthread_join(tid[i],NULL);
 	tid.clear();
 }
 
-ThreadPool::~ThreadPool()
+
+//move a grabbed submission stack into a worker queue. Caller holds wq->mtx
+void JobPool::move_submitted_jobs(SubmittedJob *list, WorkerQueue *wq)
 {
-	join_all();
+	while(list) {
+		SubmittedJob *next = list->next;
+		wq->insert(list->e);
+		delete list;
+		list = next;
+	}
+}
+
+
+//make the submitted jobs visible in a worker queue, for cancellation and inspection
+void JobPool::flush_submitted_jobs()
+{
+	if(workers.empty() || !submitted.load(std::memory_order_relaxed))
+		return;
+	WorkerQueue *wq = workers[0];
+	ScopedLock sl(wq->mtx);
+	move_submitted_jobs(submitted.exchange(NULL,std::memory_order_acquire),wq);
+}
+
+
+bool JobPool::take_job(unsigned worker, JobEntry *e)
+{
+	WorkerQueue *wq = workers[worker];
+	ScopedLock sl(wq->mtx);
+	
+	if(submitted.load(std::memory_order_relaxed))
+		move_submitted_jobs(submitted.exchange(NULL,std::memory_order_acquire),wq);
+	
+	if(wq->queue.empty()) {
+		//steal the best job and half of the rest from another worker's
+		//queue, so the best job does not wait for the victim's running job.
+		//trylock because we hold our own lock and the victim may be trying
+		//to steal from us
+		for(unsigned i=1; i<workers.size() && wq->queue.empty(); i++) {
+			WorkerQueue *victim = workers[(worker+i)%workers.size()];
+			if(pthread_mutex_trylock(&victim->mtx)!=0)
+				continue;
+			size_t n = (victim->queue.size()+1)/2;
+			wq->queue.insert(wq->queue.end(), victim->queue.begin(), victim->queue.begin()+n);
+			victim->queue.erase(victim->queue.begin(), victim->queue.begin()+n);
+			pthread_mutex_unlock(&victim->mtx);
+		}
+		if(wq->queue.empty())
+			return false;
+	}
+	
+	*e = wq->queue.front();
+	wq->queue.pop_front();
+	
+	//let a sleeping worker steal what is left
+	if(!wq->queue.empty() && num_sleeping.load()>0)
+		sem_post(&wakeup_sem);
+	
+	e->start_time = now_ms();
+	wq->is_running = true;
+	wq->running_job = *e;
+	if(e->is_io_job && e->is_io_write_job)
+		++*num_io_write_jobs_running;
+	num_queued_jobs.fetch_sub(1);
+	return true;
+}
+
+
+void JobPool::run_job(unsigned worker, JobEntry &e)
+{
+	job_exit_t job_exit;
+	if(e.start_deadline==0 || e.start_deadline>e.start_time) {
+		// Clear g_errno so the thread/job starts with a clean slate
+		g_errno = 0;
+		SamplingProfiler::setThreadType(e.thread_type);
+		e.start_routine(e.state);
+		SamplingProfiler::setThreadType(-1);
+		e.stop_time = now_ms();
+		job_exit = job_exit_normal;
+	} else {
+		job_exit = job_exit_deadline;
+	}
+	
+	if(e.is_io_job && e.is_io_write_job)
+		--*num_io_write_jobs_running;
+	
+	WorkerQueue *wq = workers[worker];
+	{
+		ScopedLock sl(wq->mtx);
+		ScopedLock esl(*exit_mtx);
+		wq->is_running = false;
+		exit_set->push_back(std::make_pair(e,job_exit));
+	}
+	
+	(job_done_notify)();
+}
+
+
+void JobPool::wait_for_work()
+{
+	//pairs with add(): announce that we sleep before the final check
+	num_sleeping.fetch_add(1);
+	if(num_queued_jobs.load()==0 && !stop)
+		sem_wait(&wakeup_sem);
+	else
+		sched_yield(); //queued jobs are in the locked queues of other workers
+	num_sleeping.fetch_sub(1);
+}
+
+
+void JobPool::worker_loop(unsigned worker)
+{
+	while(!stop) {
+		JobEntry e;
+		if(take_job(worker,&e))
+			run_job(worker,e);
+		else
+			wait_for_work();
+	}
+}
+
+
+template<typename Pred>
+void JobPool::cancel_queued_jobs(Pred pred, job_exit_t job_exit)
+{
+	flush_submitted_jobs();
+	for(auto wq : workers) {
+		ScopedLock sl(wq->mtx);
+		ScopedLock esl(*exit_mtx);
+		for(auto iter = wq->queue.begin(); iter!=wq->queue.end(); ) {
+			if(pred(*iter)) {
+				exit_set->push_back(std::make_pair(*iter,job_exit));
+				iter = wq->queue.erase(iter);
+				num_queued_jobs.fetch_sub(1);
+			} else
+				++iter;
+		}
+	}
+}
+
+
+template<typename Fn>
+bool JobPool::find_job(Fn fn)
+{
+	flush_submitted_jobs();
+	for(auto wq : workers) {
+		ScopedLock sl(wq->mtx);
+		for(const auto &e : wq->queue)
+			if(fn(e,false))
+				return true;
+		if(wq->is_running && fn(wq->running_job,true))
+			return true;
+	}
+	return false;
 }
 
 } //anonymous namespace
@@ -239,29 +426,18 @@ ThreadPool::~ThreadPool()
 // JobScheduler implementation
 
 class JobScheduler_impl {
-	mutable pthread_mutex_t mtx;
-	
-	JobQueue   coordinator_job_queue;
-	JobQueue   cpu_job_queue;
-	JobQueue   summary_job_queue;
-	JobQueue   io_job_queue;
-	JobQueue   external_job_queue;
-	JobQueue   file_meta_job_queue;
-	JobQueue   merge_job_queue;
-	
-	RunningSet running_set;
-	
+	mutable pthread_mutex_t exit_mtx;
 	ExitSet    exit_set;
 	
-	unsigned   num_io_write_jobs_running;
+	std::atomic<unsigned> num_io_write_jobs_running;
 	
-	ThreadPool coordinator_thread_pool;
-	ThreadPool cpu_thread_pool;
-	ThreadPool summary_thread_pool;
-	ThreadPool io_thread_pool;
-	ThreadPool external_thread_pool;
-	ThreadPool file_meta_thread_pool;
-	ThreadPool merge_thread_pool;
+	JobPool    coordinator_pool;
+	JobPool    cpu_pool;
+	JobPool    summary_pool;
+	JobPool    io_pool;
+	JobPool    external_pool;
+	JobPool    file_meta_pool;
+	JobPool    merge_pool;
 	
 	bool no_threads;
 	bool new_jobs_allowed;
@@ -270,27 +446,19 @@ class JobScheduler_impl {
 	
 	bool submit(thread_type_t thread_type, JobEntry &e);
 	
-	void cancel_queued_jobs(JobQueue &jq, job_exit_t job_exit);
+	void cancel_queued_jobs(JobPool &pool, job_exit_t job_exit);
 public:
 	JobScheduler_impl(unsigned num_coordinator_threads, unsigned num_cpu_threads, unsigned num_summary_threads, unsigned num_io_threads, unsigned num_external_threads, unsigned num_file_meta_threads, unsigned num_merge_threads, job_done_notify_t job_done_notify)
-	  : mtx PTHREAD_MUTEX_INITIALIZER,
-	    coordinator_job_queue(),
-	    cpu_job_queue(),
-	    summary_job_queue(),
-	    io_job_queue(),
-	    external_job_queue(),
-	    file_meta_job_queue(),
-	    merge_job_queue(),
-	    running_set(),
+	  : exit_mtx PTHREAD_MUTEX_INITIALIZER,
 	    exit_set(),
 	    num_io_write_jobs_running(0),
-	    coordinator_thread_pool("coord",num_coordinator_threads,&coordinator_job_queue,&running_set,&exit_set,&num_io_write_jobs_running,&mtx,job_done_notify),
-	    cpu_thread_pool("cpu",num_cpu_threads,&cpu_job_queue,&running_set,&exit_set,&num_io_write_jobs_running,&mtx,job_done_notify),
-	    summary_thread_pool("summary",num_summary_threads,&summary_job_queue,&running_set,&exit_set,&num_io_write_jobs_running,&mtx,job_done_notify),
-	    io_thread_pool("io",num_io_threads,&io_job_queue,&running_set,&exit_set,&num_io_write_jobs_running,&mtx,job_done_notify),
-	    external_thread_pool("ext",num_external_threads,&external_job_queue,&running_set,&exit_set,&num_io_write_jobs_running,&mtx,job_done_notify),
-	    file_meta_thread_pool("file",num_file_meta_threads,&file_meta_job_queue,&running_set,&exit_set,&num_io_write_jobs_running,&mtx,job_done_notify),
-	    merge_thread_pool("merge",num_merge_threads,&merge_job_queue,&running_set,&exit_set,&num_io_write_jobs_running,&mtx,job_done_notify),
+	    coordinator_pool("coord",num_coordinator_threads,&exit_set,&exit_mtx,&num_io_write_jobs_running,job_done_notify),
+	    cpu_pool("cpu",num_cpu_threads,&exit_set,&exit_mtx,&num_io_write_jobs_running,job_done_notify),
+	    summary_pool("summary",num_summary_threads,&exit_set,&exit_mtx,&num_io_write_jobs_running,job_done_notify),
+	    io_pool("io",num_io_threads,&exit_set,&exit_mtx,&num_io_write_jobs_running,job_done_notify),
+	    external_pool("ext",num_external_threads,&exit_set,&exit_mtx,&num_io_write_jobs_running,job_done_notify),
+	    file_meta_pool("file",num_file_meta_threads,&exit_set,&exit_mtx,&num_io_write_jobs_running,job_done_notify),
+	    merge_pool("merge",num_merge_threads,&exit_set,&exit_mtx,&num_io_write_jobs_running,job_done_notify),
 	    no_threads(num_cpu_threads==0 && num_summary_threads==0 && num_io_threads==0 && num_external_threads==0 && num_file_meta_threads==0),
 	    new_jobs_allowed(true)
 	{
@@ -332,7 +500,7 @@ public:
 	
 	void cleanup_finished_jobs();
 	
-	std::vector<JobDigest> query_job_digests() const;
+	std::vector<JobDigest> query_job_digests();
 	std::map<thread_type_t,JobTypeStatistics> query_job_statistics(bool clear);
 };
 
@@ -342,50 +510,32 @@ JobScheduler_impl::~JobScheduler_impl() {
 	//First prevent new jobs from being submitted
 	new_jobs_allowed = false;
 
-	//Then tell the worker threads to stop executing more jobs
-	coordinator_thread_pool.initiate_stop();
-	cpu_thread_pool.initiate_stop();
-	summary_thread_pool.initiate_stop();
-	io_thread_pool.initiate_stop();
-	external_thread_pool.initiate_stop();
-	file_meta_thread_pool.initiate_stop();
-	merge_thread_pool.initiate_stop();
-
-	//Then wake them if they are sleeping
-	pthread_cond_broadcast(&coordinator_job_queue.cond_not_empty);
-	pthread_cond_broadcast(&cpu_job_queue.cond_not_empty);
-	pthread_cond_broadcast(&summary_job_queue.cond_not_empty);
-	pthread_cond_broadcast(&io_job_queue.cond_not_empty);
-	pthread_cond_broadcast(&external_job_queue.cond_not_empty);
-	pthread_cond_broadcast(&file_meta_job_queue.cond_not_empty);
-	pthread_cond_broadcast(&merge_job_queue.cond_not_empty);
+	//Then tell the worker threads to stop executing more jobs, and wake them if they are sleeping
+	coordinator_pool.initiate_stop();
+	cpu_pool.initiate_stop();
+	summary_pool.initiate_stop();
+	io_pool.initiate_stop();
+	external_pool.initiate_stop();
+	file_meta_pool.initiate_stop();
+	merge_pool.initiate_stop();
 
 	//Then cancel all outstanding non-started jobs by moving them from the pending queues to the exit-set
-	{
-		ScopedLock sl(mtx);
-		cancel_queued_jobs(coordinator_job_queue,job_exit_program_exit);
-		cancel_queued_jobs(cpu_job_queue,job_exit_program_exit);
-		cancel_queued_jobs(summary_job_queue,job_exit_program_exit);
-		cancel_queued_jobs(io_job_queue,job_exit_program_exit);
-		cancel_queued_jobs(external_job_queue,job_exit_program_exit);
-		cancel_queued_jobs(file_meta_job_queue,job_exit_program_exit);
-		cancel_queued_jobs(merge_job_queue,job_exit_program_exit);
-	}
+	cancel_all_jobs_for_shutdown();
 
 	//Call finish-callbacks for all the exited / cancelled threads
 	//We "know" that this function (finalize) is only called from the main thread, *cough* *cough*
 	cleanup_finished_jobs();
 	
 	//Then wait  for worker threads to finished
-	coordinator_thread_pool.join_all();
-	cpu_thread_pool.join_all();
-	summary_thread_pool.join_all();
-	io_thread_pool.join_all();
-	file_meta_thread_pool.join_all();
-	merge_thread_pool.join_all();
-	external_thread_pool.join_all();
+	coordinator_pool.join_all();
+	cpu_pool.join_all();
+	summary_pool.join_all();
+	io_pool.join_all();
+	file_meta_pool.join_all();
+	merge_pool.join_all();
+	external_pool.join_all();
 
-	pthread_mutex_destroy(&mtx);
+	pthread_mutex_destroy(&exit_mtx);
 }
 
 
@@ -395,60 +545,56 @@ bool JobScheduler_impl::submit(thread_type_t thread_type, JobEntry &e)
 		return false;
 	e.thread_type = thread_type;
 	
-	//Determine which queue to put the job into
+	//Determine which pool to put the job into
 	//i/o jobs should have the is_io_job=true, but if they don't we will
 	//just treat them as CPU-bound. All this looks over-engineered but we
 	//need some flexibility to make experiments.
-	JobQueue *job_queue;
+	JobPool *pool;
 	if(e.is_io_job)
-		job_queue = &io_job_queue;
+		pool = &io_pool;
 	else {
 		switch(thread_type) {
-			case thread_type_query_coordinator:  job_queue = &coordinator_job_queue; break;
-			case thread_type_query_read:         job_queue = &cpu_job_queue;      break;
-			case thread_type_query_constrain:    job_queue = &cpu_job_queue;      break;
-			case thread_type_query_merge:        job_queue = &cpu_job_queue;      break;
-			case thread_type_query_intersect:    job_queue = &cpu_job_queue;      break;
-			case thread_type_query_summary:      job_queue = &summary_job_queue;  break;
-			case thread_type_spider_read:        job_queue = &cpu_job_queue;      break;
-			case thread_type_spider_write:       job_queue = &cpu_job_queue;      break;
-			case thread_type_spider_filter:      job_queue = &external_job_queue; break;
-			case thread_type_spider_query:       job_queue = &cpu_job_queue;      break;
-			case thread_type_spider_index:       job_queue = &cpu_job_queue;      break;
-			case thread_type_merge_filter:       job_queue = &merge_job_queue;      break;
-			case thread_type_replicate_write:    job_queue = &cpu_job_queue;      break;
-			case thread_type_replicate_read:     job_queue = &cpu_job_queue;      break;
-			case thread_type_file_merge:         job_queue = &merge_job_queue;    break;
-			case thread_type_file_meta_data:     job_queue = &file_meta_job_queue;break;
-			case thread_type_index_merge:        job_queue = &cpu_job_queue;      break;
-			case thread_type_index_generate:     job_queue = &merge_job_queue;    break;
-			case thread_type_verify_data:        job_queue = &cpu_job_queue;      break;
-			case thread_type_statistics:         job_queue = &cpu_job_queue;      break;
-			case thread_type_unspecified_io:     job_queue = &cpu_job_queue;      break;
-			case thread_type_generate_thumbnail: job_queue = &external_job_queue; break;
-			case thread_type_config_load:        job_queue = &cpu_job_queue;      break;
-			case thread_type_page_process:       job_queue = &cpu_job_queue;      break;
+			case thread_type_query_coordinator:  pool = &coordinator_pool; break;
+			case thread_type_query_read:         pool = &cpu_pool;      break;
+			case thread_type_query_constrain:    pool = &cpu_pool;      break;
+			case thread_type_query_merge:        pool = &cpu_pool;      break;
+			case thread_type_query_intersect:    pool = &cpu_pool;      break;
+			case thread_type_query_summary:      pool = &summary_pool;  break;
+			case thread_type_spider_read:        pool = &cpu_pool;      break;
+			case thread_type_spider_write:       pool = &cpu_pool;      break;
+			case thread_type_spider_filter:      pool = &external_pool; break;
+			case thread_type_spider_query:       pool = &cpu_pool;      break;
+			case thread_type_spider_index:       pool = &cpu_pool;      break;
+			case thread_type_merge_filter:       pool = &merge_pool;    break;
+			case thread_type_replicate_write:    pool = &cpu_pool;      break;
+			case thread_type_replicate_read:     pool = &cpu_pool;      break;
+			case thread_type_file_merge:         pool = &merge_pool;    break;
+			case thread_type_file_meta_data:     pool = &file_meta_pool;break;
+			case thread_type_index_merge:        pool = &cpu_pool;      break;
+			case thread_type_index_generate:     pool = &merge_pool;    break;
+			case thread_type_verify_data:        pool = &cpu_pool;      break;
+			case thread_type_statistics:         pool = &cpu_pool;      break;
+			case thread_type_unspecified_io:     pool = &cpu_pool;      break;
+			case thread_type_generate_thumbnail: pool = &external_pool; break;
+			case thread_type_config_load:        pool = &cpu_pool;      break;
+			case thread_type_page_process:       pool = &cpu_pool;      break;
 			default:
 				assert(false);
 
 		}
 	}
 	
-	if(job_queue->potential_worker_threads==0)
+	if(pool->potential_worker_threads()==0)
 		return false;
 	
 	e.queue_enter_time = now_ms();
-	ScopedLock sl(mtx);
-	job_queue->add(e);
+	pool->add(e);
 	return true;
 }
 
 
-void JobScheduler_impl::cancel_queued_jobs(JobQueue &jq, job_exit_t job_exit) {
-	while(!jq.empty()) {
-		exit_set.push_back(std::make_pair(jq.back(),job_exit));
-		jq.pop_back();
-	}
+void JobScheduler_impl::cancel_queued_jobs(JobPool &pool, job_exit_t job_exit) {
+	pool.cancel_queued_jobs([](const JobEntry &) { return true; }, job_exit);
 }
 
 
@@ -498,26 +644,23 @@ bool JobScheduler_impl::submit_io(start_routine_t   start_routine,
 
 bool JobScheduler_impl::are_io_write_jobs_running() const
 {
-	ScopedLock sl(mtx);
 	return num_io_write_jobs_running != 0;
 }
 
 
 
+static bool is_read_job_for_file(const JobEntry &e, const BigFile *bf) {
+	if(e.is_io_job && !e.is_io_write_job) {
+		const FileState *fstate = reinterpret_cast<const FileState*>(e.state);
+		return fstate->m_bigfile==bf;
+	}
+	return false;
+}
+
+
 void JobScheduler_impl::cancel_file_read_jobs(const BigFile *bf)
 {
-	ScopedLock sl(mtx);
-	for(JobQueue::iterator iter = io_job_queue.begin(); iter!=io_job_queue.end(); ) {
-		if(iter->is_io_job && !iter->is_io_write_job) {
-			const FileState *fstate = reinterpret_cast<const FileState*>(iter->state);
-			if(fstate->m_bigfile==bf) {
-				exit_set.push_back(std::make_pair(*iter,job_exit_cancelled));
-				iter = io_job_queue.erase(iter);
-				continue;
-			}
-		}
-		++iter;
-	}
+	io_pool.cancel_queued_jobs([bf](const JobEntry &e) { return is_read_job_for_file(e,bf); }, job_exit_cancelled);
 }
 
 
@@ -526,48 +669,57 @@ bool JobScheduler_impl::is_reading_file(const BigFile *bf)
 	//The old thread stuff tested explicitly if the start_routine was
 	//readwriteWrapper_r() in BigFile.cpp but that is fragile. Besides,
 	//we have the 'is_io_write_job' field.
-	ScopedLock sl(mtx);
-	for(const auto &e : io_job_queue) {
-		if(e.is_io_job && !e.is_io_write_job) {
-			const FileState *fstate = reinterpret_cast<const FileState*>(e.state);
-			if(fstate->m_bigfile==bf)
-				return true;
-		}
-	}
-	for(const auto &e : running_set) {
-		if(e.is_io_job && !e.is_io_write_job) {
-			const FileState *fstate = reinterpret_cast<const FileState*>(e.state);
-			if(fstate->m_bigfile==bf)
-				return true;
-		}
-	}
-	return false;
+	return io_pool.find_job([bf](const JobEntry &e, bool) { return is_read_job_for_file(e,bf); });
 }
 
 
 void JobScheduler_impl::cancel_all_jobs_for_shutdown() {
-	ScopedLock sl(mtx);
-	cancel_queued_jobs(coordinator_job_queue,job_exit_program_exit);
-	cancel_queued_jobs(cpu_job_queue,job_exit_program_exit);
-	cancel_queued_jobs(summary_job_queue,job_exit_program_exit);
-	cancel_queued_jobs(io_job_queue,job_exit_program_exit);
-	cancel_queued_jobs(external_job_queue,job_exit_program_exit);
-	cancel_queued_jobs(file_meta_job_queue,job_exit_program_exit);
-	cancel_queued_jobs(merge_job_queue,job_exit_program_exit);
+	cancel_queued_jobs(coordinator_pool,job_exit_program_exit);
+	cancel_queued_jobs(cpu_pool,job_exit_program_exit);
+	cancel_queued_jobs(summary_pool,job_exit_program_exit);
+	cancel_queued_jobs(io_pool,job_exit_program_exit);
+	cancel_queued_jobs(external_pool,job_exit_program_exit);
+	cancel_queued_jobs(file_meta_pool,job_exit_program_exit);
+	cancel_queued_jobs(merge_pool,job_exit_program_exit);
 }
 
 
 
 unsigned JobScheduler_impl::num_queued_jobs() const
 {
-	ScopedLock sl(mtx);
-	return cpu_job_queue.size() + summary_job_queue.size() + io_job_queue.size() + external_job_queue.size() + file_meta_job_queue.size() + merge_job_queue.size();
+	return cpu_pool.num_queued() + summary_pool.num_queued() + io_pool.num_queued() + external_pool.num_queued() + file_meta_pool.num_queued() + merge_pool.num_queued();
+}
+
+//never-reset statistics published to the metrics registry, unlike job_statistics
+static const int num_thread_types = thread_type_page_process+1;
+static MetricCounter    job_count_metric[num_thread_types];
+static LatencyHistogram job_queue_time_metric[num_thread_types];
+static LatencyHistogram job_running_time_metric[num_thread_types];
+static bool             job_metrics_registered = false;
+
+static void collect_job_metrics(MetricsWriter *writer) {
+	writer->printGauge("gb_jobs_queued", "Jobs waiting for a thread", NULL, g_jobScheduler.num_queued_jobs());
+}
+
+static void register_job_metrics() {
+	if(job_metrics_registered)
+		return;
+	job_metrics_registered = true;
+	g_metrics.addCollector(collect_job_metrics);
+	for(int i=0; i<num_thread_types; i++) {
+		char labels[64];
+		sprintf(labels,"type=\"%s\"",thread_type_name((thread_type_t)i));
+		g_metrics.addCounter("gb_jobs_total","Jobs finished",labels,&job_count_metric[i]);
+		g_metrics.addHistogram("gb_job_queue_time_us","Time from queueing a job until it starts",labels,&job_queue_time_metric[i]);
+		g_metrics.addHistogram("gb_job_running_time_us","Time a job runs",labels,&job_running_time_metric[i]);
+	}
 }
 
+
 void JobScheduler_impl::cleanup_finished_jobs()
 {
 	ExitSet es;
-	ScopedLock sl(mtx);
+	ScopedLock sl(exit_mtx);
 	es.swap(exit_set);
 	sl.unlock();
 	
@@ -583,6 +735,16 @@ void JobScheduler_impl::cleanup_finished_jobs()
 		s.running_time += e.first.stop_time - e.first.start_time;
 		s.done_time += e.first.finish_time - e.first.stop_time;
 		s.cleanup_time += e.first.exit_time - e.first.finish_time;
+		
+		//jobs that expired in the queue are the clearest sign of overload
+		if((e.second==job_exit_normal || e.second==job_exit_deadline) && QueryAdmission::isQueryJob(e.first.thread_type))
+			g_queryAdmission.addJobQueueTime((e.first.start_time - e.first.queue_enter_time)*1000);
+		
+		if(e.second==job_exit_normal && e.first.thread_type>=0 && e.first.thread_type<num_thread_types) {
+			job_count_metric[e.first.thread_type].add();
+			job_queue_time_metric[e.first.thread_type].add((e.first.start_time - e.first.queue_enter_time)*1000);
+			job_running_time_metric[e.first.thread_type].add((e.first.stop_time - e.first.start_time)*1000);
+		}
 	}
 }
 
@@ -602,27 +764,21 @@ static JobDigest job_entry_to_job_digest(const JobEntry& je, JobDigest::job_stat
 }
 
 
-std::vector<JobDigest> JobScheduler_impl::query_job_digests() const
+std::vector<JobDigest> JobScheduler_impl::query_job_digests()
 {
 	std::vector<JobDigest> v;
-	ScopedLock sl(mtx);
-	//v.reserve(cpu_job_queue.size() + io_job_queue.size() + external_job_queue.size() + file_meta_job_queue.size() + running_set().size() + exit_set().size());
-	for(const auto &je : coordinator_job_queue)
-		v.push_back(job_entry_to_job_digest(je,JobDigest::job_state_queued));
-	for(const auto &je : cpu_job_queue)
-		v.push_back(job_entry_to_job_digest(je,JobDigest::job_state_queued));
-	for(const auto &je : summary_job_queue)
-		v.push_back(job_entry_to_job_digest(je,JobDigest::job_state_queued));
-	for(const auto &je : io_job_queue)
-		v.push_back(job_entry_to_job_digest(je,JobDigest::job_state_queued));
-	for(const auto &je : external_job_queue)
-		v.push_back(job_entry_to_job_digest(je,JobDigest::job_state_queued));
-	for(const auto &je : file_meta_job_queue)
-		v.push_back(job_entry_to_job_digest(je,JobDigest::job_state_queued));
-	for(const auto &je : merge_job_queue)
-		v.push_back(job_entry_to_job_digest(je,JobDigest::job_state_queued));
-	for(const auto &je : running_set)
-		v.push_back(job_entry_to_job_digest(je,JobDigest::job_state_running));
+	auto add_digest = [&v](const JobEntry &je, bool is_running) {
+		v.push_back(job_entry_to_job_digest(je,is_running?JobDigest::job_state_running:JobDigest::job_state_queued));
+		return false;
+	};
+	coordinator_pool.find_job(add_digest);
+	cpu_pool.find_job(add_digest);
+	summary_pool.find_job(add_digest);
+	io_pool.find_job(add_digest);
+	external_pool.find_job(add_digest);
+	file_meta_pool.find_job(add_digest);
+	merge_pool.find_job(add_digest);
+	ScopedLock sl(exit_mtx);
 	for(const auto &je : exit_set)
 		v.push_back(job_entry_to_job_digest(je.first,JobDigest::job_state_stopped));
 	return v;
@@ -663,6 +819,7 @@ bool JobScheduler::initialize(unsigned num_coordinator_threads, unsigned num_cpu
 {
 	assert(!impl);
 	impl = new JobScheduler_impl(num_coordinator_threads,num_cpu_threads,num_summary_threads,num_io_threads,num_external_threads,num_file_meta_threads,num_merge_threads,job_done_notify);
+	register_job_metrics();
 	return true;
 }
 
@@ -792,6 +949,37 @@ std::map<thread_type_t,JobTypeStatistics> JobScheduler::query_job_statistics(boo
 }
 
 
+const char *thread_type_name(thread_type_t tt) {
+	switch(tt) {
+		case thread_type_query_coordinator:  return "query-coordinator";
+		case thread_type_query_read:         return "query-read";
+		case thread_type_query_constrain:    return "query-constrain";
+		case thread_type_query_merge:        return "query-merge";
+		case thread_type_query_intersect:    return "query-intersect";
+		case thread_type_query_summary:      return "query-summary";
+		case thread_type_spider_read:        return "spider-read";
+		case thread_type_spider_write:       return "spider-write";
+		case thread_type_spider_filter:      return "spider-filter";
+		case thread_type_spider_query:       return "spider-query";
+		case thread_type_spider_index:       return "spider-index";
+		case thread_type_merge_filter:       return "merge-filter";
+		case thread_type_replicate_write:    return "replicate-write";
+		case thread_type_replicate_read:     return "replicate-read";
+		case thread_type_file_merge:         return "file-merge";
+		case thread_type_file_meta_data:     return "file-meta-data";
+		case thread_type_index_merge:        return "index-merge";
+		case thread_type_index_generate:     return "index-generate";
+		case thread_type_verify_data:        return "verify-data";
+		case thread_type_statistics:         return "statistics";
+		case thread_type_unspecified_io:     return "unspecified IO";
+		case thread_type_generate_thumbnail: return "generate-thumbnail";
+		case thread_type_config_load:        return "config-load";
+		case thread_type_page_process:       return "page-process";
+		default: return "?";
+	}
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // The global one-and-only scheduler
 
@@ -129,4 +129,6 @@ private:
 
 extern JobScheduler g_jobScheduler;
 
+const char *thread_type_name(thread_type_t tt);
+
 #endif // GB_JOBSCHEDULER_H
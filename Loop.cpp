@@ -3,12 +3,15 @@
 #include "UdpServer.h"
 #include "HttpServer.h" // g_httpServer.m_tcp.m_numQueued
 #include "Profiler.h"
+#include "SamplingProfiler.h"
 #include "Process.h"
 #include "PageParser.h"
 #include "Conf.h"
 #include "ScopedLock.h"
 #include "Mem.h"
 #include "InstanceInfoExchange.h"
+#include "SafeBuf.h"
+#include "Pages.h"
 
 #include "Stats.h"
 #include "GbDns.h"
@@ -58,8 +61,8 @@ class Slot {
 	// this callback should be called every X milliseconds
 	int32_t      m_tick;
 
-	// when we were last called in ms time (only valid for sleep callbacks)
-	int64_t m_lastCall;
+	// when the sleep callback is called next
+	TimerWheel::Timer m_timer;
 
 	const char *m_description;
 
@@ -97,7 +100,23 @@ void Loop::unregisterWriteCallback ( int fd, void *state , void (* callback)(int
 }
 
 void Loop::unregisterSleepCallback ( void *state , void (* callback)(int fd,void *state)){
-	unregisterCallback (m_readSlots,MAX_NUM_FDS,state,callback,true);
+	ScopedLock sl(m_slotMutex);
+
+	auto it = m_sleepSlots.find(std::make_pair((uintptr_t)callback, (uintptr_t)state));
+	if ( it == m_sleepSlots.end() ) {
+		return;
+	}
+
+	Slot *s = it->second;
+	m_sleepSlots.erase(it);
+	m_sleepTimers.remove(&s->m_timer);
+
+	// don't reschedule it if we are in its callback
+	if ( m_callingSleepSlot == s ) {
+		m_callingSleepSlot = NULL;
+	}
+
+	returnSlot(s);
 }
 
 static fd_set s_selectMaskRead;
@@ -114,10 +133,6 @@ void Loop::unregisterCallback(Slot **slots, int fd, void *state, void (* callbac
 		log(LOG_LOGIC, "loop: fd to unregister is negative.");
 		return;
 	}
-	// . keep track of new min tick for sleep callbacks
-	// . sleep a min of 40ms so g_now is somewhat up to date
-	int32_t min     = 40; // 0x7fffffff;
-
 	ScopedLock sl(m_slotMutex);
 	// chase through all callbacks registered with this fd
 	Slot *prevSlot = NULL;
@@ -171,20 +186,10 @@ void Loop::unregisterCallback(Slot **slots, int fd, void *state, void (* callbac
 				m_callbacksNext = next;
 		} else {
 			prevSlot = s;
-			// if we're unregistering a sleep callback
-			// we might have to recalculate m_minTick
-			if(s->m_tick < min)
-				min = s->m_tick;
 		}
 		// advance to the next slot
 		s = next;
 	}
-	// set our new minTick if we were unregistering a sleep callback
-	if ( fd == MAX_NUM_FDS ) {
-		m_minTick = min;
-	}
-
-	return;
 }
 
 bool Loop::registerReadCallback(int fd, void *state, void (*callback)(int fd, void *state),
@@ -210,25 +215,45 @@ bool Loop::registerWriteCallback(int fd, void *state, void (*callback)(int fd, v
 	return false;
 }
 
-// tick is in milliseconds
+// . tick is in milliseconds
+// . the callback is first called after tick ms, or on the next loop
+//   iteration if "immediate"
 bool Loop::registerSleepCallback(int32_t tick, void *state, void (*callback)(int fd, void *state),
                                  const char *description, int32_t niceness, bool immediate) {
-	if (!addSlot(true, MAX_NUM_FDS, state, callback, niceness, description, tick, immediate)) {
+	logDebug(g_conf.m_logDebugLoop, "loop: registering sleep callback '%s' tick=%" PRId32, description, tick);
+
+	ScopedLock sl(m_slotMutex);
+
+	// . prevent dups so you can keep calling register w/o fear
+	auto key = std::make_pair((uintptr_t)callback, (uintptr_t)state);
+	if ( m_sleepSlots.find(key) != m_sleepSlots.end() ) {
+		log(LOG_LOGIC,"loop: sleep callback '%s' is already registered.", description);
+		return true;
+	}
+
+	Slot *s = getEmptySlot ( );
+	if ( ! s ) {
 		log( LOG_WARN, "loop: Unable to register sleep callback" );
 		return false;
 	}
 
-	ScopedLock sl(m_slotMutex);
-	if ( tick < m_minTick ) {
-		m_minTick = tick;
-	}
+	s->m_callback    = callback;
+	s->m_state       = state;
+	s->m_description = description;
+	s->m_next        = NULL;
+	s->m_niceness    = niceness;
+	s->m_tick        = tick;
+
+	TimerWheel::initTimer(&s->m_timer, s);
+	m_sleepTimers.add(&s->m_timer, getMonotonicMilliseconds() + (immediate ? 0 : tick));
+	m_sleepSlots[key] = s;
 
 	return true;
 }
 
 // . returns false and sets g_errno on error
 bool Loop::addSlot(bool forReading, int fd, void *state, void (*callback)(int fd, void *state),
-                   int32_t niceness, const char *description, int32_t tick, bool immediate) {
+                   int32_t niceness, const char *description) {
 	// ensure fd is >= 0
 	if ( fd < 0 ) {
 		g_errno = EBADENGINEER;
@@ -236,7 +261,7 @@ bool Loop::addSlot(bool forReading, int fd, void *state, void (*callback)(int fd
 		return false;
 	}
 	// sanity
-	if ( fd > MAX_NUM_FDS ) {
+	if ( fd >= MAX_NUM_FDS ) {
 		log(LOG_ERROR, "loop: bad fd of %" PRId32,(int32_t)fd);
 		g_process.shutdownAbort(true);
 	}
@@ -313,21 +338,9 @@ bool Loop::addSlot(bool forReading, int fd, void *state, void (*callback)(int fd
 	// save our niceness for doPoll()
 	s->m_niceness  = niceness;
 
-	// store the tick for sleep wrappers (should be max for others)
-	s->m_tick      = tick;
-
-	// the last called time
-	s->m_lastCall = immediate ? 0 : gettimeofdayInMilliseconds();
-
-	// if fd == MAX_NUM_FDS if it's a sleep callback
-	if ( fd == MAX_NUM_FDS ) {
-		return true;
-	}
-
-	// watch out for big bogus fds used for thread exit callbacks
-	if ( fd >  MAX_NUM_FDS ) {
-		return true;
-	}
+	// only used by sleep callbacks
+	s->m_tick      = 0x7fffffff;
+	TimerWheel::initTimer(&s->m_timer, s);
 
 	// set fd non-blocking
 	return setNonBlocking(fd);
@@ -356,7 +369,6 @@ bool Loop::setNonBlocking(int fd) {
 
 // . if "forReading" is true  call callbacks registered for reading on "fd"
 // . if "forReading" is false call callbacks registered for writing on "fd"
-// . if fd is MAX_NUM_FDS and "forReading" is true call all sleepy callbacks
 void Loop::callCallbacks_ass ( bool forReading , int fd , int64_t now , int32_t niceness ) {
 	// save the g_errno to send to all callbacks
 	int saved_errno = g_errno;
@@ -378,28 +390,12 @@ void Loop::callCallbacks_ass ( bool forReading , int fd , int64_t now , int32_t
 			continue;
 		}
 
-		// watch out if clock was set back
-		if ( s->m_lastCall > now ) {
-			s->m_lastCall = now;
-		}
-
-		// if we're a sleep callback, check to make sure not premature
-		if ( fd == MAX_NUM_FDS && s->m_lastCall + s->m_tick > now ) {
-			s = s->m_next;
-			continue;
-		}
-
 		// skip if not a niceness match
 		if ( niceness == 0 && s->m_niceness != 0 ) {
 			s = s->m_next;
 			continue;
 		}
 
-		// update the lastCall timestamp for this slot
-		if ( fd == MAX_NUM_FDS ) {
-			s->m_lastCall = now;
-		}
-
 		// do the callback
 
 		// NOTE: callback can unregister fd for Slot s, so get next
@@ -441,8 +437,119 @@ void Loop::callCallbacks_ass ( bool forReading , int fd , int64_t now , int32_t
 	m_callbacksNext = NULL;
 }
 
+// . call the sleep callbacks that are due and schedule them again tick ms
+//   after the call
+// . a callback may unregister itself or any other sleep callback
+void Loop::callSleepCallbacks() {
+	int saved_errno = g_errno;
+
+	ScopedLock sl(m_slotMutex);
+
+	int64_t now = getMonotonicMilliseconds();
+	m_sleepTimers.advance(now);
+
+	while ( TimerWheel::Timer *t = m_sleepTimers.popDue() ) {
+		Slot *s = (Slot *)t->m_data;
+
+		const char *description = s->m_description;
+		int32_t tick = s->m_tick;
+
+		logDebug(g_conf.m_logDebugLoop, "loop: enter sleep callback '%s' nice=%" PRId32, description, s->m_niceness);
+
+		m_callingSleepSlot = s;
+
+		int64_t start = getMonotonicMilliseconds();
+		int64_t lateness = start - t->m_expires;
+		int64_t took = 0;
+
+		m_slotMutex.unlock();
+		{
+			s->m_callback(MAX_NUM_FDS, s->m_state);
+			took = getMonotonicMilliseconds() - start;
+		}
+		m_slotMutex.lock();
+
+		if (took > g_conf.m_logLoopTimeThreshold) {
+			log(LOG_WARN, "loop: %s took %" PRId64"ms", description, took);
+		}
+
+		logDebug(g_conf.m_logDebugLoop, "loop: exit sleep callback '%s'", description);
+
+		SleepCallbackStats &stats = m_sleepStats[description];
+		stats.m_tick = tick;
+		stats.m_numCalls++;
+		stats.m_totalLateness += lateness;
+		stats.m_maxLateness = std::max(stats.m_maxLateness, lateness);
+		stats.m_totalTook += took;
+		stats.m_maxTook = std::max(stats.m_maxTook, took);
+
+		// still registered. next call is tick ms after this one
+		if ( m_callingSleepSlot == s ) {
+			m_sleepTimers.add(&s->m_timer, std::max(start + tick, now + 1));
+		}
+		m_callingSleepSlot = NULL;
+
+		g_errno = saved_errno;
+	}
+}
+
+void Loop::printSleepCallbacks(SafeBuf *sb) {
+	ScopedLock sl(m_slotMutex);
+
+	int64_t now = getMonotonicMilliseconds();
+
+	sb->safePrintf("<table %s>"
+	               "<tr class=hdrow><td colspan=4><center><b>Registered Sleep Callbacks (%d)</b>"
+	               "</center></td></tr>\n"
+	               "<tr class=poo>"
+	               "<td><b>callback</b></td>"
+	               "<td><b>every (ms)</b></td>"
+	               "<td><b>niceness</b></td>"
+	               "<td><b>due in (ms)</b></td>"
+	               "</tr>\n",
+	               TABLE_STYLE, (int)m_sleepSlots.size());
+	for ( const auto &it : m_sleepSlots ) {
+		const Slot *s = it.second;
+		sb->safePrintf("<tr class=poo><td>%s</td><td>%" PRId32"</td><td>%" PRId32"</td>",
+		               s->m_description, s->m_tick, s->m_niceness);
+		if ( TimerWheel::isScheduled(&s->m_timer) ) {
+			sb->safePrintf("<td>%" PRId64"</td></tr>\n", s->m_timer.m_expires - now);
+		} else {
+			sb->safePrintf("<td>running</td></tr>\n");
+		}
+	}
+	sb->safePrintf("</table><br><br>\n");
+
+	sb->safePrintf("<table %s>"
+	               "<tr class=hdrow><td colspan=7><center><b>Sleep Callback Lateness</b>"
+	               "</center></td></tr>\n"
+	               "<tr class=poo>"
+	               "<td><b>callback</b></td>"
+	               "<td><b>every (ms)</b></td>"
+	               "<td><b>calls</b></td>"
+	               "<td><b>avg late (ms)</b></td>"
+	               "<td><b>max late (ms)</b></td>"
+	               "<td><b>avg took (ms)</b></td>"
+	               "<td><b>max took (ms)</b></td>"
+	               "</tr>\n",
+	               TABLE_STYLE);
+	for ( const auto &it : m_sleepStats ) {
+		const SleepCallbackStats &stats = it.second;
+		sb->safePrintf("<tr class=poo><td>%s</td><td>%" PRId32"</td><td>%" PRId64"</td>"
+		               "<td>%.1f</td><td>%" PRId64"</td><td>%.1f</td><td>%" PRId64"</td></tr>\n",
+		               it.first, stats.m_tick, stats.m_numCalls,
+		               (double)stats.m_totalLateness / stats.m_numCalls, stats.m_maxLateness,
+		               (double)stats.m_totalTook / stats.m_numCalls, stats.m_maxTook);
+	}
+	sb->safePrintf("</table><br><br>\n");
+}
+
 Loop::Loop()
-  : m_callbacksNext(NULL),
+  : m_sleepSlots(),
+    m_sleepTimers(),
+    m_callingSleepSlot(NULL),
+    m_sleepStats(),
+    m_callbacksNext(NULL),
     m_slotMutex(),
     m_lastKeepaliveTimestamp(0)
 {
@@ -459,7 +566,6 @@ Loop::Loop()
 	m_pipeFd[0] = -1;
 	m_pipeFd[1] = -1;
 	m_shutdown = 0;
-	m_minTick = 40;
 	m_head = NULL;
 	m_tail = NULL;
 }
@@ -512,9 +618,6 @@ bool Loop::init ( ) {
 
 	// sighupHandler() will set this to true so we know when to shutdown
 	m_shutdown  = 0;
-	// . reset this cuz we have no sleep callbacks right now
-	// . sleep a min of 40ms so g_now is somewhat up to date
-	m_minTick = 40; //0x7fffffff;
 	// make slots
 	m_slots = (Slot *) mmalloc ( MAX_SLOTS * (int32_t)sizeof(Slot) , "Loop" );
 	if ( ! m_slots ) return false;
@@ -602,7 +705,10 @@ void printStackTrace (bool print_location) {
 static void sigprofHandler(int signo, siginfo_t *info, void *context)
 {
 	//This is called on SIGPROF meaning that profiling is enabled
-	g_profiler.getStackFrame();
+	if(g_samplingProfiler.isRunning())
+		g_samplingProfiler.takeSample(context);
+	else
+		g_profiler.getStackFrame();
 }
 
 // shit, we can't make this realtime!! RdbClose() cannot be called by a
@@ -612,13 +718,7 @@ void sighupHandler ( int x , siginfo_t *info , void *y ) {
 	g_loop.m_shutdown = 1;
 }
 
-// . keep a timestamp for the last time we called the sleep callbacks
-// . we have to call those every 1 second
-static int64_t s_lastTime = 0;
-
 void Loop::runLoop ( ) {
-	s_lastTime = 0;
-
 	m_isDoingLoop = true;
 
 	// . now loop forever waiting for signals
@@ -773,6 +873,9 @@ void Loop::doPoll ( ) {
 		FD_CLR( m_pipeFd[0], &readfds );
 	}
 
+	// udp slots completed by the udp io threads
+	g_udpServer.makePendingCallbacks();
+
 	// now keep this fast, too. just check fds we need to.
 	for ( int32_t i = 0 ; i < s_numReadFds ; i++ ) {
 		if ( n == 0 ) break;
@@ -847,22 +950,9 @@ void Loop::doPoll ( ) {
 
 	cleanupFinishedJobs();
 
-	// call sleepers if they need it
-	// call this every (about) 1 second
-	int32_t elapsed = gettimeofdayInMilliseconds() - s_lastTime;
-	// if someone changed the system clock on us, this could be negative
-	// so fix it! otherwise, times may NEVER get called in our lifetime
-	if ( elapsed < 0 ) {
-		elapsed = m_minTick;
-	}
-
-	if ( elapsed >= m_minTick ) {
-		// MAX_NUM_FDS is the fd for sleep callbacks
-		callCallbacks_ass ( true , MAX_NUM_FDS , gettimeofdayInMilliseconds() );
-		// note the last time we called them
-		s_lastTime = gettimeofdayInMilliseconds();
-		cleanupFinishedJobs();
-	}
+	// call sleepers that are due
+	callSleepCallbacks();
+	cleanupFinishedJobs();
 
 	logDebug( g_conf.m_logDebugLoop, "loop: Exited doPoll.");
 }
@@ -7,7 +7,10 @@
 #define GB_LOOP_H
 
 #include "GbMutex.h"
+#include "TimerWheel.h"
 #include <inttypes.h>
+#include <map>
+#include <utility>
 
 
 int gbsystem(const char *cmd);
@@ -20,6 +23,7 @@ void printStackTrace (bool print_location = false);
 
 
 class Slot;
+class SafeBuf;
 
 
 // linux 2.2 kernel has this limitation
@@ -70,8 +74,8 @@ class Loop {
 	bool registerWriteCallback(int fd, void *state, void (*callback)(int fd, void *state),
 	                           const char *description, int32_t niceness);
 
-	// . register this callback to be called every second
-	// . TODO: implement "seconds" parameter
+	// . register this callback to be called every "milliseconds"
+	// . sleep callbacks are kept in a timer wheel, see callSleepCallbacks()
 	bool registerSleepCallback(int32_t milliseconds, void *state, void (*callback)(int fd, void *state),
 	                           const char *description, int32_t niceness = 1, bool immediate = false);
 
@@ -100,6 +104,11 @@ class Loop {
 
 	// called when sigqueue overflows and we gotta do a select() or poll()
 	void doPoll ( );
+
+	// registered sleep callbacks and how late they were called, for
+	// the timers page
+	void printSleepCallbacks(SafeBuf *sb);
+
  private:
 
 
@@ -107,8 +116,10 @@ class Loop {
 				  void (* callback)(int fd,void *state) ,
 				  bool forReading );
 
+	void callSleepCallbacks();
+
 	bool addSlot(bool forReading, int fd, void *state, void (*callback)(int fd, void *state),
-	             int32_t niceness, const char *description, int32_t tick = 0x7fffffff, bool immediate = false);
+	             int32_t niceness, const char *description);
 
 	// now we use a linked list of pre-allocated slots to avoid a malloc
 	// failure which can cause the merge to dump with "URGENT MERGE FAILED"
@@ -121,13 +132,27 @@ class Loop {
 	//   is waiting on a file to become available for reading/writing
 	// . these fd's are real, not virtual
 	// . m_read/writeFds[i] is NULL if no one is waiting on fd #i
-	// . fd of MAX_NUM_FDS   is used for sleep callbacks
 	// . fd of MAX_NUM_FDS+1 is used for thread exit callbacks
 	Slot *m_readSlots  [MAX_NUM_FDS+2];
 	Slot *m_writeSlots [MAX_NUM_FDS+2];
 
-	// the minimal tick time in milliseconds (ms)
-	int32_t m_minTick;
+	// . sleep callbacks by callback/state, their timers are in
+	//   m_sleepTimers (in getMonotonicMilliseconds() time)
+	// . m_callingSleepSlot is reset if the slot being called is unregistered
+	std::map<std::pair<uintptr_t,uintptr_t>, Slot*> m_sleepSlots;
+	TimerWheel m_sleepTimers;
+	Slot *m_callingSleepSlot;
+
+	// how late the sleep callbacks were called, by description
+	struct SleepCallbackStats {
+		int32_t m_tick;
+		int64_t m_numCalls;
+		int64_t m_totalLateness;
+		int64_t m_maxLateness;
+		int64_t m_totalTook;
+		int64_t m_maxTook;
+	};
+	std::map<const char*, SleepCallbackStats> m_sleepStats;
 
 	// now we pre-allocate our slots to prevent nasty coredumps from merge
 	// because it could not register a sleep callback with us
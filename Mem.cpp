@@ -61,19 +61,31 @@ static int32_t   s_n = 0;
 static bool   s_initialized = 0;
 
 
-//note: the ScopedMemoryLimitBypass is not thread-safe. The "bypass" flag should really
-//be per-thread. Or RdbBase should be reworked to use another technique than artificially
-//raising the memory limit while adding a file.
+//note: the "bypass" flag should really be per-thread. Or RdbBase should be reworked to use
+//another technique than artificially raising the memory limit while adding a file.
+//Bypasses can overlap when collections are loaded in parallel at startup, so the limit is
+//only restored when the last one is released.
+static GbMutex s_memLimitBypassMtx;
+static int s_memLimitBypassCount = 0;
+static int64_t s_memLimitBypassOldMaxMem = 0;
+
 ScopedMemoryLimitBypass::ScopedMemoryLimitBypass()
-  : oldMaxMem(g_conf.m_maxMem)
+  : active(true)
 {
-	g_conf.m_maxMem = INT64_MAX;
+	ScopedLock sl(s_memLimitBypassMtx);
+	if(s_memLimitBypassCount++ == 0) {
+		s_memLimitBypassOldMaxMem = g_conf.m_maxMem;
+		g_conf.m_maxMem = INT64_MAX;
+	}
 }
 
 void ScopedMemoryLimitBypass::release() {
-	if(oldMaxMem>=0) {
-		g_conf.m_maxMem = oldMaxMem;
-		oldMaxMem = -1;
+	if(active) {
+		ScopedLock sl(s_memLimitBypassMtx);
+		if(--s_memLimitBypassCount == 0) {
+			g_conf.m_maxMem = s_memLimitBypassOldMaxMem;
+		}
+		active = false;
 	}
 }
 
@@ -125,7 +125,7 @@ static inline bool relabel(void *ptr, size_t size, const char *note) {
 
 
 class ScopedMemoryLimitBypass {
-	int64_t oldMaxMem;
+	bool active;
 public:
 	ScopedMemoryLimitBypass();
 	~ScopedMemoryLimitBypass() {
@@ -0,0 +1,292 @@
+#include "Metrics.h"
+#include "SafeBuf.h"
+#include "GbFormat.h"
+#include "ScopedLock.h"
+#include "Log.h"
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+
+MetricsRegistry g_metrics;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// LatencyHistogram
+
+LatencyHistogram::LatencyHistogram() {
+	reset();
+}
+
+void LatencyHistogram::reset() {
+	for(int32_t i = 0; i < s_numBuckets; i++)
+		m_buckets[i] = 0;
+	m_count = 0;
+	m_sum = 0;
+	m_max = 0;
+}
+
+// . values below 8 get their own bucket
+// . above that each power of two is split into 8 buckets
+int32_t LatencyHistogram::getBucket(uint64_t us) {
+	if(us < 8)
+		return (int32_t)us;
+	int32_t e = 63 - __builtin_clzll(us);
+	int32_t sub = (int32_t)((us >> (e - 3)) & 7);
+	int32_t bucket = 8 + (e - 3) * 8 + sub;
+	if(bucket >= s_numBuckets)
+		bucket = s_numBuckets - 1;
+	return bucket;
+}
+
+uint64_t LatencyHistogram::getBucketLowerBound(int32_t bucket) {
+	if(bucket < 8)
+		return (uint64_t)bucket;
+	int32_t e = (bucket - 8) / 8 + 3;
+	int32_t sub = (bucket - 8) % 8;
+	return (uint64_t)(8 + sub) << (e - 3);
+}
+
+void LatencyHistogram::add(uint64_t us) {
+	m_buckets[getBucket(us)]++;
+	m_count++;
+	m_sum += us;
+	uint64_t max = m_max;
+	while(us > max && !m_max.compare_exchange_weak(max, us))
+		;
+}
+
+uint64_t LatencyHistogram::getPercentile(double pct) const {
+	uint64_t count = m_count;
+	if(count == 0)
+		return 0;
+	uint64_t want = (uint64_t)(count * pct / 100.0 + 0.5);
+	if(want < 1) want = 1;
+	if(want > count) want = count;
+
+	uint64_t seen = 0;
+	for(int32_t i = 0; i < s_numBuckets; i++) {
+		seen += m_buckets[i];
+		if(seen >= want) {
+			// report the top of the bucket, but never above the max
+			uint64_t upper = i + 1 < s_numBuckets ? getBucketLowerBound(i + 1) - 1 : m_max.load();
+			return std::min(upper, m_max.load());
+		}
+	}
+	return m_max;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// MetricsWriter
+
+MetricsWriter::MetricsWriter(SafeBuf *sb, char format)
+	: m_sb(sb),
+	  m_format(format),
+	  m_lastName(NULL),
+	  m_numPrinted(0) {
+	if(m_format == FORMAT_JSON)
+		m_sb->safePrintf("{\"response\":{\n"
+		                 "\t\"statusCode\":0,\n"
+		                 "\t\"statusMsg\":\"Success\",\n"
+		                 "\t\"metrics\":[\n");
+}
+
+void MetricsWriter::finish() {
+	if(m_format == FORMAT_JSON)
+		m_sb->safePrintf("\n\t]\n}}\n");
+}
+
+// HELP and TYPE once per metric name
+void MetricsWriter::printHeader(const char *name, const char *help, const char *type) {
+	if(m_format == FORMAT_JSON)
+		return;
+	if(m_lastName && strcmp(m_lastName, name) == 0)
+		return;
+	m_lastName = name;
+	if(help)
+		m_sb->safePrintf("# HELP %s %s\n", name, help);
+	m_sb->safePrintf("# TYPE %s %s\n", name, type);
+}
+
+// . prometheus: {labels,extra}
+// . json: "labels":{"k":"v",...}, labels are k="v" pairs so just quote the keys
+void MetricsWriter::printLabels(const char *labels, const char *extra) {
+	bool haveLabels = labels && labels[0];
+	if(m_format != FORMAT_JSON) {
+		if(!haveLabels && !extra)
+			return;
+		m_sb->safePrintf("{%s%s%s}", haveLabels ? labels : "", haveLabels && extra ? "," : "", extra ? extra : "");
+		return;
+	}
+
+	m_sb->safePrintf("\"labels\":{");
+	if(haveLabels) {
+		bool inValue = false;
+		bool keyStart = true;
+		for(const char *p = labels; *p; p++) {
+			if(!inValue && keyStart) {
+				m_sb->pushChar('"');
+				keyStart = false;
+			}
+			if(!inValue && *p == '=') {
+				m_sb->safePrintf("\":");
+				continue;
+			}
+			if(*p == '"' && (p == labels || p[-1] != '\\'))
+				inValue = !inValue;
+			if(!inValue && *p == ',')
+				keyStart = true;
+			m_sb->pushChar(*p);
+		}
+	}
+	m_sb->safePrintf("}");
+}
+
+void MetricsWriter::printJsonStart(const char *name, const char *type, const char *labels) {
+	m_sb->safePrintf("%s\t\t{\"name\":\"%s\", \"type\":\"%s\", ", m_numPrinted ? ",\n" : "", name, type);
+	printLabels(labels, NULL);
+}
+
+void MetricsWriter::printCounter(const char *name, const char *help, const char *labels, uint64_t value) {
+	if(m_format == FORMAT_JSON) {
+		printJsonStart(name, "counter", labels);
+		m_sb->safePrintf(", \"value\":%" PRIu64 "}", value);
+	} else {
+		printHeader(name, help, "counter");
+		m_sb->safePrintf("%s", name);
+		printLabels(labels, NULL);
+		m_sb->safePrintf(" %" PRIu64 "\n", value);
+	}
+	m_numPrinted++;
+}
+
+void MetricsWriter::printGauge(const char *name, const char *help, const char *labels, int64_t value) {
+	if(m_format == FORMAT_JSON) {
+		printJsonStart(name, "gauge", labels);
+		m_sb->safePrintf(", \"value\":%" PRId64 "}", value);
+	} else {
+		printHeader(name, help, "gauge");
+		m_sb->safePrintf("%s", name);
+		printLabels(labels, NULL);
+		m_sb->safePrintf(" %" PRId64 "\n", value);
+	}
+	m_numPrinted++;
+}
+
+void MetricsWriter::printHistogram(const char *name, const char *help, const char *labels, const LatencyHistogram &h) {
+	static const struct {
+		double m_pct;
+		const char *m_quantile;
+		const char *m_jsonName;
+	} s_quantiles[] = {
+		{ 50, "quantile=\"0.5\"",  "p50" },
+		{ 90, "quantile=\"0.9\"",  "p90" },
+		{ 99, "quantile=\"0.99\"", "p99" },
+	};
+
+	if(m_format == FORMAT_JSON) {
+		printJsonStart(name, "summary", labels);
+		m_sb->safePrintf(", \"count\":%" PRIu64 ", \"sum\":%" PRIu64, h.getCount(), h.getSum());
+		for(const auto &q : s_quantiles)
+			m_sb->safePrintf(", \"%s\":%" PRIu64, q.m_jsonName, h.getPercentile(q.m_pct));
+		m_sb->safePrintf(", \"max\":%" PRIu64 "}", h.getMax());
+	} else {
+		printHeader(name, help, "summary");
+		for(const auto &q : s_quantiles) {
+			m_sb->safePrintf("%s", name);
+			printLabels(labels, q.m_quantile);
+			m_sb->safePrintf(" %" PRIu64 "\n", h.getPercentile(q.m_pct));
+		}
+		m_sb->safePrintf("%s_sum", name);
+		printLabels(labels, NULL);
+		m_sb->safePrintf(" %" PRIu64 "\n", h.getSum());
+		m_sb->safePrintf("%s_count", name);
+		printLabels(labels, NULL);
+		m_sb->safePrintf(" %" PRIu64 "\n", h.getCount());
+	}
+	m_numPrinted++;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// MetricsRegistry
+
+MetricsRegistry::MetricsRegistry()
+	: m_numEntries(0) {
+	memset(m_entries, 0, sizeof(m_entries));
+}
+
+bool MetricsRegistry::add(metric_type_t type, const char *name, const char *help, const char *labels,
+                          const void *metric, metrics_collector_t collector) {
+	ScopedLock sl(m_mtxAdd);
+	int32_t n = m_numEntries.load(std::memory_order_relaxed);
+	if(n >= s_maxEntries) {
+		log(LOG_WARN, "metrics: registry full, dropping %s", name ? name : "collector");
+		return false;
+	}
+	Entry &e = m_entries[n];
+	e.m_type = type;
+	e.m_name = name;
+	e.m_help = help;
+	e.m_labels[0] = '\0';
+	if(labels)
+		strncpy(e.m_labels, labels, sizeof(e.m_labels) - 1);
+	e.m_labels[sizeof(e.m_labels) - 1] = '\0';
+	e.m_metric = metric;
+	e.m_collector = collector;
+	// publish it to print()
+	m_numEntries.store(n + 1, std::memory_order_release);
+	return true;
+}
+
+bool MetricsRegistry::addCounter(const char *name, const char *help, const char *labels, const MetricCounter *counter) {
+	return add(metric_counter, name, help, labels, counter, NULL);
+}
+
+bool MetricsRegistry::addGauge(const char *name, const char *help, const char *labels, const MetricGauge *gauge) {
+	return add(metric_gauge, name, help, labels, gauge, NULL);
+}
+
+bool MetricsRegistry::addHistogram(const char *name, const char *help, const char *labels, const LatencyHistogram *histogram) {
+	return add(metric_histogram, name, help, labels, histogram, NULL);
+}
+
+bool MetricsRegistry::addCollector(metrics_collector_t collector) {
+	return add(metric_collector, NULL, NULL, NULL, NULL, collector);
+}
+
+void MetricsRegistry::print(SafeBuf *sb, char format) const {
+	MetricsWriter writer(sb, format);
+	int32_t n = m_numEntries.load(std::memory_order_acquire);
+
+	// . the samples of a name must be together but subsystems register
+	//   several names per label set. collectors go first
+	std::vector<int32_t> order(n);
+	for(int32_t i = 0; i < n; i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [this](int32_t a, int32_t b) {
+		const char *an = m_entries[a].m_name ? m_entries[a].m_name : "";
+		const char *bn = m_entries[b].m_name ? m_entries[b].m_name : "";
+		return strcmp(an, bn) < 0;
+	});
+
+	for(int32_t i : order) {
+		const Entry &e = m_entries[i];
+		switch(e.m_type) {
+			case metric_counter:
+				writer.printCounter(e.m_name, e.m_help, e.m_labels, ((const MetricCounter *)e.m_metric)->get());
+				break;
+			case metric_gauge:
+				writer.printGauge(e.m_name, e.m_help, e.m_labels, ((const MetricGauge *)e.m_metric)->get());
+				break;
+			case metric_histogram:
+				writer.printHistogram(e.m_name, e.m_help, e.m_labels, *(const LatencyHistogram *)e.m_metric);
+				break;
+			case metric_collector:
+				e.m_collector(&writer);
+				break;
+		}
+	}
+	writer.finish();
+}
@@ -0,0 +1,139 @@
+#ifndef GB_METRICS_H
+#define GB_METRICS_H
+
+#include "GbMutex.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <atomic>
+
+class SafeBuf;
+
+
+// . log-linear latency histogram, 8 sub-buckets per power of two so
+//   percentiles are within 12.5%
+// . lock-free, can be added to from any thread
+class LatencyHistogram {
+public:
+	LatencyHistogram();
+
+	void add(uint64_t us);
+	void reset();
+
+	uint64_t getCount() const { return m_count; }
+	uint64_t getSum() const { return m_sum; }
+	uint64_t getMax() const { return m_max; }
+	// upper bound of the bucket holding the pct'th percentile (0-100)
+	uint64_t getPercentile(double pct) const;
+
+	static const int32_t s_numBuckets = 8 + 37 * 8;
+	static int32_t getBucket(uint64_t us);
+	static uint64_t getBucketLowerBound(int32_t bucket);
+
+private:
+	std::atomic<uint64_t> m_buckets[s_numBuckets];
+	std::atomic<uint64_t> m_count;
+	std::atomic<uint64_t> m_sum;
+	std::atomic<uint64_t> m_max;
+};
+
+
+// monotonic count, never reset so scrapers can take rates
+class MetricCounter {
+public:
+	MetricCounter() : m_value(0) {}
+	void add(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+	uint64_t get() const { return m_value.load(std::memory_order_relaxed); }
+private:
+	std::atomic<uint64_t> m_value;
+};
+
+class MetricGauge {
+public:
+	MetricGauge() : m_value(0) {}
+	void set(int64_t v) { m_value.store(v, std::memory_order_relaxed); }
+	void add(int64_t n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+	int64_t get() const { return m_value.load(std::memory_order_relaxed); }
+private:
+	std::atomic<int64_t> m_value;
+};
+
+
+// . prints metrics in the prometheus text format or as json
+// . samples of one metric name must be printed one after another
+class MetricsWriter {
+public:
+	MetricsWriter(SafeBuf *sb, char format);
+
+	// . labels are like: type="query-read",niceness="0" or NULL
+	void printCounter(const char *name, const char *help, const char *labels, uint64_t value);
+	void printGauge(const char *name, const char *help, const char *labels, int64_t value);
+	// a summary with p50/p90/p99, the sum and the count
+	void printHistogram(const char *name, const char *help, const char *labels, const LatencyHistogram &h);
+
+	// close the json
+	void finish();
+
+private:
+	void printHeader(const char *name, const char *help, const char *type);
+	void printJsonStart(const char *name, const char *type, const char *labels);
+	void printLabels(const char *labels, const char *extra);
+
+	SafeBuf *m_sb;
+	char m_format;
+	const char *m_lastName;
+	int32_t m_numPrinted;
+};
+
+// . for values that live in a subsystem and are read when scraped
+typedef void (*metrics_collector_t)(MetricsWriter *writer);
+
+
+// . the metrics subsystems publish into
+// . metrics are registered at startup and must live until exit.
+//   registering takes a lock, printing does not
+class MetricsRegistry {
+public:
+	MetricsRegistry();
+
+	// return false if the registry is full
+	bool addCounter(const char *name, const char *help, const char *labels, const MetricCounter *counter);
+	bool addGauge(const char *name, const char *help, const char *labels, const MetricGauge *gauge);
+	bool addHistogram(const char *name, const char *help, const char *labels, const LatencyHistogram *histogram);
+	bool addCollector(metrics_collector_t collector);
+
+	// format is FORMAT_JSON or anything else for the text format
+	void print(SafeBuf *sb, char format) const;
+
+	int32_t getNumEntries() const { return m_numEntries.load(std::memory_order_acquire); }
+
+	static const int32_t s_maxEntries = 4096;
+
+private:
+	enum metric_type_t {
+		metric_counter,
+		metric_gauge,
+		metric_histogram,
+		metric_collector
+	};
+
+	struct Entry {
+		metric_type_t m_type;
+		const char *m_name;
+		const char *m_help;
+		char m_labels[96];
+		const void *m_metric;
+		metrics_collector_t m_collector;
+	};
+
+	bool add(metric_type_t type, const char *name, const char *help, const char *labels,
+	         const void *metric, metrics_collector_t collector);
+
+	Entry m_entries[s_maxEntries];
+	// entries below this are filled in, set after filling one in
+	std::atomic<int32_t> m_numEntries;
+	GbMutex m_mtxAdd;
+};
+
+extern MetricsRegistry g_metrics;
+
+#endif // GB_METRICS_H
@@ -24,6 +24,9 @@
 #include "Errno.h"
 #include "Log.h"
 #include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 
 
 static const char g_fakeReply[] =
@@ -37,6 +40,7 @@ static void gotIframeExpandedContent(void *state);
 
 static bool addToHammerQueue(Msg13Request *r);
 static void scanHammerQueue(int fd, void *state);
+static void wakeHammerQueue(int32_t firstIp);
 static void downloadTheDocForReals(Msg13Request *r);
 
 static void gotForwardedReplyWrapper ( void *state , UdpSlot *slot ) ;
@@ -467,8 +471,41 @@ static bool addIpToTwitchyTable(CollectionRec *cr, int32_t ip) {
 
 RdbCache s_hammerCache;
 static bool s_flag = false;
-static Msg13Request *s_hammerQueueHead = NULL;
-static Msg13Request *s_hammerQueueTail = NULL;
+
+// . the download requests waiting for their crawl delay, by firstIp
+// . the requests of an ip are linked through Msg13Request::m_nextLink
+struct HammerIpQueue {
+	Msg13Request *m_head;
+	Msg13Request *m_tail;
+	int32_t       m_count;
+	// when the ip should be looked at next, 0 if not scheduled
+	int64_t       m_checkTime;
+};
+
+struct HammerHeapEntry {
+	int64_t m_checkTime;
+	int32_t m_firstIp;
+	bool operator>(const HammerHeapEntry &rhs) const { return m_checkTime > rhs.m_checkTime; }
+};
+
+static std::unordered_map<int32_t,HammerIpQueue> s_hammerIpQueues;
+// . min-heap on m_checkTime so scanHammerQueue() only touches ips that are due
+// . entries whose time no longer matches the ip's m_checkTime are stale
+static std::vector<HammerHeapEntry> s_hammerHeap;
+static int32_t s_numHammerQueued = 0;
+
+// look at an ip at least this often, in case its hammer cache entry
+// expires or is evicted while we wait
+#define HAMMER_MAX_RECHECK_MS 1000
+
+// histograms for the stats page
+static const int64_t s_hammerWaitBuckets[] = { 100, 1000, 5000, 30000, 120000 };
+static const int32_t s_hammerDepthBuckets[] = { 1, 4, 16, 64, 256 };
+#define NUM_HAMMER_BUCKETS ((int32_t)(sizeof(s_hammerWaitBuckets)/sizeof(s_hammerWaitBuckets[0])) + 1)
+static int64_t s_hammerWaitHist[NUM_HAMMER_BUCKETS];
+static int64_t s_hammerDepthHist[NUM_HAMMER_BUCKETS];
+static int64_t s_hammerTotalWaitMS = 0;
+static int64_t s_hammerNumDispatched = 0;
 
 // . only return false if you want slot to be nuked w/o replying
 // . MUST always call g_udpServer::sendReply() or sendErrorReply()
@@ -923,6 +960,12 @@ void downloadTheDocForReals3b ( Msg13Request *r ) {
 	if ( maxDocLen2 < 0 || maxDocLen2 > MAX_ABSDOCLEN )
 		maxDocLen2 = MAX_ABSDOCLEN;
 
+	// . keep the connection open for the next download from this ip,
+	//   unless the crawl delay is longer than we keep idle connections
+	// . HttpServer::getDoc() ignores it for proxies
+	bool keepAlive = g_conf.m_httpKeepAlive &&
+		r->m_crawlDelayMS < g_conf.m_httpKeepAliveIdleTimeout;
+
 	// . download it
 	// . if m_proxyIp is non-zero it will make requests like:
 	//   GET http://xyz.com/abc
@@ -946,7 +989,8 @@ void downloadTheDocForReals3b ( Msg13Request *r ) {
 				     exactRequest , // our own mime!
 				     NULL , // postContent
 				     // this is NULL or '\0' if not there
-				     r->m_proxyUsernamePwdAuth ) ) {
+				     r->m_proxyUsernamePwdAuth ,
+				     keepAlive ) ) {
 		// return false if blocked
 		return;
 	}
@@ -1496,8 +1540,12 @@ void gotHttpReply2 ( void *state ,
 	// . now store the current time in the cache
 	// . do NOT do this for robots.txt etc. where we skip hammer check
 	if ( ! r->m_skipHammerCheck ) {
-		RdbCacheLock rcl(s_hammerCache);
-		s_hammerCache.addLongLong(0,r->m_firstIp,timeToAdd);
+		{
+			RdbCacheLock rcl(s_hammerCache);
+			s_hammerCache.addLongLong(0,r->m_firstIp,timeToAdd);
+		}
+		// requests waiting for this download to finish can go now
+		wakeHammerQueue ( r->m_firstIp );
 	}
 
 	// note it
@@ -2260,6 +2308,60 @@ static void gotIframeExpandedContent(void *state) {
 // ban was detected and no proxies are being used.
 #define AUTOCRAWLDELAY 5000
 
+static int32_t getHammerWaitBucket(int64_t waitedMS) {
+	int32_t i = 0;
+	while ( i < NUM_HAMMER_BUCKETS - 1 && waitedMS >= s_hammerWaitBuckets[i] ) i++;
+	return i;
+}
+
+static int32_t getHammerDepthBucket(int32_t depth) {
+	int32_t i = 0;
+	while ( i < NUM_HAMMER_BUCKETS - 1 && depth > s_hammerDepthBuckets[i] ) i++;
+	return i;
+}
+
+// . make the ip due at checkTime unless it is due earlier already
+static void scheduleHammerIp(int32_t firstIp, HammerIpQueue *q, int64_t checkTime) {
+	if ( q->m_checkTime && q->m_checkTime <= checkTime ) return;
+	q->m_checkTime = checkTime;
+	HammerHeapEntry e;
+	e.m_checkTime = checkTime;
+	e.m_firstIp = firstIp;
+	s_hammerHeap.push_back(e);
+	std::push_heap(s_hammerHeap.begin(), s_hammerHeap.end(), std::greater<HammerHeapEntry>());
+}
+
+// . when queued request "r" can be downloaded, nowms if now
+// . this is what scanHammerQueue() used to check for every queued request
+//   every 10ms
+static int64_t getHammerCheckTime(Msg13Request *r, int64_t nowms) {
+	int64_t last = s_hammerCache.getLongLong(0, r->m_firstIp, 30, true);
+	// is one from this ip outstanding? wakeHammerQueue() is called
+	// when it is done
+	if ( last == 0LL && r->m_crawlDelayFromEnd )
+		return nowms + HAMMER_MAX_RECHECK_MS;
+
+	int32_t crawlDelayMS = r->m_crawlDelayMS;
+
+	// . if we got a proxybackoff base it on # of banned proxies
+	// . try to be more sensitive for more sensitive website policy
+	// . we don't know why this proxy was banned, or if we were
+	//   responsible, or who banned it, but be more sensitive
+	if ( r->m_numBannedProxies &&
+	     r->m_hammerCallback == downloadTheDocForReals3b )
+		crawlDelayMS = r->m_numBannedProxies * DELAYPERBAN;
+
+	// download finished but haven't waited long enough?
+	if ( last > 0 && nowms - last < crawlDelayMS ) {
+		int64_t checkTime = last + crawlDelayMS;
+		if ( checkTime > nowms + HAMMER_MAX_RECHECK_MS )
+			checkTime = nowms + HAMMER_MAX_RECHECK_MS;
+		return checkTime;
+	}
+
+	return nowms;
+}
+
 // returns true if we queue the request to download later
 static bool addToHammerQueue(Msg13Request *r) {
 
@@ -2342,8 +2444,8 @@ static bool addToHammerQueue(Msg13Request *r) {
 	if ( r->m_skipHammerCheck ) queueIt = false;
 
 	// . queue it up if we haven't waited long enough
-	// . then the functionr, scanHammerQueue(), will re-eval all
-	//   the download requests in this hammer queue every 10ms. 
+	// . then scanHammerQueue() will re-eval the download requests of
+	//   this ip when its crawl delay is over or its download is done
 	// . it will just lookup the lastdownload time in the cache,
 	//   which will store maybe a -1 if currently downloading...
 	if ( queueIt ) {
@@ -2361,15 +2463,20 @@ static bool addToHammerQueue(Msg13Request *r) {
 		r->m_crawlDelayMS = crawlDelayMS;
 		// when we stored it in the hammer queue
 		r->m_stored = nowms;
-		// add it to queue
-		if ( ! s_hammerQueueHead ) {
-			s_hammerQueueHead = r;
-			s_hammerQueueTail = r;
+		// add it to the queue of its ip. value-initialized if new.
+		HammerIpQueue *q = &s_hammerIpQueues[r->m_firstIp];
+		if ( ! q->m_head ) {
+			q->m_head = r;
+			q->m_tail = r;
 		}
 		else {
-			s_hammerQueueTail->m_nextLink = r;
-			s_hammerQueueTail = r;
+			q->m_tail->m_nextLink = r;
+			q->m_tail = r;
 		}
+		q->m_count++;
+		s_numHammerQueued++;
+		s_hammerDepthHist[getHammerDepthBucket(q->m_count)]++;
+		scheduleHammerIp ( r->m_firstIp, q, getHammerCheckTime(r, nowms) );
 		return true;
 	}
 			
@@ -2405,95 +2512,86 @@ static bool addToHammerQueue(Msg13Request *r) {
 // we respect crawl delay for sure
 static void scanHammerQueue(int fd, void *state) {
 
-	if ( ! s_hammerQueueHead ) return;
+	if ( s_hammerHeap.empty() ) return;
 
 	int64_t nowms = gettimeofdayInMilliseconds();
 
-	while (Msg13Request *r = s_hammerQueueHead) {
+	// only the ips that are due
+	while ( ! s_hammerHeap.empty() && s_hammerHeap.front().m_checkTime <= nowms ) {
+		HammerHeapEntry e = s_hammerHeap.front();
+		std::pop_heap(s_hammerHeap.begin(), s_hammerHeap.end(), std::greater<HammerHeapEntry>());
+		s_hammerHeap.pop_back();
+
+		auto it = s_hammerIpQueues.find(e.m_firstIp);
+		// stale entry?
+		if ( it == s_hammerIpQueues.end() || it->second.m_checkTime != e.m_checkTime )
+			continue;
+
+		HammerIpQueue *q = &it->second;
+		q->m_checkTime = 0;
+
+		// first request of this ip that can go. they can have
+		// different crawl delays so check all of them.
 		Msg13Request *prev = NULL;
-		int64_t waited = -1LL;
-		Msg13Request *nextLink = NULL;
-		bool rescanHammerQueue = false;
-
-		// scan down the linked list of queued of msg13 requests
-		for (; r; prev = r, r = nextLink) {
-
-			// downloadTheDocForReals() could free "r" so save this here
-			nextLink = r->m_nextLink;
-
-			int64_t last;
-			last = s_hammerCache.getLongLong(0, r->m_firstIp, 30, true);
-			// is one from this ip outstanding?
-			if (last == 0LL && r->m_crawlDelayFromEnd) continue;
-
-
-			int32_t crawlDelayMS = r->m_crawlDelayMS;
-
-			// . if we got a proxybackoff base it on # of banned proxies
-			// . try to be more sensitive for more sensitive website policy
-			// . we don't know why this proxy was banned, or if we were
-			//   responsible, or who banned it, but be more sensitive
-			if ( //useProxies &&
-					r->m_numBannedProxies &&
-					r->m_hammerCallback == downloadTheDocForReals3b)
-				crawlDelayMS = r->m_numBannedProxies * DELAYPERBAN;
-
-			// download finished?
-			if (last > 0) {
-				waited = nowms - last;
-				// but skip if haven't waited long enough
-				if (waited < crawlDelayMS) continue;
-			}
-			// debug
-			//log("spider: downloading %s from crawldelay queue "
-			//    "waited=%" PRId64"ms crawldelay=%" PRId32"ms",
-			//    r->ptr_url,waited,r->m_crawlDelayMS);
-
-			// good to go
-			//downloadTheDocForReals ( r );
-
-			// sanity check
-			if (!r->m_hammerCallback) { gbshutdownLogicError(); }
-
-			// callback can now be either downloadTheDocForReals(r)
-			// or downloadTheDocForReals3b(r) if it is waiting after
-			// getting a ProxyReply that had a m_proxyBackoff set
-
-			if (g_conf.m_logDebugSpider)
-				log(LOG_DEBUG, "spider: calling hammer callback for %s (timestamp=%" PRId64",waited=%" PRId64",crawlDelayMS=%" PRId32")",
-				    r->ptr_url, last, waited, crawlDelayMS);
-
-			//
-			// it should also add the current time to the hammer cache
-			// for r->m_firstIp
-			r->m_hammerCallback(r);
-
-			//
-			// remove from future scans
-			//
-			if (prev)
-				prev->m_nextLink = nextLink;
-
-			if (s_hammerQueueHead == r)
-				s_hammerQueueHead = nextLink;
-
-			if (s_hammerQueueTail == r)
-				s_hammerQueueTail = prev;
-
-			// if "r" was freed by downloadTheDocForReals() then
-			// in the next iteration of this loop, "prev" will point
-			// to a freed memory area, so start from the top again
-			// by breaking out of this inner loop and trying the outer loop again
-			rescanHammerQueue = true;
-			break;
+		Msg13Request *r = q->m_head;
+		int64_t nextCheckTime = 0;
+		for ( ; r ; prev = r, r = r->m_nextLink ) {
+			int64_t checkTime = getHammerCheckTime(r, nowms);
+			if ( checkTime <= nowms ) break;
+			if ( ! nextCheckTime || checkTime < nextCheckTime )
+				nextCheckTime = checkTime;
 		}
 
-		if (!rescanHammerQueue) {
-			break;
+		if ( ! r ) {
+			scheduleHammerIp ( e.m_firstIp, q, nextCheckTime );
+			continue;
 		}
+
+		// remove it before calling the callback, it could free "r"
+		// or add to s_hammerIpQueues
+		if ( prev ) prev->m_nextLink = r->m_nextLink;
+		else        q->m_head = r->m_nextLink;
+		if ( q->m_tail == r ) q->m_tail = prev;
+		r->m_nextLink = NULL;
+		q->m_count--;
+		s_numHammerQueued--;
+
+		// . look at the rest of this ip again right away, the callback
+		//   updates the hammer cache for this ip so the next one
+		//   will normally have to wait
+		if ( q->m_head )
+			scheduleHammerIp ( e.m_firstIp, q, nowms );
+		else
+			s_hammerIpQueues.erase(it);
+
+		int64_t waited = nowms - r->m_stored;
+		s_hammerWaitHist[getHammerWaitBucket(waited)]++;
+		s_hammerTotalWaitMS += waited;
+		s_hammerNumDispatched++;
+
+		// sanity check
+		if (!r->m_hammerCallback) { gbshutdownLogicError(); }
+
+		if (g_conf.m_logDebugSpider)
+			log(LOG_DEBUG, "spider: calling hammer callback for %s (waited=%" PRId64",crawlDelayMS=%" PRId32")",
+			    r->ptr_url, waited, r->m_crawlDelayMS);
+
+		// . callback can now be either downloadTheDocForReals(r)
+		//   or downloadTheDocForReals3b(r) if it is waiting after
+		//   getting a ProxyReply that had a m_proxyBackoff set
+		// . it should also add the current time to the hammer cache
+		//   for r->m_firstIp
+		r->m_hammerCallback(r);
 	}
 }
 
+// the download from this ip finished, look at its queued requests now
+static void wakeHammerQueue(int32_t firstIp) {
+	auto it = s_hammerIpQueues.find(firstIp);
+	if ( it == s_hammerIpQueues.end() ) return;
+	scheduleHammerIp ( firstIp, &it->second, gettimeofdayInMilliseconds() );
+}
+
 bool addNewProxyAuthorization ( SafeBuf *req , Msg13Request *r ) {
 
 	if ( ! r->m_proxyIp   ) return true;
@@ -2713,7 +2811,8 @@ bool printHammerQueueTable ( SafeBuf *sb ) {
 	int64_t nowms = gettimeofdayInMilliseconds();
 
 
-	for(Msg13Request *r = s_hammerQueueHead; r; r = r->m_nextLink) {
+	for(auto it = s_hammerIpQueues.begin(); it != s_hammerIpQueues.end(); ++it)
+	for(Msg13Request *r = it->second.m_head; r; r = r->m_nextLink) {
 		// print row
 		char ipbuf[16];
 		sb->safePrintf( "<tr bgcolor=#%s>"
@@ -2775,6 +2874,39 @@ bool printHammerQueueTable ( SafeBuf *sb ) {
 		sb->safeTruncateEllipsis ( r->ptr_url , 128 );
 		sb->safePrintf("</a></td>");
 		sb->safePrintf("</tr>\n");
+		count++;
 	}
 	return true;
 }
+
+// how long requests waited in the hammer queue and how deep the per-ip
+// queues got, for the stats page
+void printHammerQueueStats ( SafeBuf *sb ) {
+	sb->safePrintf("<table %s>"
+	               "<tr class=hdrow><td colspan=3><center><b>Crawl Delay Queue</b> "
+	               "(%" PRId32" queued, %" PRId32" ips, %" PRId64" dispatched, avg wait %" PRId64"ms)"
+	               "</center></td></tr>\n"
+	               "<tr class=poo>"
+	               "<td><b>range</b></td>"
+	               "<td><b>wait</b></td>"
+	               "<td><b>ip queue depth</b></td>"
+	               "</tr>\n",
+	               TABLE_STYLE,
+	               s_numHammerQueued,
+	               (int32_t)s_hammerIpQueues.size(),
+	               s_hammerNumDispatched,
+	               s_hammerNumDispatched ? s_hammerTotalWaitMS / s_hammerNumDispatched : 0);
+
+	for ( int32_t i = 0 ; i < NUM_HAMMER_BUCKETS ; i++ ) {
+		sb->safePrintf("<tr class=poo><td>");
+		if ( i < NUM_HAMMER_BUCKETS - 1 )
+			sb->safePrintf("&lt;%" PRId64"ms / &lt;=%" PRId32,
+			               s_hammerWaitBuckets[i], s_hammerDepthBuckets[i]);
+		else
+			sb->safePrintf("more");
+		sb->safePrintf("</td><td>%" PRId64"</td><td>%" PRId64"</td></tr>\n",
+		               s_hammerWaitHist[i], s_hammerDepthHist[i]);
+	}
+
+	sb->safePrintf("</table><br><br>\n");
+}
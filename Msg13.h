@@ -20,6 +20,7 @@ class RdbCache;
 
 void resetMsg13Caches ( ) ;
 bool printHammerQueueTable ( SafeBuf *sb ) ;
+void printHammerQueueStats ( SafeBuf *sb ) ;
 
 class Msg13Request {
 public:
@@ -73,7 +74,7 @@ public:
 	int32_t  m_maxOtherDocLen;
 	// in milliseconds. use -1 if none or unknown.
 	int32_t  m_crawlDelayMS;
-	// for linked list, this is the hammer queue
+	// for linked list, this is the hammer queue of m_firstIp
 	class Msg13Request *m_nextLink;
 
 	char m_proxyUsernamePwdAuth[MAXUSERNAMEPWD];
@@ -19,8 +19,9 @@
 struct Msg20State {
 	UdpSlot *m_slot;
 	Msg20Request *m_req;
+	int64_t m_startUS;
 	XmlDoc m_xmldoc;
-	Msg20State(UdpSlot *slot, Msg20Request *req) : m_slot(slot), m_req(req), m_xmldoc() {}
+	Msg20State(UdpSlot *slot, Msg20Request *req, int64_t startUS) : m_slot(slot), m_req(req), m_startUS(startUS), m_xmldoc() {}
 };
 
 
@@ -28,7 +29,7 @@ static void handleRequest20(UdpSlot *slot, int32_t netnice);
 static bool gotReplyWrapperxd(void *state);
 
 
-static bool sendCachedReply ( Msg20Request *req, const void *cached_summary, size_t cached_summary_len, UdpSlot *slot );
+static bool sendCachedReply ( Msg20Request *req, const void *cached_summary, size_t cached_summary_len, UdpSlot *slot, int64_t startUS );
 
 
 Msg20::Msg20 () { 
@@ -359,6 +360,9 @@ static void handleRequest20(UdpSlot *slot, int32_t netnice) {
 		return;
 	}
 
+	// for the query trace
+	int64_t startUS = getMonotonicMicroseconds();
+
 	// parse the request
 	Msg20Request *req = (Msg20Request *)slot->m_readBuf;
 
@@ -386,11 +390,17 @@ static void handleRequest20(UdpSlot *slot, int32_t netnice) {
 	   g_unstable_summary_cache.lookup(cache_key, &cached_summary, &cached_summary_len))
 	{
 		logDebug(g_conf.m_logDebugMsg20, "msg20: Summary cache hit");
-		sendCachedReply(req,cached_summary,cached_summary_len,slot);
+		sendCachedReply(req,cached_summary,cached_summary_len,slot,startUS);
 		return;
 	} else
 		logDebug(g_conf.m_logDebugMsg20, "msg20: Summary cache miss");
 
+	// degraded query, see QueryAdmission
+	if ( req->m_cachedSummaryOnly ) {
+		g_udpServer.sendErrorReply ( slot , EQUERYSHED );
+		return;
+	}
+
 	// if it's not stored locally that's an error
 	if ( req->m_docId >= 0 && ! Titledb::isLocal ( req->m_docId ) ) {
 		log(LOG_WARN, "msg20: Got msg20 request for non-local docId %" PRId64, req->m_docId);
@@ -414,7 +424,7 @@ static void handleRequest20(UdpSlot *slot, int32_t netnice) {
 	// alloc a new state to get the titlerec
 	Msg20State *state;
 	try {
-		state = new Msg20State(slot,req);
+		state = new Msg20State(slot,req,startUS);
 	} catch(std::bad_alloc&) {
 		g_errno = ENOMEM;
 		log("msg20: msg20 new(%" PRId32"): %s", (int32_t)sizeof(XmlDoc),
@@ -467,11 +477,12 @@ bool gotReplyWrapperxd(void *state_) {
 	// and can take a int32_t time.
 	if ( state->m_req->m_niceness == 0 && (state->m_req->m_isDebug || took > 100 || took2 > 100 ) ) {
 		log(LOG_TIMING, "query: Took %" PRId64" ms (total=%" PRId64" ms) to compute summary for d=%" PRId64" "
-		    "u=%s status=%s q=%s",
+		    "u=%s status=%s trace=%016" PRIx64 " q=%s",
 		    took2,
 			took,
 		    state->m_xmldoc.m_docId, state->m_xmldoc.m_firstUrl.getUrl(),
 		    mstrerror(g_errno),
+		    state->m_req->m_traceId,
 		    state->m_req->ptr_qbuf);
 	}
 
@@ -529,6 +540,7 @@ Msg20Reply::Msg20Reply ( ) {
 	m_outlinkInComment = 0;
 	m_isPermalink = 0;
 	m_isDisplaySumSetFromTags = 0;
+	memset(m_stageUS, 0, sizeof(m_stageUS));
 
 	ptr_tbuf = NULL;
 	ptr_htag = NULL;
@@ -615,6 +627,8 @@ bool Msg20Reply::sendReply(Msg20State *state) {
 		return true;
 	}
 
+	m_stageUS[qstage_msg20_summary] = getMonotonicMicroseconds() - state->m_startUS;
+
 	// now create a buffer to store title/summary/url/docLen and send back
 	int32_t  need = getStoredSize();
 	char *buf  = (char *)mmalloc ( need , "Msg20Reply" );
@@ -672,7 +686,7 @@ bool Msg20Reply::sendReply(Msg20State *state) {
 }
 
 
-static bool sendCachedReply ( Msg20Request *req, const void *cached_summary, size_t cached_summary_len, UdpSlot *slot )
+static bool sendCachedReply ( Msg20Request *req, const void *cached_summary, size_t cached_summary_len, UdpSlot *slot, int64_t startUS )
 {
 	//copy the cached summary to a new temporary buffer, so that UDPSlot/Server can free it when possible
 	char *buf  = (char *)mmalloc ( cached_summary_len , "Msg20Reply" );
@@ -682,6 +696,9 @@ static bool sendCachedReply ( Msg20Request *req, const void *cached_summary, siz
 		return true;
 	}
 	memcpy(buf,cached_summary,cached_summary_len);
+	// the cached reply has the time it took to make it originally
+	if ( cached_summary_len >= sizeof(Msg20Reply) )
+		((Msg20Reply *)buf)->m_stageUS[qstage_msg20_summary] = getMonotonicMicroseconds() - startUS;
 	
 	g_udpServer.sendReply(buf, cached_summary_len, buf, cached_summary_len, slot);
 	
@@ -8,6 +8,7 @@
 #include "Multicast.h"
 #include "collnum_t.h"
 #include "WordVariationsConfig.h"
+#include "QueryTrace.h"
 
 
 class Msg20Request {
@@ -50,6 +51,9 @@ class Msg20Request {
 	int32_t m_ourHostHash32;
 	int32_t m_ourDomHash32;
 
+	// QueryTrace id of the query, for matching up log lines
+	int64_t m_traceId;
+
 	// language the query is in (ptr_qbuf)
 	uint8_t    m_langId;
 	uint8_t m_prefferedResultLangId;
@@ -75,6 +79,8 @@ class Msg20Request {
 	// if true, sets ptr_linkText, etc.
 	unsigned char       m_getLinkText               :1;
 	unsigned char       m_allowHighFrequencyTermCache:1;
+	// overloaded, reply with EQUERYSHED instead of generating the summary
+	unsigned char       m_cachedSummaryOnly         :1;
 
 	// pointer+size variable section
 	char      *ptr_qbuf          ;
@@ -173,6 +179,9 @@ public:
 	char       m_isPermalink         ; // set for m_getLinkText (buzz)
 
 	bool m_isDisplaySumSetFromTags;
+
+	// time spent in qstage_msg20_summary, microseconds
+	uint32_t m_stageUS[qstage_end];
 	
 	// pointer+size variable section
 	char       *ptr_tbuf                 ; // title buffer
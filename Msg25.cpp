@@ -1,5 +1,6 @@
 #include "Msg25.h"
 #include "Linkdb.h"
+#include "Anchordb.h"
 #include "UdpSlot.h"
 #include "Serialize.h"
 #include "linkspam.h"
@@ -51,9 +52,14 @@ static int32_t getNumWords(const char *s, int32_t len);
 // 1MB read size for now
 #define READSIZE 1000000
 
+// the anchordb records of a READSIZE linkdb list can be much bigger. the
+// linkers past this just get a Msg20
+#define ANCHORDB_READSIZE 20000000
+
 #define MAX_INTERNAL_INLINKS 10 
 
 static void gotListWrapper(void *state, RdbList *list, Msg5 *msg5);
+static void gotAnchorListWrapper(void *state, RdbList *list, Msg5 *msg5);
 static bool gotLinkTextWrapper(void *state);
 
 
@@ -74,6 +80,8 @@ Msg25::Msg25() {
 	m_round = 0;
 	m_linkHash64 = 0;
 	memset(&m_nextKey, 0, sizeof(m_nextKey));
+	m_anchorRound = -1;
+	memset(&m_readStartKey, 0, sizeof(m_readStartKey));
 	m_onlyNeedGoodInlinks = false;
 	m_docId = 0;
 	m_collnum = 0;
@@ -145,6 +153,9 @@ void Msg25::reset() {
 	m_fullIpTable.reset();
 	m_firstIpTable.reset();
 	m_docIdTable.reset();
+	m_anchorTable.reset();
+	m_anchorList.freeList();
+	m_anchorRound = -1;
 }
 
 
@@ -787,6 +798,9 @@ bool Msg25::doReadLoop() {
 		gbmemcpy (&startKey, &m_nextKey, LDBKS);
 	}
 
+	// the anchordb read covers the same linkers
+	gbmemcpy (&m_readStartKey, &startKey, LDBKS);
+
 	// but new links: algo does not need internal links with no link test
 	// see Links.cpp::hash() for score table
 
@@ -902,6 +916,16 @@ static void gotListWrapper(void *state, RdbList *list, Msg5 *msg5) {
 }
 
 
+static void gotAnchorListWrapper(void *state, RdbList *list, Msg5 *msg5) {
+	Msg25 *THIS = (Msg25 *) state;
+
+	THIS->gotAnchorList();
+
+	// now do what we would have done with the linkdb list
+	gotListWrapper(state, list, msg5);
+}
+
+
 // . this returns false if blocked, true otherwise
 // . sets g_errno on error
 bool Msg25::gotList() {
@@ -919,6 +943,15 @@ bool Msg25::gotList() {
 		return true;
 	}
 
+	// . get the anchordb records of the linkers in this list first
+	// . gotAnchorListWrapper() calls us again if it blocks
+	if (m_anchorRound != m_round) {
+		m_anchorRound = m_round;
+		if (!getAnchorList()) {
+			return false;
+		}
+	}
+
 	// . record the # of hits we got for weighting the score of the
 	//   link text iff it's truncated by MAX_LINKERS
 	// . TODO: if url is really popular, like yahoo, we should use the
@@ -1016,6 +1049,89 @@ bool Msg25::gotList() {
 }
 
 
+// . read the anchordb records for the key range of m_list
+// . returns false if blocked, true otherwise
+// . errors are not fatal, the linkers just get a Msg20 then
+bool Msg25::getAnchorList() {
+	m_anchorTable.reset();
+	m_anchorList.freeList();
+
+	if (!g_conf.m_useAnchordb || m_list.isEmpty()) {
+		return true;
+	}
+
+	key224_t endKey;
+	m_list.getLastKey((char *)&endKey);
+
+	logDebug(g_conf.m_logDebugLinkInfo, "msg25: reading anchordb list url=%s docid=%" PRId64" startkey=%s",
+	         m_url, m_docId, KEYSTR(&m_readStartKey, LDBKS));
+
+	m_gettingList = true;
+
+	if (!m_anchorMsg5.getList(RDB_ANCHORDB,
+	                          m_collnum,
+	                          &m_anchorList,
+	                          (char *)&m_readStartKey,
+	                          (char *)&endKey,
+	                          ANCHORDB_READSIZE,
+	                          !m_req25->m_isInjecting, // includeTree
+	                          0,          // startFileNum
+	                          -1,         // numFiles
+	                          this,
+	                          gotAnchorListWrapper,
+	                          m_niceness,
+	                          true,       // error correct?
+	                          -1,         //maxRetries
+	                          false)) {   //isRealMerge
+		return false;
+	}
+
+	gotAnchorList();
+	return true;
+}
+
+
+void Msg25::gotAnchorList() {
+	m_gettingList = false;
+
+	if (g_errno) {
+		log(LOG_WARN, "build: Had error getting anchordb records for url %s : %s.", m_url, mstrerror(g_errno));
+		g_errno = 0;
+		m_anchorList.freeList();
+		return;
+	}
+
+	if (!m_anchorTable.set(8, sizeof(char *), m_anchorList.getListSize() / 256 + 32, NULL, 0, false, "msg25anch")) {
+		log(LOG_WARN, "build: Could not alloc anchordb table for url %s : %s.", m_url, mstrerror(g_errno));
+		g_errno = 0;
+		return;
+	}
+
+	for (m_anchorList.resetListPtr(); !m_anchorList.isExhausted(); m_anchorList.skipCurrentRecord()) {
+		char *rec = m_anchorList.getCurrentRec();
+		if (KEYNEG(rec)) {
+			continue;
+		}
+
+		// . in site mode a linker has a record for each of its links to
+		//   the site, use the first one
+		int64_t docId = Linkdb::getLinkerDocId_uk((key224_t *)rec);
+		if (m_anchorTable.isInTable(&docId)) {
+			continue;
+		}
+
+		if (!m_anchorTable.addKey(&docId, &rec)) {
+			g_errno = 0;
+			m_anchorTable.reset();
+			return;
+		}
+	}
+
+	logDebug(g_conf.m_logDebugLinkInfo, "msg25: got %" PRId32" anchordb records for url=%s",
+	         m_anchorTable.getNumUsedSlots(), m_url);
+}
+
+
 // . returns false if blocked, true otherwise
 // . sets g_errno on error
 bool Msg25::sendRequests() {
@@ -1323,6 +1439,43 @@ bool Msg25::sendRequests() {
 			continue;
 		}
 
+		// . use the anchordb record if the linker has one
+		// . Msg20 would give us the same reply from the linker's titlerec
+		char **anchorRec = m_anchorTable.isInitialized() ? (char **)m_anchorTable.getValue(&docId) : NULL;
+		if (anchorRec) {
+			const char *rec = *anchorRec;
+			int32_t dataSize = *(const int32_t *)(rec + sizeof(key224_t));
+			const char *data = rec + sizeof(key224_t) + 4;
+			int32_t replySize = 0;
+			Msg20Reply *rep = Anchordb::makeMsg20Reply(data, dataSize, docId, &replySize);
+			if (rep) {
+				// the same as what Msg20 does with the link spam check
+				if (!m_doLinkSpamCheck) {
+					rep->m_isLinkSpam = 0;
+				} else if (rep->m_isLinkSpam) {
+					rep->clearVectors();
+					rep->ptr_surroundingText  = NULL;
+					rep->size_surroundingText = 0;
+				}
+
+				Msg20 *msg20 = &m_msg20s[j];
+				msg20->reset();
+				msg20->m_r            = rep;
+				msg20->m_replySize    = replySize;
+				msg20->m_replyMaxSize = replySize;
+
+				logTrace(g_conf.m_logTraceMsg25, "got link text from anchordb for docId=%" PRId64, docId);
+
+				if (gotLinkText(r)) {
+					return true;
+				}
+				continue;
+			}
+
+			log(LOG_WARN, "linkdb: bad anchordb record for docid %" PRId64" : %s", docId, mstrerror(g_errno));
+			g_errno = 0;
+		}
+
 		logDebug(g_conf.m_logDebugLinkInfo, "msg25: getting single link mode=%s site=%s url=%s docid=%" PRId64" request=%" PRId32,
 		         m_mode == MODE_SITELINKINFO ? "site" : "page", m_site, m_url, docId, m_numRequests - 1);
 
@@ -174,6 +174,8 @@ class Msg25 {
 	// private:
 	// these need to be public for wrappers to call:
 	bool gotList();
+	bool getAnchorList();
+	void gotAnchorList();
 	bool sendRequests();
 	bool gotLinkText(class Msg20Request *req);
 	bool doReadLoop();
@@ -216,6 +218,14 @@ class Msg25 {
 	Msg5 m_msg5;
 	RdbList m_list;
 
+	// . anchordb records of the linkers in m_list, keyed by linker docid
+	// . linkers with a record do not need a Msg20
+	Msg5 m_anchorMsg5;
+	RdbList m_anchorList;
+	HashTableX m_anchorTable;
+	int32_t m_anchorRound;
+	key224_t m_readStartKey;
+
 	Inlink *m_k;
 
 	int32_t      m_maxNumLinkers;
@@ -1,5 +1,6 @@
 #include "Msg3.h"
 #include "Rdb.h"
+#include "Posdb.h"
 #include "Stats.h"     // for timing and graphing merge time
 #include "RdbCache.h"
 #include "Process.h"
@@ -414,6 +415,27 @@ bool Msg3::readList  ( rdbid_t           rdbId,
 		int64_t offset      = map->getAbsoluteOffset ( p1 );
 		int64_t      bytesToRead = map->getRecSizes ( p1, p2, false);
 
+		// . posdb maps know where each termlist is. skip the file if
+		//   it does not have the term and read exactly the termlist,
+		//   not the pages around it, if all of it is wanted
+		const RdbMapTermDictEntry *termDictEntry = NULL;
+		key144_t termStartKey;
+		if ( map->hasTermDict() && Posdb::getTermId(m_fileStartKey) == Posdb::getTermId(m_endKey) ) {
+			int64_t termId = Posdb::getTermId(m_fileStartKey);
+			const RdbMapTermDictEntry *e = map->getTermDictEntry(termId);
+			key144_t termEndKey;
+			Posdb::makeStartKey(&termStartKey, termId);
+			Posdb::makeEndKey(&termEndKey, termId);
+			if ( ! e ) {
+				bytesToRead = 0;
+			} else if ( KEYCMP(m_fileStartKey,(const char*)&termStartKey,m_ks) <= 0 &&
+			            KEYCMP(m_endKey,(const char*)&termEndKey,m_ks) >= 0 ) {
+				termDictEntry = e;
+				offset        = e->m_offset;
+				bytesToRead   = e->m_size;
+			}
+		}
+
 		incrementScansStarted();
 		// . keep stats on our disk accesses
 		// . count disk seeks (assuming no fragmentation)
@@ -434,6 +456,12 @@ bool Msg3::readList  ( rdbid_t           rdbId,
 		map->getKey(p1, startKey2);
 		map->getKey(p2, endKey2);
 
+		// the termlist has no keys outside the requested range
+		if ( termDictEntry ) {
+			KEYSET(startKey2, m_fileStartKey, m_ks);
+			KEYSET(endKey2, m_endKey, m_ks);
+		}
+
 		// store in here
 		m_scan[i].m_startpg = p1;
 		m_scan[i].m_endpg   = p2;
@@ -480,6 +508,17 @@ bool Msg3::readList  ( rdbid_t           rdbId,
 		m_scan[i].m_hintOffset = map->getAbsoluteOffset(h2) - map->getAbsoluteOffset(p1);
 		KEYSET(m_scan[i].m_hintKey, map->getKeyPtr(h2), m_ks);
 
+		// the hint is relative to the termlist now, if it is in it
+		if ( termDictEntry ) {
+			int64_t hintOffset = map->getAbsoluteOffset(h2) - offset;
+			if ( hintOffset < 0 || hintOffset >= bytesToRead ) {
+				m_scan[i].m_hintOffset = 0;
+				KEYSET(m_scan[i].m_hintKey, (const char*)&termStartKey, m_ks);
+			} else {
+				m_scan[i].m_hintOffset = hintOffset;
+			}
+		}
+
 		// reset g_errno before calling setRead()
 		g_errno = 0;
 
@@ -14,6 +14,7 @@
 #include "Mem.h"
 #include "Errno.h"
 #include "GbSignature.h"
+#include "QueryAdmission.h"
 #include <new>
 #include "ScopedLock.h"
 #include <pthread.h>
@@ -157,6 +158,7 @@ void Msg39::reset() {
 	m_query.reset();
 	m_numTotalHits = 0;
 	m_gotClusterRecs = 0;
+	m_gotSimHashes = false;
 	reset2();
 	if(m_clusterBuf) {
 		mfree ( m_clusterBuf, m_clusterBufSize, "Msg39cluster");
@@ -168,11 +170,14 @@ void Msg39::reset() {
 	m_msg39req = NULL;
 	m_startTime = 0;
 	m_startTimeQuery = 0;
+	m_requestStartUS = 0;
+	memset(m_stageUS, 0, sizeof(m_stageUS));
 	m_errno = 0;
 	m_clusterBufSize = 0;
 	m_clusterDocIds = NULL;
 	m_clusterLevels = NULL;
 	m_clusterRecs = NULL;
+	m_clusterSimHashes = NULL;
 	m_numClusterDocIds = 0;
 	m_numVisible = 0;
 	m_debug = false;
@@ -229,7 +234,11 @@ static void sendReply ( UdpSlot *slot , Msg39 *msg39 , char *reply , int32_t rep
 	g_errno = 0;
 	// send an error reply if g_errno is set
 	if ( err ) {
-		log(LOG_ERROR,"%s:%s:%d: call sendErrorReply. error=%s", __FILE__, __func__, __LINE__, mstrerror(err));
+		// shedding is expected under load, QueryAdmission counts them
+		if ( err == EQUERYSHED )
+			logDebug(g_conf.m_logDebugQuery, "query: msg39: [%p] query shed", msg39);
+		else
+			log(LOG_ERROR,"%s:%s:%d: call sendErrorReply. error=%s", __FILE__, __func__, __LINE__, mstrerror(err));
 		g_udpServer.sendErrorReply( slot, err );
 	} else {
 		g_udpServer.sendReply(reply, replyLen, reply, replyMaxSize, slot);
@@ -249,6 +258,8 @@ static void sendReply ( UdpSlot *slot , Msg39 *msg39 , char *reply , int32_t rep
 // . sets g_errno on error
 // . calls gotDocIds to send a reply
 void Msg39::getDocIds ( UdpSlot *slot ) {
+	// time it all for the query trace, including the wait for a thread
+	m_requestStartUS = getMonotonicMicroseconds();
 	// remember the slot
 	m_slot = slot;
 	// reset this
@@ -282,7 +293,23 @@ void Msg39::getDocIds ( UdpSlot *slot ) {
 		return;
 	}
 
-	log(LOG_DEBUG,"query: msg39: processing query_id='%s' query='%.*s', this=%p", m_msg39req->m_queryId, (int)m_msg39req->size_query, m_msg39req->ptr_query, this);
+	log(LOG_DEBUG,"query: msg39: processing query_id='%s' trace=%016" PRIx64 " query='%.*s', this=%p", m_msg39req->m_queryId, m_msg39req->m_traceId, (int)m_msg39req->size_query, m_msg39req->ptr_query, this);
+
+	// . shed the query if this host would not make the deadline anyway
+	// . degraded queries get fewer docids. clustering and scoring info
+	//   must stay as requested, msg3a expects them in the reply
+	switch(g_queryAdmission.admit(qadmit_msg39, m_msg39req->m_timeout, m_msg39req->m_niceness)) {
+		case query_shed:
+			g_errno = EQUERYSHED;
+			sendReply ( m_slot , this , NULL , 0 , 0 , true );
+			return;
+		case query_degrade:
+			if(m_msg39req->m_docsToGet > 20)
+				m_msg39req->m_docsToGet /= 2;
+			break;
+		default:
+			break;
+	}
 	// OK, we have deserialized and checked the msg39request and we can now process
 	// it by shoveling into the jobe queue. that means that the main thread (or whoever
 	// called us) is freed up and can do other stuff.
@@ -415,6 +442,7 @@ void Msg39::controlLoop ( ) {
 	int numDocIdSplits = 1;
 	const int totalChunks = (numFiles+1)*numDocIdSplits;
 	int chunksSearched = 0;
+	int64_t clusterStartUS;
 	
 	if(g_errno) //ugly logic due to C++ prohibited jump over local variable initialization
 		goto hadError;
@@ -462,10 +490,13 @@ void Msg39::controlLoop ( ) {
 				docidRangeStart = MAX_DOCID;
 			int64_t d1 = docidRangeStart;
 
+			int64_t listsStartUS = getMonotonicMicroseconds();
 			if(fileNum!=numFiles)
 				getLists(fileNum,d0,d1);
 			else
 				getLists(-1,d0,d1);
+			int64_t intersectStartUS = getMonotonicMicroseconds();
+			m_stageUS[qstage_msg39_lists] += intersectStartUS - listsStartUS;
 			if ( g_errno ) {
 				log(LOG_ERROR,"Msg39::controlLoop: got error %d after getLists()", g_errno);
 				goto hadError;
@@ -474,6 +505,7 @@ void Msg39::controlLoop ( ) {
 			// Intersect the lists we loaded (using a thread)
 			documentIndexChecker.setFileNum(fileNum);
 			intersectLists(documentIndexChecker);
+			m_stageUS[qstage_msg39_intersect] += getMonotonicMicroseconds() - intersectStartUS;
 			if ( g_errno ) {
 				log(LOG_ERROR,"Msg39::controlLoop: got error %d after intersectLists()", g_errno);
 				goto hadError;
@@ -507,6 +539,7 @@ skipRest:
 	// . this loads them using msg51 from clusterdb
 	// . if m_msg39req->m_doSiteClustering is false it just returns true
 	// . this sets m_gotClusterRecs to true if we get them
+	clusterStartUS = getMonotonicMicroseconds();
 	getClusterRecs();
 	// error setting clusterrecs?
 	if ( g_errno ) {
@@ -519,6 +552,7 @@ skipRest:
 		log(LOG_ERROR,"Msg39::controlLoop: got error after gotClusterRecs()");
 		goto hadError;
 	}
+	m_stageUS[qstage_msg39_cluster] = getMonotonicMicroseconds() - clusterStartUS;
 
 	// . all done! set stats and send back reply
 	// . only sends back the cluster recs if m_gotClusterRecs is true
@@ -840,11 +874,16 @@ void Msg39::intersectListsThreadFunction ( void *state ) {
 // . returns true and sets g_errno on error
 void Msg39::getClusterRecs ( ) {
 
-	if ( ! m_msg39req->m_doSiteClustering )
+	// near-duplicates are dropped by their simhashdb recs if we have them
+	m_gotSimHashes = ( m_msg39req->m_doDupContentRemoval && g_conf.m_useSimhashdb );
+
+	if ( ! m_msg39req->m_doSiteClustering && ! m_gotSimHashes )
 		return; //nothing to do
 
-	// make buf for arrays of the docids, cluster levels and cluster recs
+	// make buf for arrays of the docids, cluster levels, cluster recs
+	// and simhashes
 	int32_t nodeSize  = 8 + 1 + 12;
+	if ( m_gotSimHashes ) nodeSize += 8;
 	int32_t numDocIds = m_toptree.getNumUsedNodes();
 	m_clusterBufSize = numDocIds * nodeSize;
 	m_clusterBuf = (char *)mmalloc(m_clusterBufSize, "Msg39cluster");
@@ -862,6 +901,9 @@ void Msg39::getClusterRecs ( ) {
 	char *p = m_clusterBuf;
 	// docIds
 	m_clusterDocIds = (int64_t *)p; p += numDocIds * 8;
+	if ( m_gotSimHashes ) {
+		m_clusterSimHashes = (uint64_t *)p; p += numDocIds * 8;
+	}
 	m_clusterLevels = (char      *)p; p += numDocIds * 1;
 	m_clusterRecs   = (key96_t     *)p; p += numDocIds * 12;
 	// sanity check
@@ -883,6 +925,8 @@ void Msg39::getClusterRecs ( ) {
 		// assume not found, make the whole thing is 0
 		m_clusterRecs[nd].n1 = 0;
 		m_clusterRecs[nd].n0 = 0LL;
+		if ( m_gotSimHashes )
+			m_clusterSimHashes[nd] = 0;
 	}
 
 	// store number
@@ -904,7 +948,8 @@ void Msg39::getClusterRecs ( ) {
 					&jobState,              //state
 					&JobFinishedCallback,   //callback
 					m_msg39req->m_niceness,
-					m_debug             ) )
+					m_debug,
+					m_gotSimHashes ? m_clusterSimHashes : NULL ) )
 	{
 		jobState.wait_for_finish();
 	}
@@ -916,12 +961,31 @@ bool Msg39::gotClusterRecs() {
 	if(!m_gotClusterRecs)
 		return true; //nothing to do
 
-	if(!setClusterLevels(m_clusterRecs,
+	if(m_msg39req->m_doSiteClustering) {
+		if(!setClusterLevels(m_clusterRecs,
+				     m_clusterDocIds,
+				     m_numClusterDocIds,
+				     2,  // maxdocidsperhostname (todo: configurable)
+				     m_msg39req->m_doSiteClustering,
+				     m_msg39req->m_familyFilter,
+				     m_debug,
+				     m_clusterLevels))
+		{
+			m_errno = g_errno;
+			return false;
+		}
+	} else {
+		// only got them for the simhashes
+		memset(m_clusterLevels, CR_OK, m_numClusterDocIds);
+	}
+
+	// drop near-duplicates of higher scoring results of this shard,
+	// Msg3a does it across shards
+	if(m_gotSimHashes &&
+	   !setNearDupLevels(m_clusterSimHashes,
 			     m_clusterDocIds,
 			     m_numClusterDocIds,
-			     2,  // maxdocidsperhostname (todo: configurable)
-			     m_msg39req->m_doSiteClustering,
-			     m_msg39req->m_familyFilter,
+			     g_conf.m_simhashDupMaxDistance,
 			     m_debug,
 			     m_clusterLevels))
 	{
@@ -943,6 +1007,7 @@ bool Msg39::gotClusterRecs() {
 		// set it
 		t->m_clusterLevel = m_clusterLevels[nd];
 		t->m_clusterRec   = m_clusterRecs  [nd];
+		t->m_simHash      = m_gotSimHashes ? m_clusterSimHashes[nd] : 0;
 		// visible?
 		if(t->m_clusterLevel==CR_OK)
 			m_numVisible++;
@@ -989,6 +1054,10 @@ void Msg39::estimateHitsAndSendReply(double pctSearched) {
 	mr.m_nqt = nqt;
 	// the m_errno if any
 	mr.m_errno = m_errno;
+	// how long the stages took for the query trace
+	memcpy(mr.m_stageUS, m_stageUS, sizeof(mr.m_stageUS));
+	mr.m_stageUS[qstage_msg39_total] = getMonotonicMicroseconds() - m_requestStartUS;
+	g_queryAdmission.addServiceTime(mr.m_stageUS[qstage_msg39_total]);
 	// the score info, in no particular order right now
 	mr.ptr_scoreInfo  = m_posdbTable.m_scoreInfoBuf.getBufStart();
 	mr.size_scoreInfo = m_posdbTable.m_scoreInfoBuf.length();
@@ -1004,6 +1073,7 @@ void Msg39::estimateHitsAndSendReply(double pctSearched) {
 	mr.ptr_scores       = NULL;
 	mr.ptr_flags        = NULL;
 	mr.ptr_clusterRecs  = NULL;
+	mr.ptr_simHashes    = NULL;
 	// this is how much space to reserve
 	mr.size_docIds      = sizeof(int64_t) * numDocIds;
 	mr.size_scores      = sizeof(double) * numDocIds;
@@ -1013,6 +1083,11 @@ void Msg39::estimateHitsAndSendReply(double pctSearched) {
 		mr.size_clusterRecs = sizeof(key96_t) *numDocIds;
 	else
 		mr.size_clusterRecs = 0;
+	// so msg3a can drop near-duplicates across shards
+	if(m_gotClusterRecs && m_gotSimHashes)
+		mr.size_simHashes = sizeof(uint64_t) * numDocIds;
+	else
+		mr.size_simHashes = 0;
 
 	// . that is pretty much it,so serialize it into buffer,"reply"
 	// . mr.ptr_docIds, etc., will point into the buffer so we can
@@ -1023,7 +1098,7 @@ void Msg39::estimateHitsAndSendReply(double pctSearched) {
 	int32_t  replySize;
 	char *reply = serializeMsg(sizeof(Msg39Reply),   // baseSize
 				   &mr.size_docIds,      // firstSizeParm
-				   &mr.size_clusterRecs, // lastSizePrm
+				   &mr.size_simHashes,   // lastSizePrm
 				   &mr.ptr_docIds,       // firstStrPtr
 				   &mr,                  // thisPtr
 				   &replySize,
@@ -1040,6 +1115,7 @@ void Msg39::estimateHitsAndSendReply(double pctSearched) {
 	double *topScores  = (double*) mr.ptr_scores;
 	unsigned *topFlags = (unsigned*)mr.ptr_flags;
 	key96_t *topRecs     = (key96_t*)  mr.ptr_clusterRecs;
+	uint64_t *topSimHashes = (uint64_t*)mr.ptr_simHashes;
 
 	// sanity
 	if(nqt!=m_msg2.getNumLists())
@@ -1067,6 +1143,8 @@ void Msg39::estimateHitsAndSendReply(double pctSearched) {
 		// supply clusterdb rec? only for full splits
 		if(m_gotClusterRecs)
 			topRecs [docCount] = t->m_clusterRec;
+		if(mr.size_simHashes)
+			topSimHashes[docCount] = t->m_simHash;
 		docCount++;
 
 		if(m_debug) {
@@ -14,6 +14,7 @@
 #include "BaseScoringParameters.h"
 #include "WordVariationsConfig.h"
 #include "JobScheduler.h"
+#include "QueryTrace.h"
 
 
 class UdpSlot;
@@ -73,6 +74,9 @@ class Msg39Request {
 
 	char       m_queryId[32];
 
+	// QueryTrace id of the query, for matching up log lines
+	int64_t    m_traceId;
+
 	// do not add new string parms before ptr_readSizes or
 	// after ptr_whiteList so serializeMsg() calls still work
 	char   *ptr_termFreqWeights;
@@ -105,9 +109,11 @@ public:
 	double    m_pctSearched;
 	// error code
 	int32_t   m_errno;
+	// time spent in the qstage_msg39_* stages, microseconds
+	uint32_t  m_stageUS[qstage_end];
 
 	// do not add new string parms before ptr_docIds or
-	// after ptr_clusterRecs so serializeMsg() calls still work
+	// after ptr_simHashes so serializeMsg() calls still work
 	char  *ptr_docIds         ; // the results, int64_t
 	char  *ptr_scores         ; // now doubles! so we can have intScores
 	char  *ptr_flags          ; // from Docid2FlagsAndSiteMap
@@ -115,9 +121,10 @@ public:
 	char  *ptr_pairScoreBuf   ; // transparency info
 	char  *ptr_singleScoreBuf ; // transparency info
 	char  *ptr_clusterRecs    ; // key96_t (might be empty)
+	char  *ptr_simHashes      ; // uint64_t from simhashdb (might be empty)
 	
 	// do not add new string parms before size_docIds or
-	// after size_clusterRecs so serializeMsg() calls still work
+	// after size_simHashes so serializeMsg() calls still work
 	int32_t   size_docIds;
 	int32_t   size_scores;
 	int32_t   size_flags;
@@ -125,6 +132,7 @@ public:
 	int32_t   size_pairScoreBuf  ;
 	int32_t   size_singleScoreBuf;
 	int32_t   size_clusterRecs;
+	int32_t   size_simHashes;
 
 	// variable data comes here
 };
@@ -181,6 +189,9 @@ private:
 	// used for timing
 	int64_t  m_startTime;
 	int64_t  m_startTimeQuery; //when the getDocIds2() was first called
+	// for the query trace, microseconds
+	int64_t  m_requestStartUS; //when the request came in
+	uint32_t m_stageUS[qstage_end];
 
 	// this is set if PosdbTable::addLists() had an error
 	int32_t       m_errno;
@@ -192,10 +203,12 @@ private:
 	int64_t  *m_clusterDocIds;
 	char       *m_clusterLevels;
 	key96_t      *m_clusterRecs;
+	uint64_t   *m_clusterSimHashes;
 	int32_t        m_numClusterDocIds;
 	int32_t        m_numVisible;
 	Msg51       m_msg51;
 	bool        m_gotClusterRecs;
+	bool        m_gotSimHashes;
 
 	void        controlLoop();
 	static void intersectListsThreadFunction(void *state);
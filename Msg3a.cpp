@@ -13,6 +13,8 @@
 #include "ScopedLock.h"
 #include "Errno.h"
 #include "Docid.h"
+#include "Simhashdb.h"
+#include <vector>
 
 
 static const int signature_init = 0xb0a05d5a;
@@ -22,6 +24,7 @@ static void gotReplyWrapper3a(void *state, void *state2);
 Msg3a::Msg3a()
   : m_numRequests(0),
     m_numReplies(0),
+    m_numShedReplies(0),
     m_requestsBeingSubmitted(false)
 {
 	set_signature();
@@ -50,6 +53,8 @@ void Msg3a::constructor ( ) {
 	m_moreDocIdsAvail = false;
 	m_errno = 0;
 	m_startTime = 0;
+	m_trace = NULL;
+	m_fanoutStartUS = 0;
 	m_numReplies = 0;
 	m_skippedShards = 0;
 	m_numTotalEstimatedHits = 0;
@@ -335,12 +340,15 @@ bool Msg3a::getDocIds(const SearchInput *si, Query *q, void *state, void (*callb
 		totalNumShards = 1;
 	}
 
+	m_fanoutStartUS = getMonotonicMicroseconds();
+
 	{
 		ScopedLock sl(m_mtxCounters);
 		if(m_requestsBeingSubmitted) gbshutdownLogicError();
 		m_requestsBeingSubmitted = true;
 		m_numRequests = 0;
 		m_numReplies = 0;
+		m_numShedReplies = 0;
 	}
 
 	// now we run it over ALL hosts that are up!
@@ -485,8 +493,15 @@ void Msg3a::gotReply(Multicast *m) {
 	}
 
 
-	// if one shard times out, ignore it!
-	if ( g_errno == EQUERYTRUNCATED || g_errno == EUDPTIMEDOUT )
+	// count the overloaded shards, if all are we shed the whole query
+	if ( g_errno == EQUERYSHED )
+	{
+		ScopedLock sl(m_mtxCounters);
+		m_numShedReplies++;
+	}
+
+	// if one shard times out or is overloaded, ignore it!
+	if ( g_errno == EQUERYTRUNCATED || g_errno == EUDPTIMEDOUT || g_errno == EQUERYSHED )
 	{
 		g_errno = 0;
 	}
@@ -517,6 +532,12 @@ void Msg3a::gotReply(Multicast *m) {
 	bool done = incrementReplyCount();
 	if(!done)
 		return; //still more to go
+	// . every shard shed the query, do not show an empty result page
+	// . PageResults sends a 503 for this
+	if ( m_numShedReplies == m_numRequests && ! m_errno )
+	{
+		m_errno = EQUERYSHED;
+	}
 	// return if gotAllShardReplies() blocked
 	if ( ! gotAllShardReplies( ) )
 		return;
@@ -529,6 +550,9 @@ void Msg3a::gotReply(Multicast *m) {
 
 bool Msg3a::gotAllShardReplies ( ) {
 
+	if ( m_trace )
+		m_trace->addStageTime ( qstage_msg3a_fanout, getMonotonicMicroseconds() - m_fanoutStartUS );
+
 	// if any of the shard requests had an error, give up and set m_errno
 	// but don't set if for non critical errors like query truncation
 	if ( m_errno ) {
@@ -636,7 +660,7 @@ bool Msg3a::gotAllShardReplies ( ) {
 		// deserialize it (just sets the ptr_ and size_ member vars)
 		int deserializedBytes = deserializeMsg(sizeof(Msg39Reply),
 						       &mr->size_docIds,
-						       &mr->size_clusterRecs,
+						       &mr->size_simHashes,
 						       &mr->ptr_docIds,
 						       ((char*)mr) + sizeof(*mr));
 		if(deserializedBytes != replySize) {
@@ -655,6 +679,13 @@ bool Msg3a::gotAllShardReplies ( ) {
 		m_numTotalEstimatedHits += mr->m_estimatedHits;
 		pctSearchedSum += mr->m_pctSearched;
 
+		// per-shard stage times for the query trace
+		if ( m_trace ) {
+			for ( int32_t s = qstage_msg39_total ; s <= qstage_msg39_cluster ; s++ )
+				QueryTrace::registerStageTime ( (query_stage_t)s, mr->m_stageUS[s] );
+			m_trace->addRemoteStageTimes ( mr->m_stageUS, m->m_replyingHost ? m->m_replyingHost->m_hostId : -1 );
+		}
+
 		// debug log stuff
 		if ( ! m_debug ) continue;
 		// cast these for printing out
@@ -716,6 +747,7 @@ bool Msg3a::mergeLists() {
 	double        *rsPtr [MAX_SHARDS];
 	unsigned    *flagsPtr[MAX_SHARDS];
 	key96_t         *ksPtr [MAX_SHARDS];
+	uint64_t      *shPtr [MAX_SHARDS];
 	int64_t     *diEnd [MAX_SHARDS];
 	for(int32_t j = 0; j < g_hostdb.getNumShards(); j++) {
 		if(Msg39Reply *mr =m_reply[j]) {
@@ -723,6 +755,8 @@ bool Msg3a::mergeLists() {
 			rsPtr[j] = (double*) mr->ptr_scores;
 			flagsPtr[j] = (unsigned*)mr->ptr_flags;
 			ksPtr[j] = (key96_t*)mr->ptr_clusterRecs;
+			// the shard only sends these with dup content removal
+			shPtr[j] = mr->size_simHashes > 0 ? (uint64_t*)mr->ptr_simHashes : NULL;
 			diEnd[j] = (int64_t*)(mr->ptr_docIds + mr->m_numDocIds * 8);
 		} else {
 			// if we have gbdocid:| in query this could be NULL
@@ -731,6 +765,7 @@ bool Msg3a::mergeLists() {
 			rsPtr[j] = NULL;
 			flagsPtr[j] = NULL;
 			ksPtr[j] = NULL;
+			shPtr[j] = NULL;
 		}
 	}
 
@@ -788,6 +823,12 @@ bool Msg3a::mergeLists() {
 	if(m_msg39req.m_doSiteClustering && !htable2.set (nd*2))
 		return true;
 
+	// simhashes of the merged docids so far for dropping near-duplicates
+	// across shards. each shard already dropped its own
+	std::vector<uint64_t> mergedSimHashes;
+	if(m_msg39req.m_doDupContentRemoval)
+		mergedSimHashes.reserve(nd);
+
 	//
 	// ***MERGE ALL SHARDS INTO m_docIds[], etc.***
 	//
@@ -831,6 +872,21 @@ bool Msg3a::mergeLists() {
 			goto doneMerge;
 		}
 
+		// drop it if a higher scoring docid of another shard has
+		// about the same content
+		if(m_msg39req.m_doDupContentRemoval && shPtr[maxj] &&
+		   Simhashdb::isNearDupOfAny(*shPtr[maxj],
+					     mergedSimHashes.data(),
+					     (int32_t)mergedSimHashes.size(),
+					     g_conf.m_simhashDupMaxDistance))
+		{
+			g_stats.m_filterStats[CR_DUP_CONTENT]++;
+			if(m_debug)
+				logf(LOG_DEBUG, "query: msg3a: docId=%012" PRIu64" is a near-duplicate, simhash=%016" PRIx64,
+				     *diPtr[maxj], *shPtr[maxj]);
+			goto skip;
+		}
+
 		// only do this logic if we have clusterdb recs included
 		if(m_msg39req.m_doSiteClustering &&
 		     // if the clusterLevel was set to CR_*errorCode* then this key
@@ -928,6 +984,8 @@ bool Msg3a::mergeLists() {
 			m_flags[m_numDocIds] = *flagsPtr[maxj];
 			if(m_msg39req.m_doSiteClustering)
 				m_clusterRecs[m_numDocIds]= *ksPtr[maxj];
+			if(m_msg39req.m_doDupContentRemoval && shPtr[maxj] && *shPtr[maxj])
+				mergedSimHashes.push_back(*shPtr[maxj]);
 
 			// point to next available slot to add to
 			m_numDocIds++;
@@ -943,6 +1001,8 @@ bool Msg3a::mergeLists() {
 		diPtr[maxj]++;
 		flagsPtr[maxj]++;
 		ksPtr[maxj]++;
+		if(shPtr[maxj])
+			shPtr[maxj]++;
 		// get the next highest docid and add it in
 	} while(m_numDocIds < m_docsToGet);
 
@@ -100,6 +100,11 @@ public:
 	// for timing how long things take
 	int64_t  m_startTime;
 
+	// . query trace of Msg40, NULL if not tracing
+	// . not touched by reset() so set it before calling getDocIds()
+	class QueryTrace *m_trace;
+	int64_t  m_fanoutStartUS;
+
 	// this buffer should be big enough to hold all requests
 	//char       m_request [MAX_MSG39_REQUEST_SIZE * MAX_SHARDS];
 
@@ -150,8 +155,9 @@ private:
 	
 	int32_t m_numRequests;
 	int32_t m_numReplies;
+	int32_t m_numShedReplies; //shards that replied with EQUERYSHED
 	bool m_requestsBeingSubmitted;
-	GbMutex m_mtxCounters; //protects the two counters and flag above
+	GbMutex m_mtxCounters; //protects the counters and flag above
 };
 
 #endif // GB_MSG3A_H
@@ -19,6 +19,7 @@
 #include "Mem.h"
 #include "ScopedLock.h"
 #include "Errno.h"
+#include "QueryAdmission.h"
 #include <new>
 
 
@@ -32,7 +33,11 @@ static bool gotSummaryWrapper            ( void *state );
 static bool isVariantLikeSubDomain(const char *s, int32_t len);
 
 Msg40::Msg40()
-  : m_deadline(0),
+  : m_trace(),
+    m_summariesStartUS(0),
+    m_classificationStartUS(0),
+    m_numTracedSummaries(0),
+    m_deadline(0),
     m_numRealtimeClassificationsStarted(0),
     m_numRealtimeClassificationsCompleted(0),
     m_mtxRealtimeClassificationsCounters(),
@@ -55,6 +60,7 @@ Msg40::Msg40()
 	m_numDisplayed  = 0;
 	m_numPrintedSoFar = 0;
 	m_didSummarySkip = false;
+	m_degraded       = false;
 	m_omitCount      = 0;
 	m_printCount = 0;
 	m_numCollsToSearch = 0;
@@ -124,8 +130,10 @@ bool Msg40::getResults ( SearchInput *si      ,
 			 void        *state   ,
 			 void   (* callback) ( void *state ) ) {
 
-	log(LOG_INFO, "query: Msg40 start: query_id='%s' query='%s'", si->m_queryId, si->m_query);
+	m_trace.start(si->m_query);
+	log(LOG_INFO, "query: Msg40 start: query_id='%s' trace=%016" PRIx64 " query='%s'", si->m_queryId, m_trace.getTraceId(), si->m_query);
 	m_omitCount = 0;
+	m_numTracedSummaries = 0;
 
 	if(g_conf.m_msg40_msg39_timeout>0) {
 		m_deadline = gettimeofdayInMilliseconds() + g_conf.m_msg40_msg39_timeout;
@@ -188,6 +196,23 @@ bool Msg40::getResults ( SearchInput *si      ,
 		log(LOG_DEBUG,"msg40: limiting docs-offset from %d to %d", m_si->m_firstResultNum, g_conf.m_maxFirstResultNum);
 		m_si->m_firstResultNum = g_conf.m_maxFirstResultNum;
 	}
+
+	// . shed the query if this host is too overloaded to make the deadline
+	// . a degraded query skips site clustering and the extra docids for
+	//   deduping and only shows results with a cached summary
+	m_degraded = false;
+	switch(g_queryAdmission.admit(qadmit_msg40, g_conf.m_msg40_msg39_timeout, m_si->m_niceness)) {
+		case query_shed:
+			g_errno = EQUERYSHED;
+			return true;
+		case query_degrade:
+			m_degraded = true;
+			m_si->m_doSiteClustering = false;
+			break;
+		default:
+			break;
+	}
+
 	// how many docids do we need to get?
 	int32_t get = m_si->m_docsWanted + m_si->m_firstResultNum ;
 	// we get one extra for so we can set m_moreToFollow so we know
@@ -206,7 +231,7 @@ bool Msg40::getResults ( SearchInput *si      ,
 
 	// . get a little more since this usually doesn't remove many docIds
 	// . deduping is now done in Msg40.cpp once the summaries are gotten
-	if ( m_si->m_doDupContentRemoval ) get = (get*120LL)/100LL;
+	if ( m_si->m_doDupContentRemoval && ! m_degraded ) get = (get*120LL)/100LL;
 
 	// . ALWAYS get at least this many
 	// . this allows Msg3a to allow higher scoring docids in tier #1 to
@@ -349,6 +374,7 @@ bool Msg40::federatedLoop ( ) {
 	mr.m_minSerpDocId              = m_si->m_minSerpDocId;
 	mr.m_maxSerpScore              = m_si->m_maxSerpScore;
 	memcpy(mr.m_queryId, m_si->m_queryId, sizeof(m_si->m_queryId));
+	mr.m_traceId                   = m_trace.getTraceId();
 
 	if ( mr.m_timeout < m_si->m_minMsg3aTimeout )
 		mr.m_timeout = m_si->m_minMsg3aTimeout;
@@ -425,6 +451,7 @@ bool Msg40::federatedLoop ( ) {
 		}
 		// assign it
 		m_msg3aPtrs[i] = mp;
+		mp->m_trace = &m_trace;
 		// assign the request for it
 		memcpy ( &mp->m_msg39req , &mr , sizeof(Msg39Request) );
 		// then customize it to just search this collnum
@@ -502,6 +529,7 @@ bool Msg40::gotDocIds ( ) {
 
 	// time this
 	m_startTime = gettimeofdayInMilliseconds();
+	m_summariesStartUS = getMonotonicMicroseconds();
 
 	// we haven't got any Msg20 responses as of yet or sent any requests
 	m_numRequests  =  0;
@@ -934,6 +962,7 @@ bool Msg40::launchMsg20s(bool recalled) {
 		req.m_highlightQueryTerms = m_si->m_doQueryHighlighting;
 
 		req.m_isDebug            = (bool)m_si->m_debug;
+		req.m_traceId            = m_trace.getTraceId();
 
 		if ( m_si->m_displayMetas && m_si->m_displayMetas[0] ) {
 			int32_t dlen = strlen(m_si->m_displayMetas);
@@ -958,6 +987,7 @@ bool Msg40::launchMsg20s(bool recalled) {
 		req.m_niceness           = m_si->m_niceness;
 		req.m_showBanned         = m_si->m_showBanned;
 		req.m_includeCachedCopy  = m_si->m_includeCachedCopy;
+		req.m_cachedSummaryOnly  = m_degraded;
 		req.m_getSummaryVector   = true;
 		req.m_titleMaxLen = m_si->m_titleMaxLen;
 		req.m_summaryMaxLen = cr->m_summaryMaxLen;
@@ -1220,6 +1250,20 @@ bool Msg40::gotSummary ( ) {
 bool Msg40::gotSummaries() {
 	int64_t startTime = gettimeofdayInMilliseconds();
 
+	// . summary times for the query trace
+	// . skip the ones we already added if re-called for more docids
+	if ( ! m_si->m_docIdsOnly ) {
+		m_trace.addStageTime ( qstage_msg20_summaries, getMonotonicMicroseconds() - m_summariesStartUS );
+		for ( int32_t i = m_numTracedSummaries ; i < m_numReplies ; i++ ) {
+			if ( ! m_msg20[i] || ! m_msg20[i]->m_r ) continue;
+			const Msg20Reply *mr = m_msg20[i]->m_r;
+			QueryTrace::registerStageTime ( qstage_msg20_summary, mr->m_stageUS[qstage_msg20_summary] );
+			m_trace.addRemoteStageTimes ( mr->m_stageUS, -1 );
+		}
+		if ( m_numReplies > m_numTracedSummaries )
+			m_numTracedSummaries = m_numReplies;
+	}
+
 	// loop over each clusterLevel and set it
 	for ( int32_t i = 0 ; i < m_numReplies ; i++ ) {
 		// did we skip the first X summaries because we were
@@ -1464,6 +1508,8 @@ bool Msg40::submitUrlRealtimeClassification() {
 		return true; //done
 	}
 	
+	m_classificationStartUS = getMonotonicMicroseconds();
+
 	{
 		ScopedLock sl(m_mtxRealtimeClassificationsCounters);
 		m_realtimeClassificationsSubmitted = true;
@@ -1497,6 +1543,8 @@ bool Msg40::submitUrlRealtimeClassification() {
 		m_realtimeClassificationsSubmitted = false;
 		done = (m_numRealtimeClassificationsCompleted == m_numRealtimeClassificationsStarted);
 	}
+	if ( done )
+		m_trace.addStageTime ( qstage_url_classification, getMonotonicMicroseconds() - m_classificationStartUS );
 	
 	return done;
 }
@@ -1516,6 +1564,7 @@ void Msg40::urlClassificationCallback1(int i, uint32_t classification) {
 	}
 	if(incrementRealtimeClassificationsCompleted()) {
 		log(LOG_TRACE,"msg40: all URL classifications completed");
+		m_trace.addStageTime ( qstage_url_classification, getMonotonicMicroseconds() - m_classificationStartUS );
 		if(gotEnoughSummaries()) {
 			log(LOG_INFO, "query: Msg40 end: query_id='%s' query='%s', results=%d", m_si->m_queryId, m_si->m_query, getNumResults());
 			m_callback(m_state);
@@ -1524,6 +1573,20 @@ void Msg40::urlClassificationCallback1(int i, uint32_t classification) {
 }
 
 
+// . should we get more docids because too many results were not visible?
+// . not for a degraded query. summaries not in the cache are errors then,
+//   and getting more docids would only add load to an overloaded host, so
+//   we show a short page instead
+bool Msg40::needMoreDocIds ( int32_t visible ) const {
+	return visible < m_docsToGetVisible && m_msg3a.m_moreDocIdsAvail &&
+	       // do not spin too long in this!
+	       // TODO: fix this better somehow later
+	       m_docsToGet <= 1000 &&
+	       // doesn't work on multi-coll just yet, it cores
+	       m_numCollsToSearch == 1 &&
+	       ! m_degraded;
+}
+
 bool Msg40::gotEnoughSummaries() {
 	m_omitCount = 0;
 
@@ -1566,12 +1629,7 @@ bool Msg40::gotEnoughSummaries() {
 		      m_docsToGet , m_msg3aRecallCnt);
 
 	// if we do not have enough visible, try to get more
-	if ( visible < m_docsToGetVisible && m_msg3a.m_moreDocIdsAvail &&
-	     // do not spin too long in this!
-	     // TODO: fix this better somehow later
-	     m_docsToGet <= 1000 &&
-	     // doesn't work on multi-coll just yet, it cores
-	     m_numCollsToSearch == 1 ) {
+	if ( needMoreDocIds ( visible ) ) {
 		if(m_deadline>0 && m_deadline>gettimeofdayInMilliseconds()) {
 			// can it cover us?
 			int32_t need = m_docsToGet + 20;
@@ -1600,6 +1658,10 @@ bool Msg40::gotEnoughSummaries() {
 		}
 	}
 
+	if ( m_degraded && visible < m_docsToGetVisible )
+		log(LOG_INFO, "query: Msg40 degraded: query_id='%s' query='%s', visible=%d, wanted=%d",
+		    m_si->m_queryId, m_si->m_query, visible, m_docsToGetVisible);
+
 	// get time now
 	int64_t now = gettimeofdayInMilliseconds();
 	// . add the stat for how long to get all the summaries
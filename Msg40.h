@@ -55,6 +55,7 @@ public:
 	bool gotSummary       ( ) ;
 	bool gotSummaries();
 	bool gotEnoughSummaries();
+	bool needMoreDocIds ( int32_t visible ) const;
 	bool reallocMsg20Buf ( ) ;
 
 	// . estimated # of total hits
@@ -138,6 +139,9 @@ public:
 
 	bool m_didSummarySkip;
 
+	// admission control degraded the query, see QueryAdmission
+	bool m_degraded;
+
 	// for timing how long to get all summaries
 	int64_t  m_startTime;
 
@@ -171,7 +175,15 @@ public:
 
 	HashTableT<uint64_t, uint64_t> m_urlTable;
 
+	// per-stage timings of this query, finished by PageResults
+	QueryTrace m_trace;
+
 private:
+	int64_t      m_summariesStartUS;
+	int64_t      m_classificationStartUS;
+	// msg20 replies already added to the query trace
+	int32_t      m_numTracedSummaries;
+
 	int64_t      m_deadline; //deadline for providing a result, even if empty. (not completely enforced yet)
 
 	int32_t      m_numRealtimeClassificationsStarted;
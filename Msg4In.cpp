@@ -11,6 +11,7 @@
 #include "ip.h"
 #include "Mem.h"
 #include "Titledb.h"	// for Titledb::validateSerializedRecord
+#include "Tagdb.h"	// for Msg8a::invalidateCache
 #include "SpiderdbRdbSqliteBridge.h"
 #include "SiteMedianPageTemperatureRegistry.h"
 #include "Errno.h"
@@ -417,6 +418,11 @@ static bool Msg4In::addMetaList(const char *p, UdpSlot *slot) {
 						else
 							goto break_out_of_for;
 					}
+
+					// tagrec lookups from this host should see the new tag
+					if(rdbItem.first == RDB_TAGDB) {
+						Msg8a::invalidateCache(item.m_collNum, (const key128_t *)item.m_rec);
+					}
 				}
 				break;
 			}
@@ -17,6 +17,7 @@
 #include "GbMutex.h"
 #include "ScopedLock.h"
 #include "Titledb.h"	// for Titledb::validateSerializedRecord
+#include "Tagdb.h"	// for Msg8a::invalidateCache
 #include "fctypes.h"
 #include <sys/stat.h> //stat()
 #include <fcntl.h>
@@ -640,6 +641,27 @@ static void returnMulticast(Multicast *mcast) {
 	s_multicastInUseCount--;
 }
 
+// . the tagdb records we sent are in tagdb now, so our next tagrec lookup
+//   of their sites must not use a cached list
+// . the cached list is dropped here and not when the record is queued,
+//   otherwise a lookup before the add is done caches the old list again
+static void invalidateTagdbRecs(const char *request) {
+	const char *p    = request + 4 + 8;
+	const char *pend = request + *(const int32_t *)request;
+	while (p < pend) {
+		collnum_t collnum = *(const collnum_t *)p;
+		p += sizeof(collnum_t);
+		rdbid_t rdbId = static_cast<rdbid_t>(*p);
+		p += 1;
+		int32_t recSize = *(const int32_t *)p;
+		p += 4;
+		if (rdbId == RDB_TAGDB) {
+			Msg8a::invalidateCache(collnum, (const key128_t *)p);
+		}
+		p += recSize;
+	}
+}
+
 // just free the request
 static void gotReplyWrapper4(void *state , void *state2) {
 	int32_t allocSize = (int32_t)(intptr_t)state;
@@ -649,6 +671,7 @@ static void gotReplyWrapper4(void *state , void *state2) {
 	char *request = mcast->m_msg;
 
 	if (request) {
+		invalidateTagdbRecs(request);
 		mfree(request, allocSize, "Msg4");
 	}
 
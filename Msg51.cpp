@@ -4,6 +4,7 @@
 #include "Msg51.h"
 
 #include "Clusterdb.h"
+#include "Simhashdb.h"
 #include "Stats.h"
 #include "HashTableT.h"
 #include "HashTableX.h"
@@ -16,6 +17,7 @@
 #include "Conf.h"
 #include "Errno.h"
 #include "Docid.h"
+#include "Mem.h"
 
 
 // how many Msg0 requests can we launch at the same time?
@@ -44,17 +46,27 @@ const char * const g_crStrings[] = {
 	"blacklisted"            ,
 	"ruleset filtered"       ,
 	"malicious",
+	"near-duplicate content" ,
 	"end -- do not use"      
 };
 
 RdbCache s_clusterdbQuickCache;
 static bool     s_cacheInit = false;
 
+// what we keep in s_clusterdbQuickCache
+struct ClusterQuickCacheRec {
+	key96_t  m_clusterRec;
+	uint64_t m_simHash;
+	// if we looked up m_simHash in simhashdb
+	bool     m_gotSimHash;
+} __attribute__((packed, aligned(4)));
+
 
 Msg51::Msg51() : m_slot(NULL), m_numSlots(0)
 {
 	m_clusterRecs     = NULL;
 	m_clusterLevels   = NULL;
+	m_simHashes       = NULL;
 	pthread_mutex_init(&m_mtx,NULL);
 	set_signature();
 	reset();
@@ -68,6 +80,7 @@ Msg51::~Msg51 ( ) {
 void Msg51::reset ( ) {
 	m_clusterRecs     = NULL;
 	m_clusterLevels   = NULL;
+	m_simHashes       = NULL;
 	m_numSlots = 0;
 	if( m_slot ) {
 		delete[] m_slot;
@@ -100,7 +113,8 @@ bool Msg51::getClusterRecs ( const int64_t     *docIds,
 			     void        (* callback)( void *state ) ,
 			     int32_t           niceness                 ,
 			     // output
-			     bool           isDebug                  )
+			     bool           isDebug                  ,
+			     uint64_t      *simHashes                )
 {
 	verify_signature();
 	// warning
@@ -125,6 +139,7 @@ bool Msg51::getClusterRecs ( const int64_t     *docIds,
 	m_docIds        = docIds;
 	m_clusterLevels = clusterLevels;
 	m_clusterRecs   = clusterRecs;
+	m_simHashes     = simHashes;
 	m_numDocIds     = numDocIds;
 	m_isDebug       = isDebug;
 
@@ -196,34 +211,15 @@ bool Msg51::sendRequests_unlocked(int32_t k) {
 		goto sendLoop;
 	}
 
-	// . check our quick local cache to see if we got it
-	// . use a max age of 1 hour
-	// . this cache is primarly meant to avoid repetetive lookups
-	//   when going to the next tier in Msg3a and re-requesting cluster
-	//   recs for the same docids we did a second ago
-	if(s_cacheInit) {
-		int32_t   crecSize;
-		char     *crecPtr = NULL;
-		key96_t   ckey = (key96_t)m_docIds[m_nexti];
-		
-		RdbCacheLock rcl(s_clusterdbQuickCache);
-		bool found = s_clusterdbQuickCache.getRecord(m_collnum,
-							     ckey      , // cache key
-							     &crecPtr  , // pointer to it
-							     &crecSize,
-							     false     , // do copy?
-							     3600      , // max age in secs
-							     true      , // inc counts?
-							     NULL      );// cachedTime
-		if ( found ) {
-			if ( crecSize != sizeof(key96_t) ) gbshutdownLogicError();
-			m_clusterRecs[m_nexti] = *(key96_t *)crecPtr;
-			// it is no longer CR_UNINIT, we got the rec now
-			m_clusterLevels[m_nexti] = CR_GOT_REC;
-			//logf(LOG_DEBUG,"query: msg51 getRec k.n0=%" PRIu64" rec.n0=%" PRIu64, ckey.n0,m_clusterRecs[m_nexti].n0);
-			m_nexti++;
-			goto sendLoop;
-		}
+	// check our quick local cache to see if we got it
+	if ( getFromQuickCache ( m_collnum, m_docIds[m_nexti],
+				 m_simHashes != NULL,
+				 &m_clusterRecs[m_nexti],
+				 m_simHashes ? &m_simHashes[m_nexti] : NULL ) ) {
+		// it is no longer CR_UNINIT, we got the rec now
+		m_clusterLevels[m_nexti] = CR_GOT_REC;
+		m_nexti++;
+		goto sendLoop;
 	}
 
 	// . do not hog all the udpserver's slots!
@@ -276,8 +272,44 @@ bool Msg51::sendRequest ( int32_t    i ) {
 
 	m_slot[i].m_ci = ci;
 	m_slot[i].m_inUse = true;
+	m_slot[i].m_numPending = 1;
+	m_slot[i].m_clusterErrno = 0;
+	m_slot[i].m_simHashErrno = 0;
 	// count it
 	m_numRequests++;
+
+	// . get the simhashdb rec too, it is on the same shard
+	// . an error just means we have no simhash
+	if ( m_simHashes ) {
+		key96_t shStartKey = Simhashdb::makeFirstKey ( d );
+		key96_t shEndKey   = Simhashdb::makeLastKey  ( d );
+		m_slot[i].m_numPending++;
+		if ( m_slot[i].m_simHashMsg0.getList ( -1 , // hostid
+						      RDB_SIMHASHDB ,
+						      m_collnum ,
+						      &m_slot[i].m_simHashList,
+						      (char *)&shStartKey ,
+						      (char *)&shEndKey ,
+						      SIMHASHDB_REC_SIZE , // minRecSizes
+						      &m_slot[i] ,
+						      gotSimHashWrapper51 ,
+						      m_niceness ,
+						      true , // doErrorCorrection
+						      true , // includeTree
+						      -1 , // firstHostId
+						      0 , // startFileNum
+						      -1 , // numFiles
+						      30000 , // timeout
+						      false , // isRealMerge?
+						      false , // noSplit?
+						      -1 ) ) { // forceParitySplit
+			// did not block
+			m_slot[i].m_simHashErrno = g_errno;
+			g_errno = 0;
+			m_slot[i].m_numPending--;
+		}
+	}
+
 	// lookup in clusterdb, need a start and endkey
 	key96_t startKey = Clusterdb::makeFirstClusterRecKey ( d );
 	key96_t endKey   = Clusterdb::makeLastClusterRecKey  ( d );
@@ -313,17 +345,33 @@ bool Msg51::sendRequest ( int32_t    i ) {
 		//m_msg0[i].m_msg5 = NULL; 
 		return false; 
 	}
+	m_slot[i].m_clusterErrno = g_errno;
+	g_errno = 0;
+	// still waiting for the simhashdb rec?
+	if ( --m_slot[i].m_numPending > 0 ) return false;
 	// otherwise, process the response
 	gotClusterRec ( &m_slot[i] );
 	return true;
 }
 
 void Msg51::gotClusterRecWrapper51(void *state) {
-	Slot *slot = static_cast<Slot*>(state);
+	gotListWrapper51(static_cast<Slot*>(state), false);
+}
+
+void Msg51::gotSimHashWrapper51(void *state) {
+	gotListWrapper51(static_cast<Slot*>(state), true);
+}
+
+void Msg51::gotListWrapper51(Slot *slot, bool isSimHashList) {
 	Msg51 *THIS = slot->m_msg51;
 	verify_signature_at(THIS->signature);
 	{
 		ScopedLock sl(THIS->m_mtx);
+		if ( isSimHashList ) slot->m_simHashErrno = g_errno;
+		else                 slot->m_clusterErrno = g_errno;
+		g_errno = 0;
+		// wait for the other list of this slot
+		if ( --slot->m_numPending > 0 ) return;
 		// process it
 		THIS->gotClusterRec(slot);
 		// get slot number for re-send on this slot
@@ -352,7 +400,13 @@ void Msg51::gotClusterRec(Slot *slot) {
 	// this doubles as a ptr to a cluster rec
 	int32_t    ci = slot->m_ci;
 	int64_t docId = m_docIds[ci];
-	
+
+	// the simhash, if the simhashdb rec is there and not deleted
+	if ( m_simHashes )
+		m_simHashes[ci] = slot->m_simHashErrno ? 0 : getSimHashFromList ( docId, &slot->m_simHashList );
+
+	g_errno = slot->m_clusterErrno;
+
 	// update m_errno if we had an error
 	if ( ! m_errno ) m_errno = g_errno;
 
@@ -399,29 +453,98 @@ void Msg51::gotClusterRec(Slot *slot) {
 	// it is legit, set to CR_OK
 	m_clusterLevels[ci] = CR_OK;
 
+	// . add the record to our quick cache with the simhash
+	// . ignore any error
+	addToQuickCache ( m_collnum, docId, rec,
+			  m_simHashes ? m_simHashes[ci] : 0,
+			  m_simHashes && ! slot->m_simHashErrno );
+
+	// clear it in case the cache set it, we don't care
+	g_errno = 0;
+}
+
+// . the simhash in a simhashdb list of "docId"
+// . 0 if the rec is not there or deleted
+uint64_t Msg51::getSimHashFromList ( int64_t docId, RdbList *list ) {
+	if ( list->getListSize() < (int32_t)SIMHASHDB_REC_SIZE )
+		return 0;
+	const char *shRec = list->getList();
+	if ( Simhashdb::getDocId ( (const key96_t *)shRec ) != docId ||
+	     ! ( shRec[0] & 0x01 ) )
+		return 0;
+	uint64_t simHash;
+	memcpy ( &simHash, shRec + sizeof(key96_t), 8 );
+	return simHash;
+}
+
+// . add the cluster rec of "docId" to s_clusterdbQuickCache
+// . "gotSimHash" is true if "simHash" was looked up in simhashdb, it is
+//   0 then if the docid has none
+void Msg51::addToQuickCache ( collnum_t collnum, int64_t docId, const key96_t *clusterRec,
+			      uint64_t simHash, bool gotSimHash ) {
 	RdbCacheLock rcl(s_clusterdbQuickCache);
 	// . init the quick cache
 	if(!s_cacheInit &&
 		s_clusterdbQuickCache.init(g_conf.m_clusterdbQuickCacheMem,
-					   sizeof(key96_t),  // fixedDataSize (clusterdb rec)
-					   g_conf.m_clusterdbQuickCacheMem/sizeof(key96_t)/2,
+					   sizeof(ClusterQuickCacheRec),  // fixedDataSize
+					   g_conf.m_clusterdbQuickCacheMem/sizeof(ClusterQuickCacheRec)/2,
 					   "clusterdbQuickCache" ,
 					   false,            // load from disk?
 					   sizeof(key96_t),  // cache key size
 					   -1))              // numPtrsMax
 		// only init once if successful
 		s_cacheInit = true;
-	// . add the record to our quick cache as a int64_t
-	// . ignore any error
-	if(s_cacheInit)
-		s_clusterdbQuickCache.addRecord(m_collnum,
-						(key96_t)docId, // docid is key
-						(char *)rec,
-						sizeof(key96_t), // recSize
-						0);
+	if(!s_cacheInit)
+		return;
 
-	// clear it in case the cache set it, we don't care
-	g_errno = 0;
+	ClusterQuickCacheRec crec;
+	crec.m_clusterRec = *clusterRec;
+	crec.m_simHash    = simHash;
+	crec.m_gotSimHash = gotSimHash;
+	s_clusterdbQuickCache.addRecord(collnum,
+					(key96_t)docId, // docid is key
+					(char *)&crec,
+					sizeof(crec), // recSize
+					0);
+}
+
+// . get the cluster rec of "docId" from s_clusterdbQuickCache, and its
+//   simhash if "needSimHash"
+// . use a max age of 1 hour
+// . this cache is primarly meant to avoid repetetive lookups
+//   when going to the next tier in Msg3a and re-requesting cluster
+//   recs for the same docids we did a second ago
+// . returns false if not found, or cached without the simhash and we
+//   need it
+bool Msg51::getFromQuickCache ( collnum_t collnum, int64_t docId, bool needSimHash,
+				key96_t *clusterRec, uint64_t *simHash ) {
+	if(!s_cacheInit)
+		return false;
+
+	int32_t   crecSize;
+	char     *crecPtr = NULL;
+	key96_t   ckey = (key96_t)docId;
+
+	RdbCacheLock rcl(s_clusterdbQuickCache);
+	if ( ! s_clusterdbQuickCache.getRecord(collnum,
+					       ckey      , // cache key
+					       &crecPtr  , // pointer to it
+					       &crecSize,
+					       false     , // do copy?
+					       3600      , // max age in secs
+					       true      , // inc counts?
+					       NULL      ))// cachedTime
+		return false;
+	if ( crecSize != sizeof(ClusterQuickCacheRec) ) gbshutdownLogicError();
+	const ClusterQuickCacheRec *crec = (const ClusterQuickCacheRec *)crecPtr;
+	// need to look up the simhash if it was cached without
+	if ( needSimHash && ! crec->m_gotSimHash )
+		return false;
+
+	*clusterRec = crec->m_clusterRec;
+	if ( needSimHash )
+		*simHash = crec->m_simHash;
+	return true;
 }
 
 // . cluster the docids based on the clusterRecs
@@ -526,3 +649,39 @@ bool setClusterLevels ( const key96_t   *clusterRecs,
 	// we are all done
 	return true;
 }
+
+// . set the cluster level of visible results whose content is a
+//   near-duplicate of a higher scoring visible result to CR_DUP_CONTENT
+// . the results must be in score order, highest first
+// . results without a simhash (0) stay visible
+bool setNearDupLevels ( const uint64_t *simHashes,
+			const int64_t *docIds,
+			int32_t       numRecs,
+			int32_t       maxDistance,
+			bool          isDebug,
+			char         *clusterLevels ) {
+
+	if ( numRecs <= 0 || maxDistance < 0 ) return true;
+
+	// simhashes of the visible results so far
+	uint64_t *visible = (uint64_t *)mmalloc ( numRecs * sizeof(uint64_t), "neardup" );
+	if ( ! visible ) return false;
+	int32_t numVisible = 0;
+
+	for ( int32_t i = 0 ; i < numRecs ; i++ ) {
+		if ( clusterLevels[i] != CR_OK ) continue;
+		if ( ! simHashes[i] ) continue;
+		if ( Simhashdb::isNearDupOfAny ( simHashes[i], visible, numVisible, maxDistance ) ) {
+			clusterLevels[i] = CR_DUP_CONTENT;
+			g_stats.m_filterStats[CR_DUP_CONTENT]++;
+			if ( isDebug )
+				logf(LOG_DEBUG,"query: msg51: hit #%2d) docid=%" PRId64" simhash=%016" PRIx64" is a near-duplicate",
+				     (int32_t)i, docIds[i], simHashes[i]);
+			continue;
+		}
+		visible[numVisible++] = simHashes[i];
+	}
+
+	mfree ( visible, numRecs * sizeof(uint64_t), "neardup" );
+	return true;
+}
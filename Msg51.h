@@ -60,6 +60,8 @@ enum {
 	CR_RULESET_FILTERED ,
 	// URL (or site) classified as malicious (spyware, trojan, phishing, ...)
 	CR_MALICIOUS,
+	// content is a near-duplicate of a higher scoring result (simhashdb)
+	CR_DUP_CONTENT,
 	// verify this is LAST entry cuz we use i<CR_END for ending for-loops
 	CR_END
 };
@@ -77,6 +79,17 @@ bool setClusterLevels ( const key96_t   *clusterRecs,
 			// output to clusterLevels[]
 			char      *clusterLevels        );
 
+// . mark visible results that are near-duplicates of a higher scoring
+//   visible result as CR_DUP_CONTENT, using their simhashdb simhashes
+// . returns false and sets g_errno on error
+bool setNearDupLevels ( const uint64_t *simHashes,
+			const int64_t *docIds,
+			int32_t       numRecs,
+			int32_t       maxDistance,
+			bool          isDebug,
+			// input/output
+			char         *clusterLevels );
+
 class Msg51 {
 
  public:
@@ -97,7 +110,10 @@ class Msg51 {
 			      void        (* callback)( void *state ) ,
 			      int32_t           niceness                 ,
 			      // output to clusterRecs[]
-			      bool           isDebug                  ) ;
+			      bool           isDebug                  ,
+			      // . also get the simhashdb recs if not NULL,
+			      //   0 if the docid has none
+			      uint64_t      *simHashes = NULL         ) ;
 
 	// see Clusterdb.h for this bitmap. we store the lower 64 bits of
 	// the clusterdb key into the "clusterRecs" array
@@ -111,6 +127,17 @@ class Msg51 {
 
         key96_t getClusterRec ( int32_t i ) const { return m_clusterRecs[i]; }
 
+	// . the simhash of "docId" in its simhashdb list, 0 if none
+	static uint64_t getSimHashFromList ( int64_t docId, RdbList *list );
+
+	// . s_clusterdbQuickCache with the simhash of each cluster rec
+	// . gotSimHash is false if simhashdb was not looked up, then a lookup
+	//   that needs the simhash misses
+	static void addToQuickCache ( collnum_t collnum, int64_t docId, const key96_t *clusterRec,
+				      uint64_t simHash, bool gotSimHash );
+	static bool getFromQuickCache ( collnum_t collnum, int64_t docId, bool needSimHash,
+					key96_t *clusterRec, uint64_t *simHash );
+
 private:
 	bool sendRequests   ( int32_t k );
 	bool sendRequests_unlocked(int32_t k);
@@ -125,6 +152,7 @@ private:
 	// the lower 64 bits of each cluster rec
 	key96_t      *m_clusterRecs;
 	char       *m_clusterLevels;
+	uint64_t   *m_simHashes;
 
 	void     (*m_callback ) ( void *state );
 	void      *m_state;
@@ -148,13 +176,21 @@ private:
 		Msg51     *m_msg51; //points to self
 		Msg0       m_msg0;
 		RdbList    m_list;
+		Msg0       m_simHashMsg0;
+		RdbList    m_simHashList;
 		bool       m_inUse;
 		int32_t    m_ci;
+		// outstanding msg0s, and their errors
+		int32_t    m_numPending;
+		int32_t    m_clusterErrno;
+		int32_t    m_simHashErrno;
 	};
 	Slot *m_slot;
 	int32_t m_numSlots;
 
 	static void gotClusterRecWrapper51(void *state);
+	static void gotSimHashWrapper51(void *state);
+	static void gotListWrapper51(Slot *slot, bool isSimHashList);
 	void gotClusterRec(Slot *slot);
 };
 
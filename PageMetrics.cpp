@@ -0,0 +1,192 @@
+#include "TcpServer.h"
+#include "Pages.h"
+#include "HttpServer.h"
+#include "HttpRequest.h"
+#include "SafeBuf.h"
+#include "GbFormat.h"
+#include "Metrics.h"
+#include "QueryTrace.h"
+#include "QueryAdmission.h"
+#include "Stats.h"
+#include "Mem.h"
+#include "Process.h"
+#include "Rdb.h"
+#include "RdbCache.h"
+#include "Msg3.h"
+#include "Msg13.h"
+#include "Msg51.h"
+#include "Dns.h"
+#include "SpiderLoop.h"
+#include <time.h>
+#include <algorithm>
+
+// . machine readable counterpart of PageStats/PagePerf/PageThreads
+// . the subsystems publish their counters into g_metrics, the values
+//   that already live in them are read by the collectors below
+
+
+static void collectProcessMetrics(MetricsWriter *w) {
+	w->printGauge("gb_uptime_seconds", "Seconds since start", NULL, time(NULL) - g_stats.m_uptimeStart);
+	w->printGauge("gb_mem_used_bytes", "Memory allocated through Mem", NULL, g_mem.getUsedMem());
+	w->printGauge("gb_mem_max_bytes", "Memory limit", NULL, g_mem.getMaxMem());
+	w->printGauge("gb_mem_allocations", "Outstanding allocations", NULL, g_mem.getNumAllocated());
+}
+
+static void collectRdbMetrics(MetricsWriter *w) {
+	static const struct {
+		const char *m_name;
+		const char *m_help;
+	} s_gauges[] = {
+		{ "gb_rdb_files",        "Data files" },
+		{ "gb_rdb_records",      "Records in files and tree, from the maps" },
+		{ "gb_rdb_mem_used_bytes",  "Tree or buckets memory used" },
+		{ "gb_rdb_mem_avail_bytes", "Tree or buckets memory available" },
+		{ "gb_rdb_map_mem_bytes",   "Memory of the rdb maps" },
+	};
+
+	// one name at a time so the samples of a name are together
+	for(int32_t g = 0; g < (int32_t)(sizeof(s_gauges) / sizeof(s_gauges[0])); g++) {
+		for(int32_t i = 0; i < g_process.m_numRdbs; i++) {
+			Rdb *rdb = g_process.m_rdbs[i];
+			if(!rdb || !rdb->isInitialized())
+				continue;
+			char labels[64];
+			snprintf(labels, sizeof(labels), "rdb=\"%s\"", rdb->getDbname());
+			int64_t value = 0;
+			switch(g) {
+				case 0: value = rdb->getNumFiles(); break;
+				case 1: value = rdb->getNumTotalRecs(true); break;
+				case 2: value = rdb->getUsedMem(); break;
+				case 3: value = rdb->getAvailMem(); break;
+				case 4: value = rdb->getMapMemAllocated(); break;
+			}
+			w->printGauge(s_gauges[g].m_name, s_gauges[g].m_help, labels, value);
+		}
+	}
+}
+
+static int32_t getCaches(const RdbCache **caches, int32_t maxCaches) {
+	int32_t n = 0;
+	for(const RdbCache *c : {(const RdbCache *)Msg13::getHttpCacheRobots(), (const RdbCache *)Msg13::getHttpCacheOthers(),
+	                         (const RdbCache *)g_dns.getCache(), (const RdbCache *)g_dns.getCacheLocal(),
+	                         (const RdbCache *)&s_clusterdbQuickCache}) {
+		if(c && n < maxCaches)
+			caches[n++] = c;
+	}
+	// the disk page caches
+	for(int32_t i = 0; i < g_process.m_numRdbs && n < maxCaches; i++) {
+		Rdb *rdb = g_process.m_rdbs[i];
+		if(!rdb || !rdb->isInitialized())
+			continue;
+		const RdbCache *c = getDiskPageCache(rdb->getRdbId());
+		if(c && std::find(caches, caches + n, c) == caches + n)
+			caches[n++] = c;
+	}
+	return n;
+}
+
+static void collectCacheMetrics(MetricsWriter *w) {
+	const RdbCache *caches[64];
+	int32_t n = getCaches(caches, 64);
+
+	char labels[64];
+#define CACHE_METRIC(PRINT, NAME, HELP, VALUE) \
+	for(int32_t i = 0; i < n; i++) { \
+		const RdbCache *c = caches[i]; \
+		snprintf(labels, sizeof(labels), "cache=\"%s\"", c->getDbname()); \
+		w->PRINT(NAME, HELP, labels, VALUE); \
+	}
+	CACHE_METRIC(printCounter, "gb_cache_hits_total", "Cache lookups found", c->getNumHits())
+	CACHE_METRIC(printCounter, "gb_cache_misses_total", "Cache lookups not found", c->getNumMisses())
+	CACHE_METRIC(printCounter, "gb_cache_adds_total", "Records added to the cache", c->getNumAdds())
+	CACHE_METRIC(printCounter, "gb_cache_deletes_total", "Records removed from the cache", c->getNumDeletes())
+	CACHE_METRIC(printGauge, "gb_cache_mem_used_bytes", "Cache memory used", c->getMemOccupied())
+	CACHE_METRIC(printGauge, "gb_cache_mem_max_bytes", "Cache memory limit", c->getMaxMem())
+	CACHE_METRIC(printGauge, "gb_cache_records", "Records in the cache", c->getNumUsedNodes())
+#undef CACHE_METRIC
+
+	auto const wl = g_spiderLoop.m_winnerListCache.query_statistics();
+	w->printCounter("gb_winnerlist_cache_hits_total", "Spider winner list cache lookups found", NULL, wl.lookup_hits);
+	w->printCounter("gb_winnerlist_cache_misses_total", "Spider winner list cache lookups not found", NULL, wl.lookup_misses);
+	w->printGauge("gb_winnerlist_cache_mem_used_bytes", "Spider winner list cache memory used", NULL, wl.memory_used);
+}
+
+// . the udp dgram counters of g_stats, msg types with traffic only
+static void collectUdpMetrics(MetricsWriter *w) {
+	static const struct {
+		const char *m_name;
+		const char *m_help;
+		const std::atomic<int32_t> (*m_counts)[2];
+	} s_counters[] = {
+		{ "gb_udp_dgrams_in_total",   "Datagrams read",                   g_stats.m_packetsIn },
+		{ "gb_udp_dgrams_out_total",  "Datagrams sent",                   g_stats.m_packetsOut },
+		{ "gb_udp_dropped_total",     "Datagrams dropped",                g_stats.m_dropped },
+		{ "gb_udp_errors_total",      "Requests that got an error reply", g_stats.m_errors },
+		{ "gb_udp_timeouts_total",    "Requests that timed out",          g_stats.m_timeouts },
+	};
+
+	char labels[64];
+	for(const auto &c : s_counters) {
+		for(int32_t t = 0; t < MAX_MSG_TYPES; t++) {
+			for(int32_t niceness = 0; niceness < 2; niceness++) {
+				if(c.m_counts[t][niceness] == 0)
+					continue;
+				snprintf(labels, sizeof(labels), "msgtype=\"0x%02" PRIx32 "\",niceness=\"%" PRId32 "\"", t, niceness);
+				w->printCounter(c.m_name, c.m_help, labels, (uint32_t)c.m_counts[t][niceness].load());
+			}
+		}
+	}
+}
+
+static void collectQueryAdmissionMetrics(MetricsWriter *w) {
+	w->printGauge("gb_query_predicted_ms", "Predicted time of a new query, for admission control", NULL,
+	              g_queryAdmission.getPredictedMS());
+}
+
+static void registerMetrics() {
+	static bool s_registered = false;
+	if(s_registered)
+		return;
+	s_registered = true;
+
+	g_metrics.addCollector(collectProcessMetrics);
+	g_metrics.addCollector(collectRdbMetrics);
+	g_metrics.addCollector(collectCacheMetrics);
+	g_metrics.addCollector(collectUdpMetrics);
+	g_metrics.addCollector(collectQueryAdmissionMetrics);
+
+	for(int32_t p = 0; p < qadmit_end; p++) {
+		for(int32_t d = 0; d < query_admission_end; d++) {
+			char labels[64];
+			snprintf(labels, sizeof(labels), "point=\"%s\",decision=\"%s\"",
+			         QueryAdmission::getPointName((query_admission_point_t)p),
+			         QueryAdmission::getDecisionName((query_admission_t)d));
+			g_metrics.addCounter("gb_query_admission_total", "Queries admitted, degraded or shed",
+			                     labels, g_queryAdmission.getCounter((query_admission_point_t)p, (query_admission_t)d));
+		}
+	}
+
+	for(int32_t i = 0; i < qstage_end; i++) {
+		char labels[64];
+		snprintf(labels, sizeof(labels), "stage=\"%s\"", getQueryStageName((query_stage_t)i));
+		g_metrics.addHistogram("gb_query_stage_time_us", "Query time by stage, see /admin/perf",
+		                       labels, QueryTrace::getHistogram((query_stage_t)i));
+	}
+}
+
+// . /admin/metrics, prometheus text format or format=json
+// . nothing in here resets a counter so it can be scraped often
+bool sendPageMetrics(TcpSocket *s, HttpRequest *r) {
+	registerMetrics();
+
+	char format = r->getReplyFormat();
+	if(format != FORMAT_JSON)
+		format = FORMAT_TXT;
+
+	SafeBuf sb;
+	g_metrics.print(&sb, format);
+
+	return g_httpServer.sendDynamicPage(s, sb.getBufStart(), sb.length(), -1, false,
+	                                    format == FORMAT_JSON ? "application/json" : "text/plain",
+	                                    -1, NULL, "utf8");
+}
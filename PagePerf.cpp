@@ -4,6 +4,9 @@
 #include "HttpServer.h"
 #include "HttpRequest.h"
 #include "Errno.h"
+#include "QueryTrace.h"
+#include "QueryAdmission.h"
+#include "GbFormat.h"
 #include <ctype.h>
 
 // . returns false if blocked, true otherwise
@@ -15,6 +18,21 @@ bool sendPagePerf ( TcpSocket *s , HttpRequest *r ) {
 	StackBuf<64*1024> p;
 	p.setLabel ( "perfgrph" );
 
+	if ( r->getLong("resettrace", 0) )
+		QueryTrace::resetStats();
+
+	// query stage histograms and slowest queries for monitoring
+	char format = r->getReplyFormat();
+	if ( format == FORMAT_JSON ) {
+		p.safePrintf("{\"response\":{\n"
+			     "\t\"statusCode\":0,\n"
+			     "\t\"statusMsg\":\"Success\",\n");
+		g_queryAdmission.printStats ( &p , FORMAT_JSON );
+		QueryTrace::printStats ( &p , FORMAT_JSON );
+		p.safePrintf("}\n}\n");
+		return g_httpServer.sendDynamicPage ( s, p.getBufStart(), p.length(), -1, false, "application/json" );
+	}
+
 	// print standard header
 	g_pages.printAdminTop ( &p , s , r );
 
@@ -162,6 +180,14 @@ bool sendPagePerf ( TcpSocket *s , HttpRequest *r ) {
 		       , TABLE_STYLE
 		       );
 
+	// per-stage query latencies, summed up over the cluster by the
+	// hosts that got the queries
+	p.safePrintf("<br>");
+	g_queryAdmission.printStats ( &p , FORMAT_HTML );
+	QueryTrace::printStats ( &p , FORMAT_HTML );
+	p.safePrintf("<br><a href=\"/admin/perf?resettrace=1\">reset query stages</a>"
+		     " &nbsp; <a href=\"/admin/perf?format=json\">json</a><br>\n");
+
 	if(autoRefresh > 0) p.safePrintf("</body>"); 
 
 	// print the final tail
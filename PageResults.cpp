@@ -119,6 +119,7 @@ static bool sendReply(State0 *st, const char *reply, int32_t rlen) {
 	logf(LOG_DEBUG,"gb: sending back %" PRId32" bytes",rlen);
 
 	Statistics::register_query_time(si->m_q.m_numWords, si->m_queryLangId, savedErr, (gettimeofdayInMilliseconds() - st->m_startTime));
+	st->m_msg40.m_trace.finish(savedErr);
 
 	// . log the time
 	// . do not do this if g_errno is set lest m_sbuf1 be bogus b/c
@@ -180,6 +181,8 @@ static bool sendReply(State0 *st, const char *reply, int32_t rlen) {
 	    savedErr == ENOPERM ||
 	    savedErr == ENOCOLLREC) 
 		status = 400;
+	if (savedErr == EQUERYSHED)
+		status = 503;
 
 	if ( sock )
 	g_httpServer.sendQueryErrorReply(sock,
@@ -93,8 +93,13 @@ static bool printList       ( State11 *st );
 
 static bool loadLoop ( State11 *st ) {
 	for(;;) {
+		// the doled urls may be in the in-memory frontier instead
+		SpiderColl *sc = g_spiderCache.getSpiderCollIffNonNull(st->m_collnum);
+		if ( sc && sc->useFrontier() ) {
+			sc->getFrontier()->getList(st->m_startKey, st->m_endKey, st->m_minRecSizes, &st->m_list);
+		}
 		// let's get the local list for THIS machine (use msg5)
-		if(! st->m_msg5.getList(RDB_DOLEDB,
+		else if(! st->m_msg5.getList(RDB_DOLEDB,
 					st->m_collnum,
 					&st->m_list,
 					&st->m_startKey,
@@ -309,14 +314,23 @@ static bool generatePageHTML(CollectionRec *cr, SafeBuf *sb, const SafeBuf *dole
 
 	int32_t ns = sc->getDoledbIpTableCount();
 
+	// dole throughput of whichever path is in use
+	int64_t doleElapsedMS = getMonotonicMilliseconds() - g_spiderLoop.m_doleStatsStartMS;
+	double doledPerSec = doleElapsedMS > 0 ? g_spiderLoop.m_numUrlsDoled * 1000.0 / doleElapsedMS : 0.0;
+	int64_t avgReadUS = g_spiderLoop.m_numDoleReads > 0 ? g_spiderLoop.m_doleReadTimeUS / g_spiderLoop.m_numDoleReads : 0;
+
 	// begin the table
 	sb->safePrintf ( "<table class=\"main\" width=100%%>\n"
 	                "<tr class=\"level1\"><th colspan=50>"
 	                "URLs Ready to Spider for collection "
 	                "<font color=red>%s</font>"
-	                " <span class=\"comment\">(%" PRId32" ips in doleiptable)</span>",
+	                " <span class=\"comment\">(%" PRId32" ips in doleiptable, "
+	                "%s, %.2f urls doled/sec, %" PRId64"us avg list read)</span>",
 	                cr->m_coll ,
-	                ns );
+	                ns ,
+	                sc->useFrontier() ? "frontier" : "doledb" ,
+	                doledPerSec ,
+	                avgReadUS );
 
 	// print time format: 7/23/1971 10:45:32
 	time_t nowUTC = getTime();
@@ -548,6 +562,11 @@ static bool generatePageJSON(CollectionRec *cr, SafeBuf *sb, const SafeBuf *dole
 	/////
 
 	sb->safePrintf("\t\"doleIPCount\": %d,\n", sc->getDoledbIpTableCount());
+	sb->safePrintf("\t\"doleSource\": \"%s\",\n", sc->useFrontier() ? "frontier" : "doledb");
+	sb->safePrintf("\t\"doleListReads\": %" PRId64",\n", g_spiderLoop.m_numDoleReads);
+	sb->safePrintf("\t\"doleListReadTimeUS\": %" PRId64",\n", g_spiderLoop.m_doleReadTimeUS);
+	sb->safePrintf("\t\"urlsDoled\": %" PRId64",\n", g_spiderLoop.m_numUrlsDoled);
+	sb->safePrintf("\t\"doleStatsTimeMS\": %" PRId64",\n", getMonotonicMilliseconds() - g_spiderLoop.m_doleStatsStartMS);
 
 	sb->safePrintf("\t\"doleIPs\": [\n");
 
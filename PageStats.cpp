@@ -5,6 +5,8 @@
 #include "Tagdb.h"
 #include "Clusterdb.h"
 #include "Linkdb.h"
+#include "Anchordb.h"
+#include "Simhashdb.h"
 #include "Posdb.h"
 #include "Dns.h"
 #include "TcpServer.h"
@@ -22,6 +24,9 @@
 #include "Msg3.h"
 #include "Mem.h"
 #include "Errno.h"
+#include "StartupGraph.h"
+#include "DocConverterPool.h"
+#include "RdbMerge.h"
 #include <cmath>
 #include <unistd.h>
 
@@ -624,6 +629,30 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 			       "\t},\n"
 			       ,nowStr,(int32_t)nowg);
 
+	// how long each component took to load at startup
+	if ( format == FORMAT_HTML )
+		printStartupTimeline ( &p );
+
+	// conversion latency of the gbconvert.sh workers
+	if ( format == FORMAT_HTML )
+		g_docConverterPool.printStats ( &p );
+
+	// connection re-use of spider downloads
+	if ( format == FORMAT_HTML )
+		g_httpServer.printKeepAliveStats ( &p );
+
+	// hit ratio of the local tagdb list cache
+	if ( format == FORMAT_HTML )
+		Msg8a::printCacheStats ( &p );
+
+	// crawl delay wait and per-ip queue depth of Msg13
+	if ( format == FORMAT_HTML )
+		printHammerQueueStats ( &p );
+
+	// progress and throughput of the merge running on this host
+	if ( format == FORMAT_HTML )
+		g_merge.printStatus ( &p );
+
 
 	//
 	// print network stats
@@ -1089,16 +1118,16 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 					     i3, // niceness
 					     (unsigned char)i1, // msgType
 					     //i2, // request?
-					     g_stats.m_packetsIn [i1][i3],
-					     g_stats.m_packetsOut[i1][i3],
-					     g_stats.m_acksIn [i1][i3],
-					     g_stats.m_acksOut[i1][i3],
-					     g_stats.m_reroutes[i1][i3],
-					     g_stats.m_dropped[i1][i3],
-					     g_stats.m_cancelRead[i1][i3],
-					     g_stats.m_errors[i1][i3],
-					     g_stats.m_timeouts[i1][i3],
-					     g_stats.m_nomem[i1][i3]
+					     g_stats.m_packetsIn [i1][i3].load(),
+					     g_stats.m_packetsOut[i1][i3].load(),
+					     g_stats.m_acksIn [i1][i3].load(),
+					     g_stats.m_acksOut[i1][i3].load(),
+					     g_stats.m_reroutes[i1][i3].load(),
+					     g_stats.m_dropped[i1][i3].load(),
+					     g_stats.m_cancelRead[i1][i3].load(),
+					     g_stats.m_errors[i1][i3].load(),
+					     g_stats.m_timeouts[i1][i3].load(),
+					     g_stats.m_nomem[i1][i3].load()
 					      );
 			if ( format == FORMAT_XML )
 				p.safePrintf(
@@ -1118,16 +1147,16 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 					     "\t</messageStat>\n"
 					     ,i3, // niceness
 					     (unsigned char)i1, // msgType
-					     g_stats.m_packetsIn [i1][i3],
-					     g_stats.m_packetsOut[i1][i3],
-					     g_stats.m_acksIn [i1][i3],
-					     g_stats.m_acksOut[i1][i3],
-					     g_stats.m_reroutes[i1][i3],
-					     g_stats.m_dropped[i1][i3],
-					     g_stats.m_cancelRead[i1][i3],
-					     g_stats.m_errors[i1][i3],
-					     g_stats.m_timeouts[i1][i3],
-					     g_stats.m_nomem[i1][i3]
+					     g_stats.m_packetsIn [i1][i3].load(),
+					     g_stats.m_packetsOut[i1][i3].load(),
+					     g_stats.m_acksIn [i1][i3].load(),
+					     g_stats.m_acksOut[i1][i3].load(),
+					     g_stats.m_reroutes[i1][i3].load(),
+					     g_stats.m_dropped[i1][i3].load(),
+					     g_stats.m_cancelRead[i1][i3].load(),
+					     g_stats.m_errors[i1][i3].load(),
+					     g_stats.m_timeouts[i1][i3].load(),
+					     g_stats.m_nomem[i1][i3].load()
 					      );
 			if ( format == FORMAT_JSON )
 				p.safePrintf(
@@ -1147,16 +1176,16 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 					     "\t},\n"
 					     ,i3, // niceness
 					     (unsigned char)i1, // msgType
-					     g_stats.m_packetsIn [i1][i3],
-					     g_stats.m_packetsOut[i1][i3],
-					     g_stats.m_acksIn [i1][i3],
-					     g_stats.m_acksOut[i1][i3],
-					     g_stats.m_reroutes[i1][i3],
-					     g_stats.m_dropped[i1][i3],
-					     g_stats.m_cancelRead[i1][i3],
-					     g_stats.m_errors[i1][i3],
-					     g_stats.m_timeouts[i1][i3],
-					     g_stats.m_nomem[i1][i3]
+					     g_stats.m_packetsIn [i1][i3].load(),
+					     g_stats.m_packetsOut[i1][i3].load(),
+					     g_stats.m_acksIn [i1][i3].load(),
+					     g_stats.m_acksOut[i1][i3].load(),
+					     g_stats.m_reroutes[i1][i3].load(),
+					     g_stats.m_dropped[i1][i3].load(),
+					     g_stats.m_cancelRead[i1][i3].load(),
+					     g_stats.m_errors[i1][i3].load(),
+					     g_stats.m_timeouts[i1][i3].load(),
+					     g_stats.m_nomem[i1][i3].load()
 					      );
 		}
 	}
@@ -1412,6 +1441,8 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 		g_tagdb.getRdb(),
 		g_clusterdb.getRdb(),
 		g_linkdb.getRdb(),
+		g_anchordb.getRdb(),
+		g_simhashdb.getRdb(),
 	};
 	int32_t nr = sizeof(rdbs) / sizeof(Rdb *);
 	//TODO: sqlite: show statistics for sqlite database(s)
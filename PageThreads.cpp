@@ -6,37 +6,6 @@
 #include "Profiler.h"
 
 
-static const char *thread_type_name(thread_type_t tt) {
-	switch(tt) {
-		case thread_type_query_coordinator:  return "query-coordinator";
-		case thread_type_query_read:         return "query-read";
-		case thread_type_query_constrain:    return "query-constrain";
-		case thread_type_query_merge:        return "query-merge";
-		case thread_type_query_intersect:    return "query-intersect";
-		case thread_type_query_summary:      return "query-summary";
-		case thread_type_spider_read:        return "spider-read";
-		case thread_type_spider_write:       return "spider-write";
-		case thread_type_spider_filter:      return "spider-filter";
-		case thread_type_spider_query:       return "spider-query";
-		case thread_type_spider_index:       return "spider-index";
-		case thread_type_merge_filter:       return "merge-filter";
-		case thread_type_replicate_write:    return "replicate-write";
-		case thread_type_replicate_read:     return "replicate-read";
-		case thread_type_file_merge:         return "file-merge";
-		case thread_type_file_meta_data:     return "file-meta-data";
-		case thread_type_index_merge:        return "index-merge";
-		case thread_type_index_generate:     return "index-generate";
-		case thread_type_verify_data:        return "verify-data";
-		case thread_type_statistics:         return "statistics";
-		case thread_type_unspecified_io:     return "unspecified IO";
-		case thread_type_generate_thumbnail: return "generate-thumbnail";
-		case thread_type_config_load:        return "config-load";
-		case thread_type_page_process:       return "page-process";
-		default: return "?";
-	}
-}
-
-
 bool sendPageThreads ( TcpSocket *s , HttpRequest *r ) {
 	StackBuf<64*1024> p;
 	g_pages.printAdminTop ( &p , s , r );
@@ -0,0 +1,28 @@
+#include "TcpServer.h"
+#include "HttpServer.h"
+#include "Pages.h"
+#include "Loop.h"
+#include "UdpServer.h"
+#include "SafeBuf.h"
+
+
+bool sendPageTimers ( TcpSocket *s , HttpRequest *r ) {
+	StackBuf<64*1024> p;
+	g_pages.printAdminTop ( &p , s , r );
+
+	g_loop.printSleepCallbacks(&p);
+
+	size_t numScheduled = 0;
+	int64_t numChecks = 0;
+	g_udpServer.getTimeoutTimerStats(&numScheduled, &numChecks);
+
+	p.safePrintf("<table %s>", TABLE_STYLE);
+	p.safePrintf("<tr class=hdrow><td colspan=2><center><b>Udp Slot Timers</b></center></td></tr>\n");
+	p.safePrintf("<tr class=poo><td>Active slots</td><td>%" PRId32"</td></tr>\n", g_udpServer.getNumUsedSlots());
+	p.safePrintf("<tr class=poo><td>Scheduled timers</td><td>%zu</td></tr>\n", numScheduled);
+	p.safePrintf("<tr class=poo><td>Timeout checks</td><td>%" PRId64"</td></tr>\n", numChecks);
+	p.safePrintf("</table><br><br>\n");
+
+	return g_httpServer.sendDynamicPage ( s , (char*) p.getBufStart() ,
+						p.length() );
+}
@@ -199,6 +199,11 @@ static WebPage s_pages[] = {
 	  sendPageThreads,
 	  PG_STATUS|PG_NOAPI|PG_MASTERADMIN|PG_ACTIVE},
 
+	{ PAGE_TIMERS     , "admin/timers"    , 0 , "Timers" , page_method_t::page_method_get,
+	  "timers",
+	  sendPageTimers,
+	  PG_STATUS|PG_NOAPI|PG_MASTERADMIN|PG_ACTIVE},
+
 	{ PAGE_API , "admin/api"         , 0 , "api" , page_method_t::page_method_get,
 	  "api",  
 	  sendPageAPI,
@@ -254,6 +259,11 @@ static WebPage s_pages[] = {
 	  sendPageHealthCheck,
 	  PG_NOAPI|PG_ACTIVE},
 
+	{ PAGE_METRICS, "admin/metrics"   , 0 , "metrics" , page_method_t::page_method_get,
+	  "counters, gauges and histograms for monitoring",
+	  sendPageMetrics,
+	  PG_NOAPI|PG_MASTERADMIN|PG_ACTIVE},
+
 };
 static const int32_t s_numPages = sizeof(s_pages) / sizeof(WebPage);
 
@@ -1089,6 +1099,7 @@ bool  Pages::printAdminLinks ( SafeBuf *sb,
 		if ( i == PAGE_SEARCHBOX ) continue;
 		if ( i == PAGE_TITLEDB ) continue;
 		if ( i == PAGE_HEALTHCHECK ) continue;
+		if ( i == PAGE_METRICS ) continue;
 		if ( i == PAGE_DOCPROCESS ) continue;
 		
 
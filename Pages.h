@@ -67,9 +67,11 @@ bool sendPageAddUrl2  ( TcpSocket *s , HttpRequest *r );
 bool sendPageGeneric  ( TcpSocket *s , HttpRequest *r ); // in Parms.cpp
 bool sendPageProfiler   ( TcpSocket *s , HttpRequest *r );
 bool sendPageThreads    ( TcpSocket *s , HttpRequest *r );
+bool sendPageTimers     ( TcpSocket *s , HttpRequest *r );
 bool sendPageAPI        ( TcpSocket *s , HttpRequest *r );
 bool sendPageHelp       ( TcpSocket *s , HttpRequest *r );
 bool sendPageHealthCheck ( TcpSocket *sock , HttpRequest *hr ) ;
+bool sendPageMetrics     ( TcpSocket *sock , HttpRequest *hr ) ;
 bool sendPageDefaultCss(TcpSocket *s, HttpRequest *r);
 bool sendPageDocProcess(TcpSocket *s, HttpRequest *r);
 
@@ -207,6 +209,7 @@ enum {
 
 	PAGE_PROFILER    ,
 	PAGE_THREADS     ,
+	PAGE_TIMERS      ,
 
 	PAGE_API ,
 
@@ -220,6 +223,7 @@ enum {
 	PAGE_DOCPROCESS  ,
 	PAGE_SITEDB      ,
 	PAGE_HEALTHCHECK ,
+	PAGE_METRICS     ,
 	PAGE_NONE     	};
 	
 
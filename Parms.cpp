@@ -31,6 +31,8 @@
 #include "Spider.h"
 #include "Tagdb.h"
 #include "Clusterdb.h"
+#include "Anchordb.h"
+#include "Simhashdb.h"
 #include "Collectiondb.h"
 #include "Doledb.h"
 #include "GbDns.h"
@@ -744,6 +746,8 @@ static bool CommandDiskDump(const char *rec) {
 	g_posdb.getRdb()->submitRdbDumpJob(true);
 	g_titledb.getRdb()->submitRdbDumpJob(true);
 	g_linkdb.getRdb()->submitRdbDumpJob(true);
+	g_anchordb.getRdb()->submitRdbDumpJob(true);
+	g_simhashdb.getRdb()->submitRdbDumpJob(true);
 	//g_doledb is a tree-only dbs so cannot be dumped
 	g_errno = 0;
 	return true;
@@ -5040,6 +5044,64 @@ void Parms::init ( ) {
 	m->m_page  = PAGE_MASTER;
 	m++;
 
+	m->m_title = "document converter workers";
+	m->m_desc  = "Number of long-lived worker processes that run gbconvert.sh "
+		"for pdf, doc, xls, ppt, ps and filterable html documents. The "
+		"content is passed to the workers over pipes instead of temporary "
+		"files. Set to 0 to run gbconvert.sh through system() for every "
+		"document.";
+	m->m_cgi   = "dcw";
+	simple_m_set(Conf,m_docConverterWorkers);
+	m->m_def   = "4";
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m++;
+
+	m->m_title = "document converter timeout";
+	m->m_desc  = "A document converter worker that takes longer than this "
+		"to convert a document is killed and restarted.";
+	m->m_cgi   = "dct";
+	simple_m_set(Conf,m_docConverterTimeout);
+	m->m_def   = "60000";
+	m->m_units = "milliseconds";
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m++;
+
+	m->m_title = "document converter max memory";
+	m->m_desc  = "Address space limit of each conversion run by a "
+		"document converter worker. 0 means no limit.";
+	m->m_cgi   = "dcmm";
+	simple_m_set(Conf,m_docConverterMaxMem);
+	m->m_def   = "1024";
+	m->m_units = "MB";
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m++;
+
+	m->m_title = "document converter max conversions";
+	m->m_desc  = "Restart a document converter worker after it has "
+		"converted this many documents. 0 means never.";
+	m->m_cgi   = "dcmc";
+	simple_m_set(Conf,m_docConverterMaxConversions);
+	m->m_def   = "1000";
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m++;
+
+	m->m_title = "thumbnail max decoded pixels";
+	m->m_desc  = "Do not make thumbnails of jpeg and png images that would "
+		"have more than this many pixels when decoded. Jpegs are "
+		"decoded at a reduced scale when possible. Bounds the memory "
+		"and cpu used per thumbnail.";
+	m->m_cgi   = "tmdp";
+	simple_m_set(Conf,m_thumbnailMaxPixels);
+	m->m_def   = "25000000";
+	m->m_units = "pixels";
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m++;
+
 	m->m_title = "spider dead host check interval";
 	m->m_desc  = "Number of seconds before rechecking Hostdb for dead host. This will impact how fast we stop spidering"
 	             "after dead host is detected.";
@@ -5136,6 +5198,17 @@ void Parms::init ( ) {
 	m->m_page  = PAGE_MASTER;
 	m++;
 
+	m->m_title = "udp io threads";
+	m->m_desc  = "Threads reading the UDP port, each with its own socket. They reassemble and ACK "
+		"datagrams while the handlers are still called by the main thread. 0 reads the port "
+		"in the main thread. (Changes requires restart)";
+	m->m_cgi   = "udpiothreads";
+	simple_m_set(Conf,m_udpIoThreads);
+	m->m_def   = "0";
+	m->m_min   = 0;
+	m->m_page  = PAGE_MASTER;
+	m++;
+
 	m->m_title = "max http sockets";
 	m->m_desc  = "Maximum sockets available to serve incoming HTTP "
 		"requests. Too many outstanding requests will increase "
@@ -5364,6 +5437,51 @@ void Parms::init ( ) {
 	m->m_page  = PAGE_MASTER;
 	m++;
 
+	m->m_title = "keep-alive connections when downloading";
+	m->m_desc  = "If this is true, gb asks web servers to keep the "
+		"connection open after a download and re-uses it for the "
+		"next download from the same ip, and resumes TLS sessions "
+		"of https sites. Not used for downloads "
+		"through a proxy or when the crawl delay of the site is "
+		"longer than the keep-alive idle timeout.";
+	m->m_cgi   = "httpka";
+	simple_m_set(Conf,m_httpKeepAlive);
+	m->m_def   = "0";
+	m->m_page  = PAGE_MASTER;
+	m++;
+
+	m->m_title = "keep-alive idle timeout";
+	m->m_desc  = "Idle keep-alive connections are closed after this long. "
+		"Keep it below the keep-alive timeout of common web servers "
+		"(5 seconds for apache) so we close them before they do.";
+	m->m_cgi   = "httpkait";
+	simple_m_set(Conf,m_httpKeepAliveIdleTimeout);
+	m->m_def   = "4000";
+	m->m_units = "milliseconds";
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m++;
+
+	m->m_title = "max keep-alive connections per ip";
+	m->m_desc  = "Maximum number of idle keep-alive connections kept "
+		"open to one ip.";
+	m->m_cgi   = "httpkamc";
+	simple_m_set(Conf,m_httpKeepAliveMaxPerIp);
+	m->m_def   = "2";
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m++;
+
+	m->m_title = "max requests per keep-alive connection";
+	m->m_desc  = "A keep-alive connection is closed after this many "
+		"downloads.";
+	m->m_cgi   = "httpkamr";
+	simple_m_set(Conf,m_httpKeepAliveMaxRequests);
+	m->m_def   = "100";
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m++;
+
 	m->m_title = "document summary (w/desc) cache max age";
 	m->m_desc = "How many milliseconds should we cache document summaries";
 	m->m_cgi  = "dswdmca";
@@ -5779,6 +5897,19 @@ void Parms::init ( ) {
 	m->m_group = false;
 	m++;
 
+	m->m_title = "store passage index";
+	m->m_desc  = "Store the section flags of each word in the title record "
+		"when indexing, so summaries can be made without setting the "
+		"sections of the document. Documents indexed without it are "
+		"parsed fully.";
+	m->m_cgi   = "storepassidx";
+	simple_m_set(Conf,m_storePassageIndex);
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_group = false;
+	m++;
+
 	m->m_title = "redirect non-raw traffic";
 	m->m_desc = "If this is non empty, http traffic will be redirected "
 				"to the specified address.";
@@ -6038,7 +6169,8 @@ void Parms::init ( ) {
 	m++;
 
 	m->m_title = "dns cache max age";
-	m->m_desc  = "How long to cache dns records";
+	m->m_desc  = "How long to cache dns records at most. Records are "
+		"cached for their TTL if that is shorter.";
 	m->m_cgi   = "dnscachemaxage";
 	simple_m_set(Conf,m_dnsCacheMaxAge);
 	m->m_def   = "300";
@@ -6048,6 +6180,44 @@ void Parms::init ( ) {
 	m->m_page  = PAGE_MASTER;
 	m++;
 
+	m->m_title = "dns cache min ttl";
+	m->m_desc  = "Cache dns records at least this long even if their TTL "
+		"is shorter. Also used for lookups that failed with a timeout "
+		"or server error.";
+	m->m_cgi   = "dnscachemint";
+	simple_m_set(Conf,m_dnsCacheMinTtl);
+	m->m_def   = "60";
+	m->m_units = "seconds";
+	m->m_group = false;
+	m->m_flags = PF_REBUILDDNSSETTINGS;
+	m->m_page  = PAGE_MASTER;
+	m++;
+
+	m->m_title = "dns negative cache max age";
+	m->m_desc  = "How long to cache non-existing hostnames at most. They "
+		"are cached for the negative TTL of the SOA record in the "
+		"response if that is shorter.";
+	m->m_cgi   = "dnsnegcachemaxage";
+	simple_m_set(Conf,m_dnsNegativeCacheMaxAge);
+	m->m_def   = "3600";
+	m->m_units = "seconds";
+	m->m_group = false;
+	m->m_flags = PF_REBUILDDNSSETTINGS;
+	m->m_page  = PAGE_MASTER;
+	m++;
+
+	m->m_title = "dns max prefetches";
+	m->m_desc  = "Hostnames of new spider requests are looked up ahead of "
+		"spidering them. This is the maximum number of such lookups "
+		"outstanding, more are skipped. 0 disables it.";
+	m->m_cgi   = "dnsmaxprefetch";
+	simple_m_set(Conf,m_dnsMaxPrefetches);
+	m->m_def   = "100";
+	m->m_units = "";
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m++;
+
 	m->m_title = "default collection";
 	m->m_desc  = "When no collection is explicitly specified, assume "
 		"this collection name.";
@@ -6248,6 +6418,17 @@ void Parms::init ( ) {
 	m->m_group = false;
 	m++;
 
+	m->m_title = "verify posdb pair scores";
+	m->m_desc  = "Also compute the sliding window term pair scores with the scalar scorer and log "
+		"differences beyond rounding. Decreases query performance. Used for debugging.";
+	m->m_cgi   = "vpps";
+	simple_m_set(Conf,m_verifyPosdbPairScores);
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_group = false;
+	m++;
+
 	m->m_title = "fallback spider->query allowed";
 	m->m_desc  = "If a spider-host is unavailable can requests fall back to any query-hosts in the shard?";
 	m->m_cgi   = "fallbackspidertoquery";
@@ -7470,6 +7651,28 @@ void Parms::init ( ) {
 	m->m_flags = 0;
 	m++;
 
+	m->m_title = "query admission control";
+	m->m_desc  = "If enabled, queries that are predicted to take longer than the msg40->39 timeout, "
+		"based on the recent query job queue times, are rejected and queries close to it are "
+		"degraded (no site clustering, cached summaries only) so overload does not make all queries slow.";
+	m->m_cgi   = "qadmission";
+	simple_m_set(Conf,m_queryAdmissionControl);
+	m->m_page  = PAGE_SEARCH;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m++;
+
+	m->m_title = "query degrade threshold";
+	m->m_desc  = "Degrade queries when the predicted time is above this percentage of the timeout.";
+	m->m_cgi   = "qdegradepct";
+	simple_m_set(Conf,m_queryDegradePercent);
+	m->m_page  = PAGE_SEARCH;
+	m->m_def   = "50";
+	m->m_units = "percent";
+	m->m_min   = 1;
+	m->m_flags = 0;
+	m++;
+
 	m->m_title = "use high frequency term cache";
 	m->m_desc  = "If enabled, return generated DocIds from cache "
 		"when detecting a high frequency term.";
@@ -7750,6 +7953,106 @@ void Parms::init ( ) {
 	m->m_group = false;
 	m++;
 
+	////////////////////
+	// anchordb settings
+	////////////////////
+
+	m->m_title = "use anchordb";
+	m->m_desc  = "Store the anchor text of outlinks in anchordb when a "
+	             "document is indexed, and build the link info of a url "
+	             "from anchordb instead of looking up the titlerec of "
+	             "each linker. Linkers without an anchordb record are "
+	             "still looked up.";
+	m->m_cgi   = "useanchordb";
+	simple_m_set(Conf,m_useAnchordb);
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_group = true;
+	m++;
+
+	m->m_title = "anchordb max percentage of lost positives after merge";
+	m->m_desc  = "Maximum percentage of positive keys lost after merge that we'll allow for anchordb. "
+	             "Anything above that we'll abort the instance";
+	m->m_cgi   = "plpanmerge";
+	simple_m_set(Conf,m_anchordbMaxLostPositivesPercentage);
+	m->m_def   = "50";
+	m->m_units = "percent";
+	m->m_flags = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_group = false;
+	m++;
+
+	m->m_title = "anchordb max tree mem";
+	m->m_desc  = "";
+	m->m_cgi   = "manmt";
+	simple_m_set(Conf,m_anchordbMaxTreeMem);
+#ifndef PRIVACORE_TEST_VERSION
+	m->m_def   = "100000000";
+#else
+	m->m_def   = "10000000";
+#endif
+	m->m_flags = PF_NOSYNC|PF_NOAPI;
+	m->m_page  = PAGE_RDB;
+	m->m_group = false;
+	m++;
+
+	////////////////////
+	// simhashdb settings
+	////////////////////
+
+	m->m_title = "use simhashdb";
+	m->m_desc  = "Store a simhash of the content in simhashdb when a "
+	             "document is indexed, and drop near-duplicate results "
+	             "by their simhashes before getting the summaries when "
+	             "duplicate content removal is on. Documents without a "
+	             "simhashdb record are still deduped by their summaries.";
+	m->m_cgi   = "usesimhashdb";
+	simple_m_set(Conf,m_useSimhashdb);
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_group = true;
+	m++;
+
+	m->m_title = "simhashdb near-duplicate max distance";
+	m->m_desc  = "Two results are near-duplicates if their simhashes "
+	             "differ in at most this many of the 64 bits.";
+	m->m_cgi   = "shdupdist";
+	simple_m_set(Conf,m_simhashDupMaxDistance);
+	m->m_def   = "3";
+	m->m_units = "bits";
+	m->m_flags = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_group = false;
+	m++;
+
+	m->m_title = "simhashdb max percentage of lost positives after merge";
+	m->m_desc  = "Maximum percentage of positive keys lost after merge that we'll allow for simhashdb. "
+	             "Anything above that we'll abort the instance";
+	m->m_cgi   = "plpshmerge";
+	simple_m_set(Conf,m_simhashdbMaxLostPositivesPercentage);
+	m->m_def   = "50";
+	m->m_units = "percent";
+	m->m_flags = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_group = false;
+	m++;
+
+	m->m_title = "simhashdb max tree mem";
+	m->m_desc  = "";
+	m->m_cgi   = "mshmt";
+	simple_m_set(Conf,m_simhashdbMaxTreeMem);
+#ifndef PRIVACORE_TEST_VERSION
+	m->m_def   = "20000000";
+#else
+	m->m_def   = "2000000";
+#endif
+	m->m_flags = PF_NOSYNC|PF_NOAPI;
+	m->m_page  = PAGE_RDB;
+	m->m_group = false;
+	m++;
+
 	////////////////////
 	// posdb settings
 	////////////////////
@@ -7910,6 +8213,44 @@ void Parms::init ( ) {
 	m->m_group = false;
 	m++;
 
+	m->m_title = "tagrec cache size";
+	m->m_desc  = "How many tagdb lists of sites and domains to cache for "
+	             "tagrec lookups. 0 disables the cache.";
+	m->m_cgi   = "trcachesize";
+	simple_m_set(Conf,m_tagRecCacheSize);
+	m->m_def   = "100000";
+	m->m_units = "";
+	m->m_flags = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_group = false;
+	m++;
+
+	m->m_title = "tagrec cache max age";
+	m->m_desc  = "How long to cache tagdb lists. Tags added from this host "
+	             "remove the list from the cache right away, tags added "
+	             "from other hosts are seen after at most this long.";
+	m->m_cgi   = "trcachemaxage";
+	simple_m_set(Conf,m_tagRecCacheMaxAge);
+	m->m_def   = "3600";
+	m->m_units = "seconds";
+	m->m_flags = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_group = false;
+	m++;
+
+	m->m_title = "tagrec cache volatile max age";
+	m->m_desc  = "How long to cache tagdb lists with tags that are "
+	             "regenerated regularly, like sitenuminlinks, and lists "
+	             "without any tags.";
+	m->m_cgi   = "trcachevolmaxage";
+	simple_m_set(Conf,m_tagRecCacheVolatileMaxAge);
+	m->m_def   = "300";
+	m->m_units = "seconds";
+	m->m_flags = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_group = false;
+	m++;
+
 	////////////////////
 	// titledb settings
 	////////////////////
@@ -8023,6 +8364,50 @@ void Parms::init ( ) {
 	m->m_group = false;
 	m++;
 
+	m->m_title = "merge max MB/s";
+	m->m_desc  = "Limit the disk bandwidth used by a merge to this many "
+		"megabytes per second, counting both the reads and the writes. "
+		"Lower values leave more of the disk to queries, but the merge "
+		"takes longer. Use 0 for no limit.";
+	m->m_cgi   = "mmbps";
+	simple_m_set(Conf,m_mergeMaxMBPerSec);
+	m->m_def   = "0";
+	m->m_units = "MB/s";
+	m->m_flags = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_group = false;
+	m++;
+
+	m->m_title = "merge partitions";
+	m->m_desc  = "Split a large merge into up to this many key ranges "
+		"which are read, merged and written concurrently, then copied "
+		"into the merged file in parallel. The number of key ranges is "
+		"also limited by max merge threads and merge partitions max "
+		"mem. A partitioned merge needs temporary disk space for all but "
+		"the first key range. Merges resumed after a restart are not "
+		"split. Use 1 to disable.";
+	m->m_cgi   = "mergeparts";
+	simple_m_set(Conf,m_mergeNumPartitions);
+	m->m_def   = "1";
+	m->m_flags = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_group = false;
+	m++;
+
+	m->m_title = "merge partitions max mem";
+	m->m_desc  = "Limit the read and write buffers of the key ranges of a "
+		"partitioned merge to this many megabytes. Each key range "
+		"needs about merge buf size bytes for every file merged plus "
+		"two more.";
+	m->m_cgi   = "mergepartsmem";
+	simple_m_set(Conf,m_mergePartitionsMaxMem);
+	m->m_def   = "256";
+	m->m_units = "MB";
+	m->m_flags = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_group = false;
+	m++;
+
 	m->m_title = "Doledb nuke interval";
 	m->m_desc  = "Sometimes spiderrecords get stuck due to plain bugs or due to priority inversion."
 		"Nuking doledb periodically masks this. 0=disabled";
@@ -8035,6 +8420,18 @@ void Parms::init ( ) {
 	m->m_group = false;
 	m++;
 
+	m->m_title = "use spider frontier";
+	m->m_desc  = "Keep the doled urls in an in-memory frontier per collection instead of in doledb. "
+		"The frontier is saved with the waiting tree. Urls doled before switching are redoled "
+		"from spiderdb. (Changes requires restart)";
+	m->m_cgi   = "spiderfrontier";
+	simple_m_set(Conf,m_spiderFrontierEnabled);
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_group = false;
+	m++;
+
 	m->m_title = "Nuke doledb now";
 	m->m_desc  = "Clears doledb+waitingtree and refills them from spiderdb";
 	m->m_cgi   = "nukedoledbnow";
@@ -294,6 +294,8 @@ static void initializeCaches() {
 // . returns an UPPER BOUND
 // . because this is over POSDB now and not indexdb, a document is counted
 //   once for every occurence of term "termId" it has... :{
+// . if all files have a term dictionary the files count each document once
+//   and only the in-memory part is estimated
 int64_t Posdb::getTermFreq ( collnum_t collnum, int64_t termId ) {
 	initializeCaches();
 	
@@ -322,11 +324,15 @@ int64_t Posdb::getTermFreq ( collnum_t collnum, int64_t termId ) {
 	makeStartKey(&startKey, termId);
 	makeEndKey  (&endKey  , termId);
 
-	int64_t maxRecs = m_rdb.estimateListSize(collnum,
+	int64_t maxRecs;
+	const RdbBase *base = m_rdb.getBase(collnum);
+	if ( ! base || ! base->getTermDictNumDocs(termId, &maxRecs) ) {
+		maxRecs = m_rdb.estimateListSize(collnum,
 						 (const char*)&startKey,
 						 (const char*)&endKey,
 						 (char *)&maxKey,
 						 -1 ); //no truncation
+	}
 
 	RdbBuckets *buckets = m_rdb.getBuckets();
 	if( !buckets ) {
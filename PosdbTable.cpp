@@ -60,14 +60,29 @@ struct MiniMergeBuffer {
 	int16_t termIndex[300000/6];
 	std::vector<const char *> mergedListStart;
 	std::vector<const char *> mergedListEnd;
+	//pre-decoded keys, indexed like termIndex. Set by mergeTermSubListsForDocId() so the sliding window doesn't have
+	//to decode the same keys again for every window and term pair
+	std::vector<int32_t> wordPos;
+	std::vector<float> pairWeight; //density*hashgroup*spam*user*term weight
 	MiniMergeBuffer(int numQueryTerms)
 	  : mergedListStart(numQueryTerms),
-	    mergedListEnd(numQueryTerms)
+	    mergedListEnd(numQueryTerms),
+	    wordPos(sizeof(buffer)/6),
+	    pairWeight(sizeof(buffer)/6)
 	{
 #ifdef _VALGRIND_
 		VALGRIND_MAKE_MEM_UNDEFINED(termIndex,sizeof(termIndex));
 #endif
 	}
+	size_t getDecodedIndex(const char *ptr) const {
+		return (size_t)(ptr-buffer)/6;
+	}
+	int32_t getWordPosForBufferPos(const char *ptr) const {
+		return wordPos[getDecodedIndex(ptr)];
+	}
+	float getPairWeightForBufferPos(const char *ptr) const {
+		return pairWeight[getDecodedIndex(ptr)];
+	}
 	int16_t *getTermIndexPtrForBufferPos(const char *ptr) {
 		size_t bufferOffset = (size_t)(ptr-buffer)/6;
 		return termIndex+bufferOffset;
@@ -100,6 +115,26 @@ public:
 };
 
 
+//The positions of the current sliding window as structure-of-arrays, one entry per query term. Lets
+//findMinTermPairScoreInWindow() score a term against all the others in a single loop the compiler can vectorize
+struct PairWindow {
+	std::vector<float> pos;           //word position in the window
+	std::vector<float> weight;        //pair weight of that position, 0 if no position
+	std::vector<float> nonBodyWeight; //pair weight of the best non-body position, -1 if none
+	std::vector<int32_t> wikiPhraseId;
+	std::vector<int32_t> qpos;
+	std::vector<float> rowScore;      //output of scoreWindowRow()
+	PairWindow(int numQueryTerms)
+	  : pos(numQueryTerms),
+	    weight(numQueryTerms),
+	    nonBodyWeight(numQueryTerms),
+	    wikiPhraseId(numQueryTerms),
+	    qpos(numQueryTerms),
+	    rowScore(numQueryTerms)
+	    {}
+};
+
+
 
 //////////////////
 //
@@ -2642,7 +2677,7 @@ bool PosdbTable::prefilterMaxPossibleScoreByDistance(float minWinningScore) {
 		// if any one of these terms have a max score below the
 		// worst score of the 10th result, then it can not win.
 		// @todo: BR. Really? ANY of them?
-		if ( maxScore2 <= minWinningScore ) {
+		if ( maxScore2 < minWinningScore ) {
 			logTrace(g_conf.m_logTracePosdb, "END - docid score too low");
 			return false;
 		}
@@ -2654,6 +2689,21 @@ bool PosdbTable::prefilterMaxPossibleScoreByDistance(float minWinningScore) {
 
 
 
+// . store the decoded position and the combined pair weight of a merged key
+// . the weight is everything getScoreForTermPair() multiplies in for one
+//   side of the pair
+void PosdbTable::decodeMergedKey(MiniMergeBuffer *miniMergeBuffer, const char *mptr, int termIndex) {
+	PosdbDecodeHelper helper;
+	helper.set(mptr, m_derivedScoringWeights);
+	const QueryTerm &qterm = m_q->m_qterms[termIndex];
+
+	size_t idx = miniMergeBuffer->getDecodedIndex(mptr);
+	miniMergeBuffer->wordPos[idx] = helper.p;
+	miniMergeBuffer->pairWeight[idx] = helper.denw * m_derivedScoringWeights.m_hashGroupWeights[helper.hg] *
+	                                   qterm.m_userWeight * qterm.m_termWeight * helper.spamw;
+}
+
+
 //
 // Data for the current DocID found in sublists of each query term
 // is merged into a single list, so we end up with one list per query 
@@ -2789,6 +2839,7 @@ void PosdbTable::mergeTermSubListsForDocId(MiniMergeBuffer *miniMergeBuffer, int
 				// the first key for the termid, and 18 bytes.
 				mptr[0] &= 0xf9;
 				mptr[0] |= 0x02;
+				decodeMergedKey(miniMergeBuffer, mptr, termIndex);
 				// save it
 				lastMptr = mptr;
 				mptr += 12;
@@ -2827,6 +2878,7 @@ void PosdbTable::mergeTermSubListsForDocId(MiniMergeBuffer *miniMergeBuffer, int
 				// on the 2 compression bits
 				mptr[0] &= 0xf9;
 				mptr[0] |= 0x06;
+				decodeMergedKey(miniMergeBuffer, mptr, termIndex);
 				// save it
 				lastMptr = mptr;
 				mptr += 6;
@@ -3064,6 +3116,85 @@ float PosdbTable::getMinSingleTermScoreSum(const MiniMergeBuffer *miniMergeBuffe
 
 
 
+// . score term i of the window against terms i+1..n-1 into rowScore[]
+// . same as the max of the four getScoreForTermPair() calls in
+//   findMinTermPairScoreInWindow(): in-window distance and the sub-outs of
+//   the best non-body positions at FIXED_DISTANCE
+// . no branches or calls so the compiler vectorizes the loop. entries for
+//   terms without a position are garbage and skipped by the caller
+static void scoreWindowRow(PairWindow &w, int32_t i, int32_t n) {
+	const float pi = w.pos[i];
+	const float wi = w.weight[i];
+	const float nbi = w.nonBodyWeight[i];
+	const int32_t wikiIdi = w.wikiPhraseId[i];
+	const int32_t qposi = w.qpos[i];
+	const float *pos = &w.pos[0];
+	const float *weight = &w.weight[0];
+	const float *nonBodyWeight = &w.nonBodyWeight[0];
+	const int32_t *wikiPhraseId = &w.wikiPhraseId[0];
+	const int32_t *qpos = &w.qpos[0];
+	float *rowScore = &w.rowScore[0];
+	const float fixedDiv = FIXED_DISTANCE + 1.0f;
+
+	for ( int32_t j = i + 1; j < n; j++ ) {
+		// same wikipedia phrase? keep the distance as in the query
+		float phraseQdist = (float)(qpos[j] - qposi);
+		float qdist = ( wikiIdi != 0 && wikiPhraseId[j] == wikiIdi ) ? phraseQdist : 2.0f;
+
+		float dist = fabsf(pi - pos[j]);
+		dist = dist < 2.0f ? 2.0f : dist;
+		float closerDist = dist - qdist;
+		dist = dist >= qdist ? closerDist : dist;
+		// out of order
+		float outOfOrderDist = dist + 1.0f;
+		dist = pos[j] < pi ? outOfOrderDist : dist;
+
+		float score = 100.0f * wi * weight[j] / (dist + 1.0f);
+
+		// sub-outs of the best non-body positions, -1 if none. always
+		// compute them so there is nothing to branch on
+		float nbj = nonBodyWeight[j];
+		float sub1 = 100.0f * nbi * weight[j] / fixedDiv;
+		float sub2 = 100.0f * nbi * nbj / fixedDiv;
+		float sub3 = 100.0f * wi * nbj / fixedDiv;
+		sub1 = nbi >= 0.0f ? sub1 : -1.0f;
+		sub2 = nbi >= 0.0f ? sub2 : -1.0f;
+		sub2 = nbj >= 0.0f ? sub2 : -1.0f;
+		sub3 = nbj >= 0.0f ? sub3 : -1.0f;
+
+		score = gbmax(score, sub1);
+		score = gbmax(score, sub2);
+		score = gbmax(score, sub3);
+		rowScore[j] = score;
+	}
+}
+
+
+// scalar version of scoreWindowRow() for one pair, used to verify it
+float PosdbTable::getWindowPairScore(const MiniMergeBuffer *miniMergeBuffer, const char *wpi, const char *wpj, const char *nbi, const char *nbj, int32_t qdist) {
+	// this will be -1 if wpi or wpj is NULL
+	float max = getScoreForTermPair(miniMergeBuffer, wpi, wpj, 0, qdist);
+
+	// try sub-ing in the best title occurence or best
+	// inlink text occurence. cuz if the term is in the title
+	// but these two terms are really far apart, we should
+	// get a better score
+	float score = getScoreForTermPair(miniMergeBuffer, nbi, wpj, FIXED_DISTANCE, qdist);
+	max = gbmax(max,score);
+
+	// a double pair sub should be covered in the
+	// getMaxScoreForNonBodyTermPair() function
+	score = getScoreForTermPair(miniMergeBuffer, nbi, nbj, FIXED_DISTANCE, qdist);
+	max = gbmax(max,score);
+
+	score = getScoreForTermPair(miniMergeBuffer, wpi, nbj, FIXED_DISTANCE, qdist);
+	max = gbmax(max,score);
+
+	return max;
+}
+
+
+
 // Like getTermPairScore, but uses the word positions currently pointed to by ptrs[i].
 // Does NOT scan the word position lists.
 // Also tries to sub-out each term with the title or linktext wordpos term
@@ -3073,7 +3204,7 @@ float PosdbTable::getMinSingleTermScoreSum(const MiniMergeBuffer *miniMergeBuffe
 //   bestMinTermPairWindowScore: The best minimum window score
 //   bestMinTermPairWindowPtrs : Pointers to query term positions giving the best minimum score
 //
-void PosdbTable::findMinTermPairScoreInWindow(const MiniMergeBuffer *miniMergeBuffer, const std::vector<const char *> &ptrs, std::vector<const char *> *bestMinTermPairWindowPtrs, float *bestMinTermPairWindowScore, const std::vector<const char *> &highestScoringNonBodyPos, const PairScoreMatrix &scoreMatrix) {
+void PosdbTable::findMinTermPairScoreInWindow(const MiniMergeBuffer *miniMergeBuffer, const std::vector<const char *> &ptrs, std::vector<const char *> *bestMinTermPairWindowPtrs, float *bestMinTermPairWindowScore, const std::vector<const char *> &highestScoringNonBodyPos, const PairScoreMatrix &scoreMatrix, PairWindow *window) {
 	float minTermPairScoreInWindow = 999999999.0;
 	bool mergedListFound = false;
 	bool allSpecialTerms = true;
@@ -3081,6 +3212,24 @@ void PosdbTable::findMinTermPairScoreInWindow(const MiniMergeBuffer *miniMergeBu
 
 	logTrace(g_conf.m_logTracePosdb, "BEGIN.");
 
+	// gather the window from the pre-decoded keys
+	for ( int32_t i = 0 ; i < m_numQueryTermInfos; i++ ) {
+		if ( ptrs[i] ) {
+			window->pos[i] = miniMergeBuffer->getWordPosForBufferPos(ptrs[i]);
+			window->weight[i] = miniMergeBuffer->getPairWeightForBufferPos(ptrs[i]);
+		} else {
+			window->pos[i] = 0;
+			window->weight[i] = 0;
+		}
+		if ( highestScoringNonBodyPos[i] ) {
+			window->nonBodyWeight[i] = miniMergeBuffer->getPairWeightForBufferPos(highestScoringNonBodyPos[i]);
+		} else {
+			window->nonBodyWeight[i] = -1.0;
+		}
+		window->wikiPhraseId[i] = m_wikiPhraseIds[i];
+		window->qpos[i] = m_qpos[i];
+	}
+
 	// TODO: only do this loop on the (i,j) pairs where i or j
 	// is the term whose position got advanced in the sliding window.
 
@@ -3104,6 +3253,10 @@ void PosdbTable::findMinTermPairScoreInWindow(const MiniMergeBuffer *miniMergeBu
 
 		const char *wpi = ptrs[i];
 
+		// the max of the in-window and sub-out scores of term i
+		// against all the terms after it
+		scoreWindowRow(*window, i, m_numQueryTermInfos);
+
 		// loop over other terms
 		for(int32_t j = i + 1; j < m_numQueryTermInfos; j++) {
 			// skip if to the left of a pipe operator
@@ -3147,24 +3300,18 @@ void PosdbTable::findMinTermPairScoreInWindow(const MiniMergeBuffer *miniMergeBu
 				wikiWeight = 1.0;
 			}
 
-			// this will be -1 if wpi or wpj is NULL
-			float max = getScoreForTermPair(miniMergeBuffer, wpi, wpj, 0, qdist);
+			float max = window->rowScore[j];
 			scoredTerms = true;
 
-			// try sub-ing in the best title occurence or best
-			// inlink text occurence. cuz if the term is in the title
-			// but these two terms are really far apart, we should
-			// get a better score
-			float score = getScoreForTermPair(miniMergeBuffer, highestScoringNonBodyPos[i], wpj, FIXED_DISTANCE, qdist);
-			max = gbmax(max,score);
-
-			// a double pair sub should be covered in the
-			// getMaxScoreForNonBodyTermPair() function
-			score = getScoreForTermPair(miniMergeBuffer, highestScoringNonBodyPos[i], highestScoringNonBodyPos[j], FIXED_DISTANCE, qdist);
-			max = gbmax(max,score);
-
-			score = getScoreForTermPair(miniMergeBuffer, wpi, highestScoringNonBodyPos[j], FIXED_DISTANCE, qdist);
-			max = gbmax(max,score);
+			// compare with the scalar scorer. the weights are
+			// multiplied in a different order so allow for rounding
+			if ( g_conf.m_verifyPosdbPairScores ) {
+				float scalarMax = getWindowPairScore(miniMergeBuffer, wpi, wpj, highestScoringNonBodyPos[i], highestScoringNonBodyPos[j], qdist);
+				if ( fabsf(max - scalarMax) > 1e-4f * gbmax(fabsf(max), fabsf(scalarMax)) ) {
+					log(LOG_WARN, "posdb: pair score mismatch for docId %" PRIu64 " i=%" PRId32 " j=%" PRId32 ": %.9g != %.9g",
+					    m_docId, i, j, max, scalarMax);
+				}
+			}
 
 			// wikipedia phrase weight
 			if ( !almostEqualFloat(wikiWeight, 1.0) ) {
@@ -3281,7 +3428,7 @@ static const char *findNextBodyPosdbEntry(const char *p, const char *listEnd) {
 
 
 
-float PosdbTable::getMinTermPairScoreSlidingWindow(const MiniMergeBuffer *miniMergeBuffer, const std::vector<const char *> &highestScoringNonBodyPos, std::vector<const char *> &bestMinTermPairWindowPtrs, std::vector<const char *> &xpos, const PairScoreMatrix &scoreMatrix, DocIdScore *pdcs) {
+float PosdbTable::getMinTermPairScoreSlidingWindow(const MiniMergeBuffer *miniMergeBuffer, const std::vector<const char *> &highestScoringNonBodyPos, std::vector<const char *> &bestMinTermPairWindowPtrs, std::vector<const char *> &xpos, const PairScoreMatrix &scoreMatrix, PairWindow *window, DocIdScore *pdcs) {
 	logTrace(g_conf.m_logTracePosdb, "Sliding Window algorithm begins");
 
 	//bestMinTermPairWindowPtrs is just a buffer allocated ones by caller
@@ -3358,7 +3505,7 @@ float PosdbTable::getMinTermPairScoreSlidingWindow(const MiniMergeBuffer *miniMe
 		//
 		// Sets m_bestMinTermPairWindowScore and bestMinTermPairWindowPtrs if this window score beats it.
 		//
-		findMinTermPairScoreInWindow(miniMergeBuffer, xpos, &bestMinTermPairWindowPtrs, &bestMinTermPairWindowScore, highestScoringNonBodyPos, scoreMatrix);
+		findMinTermPairScoreInWindow(miniMergeBuffer, xpos, &bestMinTermPairWindowPtrs, &bestMinTermPairWindowScore, highestScoringNonBodyPos, scoreMatrix, window);
 
 		bool advanceMin = true;
 
@@ -3372,9 +3519,9 @@ float PosdbTable::getMinTermPairScoreSlidingWindow(const MiniMergeBuffer *miniMe
 			int32_t minPosTermIdx = -1;
 			int32_t minPos = 0;
 			for ( int32_t x = 0 ; x < m_numQueryTermInfos ; x++ ) {
-				if(xpos[x]!=NULL && (minPosTermIdx == -1 || Posdb::getWordPos(xpos[x]) < minPos)) {
+				if(xpos[x]!=NULL && (minPosTermIdx == -1 || miniMergeBuffer->getWordPosForBufferPos(xpos[x]) < minPos)) {
 					minPosTermIdx = x;
-					minPos = Posdb::getWordPos(xpos[x]);
+					minPos = miniMergeBuffer->getWordPosForBufferPos(xpos[x]);
 				}
 			}
 			// sanity
@@ -3522,6 +3669,7 @@ void PosdbTable::intersectLists_real() {
 	std::vector<const char *> bestMinTermPairWindowPtrs(m_numQueryTermInfos);
 	std::vector<const char *> xpos(m_numQueryTermInfos);
 	PairScoreMatrix           scoreMatrix(m_numQueryTermInfos);
+	PairWindow                pairWindow(m_numQueryTermInfos);
 	
 	int64_t lastTime = gettimeofdayInMilliseconds();
 	int64_t now;
@@ -3563,7 +3711,10 @@ void PosdbTable::intersectLists_real() {
 	MiniMergeBuffer miniMergeBuf(m_numQueryTermInfos);
 	const char *docIdPtr;
 	char *docIdEnd = m_docIdVoteBuf.getBufStart()+m_docIdVoteBuf.length();
-	float minWinningScore = -1.0;
+	// . the top tree may be full from previous files already
+	// . docids scoring the same as its lowest node are still scored, they
+	//   win the tie if their docid is lower
+	float minWinningScore = m_msg39req->m_doMaxScoreAlgo ? m_topTree->getMinWinningScore() : -1.0;
 	int32_t topCursor = -9;
 	int32_t numProcessed = 0;
 	int32_t prefiltMaxPossScoreFail 		= 0;
@@ -3746,7 +3897,7 @@ void PosdbTable::intersectLists_real() {
 							// logTrace(g_conf.m_logTracePosdb, "maxScore=%f  minWinningScore=%f", maxScore, minWinningScore);
 							// if any one of these terms have a max score below the
 							// worst score of the 10th result, then it can not win.
-							if ( maxScore <= minWinningScore ) {
+							if ( maxScore < minWinningScore ) {
 								docIdPtr += 6;
 								prefiltMaxPossScoreFail++;
 								skipToNextDocId = true;
@@ -3859,7 +4010,7 @@ void PosdbTable::intersectLists_real() {
 				// term positions set ("window") that has the highest minimum score. These
 				// pointers are used when determining the minimum term pair score returned
 				// by the function.
-				float minPairScore = getMinTermPairScoreSlidingWindow(&miniMergeBuf, highestScoringNonBodyPos, bestMinTermPairWindowPtrs, xpos, scoreMatrix, pdcs);
+				float minPairScore = getMinTermPairScoreSlidingWindow(&miniMergeBuf, highestScoringNonBodyPos, bestMinTermPairWindowPtrs, xpos, scoreMatrix, &pairWindow, pdcs);
 				logTrace(g_conf.m_logTracePosdb, "minPairScore=%f before multiplication for docId %" PRIu64 "", minPairScore, m_docId);
 
 				minPairScore *= completeScoreMultiplier;
@@ -4040,11 +4191,10 @@ void PosdbTable::intersectLists_real() {
 				// enough domains represented in the search results.
 				// See TopTree::addNode(). it will not add the "t" node if
 				// its score is not high enough when the top tree is full.
-				if ( m_topTree->getNumUsedNodes() > m_topTree->getNumDocsWanted() ) {
-					// get the lowest scoring node
-					int32_t lowNode = m_topTree->getLowNode();
-					// and record its score in "minWinningScore"
-					minWinningScore = m_topTree->getNode(lowNode)->m_score;
+				// Once it is full the score of its lowest node is what
+				// the next docids have to beat.
+				if ( m_msg39req->m_doMaxScoreAlgo ) {
+					minWinningScore = m_topTree->getMinWinningScore();
 				}
 			}
 
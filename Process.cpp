@@ -1,6 +1,8 @@
 #include "Process.h"
 #include "Rdb.h"
 #include "Clusterdb.h"
+#include "Anchordb.h"
+#include "Simhashdb.h"
 #include "Collectiondb.h"
 #include "Hostdb.h"
 #include "Tagdb.h"
@@ -291,6 +293,8 @@ bool Process::init ( ) {
 	m_rdbs[m_numRdbs++] = g_clusterdb2.getRdb  ();
 	m_rdbs[m_numRdbs++] = g_linkdb2.getRdb     ();
 	m_rdbs[m_numRdbs++] = g_tagdb2.getRdb      ();
+	m_rdbs[m_numRdbs++] = g_anchordb.getRdb    ();
+	m_rdbs[m_numRdbs++] = g_simhashdb.getRdb   ();
 	/////////////////
 	// CAUTION!!!
 	/////////////////
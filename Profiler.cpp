@@ -1,4 +1,5 @@
 #include "Profiler.h"
+#include "SamplingProfiler.h"
 #include <execinfo.h>
 #include "HttpRequest.h"
 #include "HttpServer.h"
@@ -84,8 +85,10 @@ bool sendPageProfiler ( TcpSocket *s , HttpRequest *r ) {
 
 	int startRt=(int)r->getLong("rtstart",0);
 	int stopRt=(int)r->getLong("rtstop",0);
-	
-	g_pages.printAdminTop ( &sb , s , r );
+	int startSampling=(int)r->getLong("sstart",0);
+	int stopSampling=(int)r->getLong("sstop",0);
+	int clearSampling=(int)r->getLong("sclear",0);
+	int foldedSampling=(int)r->getLong("sfolded",0);
 
 	// no permmission?
 	bool isMasterAdmin = g_conf.isMasterAdmin ( s , r );
@@ -93,7 +96,34 @@ bool sendPageProfiler ( TcpSocket *s , HttpRequest *r ) {
 	if ( ! isMasterAdmin && ! isCollAdmin ) {
 		startRt = 0;
 		stopRt = 0;
+		startSampling = 0;
+		stopSampling = 0;
+		clearSampling = 0;
+		foldedSampling = 0;
+	}
+
+	// . flamegraph.pl/speedscope compatible, stop the profiler first
+	//   or the counts keep moving while we print
+	if ( foldedSampling ) {
+		if ( ! g_samplingProfiler.getFoldedStacks ( &sb , true ) )
+			return g_httpServer.sendErrorReply ( s , 500 , mstrerror(g_errno) );
+		return g_httpServer.sendDynamicPage ( s, sb.getBufStart(), sb.length(), -1, false, "text/plain" );
+	}
+
+	g_pages.printAdminTop ( &sb , s , r );
+
+	// the sampling profiler is cheap enough to not need m_profilingEnabled
+	if ( stopSampling ) {
+		g_samplingProfiler.stop();
+	} else if ( startSampling ) {
+		int32_t intervalUS = r->getLong ( "sinterval" , SamplingProfiler::s_defaultIntervalUS );
+		if ( ! g_samplingProfiler.start ( intervalUS ) )
+			sb.safePrintf("<font color=#ff0000><b>Could not start the sampling profiler: %s</b></font><br>",
+				      mstrerror(g_errno));
+	} else if ( clearSampling ) {
+		g_samplingProfiler.clear();
 	}
+	g_samplingProfiler.printStatus ( &sb );
 
 	if (!g_conf.m_profilingEnabled) {
 		sb.safePrintf("<font color=#ff0000><b><center>"
@@ -106,6 +136,8 @@ bool sendPageProfiler ( TcpSocket *s , HttpRequest *r ) {
 				g_profiler.m_ipBuf.purge();
 			}
 		} else if (startRt) {
+			// they share SIGPROF
+			g_samplingProfiler.stop();
 			g_profiler.startRealTimeProfiler();
 		}
 				
@@ -0,0 +1,156 @@
+#include "QueryAdmission.h"
+#include "ScopedLock.h"
+#include "SafeBuf.h"
+#include "GbFormat.h"
+#include "Pages.h"       //TABLE_STYLE etc.
+#include "Conf.h"
+#include "Log.h"
+#include "fctypes.h"
+#include <math.h>
+
+
+QueryAdmission g_queryAdmission;
+
+// weight of a new sample
+static const double s_alpha = 0.05;
+// without samples for this long the average starts decaying
+static const int64_t s_idleMS = 1000;
+// and halves every this long
+static const int64_t s_halfLifeMS = 2000;
+
+
+double QueryAdmission::DecayingAverage::get(int64_t nowMS) const {
+	int64_t idle = nowMS - m_lastUpdateMS - s_idleMS;
+	if(idle <= 0)
+		return m_value;
+	return m_value * pow(0.5, (double)idle / s_halfLifeMS);
+}
+
+void QueryAdmission::DecayingAverage::add(double v, int64_t nowMS) {
+	double old = get(nowMS);
+	m_value = old + (v - old) * s_alpha;
+	m_lastUpdateMS = nowMS;
+}
+
+
+QueryAdmission::QueryAdmission()
+  : m_mtx() {
+	m_queueUS.m_value = 0;
+	m_queueUS.m_lastUpdateMS = 0;
+	m_serviceUS.m_value = 0;
+	m_serviceUS.m_lastUpdateMS = 0;
+}
+
+
+bool QueryAdmission::isQueryJob(thread_type_t tt) {
+	switch(tt) {
+		case thread_type_query_coordinator:
+		case thread_type_query_read:
+		case thread_type_query_constrain:
+		case thread_type_query_merge:
+		case thread_type_query_intersect:
+		case thread_type_query_summary:
+			return true;
+		default:
+			return false;
+	}
+}
+
+
+const char *QueryAdmission::getDecisionName(query_admission_t decision) {
+	switch(decision) {
+		case query_admit:   return "admitted";
+		case query_degrade: return "degraded";
+		case query_shed:    return "shed";
+		default:            return "?";
+	}
+}
+
+const char *QueryAdmission::getPointName(query_admission_point_t point) {
+	switch(point) {
+		case qadmit_msg40: return "msg40";
+		case qadmit_msg39: return "msg39";
+		default:           return "?";
+	}
+}
+
+
+void QueryAdmission::addJobQueueTime(uint64_t us) {
+	ScopedLock sl(m_mtx);
+	m_queueUS.add(us, gettimeofdayInMilliseconds());
+}
+
+void QueryAdmission::addServiceTime(uint64_t us) {
+	ScopedLock sl(m_mtx);
+	m_serviceUS.add(us, gettimeofdayInMilliseconds());
+}
+
+
+// . the msg39 time already includes the queueing of its jobs but lags
+//   behind, so the current job queue time is added on top
+int64_t QueryAdmission::getPredictedMS() {
+	int64_t now = gettimeofdayInMilliseconds();
+	ScopedLock sl(m_mtx);
+	return (int64_t)((m_queueUS.get(now) + m_serviceUS.get(now)) / 1000);
+}
+
+
+query_admission_t QueryAdmission::admit(query_admission_point_t point, int64_t budgetMS, int32_t niceness) {
+	query_admission_t decision = query_admit;
+
+	if(g_conf.m_queryAdmissionControl) {
+		if(budgetMS <= 0)
+			budgetMS = g_conf.m_msg40_msg39_timeout;
+		if(niceness > 0)
+			budgetMS /= 2;
+
+		if(budgetMS > 0) {
+			int64_t predicted = getPredictedMS();
+			if(predicted > budgetMS)
+				decision = query_shed;
+			else if(predicted * 100 > budgetMS * g_conf.m_queryDegradePercent)
+				decision = query_degrade;
+
+			if(decision != query_admit)
+				log(LOG_DEBUG, "query: admission: %s query at %s, predicted %" PRId64 "ms, budget %" PRId64 "ms",
+				    getDecisionName(decision), getPointName(point), predicted, budgetMS);
+		}
+	}
+
+	m_counters[point][decision].add();
+	return decision;
+}
+
+
+void QueryAdmission::printStats(SafeBuf *sb, char format) {
+	int64_t predicted = getPredictedMS();
+
+	if(format == FORMAT_JSON) {
+		sb->safePrintf("\t\"queryAdmission\":{\"enabled\":%s, \"predictedMs\":%" PRId64,
+		               g_conf.m_queryAdmissionControl ? "true" : "false", predicted);
+		for(int32_t p = 0; p < qadmit_end; p++) {
+			sb->safePrintf(", \"%s\":{", getPointName((query_admission_point_t)p));
+			for(int32_t d = 0; d < query_admission_end; d++)
+				sb->safePrintf("%s\"%s\":%" PRIu64, d ? ", " : "", getDecisionName((query_admission_t)d),
+				               m_counters[p][d].get());
+			sb->safePrintf("}");
+		}
+		sb->safePrintf("},\n");
+		return;
+	}
+
+	sb->safePrintf("<table %s>\n"
+	               "<tr class=hdrow><td colspan=4><center><b>Query Admission</b> (%s, predicted %" PRId64 " ms)</center></td></tr>\n"
+	               "<tr bgcolor=#%s><td></td>",
+	               TABLE_STYLE, g_conf.m_queryAdmissionControl ? "enabled" : "disabled", predicted, DARK_BLUE);
+	for(int32_t d = 0; d < query_admission_end; d++)
+		sb->safePrintf("<td><b>%s</b></td>", getDecisionName((query_admission_t)d));
+	sb->safePrintf("</tr>\n");
+	for(int32_t p = 0; p < qadmit_end; p++) {
+		sb->safePrintf("<tr bgcolor=#%s><td>%s</td>", LIGHT_BLUE, getPointName((query_admission_point_t)p));
+		for(int32_t d = 0; d < query_admission_end; d++)
+			sb->safePrintf("<td>%" PRIu64 "</td>", m_counters[p][d].get());
+		sb->safePrintf("</tr>\n");
+	}
+	sb->safePrintf("</table><br>\n");
+}
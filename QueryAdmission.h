@@ -0,0 +1,78 @@
+#ifndef GB_QUERYADMISSION_H
+#define GB_QUERYADMISSION_H
+
+#include "GbMutex.h"
+#include "Metrics.h"
+#include "JobScheduler.h"
+#include <inttypes.h>
+
+class SafeBuf;
+
+
+enum query_admission_t {
+	query_admit,
+	query_degrade,   // run it cheaper
+	query_shed,      // reject it with EQUERYSHED
+	query_admission_end
+};
+
+// where the decision is made, counted separately
+enum query_admission_point_t {
+	qadmit_msg40,    // the host that got the query from the user
+	qadmit_msg39,    // each shard
+	qadmit_end
+};
+
+
+// . host-wide admission control for queries
+// . predicts when a new query would complete from the recent queue time of
+//   the thread_type_query_* jobs and the recent msg39 time, and sheds or
+//   degrades it if that is past its deadline. under overload some queries
+//   then stay fast instead of all of them getting slow together
+class QueryAdmission {
+public:
+	QueryAdmission();
+
+	// . budgetMS is the time the query may take, <=0 for the default
+	// . low priority (niceness>0) queries get half the budget so they
+	//   are shed first
+	query_admission_t admit(query_admission_point_t point, int64_t budgetMS, int32_t niceness);
+
+	// queue time of a query job, from JobScheduler
+	void addJobQueueTime(uint64_t us);
+	// msg39 time from request to reply
+	void addServiceTime(uint64_t us);
+
+	// predicted milliseconds until a query admitted now completes
+	int64_t getPredictedMS();
+
+	const MetricCounter *getCounter(query_admission_point_t point, query_admission_t decision) const {
+		return &m_counters[point][decision];
+	}
+
+	void printStats(SafeBuf *sb, char format);
+
+	static bool isQueryJob(thread_type_t tt);
+	static const char *getDecisionName(query_admission_t decision);
+	static const char *getPointName(query_admission_point_t point);
+
+private:
+	// . moving average that decays towards zero when samples stop coming
+	//   in, so shedding everything does not keep the prediction high
+	struct DecayingAverage {
+		double  m_value;
+		int64_t m_lastUpdateMS;
+		double get(int64_t nowMS) const;
+		void add(double v, int64_t nowMS);
+	};
+
+	GbMutex m_mtx;
+	DecayingAverage m_queueUS;
+	DecayingAverage m_serviceUS;
+
+	MetricCounter m_counters[qadmit_end][query_admission_end];
+};
+
+extern QueryAdmission g_queryAdmission;
+
+#endif // GB_QUERYADMISSION_H
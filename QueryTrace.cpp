@@ -0,0 +1,216 @@
+#include "QueryTrace.h"
+#include "SafeBuf.h"
+#include "GbFormat.h"
+#include "GbMutex.h"
+#include "ScopedLock.h"
+#include "Hostdb.h"
+#include "Pages.h"       //TABLE_STYLE etc.
+#include "Errno.h"
+#include "Conf.h"
+#include "Log.h"
+#include "fctypes.h"
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+
+static const char * const s_stageNames[qstage_end] = {
+	"total",
+	"msg3a_fanout",
+	"msg39_total",
+	"msg39_lists",
+	"msg39_intersect",
+	"msg39_cluster",
+	"msg20_summaries",
+	"msg20_summary",
+	"url_classification"
+};
+
+const char *getQueryStageName(query_stage_t stage) {
+	if(stage < 0 || stage >= qstage_end)
+		return "unknown";
+	return s_stageNames[stage];
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// aggregates
+
+static LatencyHistogram s_stageHistograms[qstage_end];
+
+// the slowest traces since startup or resetStats(), slowest first
+static std::vector<QueryTrace> s_slowest;
+static GbMutex s_mtxSlowest;
+
+static std::atomic<uint32_t> s_traceSeq(0);
+
+
+void QueryTrace::registerStageTime(query_stage_t stage, uint64_t us) {
+	s_stageHistograms[stage].add(us);
+}
+
+const LatencyHistogram *QueryTrace::getHistogram(query_stage_t stage) {
+	return &s_stageHistograms[stage];
+}
+
+void QueryTrace::resetStats() {
+	for(int32_t i = 0; i < qstage_end; i++)
+		s_stageHistograms[i].reset();
+	ScopedLock sl(s_mtxSlowest);
+	s_slowest.clear();
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// QueryTrace
+
+QueryTrace::QueryTrace() {
+	memset(this, 0, sizeof(*this));
+	m_slowestHostId = -1;
+}
+
+void QueryTrace::start(const char *query) {
+	memset(m_stageUS, 0, sizeof(m_stageUS));
+	m_startUS = getMonotonicMicroseconds();
+	m_startTime = gettimeofdayInMilliseconds();
+	m_errno = 0;
+	m_slowestHostId = -1;
+	// host id, time and a sequence number so it is unique in the cluster
+	m_traceId = ((int64_t)(g_hostdb.m_myHostId & 0xffff) << 48) |
+	            ((m_startTime & 0xffffff) << 24) |
+	            (s_traceSeq++ & 0xffffff);
+	if(query)
+		strncpy(m_query, query, sizeof(m_query) - 1);
+	m_query[sizeof(m_query) - 1] = '\0';
+	m_started = true;
+}
+
+void QueryTrace::addStageTime(query_stage_t stage, int64_t us) {
+	if(us < 0) us = 0;
+	uint64_t sum = (uint64_t)m_stageUS[stage] + us;
+	m_stageUS[stage] = sum > 0xffffffff ? 0xffffffff : (uint32_t)sum;
+}
+
+void QueryTrace::addRemoteStageTimes(const uint32_t *stageUS, int32_t hostId) {
+	if(stageUS[qstage_msg39_total] > m_stageUS[qstage_msg39_total])
+		m_slowestHostId = hostId;
+	for(int32_t i = 0; i < qstage_end; i++) {
+		if(stageUS[i] > m_stageUS[i])
+			m_stageUS[i] = stageUS[i];
+	}
+}
+
+void QueryTrace::finish(int32_t errorCode) {
+	if(!m_started)
+		return;
+	m_started = false;
+	m_errno = errorCode;
+	addStageTime(qstage_total, getMonotonicMicroseconds() - m_startUS);
+
+	// remote stages were registered as their replies came in
+	registerStageTime(qstage_total, m_stageUS[qstage_total]);
+	if(m_stageUS[qstage_msg3a_fanout])
+		registerStageTime(qstage_msg3a_fanout, m_stageUS[qstage_msg3a_fanout]);
+	if(m_stageUS[qstage_msg20_summaries])
+		registerStageTime(qstage_msg20_summaries, m_stageUS[qstage_msg20_summaries]);
+	if(m_stageUS[qstage_url_classification])
+		registerStageTime(qstage_url_classification, m_stageUS[qstage_url_classification]);
+
+	if(m_stageUS[qstage_total] / 1000 >= (uint32_t)g_conf.m_logQueryTimeThreshold) {
+		SafeBuf sb;
+		for(int32_t i = 0; i < qstage_end; i++)
+			sb.safePrintf(" %s=%.1f", s_stageNames[i], m_stageUS[i] / 1000.0);
+		log(LOG_TIMING, "query: trace %016" PRIx64 " ms:%s slowest_shard_host=%" PRId32 " q=%s",
+		    m_traceId, sb.getBufStart(), m_slowestHostId, m_query);
+	}
+
+	ScopedLock sl(s_mtxSlowest);
+	if((int32_t)s_slowest.size() >= s_maxSlowest &&
+	   s_slowest.back().m_stageUS[qstage_total] >= m_stageUS[qstage_total])
+		return;
+	auto pos = std::upper_bound(s_slowest.begin(), s_slowest.end(), *this,
+	                            [](const QueryTrace &a, const QueryTrace &b) {
+		                            return a.m_stageUS[qstage_total] > b.m_stageUS[qstage_total];
+	                            });
+	s_slowest.insert(pos, *this);
+	if((int32_t)s_slowest.size() > s_maxSlowest)
+		s_slowest.pop_back();
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// printing
+
+static double toMs(uint64_t us) {
+	return us / 1000.0;
+}
+
+void QueryTrace::printStats(SafeBuf *sb, char format) {
+	ScopedLock sl(s_mtxSlowest);
+	std::vector<QueryTrace> slowest(s_slowest);
+	sl.unlock();
+
+	if(format == FORMAT_JSON) {
+		sb->safePrintf("\t\"queryStages\":[\n");
+		for(int32_t i = 0; i < qstage_end; i++) {
+			const LatencyHistogram &h = s_stageHistograms[i];
+			uint64_t count = h.getCount();
+			sb->safePrintf("\t\t{\"name\":\"%s\", \"count\":%" PRIu64 ", \"avgUs\":%" PRIu64 ", "
+			               "\"p50Us\":%" PRIu64 ", \"p90Us\":%" PRIu64 ", \"p99Us\":%" PRIu64 ", \"maxUs\":%" PRIu64 "}%s\n",
+			               s_stageNames[i], count, count ? h.getSum() / count : 0,
+			               h.getPercentile(50), h.getPercentile(90), h.getPercentile(99), h.getMax(),
+			               i + 1 < qstage_end ? "," : "");
+		}
+		sb->safePrintf("\t],\n");
+
+		sb->safePrintf("\t\"slowestQueries\":[\n");
+		for(size_t j = 0; j < slowest.size(); j++) {
+			const QueryTrace &t = slowest[j];
+			sb->safePrintf("\t\t{\"traceId\":\"%016" PRIx64 "\", \"time\":%" PRId64 ", \"error\":%" PRId32 ", "
+			               "\"slowestShardHostId\":%" PRId32 ", \"query\":\"",
+			               t.m_traceId, t.m_startTime / 1000, t.m_errno, t.m_slowestHostId);
+			sb->jsonEncode(t.m_query);
+			sb->safePrintf("\"");
+			for(int32_t i = 0; i < qstage_end; i++)
+				sb->safePrintf(", \"%sUs\":%" PRIu32, s_stageNames[i], t.m_stageUS[i]);
+			sb->safePrintf("}%s\n", j + 1 < slowest.size() ? "," : "");
+		}
+		sb->safePrintf("\t]\n");
+		return;
+	}
+
+	sb->safePrintf("<table %s>\n"
+	               "<tr class=hdrow><td colspan=7><center><b>Query Stages</b> (ms)</center></td></tr>\n"
+	               "<tr bgcolor=#%s><td><b>stage</b></td><td><b>count</b></td><td><b>avg</b></td>"
+	               "<td><b>p50</b></td><td><b>p90</b></td><td><b>p99</b></td><td><b>max</b></td></tr>\n",
+	               TABLE_STYLE, DARK_BLUE);
+	for(int32_t i = 0; i < qstage_end; i++) {
+		const LatencyHistogram &h = s_stageHistograms[i];
+		uint64_t count = h.getCount();
+		sb->safePrintf("<tr bgcolor=#%s><td>%s</td><td>%" PRIu64 "</td><td>%.2f</td>"
+		               "<td>%.2f</td><td>%.2f</td><td>%.2f</td><td>%.2f</td></tr>\n",
+		               LIGHT_BLUE, s_stageNames[i], count, count ? toMs(h.getSum() / count) : 0.0,
+		               toMs(h.getPercentile(50)), toMs(h.getPercentile(90)), toMs(h.getPercentile(99)),
+		               toMs(h.getMax()));
+	}
+	sb->safePrintf("</table><br>\n");
+
+	sb->safePrintf("<table %s>\n"
+	               "<tr class=hdrow><td colspan=%d><center><b>Slowest Queries</b> (ms)</center></td></tr>\n"
+	               "<tr bgcolor=#%s><td><b>trace id</b></td><td><b>error</b></td>",
+	               TABLE_STYLE, qstage_end + 4, DARK_BLUE);
+	for(int32_t i = 0; i < qstage_end; i++)
+		sb->safePrintf("<td><b>%s</b></td>", s_stageNames[i]);
+	sb->safePrintf("<td><b>slowest shard host</b></td><td><b>query</b></td></tr>\n");
+	for(size_t j = 0; j < slowest.size(); j++) {
+		const QueryTrace &t = slowest[j];
+		sb->safePrintf("<tr bgcolor=#%s><td>%016" PRIx64 "</td><td>%s</td>",
+		               LIGHT_BLUE, t.m_traceId, t.m_errno ? mstrerror(t.m_errno) : "");
+		for(int32_t i = 0; i < qstage_end; i++)
+			sb->safePrintf("<td>%.2f</td>", toMs(t.m_stageUS[i]));
+		sb->safePrintf("<td>%" PRId32 "</td><td>", t.m_slowestHostId);
+		sb->htmlEncode(t.m_query);
+		sb->safePrintf("</td></tr>\n");
+	}
+	sb->safePrintf("</table>\n");
+}
@@ -0,0 +1,72 @@
+#ifndef GB_QUERYTRACE_H
+#define GB_QUERYTRACE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "Metrics.h"     //LatencyHistogram
+
+class SafeBuf;
+
+// . stages of a search that we time
+// . the msg39 and msg20 stages are measured on the host doing the work and
+//   returned in Msg39Reply/Msg20Reply, the rest on the host running Msg40
+enum query_stage_t {
+	qstage_total = 0,             // whole query, Msg40 start to reply
+	qstage_msg3a_fanout,          // Msg3a sending to all shards until all replied
+	qstage_msg39_total,           // shard: request received until reply sent
+	qstage_msg39_lists,           // shard: Msg2 termlist reads
+	qstage_msg39_intersect,       // shard: PosdbTable intersection
+	qstage_msg39_cluster,         // shard: Msg51 clusterdb lookups and clustering
+	qstage_msg20_summaries,       // Msg40 getting all summaries
+	qstage_msg20_summary,         // one summary on the host of the docid
+	qstage_url_classification,    // realtime url classification of the results
+	qstage_end
+};
+
+const char *getQueryStageName(query_stage_t stage);
+
+
+// . per-query trace context, one lives in each Msg40
+// . the trace id is passed along in Msg39Request/Msg20Request so the
+//   log lines of the shards can be matched up with the query
+class QueryTrace {
+public:
+	QueryTrace();
+
+	void start(const char *query);
+	// record histograms and maybe keep us as one of the slowest
+	void finish(int32_t errorCode);
+
+	bool isStarted() const { return m_started; }
+	int64_t getTraceId() const { return m_traceId; }
+
+	// stage done on this host, accumulates over Msg40 re-calls
+	void addStageTime(query_stage_t stage, int64_t us);
+	// . stage times from a shard or summary reply
+	// . the trace keeps the slowest of them
+	void addRemoteStageTimes(const uint32_t *stageUS, int32_t hostId);
+
+	uint32_t getStageTime(query_stage_t stage) const { return m_stageUS[stage]; }
+
+	// . aggregates over all queries since startup or resetStats()
+	static void registerStageTime(query_stage_t stage, uint64_t us);
+	static const LatencyHistogram *getHistogram(query_stage_t stage);
+	static void resetStats();
+
+	// . print the stage histograms and the slowest traces
+	// . format is FORMAT_HTML or FORMAT_JSON
+	static void printStats(SafeBuf *sb, char format);
+
+	static const int32_t s_maxSlowest = 20;
+
+	int64_t  m_traceId;
+	int64_t  m_startUS;
+	int64_t  m_startTime;     // wall clock, ms
+	int32_t  m_errno;
+	int32_t  m_slowestHostId; // host of the slowest msg39 reply
+	uint32_t m_stageUS[qstage_end];
+	char     m_query[128];
+	bool     m_started;
+};
+
+#endif // GB_QUERYTRACE_H
@@ -12,6 +12,8 @@
 #include "SpiderColl.h"
 #include "Doledb.h"
 #include "Linkdb.h"
+#include "Anchordb.h"
+#include "Simhashdb.h"
 #include "Collectiondb.h"
 #include "hash.h"
 #include "Stats.h"
@@ -142,6 +144,7 @@ bool Rdb::init(const char *dbname,
 		case RDB2_SPIDERDB2_DEPRECATED:
 		case RDB_LINKDB:
 		case RDB2_LINKDB2:
+		case RDB_ANCHORDB:
 			m_pageSize = GB_INDEXDB_PAGE_SIZE;
 			break;
 		// Not a real rdb: case RDB_SPIDERDB_SQLITE:
@@ -1066,6 +1069,8 @@ void attemptMergeAll() {
 			RDB_LINKDB,
 			RDB_SPIDERDB_DEPRECATED,
 			RDB_CLUSTERDB,
+			RDB_ANCHORDB,
+			RDB_SIMHASHDB,
 			// also try to merge on rdbs being rebuilt
 			RDB2_POSDB2,
 			RDB2_TITLEDB2,
@@ -1131,6 +1136,8 @@ bool Rdb::addList(collnum_t collnum, RdbList *list, bool checkForRoom) {
 	       m_rdbId == RDB_POSDB      ||
 	       m_rdbId == RDB_CLUSTERDB  ||
 	       m_rdbId == RDB_LINKDB     ||
+	       m_rdbId == RDB_ANCHORDB   ||
+	       m_rdbId == RDB_SIMHASHDB  ||
 	       m_rdbId == RDB_DOLEDB     ||
 	       m_rdbId == RDB_SPIDERDB_DEPRECATED ) ) {
 
@@ -1769,6 +1776,8 @@ Rdb *getRdbFromId ( rdbid_t rdbId ) {
 		case RDB_DOLEDB: return g_doledb.getRdb();
 		case RDB_CLUSTERDB: return g_clusterdb.getRdb();
 		case RDB_LINKDB: return g_linkdb.getRdb();
+		case RDB_ANCHORDB: return g_anchordb.getRdb();
+		case RDB_SIMHASHDB: return g_simhashdb.getRdb();
 
 		case RDB2_POSDB2: return g_posdb2.getRdb();
 		case RDB2_TITLEDB2: return g_titledb2.getRdb();
@@ -1790,6 +1799,8 @@ rdbid_t getIdFromRdb ( Rdb *rdb ) {
 	if ( rdb == g_doledb.getRdb    () ) return RDB_DOLEDB;
 	if ( rdb == g_clusterdb.getRdb () ) return RDB_CLUSTERDB;
 	if ( rdb == g_linkdb.getRdb    () ) return RDB_LINKDB;
+	if ( rdb == g_anchordb.getRdb  () ) return RDB_ANCHORDB;
+	if ( rdb == g_simhashdb.getRdb () ) return RDB_SIMHASHDB;
 	if ( rdb == g_posdb2.getRdb   () ) return RDB2_POSDB2;
 	if ( rdb == g_tagdb2.getRdb     () ) return RDB2_TAGDB2;
 	if ( rdb == g_titledb2.getRdb   () ) return RDB2_TITLEDB2;
@@ -1829,12 +1840,14 @@ char getKeySizeFromRdbId(rdbid_t rdbId) {
 			return sizeof(key144_t); // 18
 		case RDB_LINKDB:
 		case RDB2_LINKDB2:
+		case RDB_ANCHORDB:
 			return sizeof(key224_t); // 28
 		case RDB_TITLEDB:
 		case RDB2_TITLEDB2:
 		case RDB_CLUSTERDB:
 		case RDB2_CLUSTERDB2:
 		case RDB_DOLEDB:
+		case RDB_SIMHASHDB:
 			return sizeof(key96_t); // 12
 		case RDB_SITEDEFAULTPAGETEMPERATURE:
 			return 8; //fake
@@ -1867,7 +1880,8 @@ int32_t getDataSizeFromRdbId ( rdbid_t rdbId ) {
 				  i == RDB_TAGDB   ||
 				  i == RDB_SPIDERDB_DEPRECATED ||
 				  i == RDB_SPIDERDB_SQLITE ||
-				  i == RDB_DOLEDB )
+				  i == RDB_DOLEDB ||
+				  i == RDB_ANCHORDB )
 				ds = -1;
 			else if ( i == RDB2_POSDB2 ||
 				  i == RDB2_CLUSTERDB2 ||
@@ -1878,6 +1892,8 @@ int32_t getDataSizeFromRdbId ( rdbid_t rdbId ) {
 				  i == RDB2_SPIDERDB2_DEPRECATED ||
 				  i == RDB2_SPIDERDB2_SQLITE )
 				ds = -1;
+			else if ( i == RDB_SIMHASHDB )
+				ds = 8;
 			else if ( i == RDB_SITEDEFAULTPAGETEMPERATURE )
 				ds = 4+4; //fake
 			else {
@@ -1904,40 +1920,6 @@ const char *getDbnameFromId(rdbid_t rdbId) {
 	}
 }
 
-
-bool initialiseAllPrimaryRdbs() {
-	if(!g_posdb.init()) {
-		log( LOG_ERROR, "db: Posdb init failed." );
-		return false;
-	}
-	if(!g_titledb.init()) {
-		log( LOG_ERROR, "db: Titledb init failed." );
-		return false;
-	}
-	if(!g_tagdb.init()) {
-		log( LOG_ERROR, "db: Tagdb init failed." );
-		return false;
-	}
-	if(!g_spiderdb.init()) {
-		log( LOG_ERROR, "db: Spiderdb init failed." );
-		return false;
-	}
-	if(!g_doledb.init()) {
-		log( LOG_ERROR, "db: Doledb init failed." );
-		return false;
-	}
-	if(!g_clusterdb.init()   ) {
-		log( LOG_ERROR, "db: Clusterdb init failed." );
-		return false;
-	}
-	if(!g_linkdb.init()) {
-		log( LOG_ERROR, "db: Linkdb init failed." );
-		return false;
-	}
-	return true;
-}
-
-
 // get the RdbBase class for an rdbId and collection name
 RdbBase *getRdbBase(rdbid_t rdbId, collnum_t collnum) {
 	Rdb *rdb = getRdbFromId ( rdbId );
@@ -8,6 +8,8 @@
 #include "Sections.h"
 #include "Spider.h"
 #include "Linkdb.h"
+#include "Anchordb.h"
+#include "Simhashdb.h"
 #include "Collectiondb.h"
 #include "RdbMerge.h"
 #include "Repair.h"
@@ -678,6 +680,31 @@ bool RdbBase::cleanupAnyChrashedMerges(bool doDryrun, bool *anyCrashedMerges) {
 		}
 	}
 
+	//Remove mergedir/mergeseg*.<dbname>*.dat segments of a partitioned merge. Only the
+	//target file is resumed, the segments are copied into it once all partitions are done
+	{
+		Dir dir;
+		dir.set(m_mergeDirName);
+		if(!dir.open())
+			return false;
+		while(const char *filename = dir.getNextFilename(RDBMERGE_SEGMENT_PREFIX "*")) {
+			const char *targetName = strchr(filename,'.');
+			if(!targetName || strncmp(targetName+1,m_dbname,m_dbnameLen)!=0)
+				continue;
+			*anyCrashedMerges = true;
+			char fullname[1024];
+			sprintf(fullname,"%s/%s",m_mergeDirName,filename);
+			log(LOG_DEBUG,"Removing %s", fullname);
+			if(!doDryrun) {
+				if(::unlink(fullname)!=0) {
+					g_errno = errno;
+					log(LOG_ERROR,"unlink(%s) failed with errno=%d (%s)", fullname, errno, strerror(errno));
+					return false;
+				}
+			}
+		}
+	}
+
 	log(LOG_DEBUG, "Cleaned up any unfinished merges of %s %s", m_coll, m_dbname);
 	return true;
 }
@@ -959,6 +986,10 @@ int32_t RdbBase::addFile ( bool isNew, int32_t fileId, int32_t fileId2, int32_t
 	char mapName[1024];
 	generateMapFilename(mapName,sizeof(mapName),fileId,fileId2,0,-1);
 	m->set(dirName, mapName, m_fixedDataSize, m_useHalfKeys, m_ks, m_pageSize);
+	// posdb maps know where each termlist is and how many docs it has
+	if ( m_rdb->getRdbId() == RDB_POSDB || m_rdb->getRdbId() == RDB2_POSDB2 ) {
+		m->setBuildTermDict();
+	}
 	if ( ! isNew && !isInMergeDir && ! m->readMap ( f ) ) {
 		// if out of memory, do not try to regen for that
 		if ( g_errno == ENOMEM ) {
@@ -1255,6 +1286,10 @@ static int32_t getMaxLostPositivesPercentage(rdbid_t rdbId) {
 		case RDB_LINKDB:
 		case RDB2_LINKDB2:
 			return g_conf.m_linkdbMaxLostPositivesPercentage;
+		case RDB_ANCHORDB:
+			return g_conf.m_anchordbMaxLostPositivesPercentage;
+		case RDB_SIMHASHDB:
+			return g_conf.m_simhashdbMaxLostPositivesPercentage;
 		case RDB_NONE:
 		case RDB_END:
 		default:
@@ -2413,6 +2448,26 @@ int64_t RdbBase::estimateListSize(const char *startKey, const char *endKey, char
 	return totalBytes;
 }
 
+bool RdbBase::getTermDictNumDocs(int64_t termId, int64_t *numDocs) const {
+	ScopedLock sl(m_mtxFileInfo);
+	int64_t total = 0;
+	for ( int32_t i = 0 ; i < m_numFiles ; i++ ) {
+		if ( ! m_fileInfo[i].m_allowReads ) {
+			continue;
+		}
+		const RdbMap *map = m_fileInfo[i].m_map;
+		if ( ! map->hasTermDict() ) {
+			return false;
+		}
+		const RdbMapTermDictEntry *e = map->getTermDictEntry(termId);
+		if ( e ) {
+			total += e->m_numDocs;
+		}
+	}
+	*numDocs = total;
+	return true;
+}
+
 int64_t RdbBase::estimateNumGlobalRecs() const {
 	return getNumTotalRecs() * g_hostdb.m_numShards;
 }
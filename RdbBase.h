@@ -117,6 +117,10 @@ class RdbBase {
 	int64_t estimateListSize(const char *startKey, const char *endKey, char *maxKey,
 	                         int64_t oldTruncationLimit) const;
 
+	// . number of docs with the posdb term in the readable files
+	// . returns false if a file has no term dictionary
+	bool getTermDictNumDocs(int64_t termId, int64_t *numDocs) const;
+
 	// positive minus negative
 	int64_t getNumTotalRecs() const;
 
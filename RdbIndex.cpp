@@ -420,6 +420,17 @@ void RdbIndex::addRecord_unlocked(const char *key) {
 	}
 }
 
+void RdbIndex::addIndex(RdbIndex *other) {
+	docidsconst_ptr_t docIds = other->mergePendingDocIds();
+
+	ScopedLock sl(m_pendingDocIdsMtx);
+	m_needToWrite = true;
+
+	// pending docids are stable sorted so these are merged in after ours
+	m_pendingDocIds->insert(m_pendingDocIds->end(), docIds->begin(), docIds->end());
+	m_prevPendingDocId = MAX_DOCID + 1;
+}
+
 void RdbIndex::printIndex() {
 	auto docIds = getDocIds();
 	for (auto it = docIds->begin(); it != docIds->end(); ++it) {
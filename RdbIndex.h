@@ -72,6 +72,12 @@ public:
 
 	void addRecord(const char *key);
 
+	// . add the records of an index of data that follows ours in the data
+	//   file, they win over ours like later records do
+	void addIndex(RdbIndex *other);
+
+	docidsconst_ptr_t mergePendingDocIds(bool finalWrite = false);
+
 	// key format
 	// ........ ........ ........ dddddddd  d = docId
 	// dddddddd dddddddd dddddddd dddddd.Z  Z = delBit
@@ -91,7 +97,6 @@ private:
 	bool writeIndex2(bool finalWrite);
 	bool readIndex2();
 
-	docidsconst_ptr_t mergePendingDocIds(bool finalWrite = false);
 	docidsconst_ptr_t mergePendingDocIds_unlocked(bool finalWrite = false);
 
 	void swapDocIds(docidsconst_ptr_t docIds);
@@ -7,8 +7,28 @@
 #include "Mem.h"
 #include "Errno.h"
 #include "hash.h"
+#include "Posdb.h"
 #include <fcntl.h>
 #include <unistd.h>
+#include <vector>
+#include <algorithm>
+
+
+static const char s_mapMagic[8] = { 'G','B','R','D','B','M','A','P' };
+
+static_assert(sizeof(RdbMapFileHeader) <= RDBMAP_HEADER_SIZE, "RdbMapFileHeader does not fit in RDBMAP_HEADER_SIZE");
+
+// the offsets array follows the keys array, aligned to 8 bytes
+static int64_t getOffsetsArrayStart(int32_t numPages, int32_t ks) {
+	int64_t keysSize = (int64_t)numPages * ks;
+	return RDBMAP_HEADER_SIZE + ((keysSize + 7) & ~7LL);
+}
+
+// the term dictionary follows the offsets array, aligned to 8 bytes
+static int64_t getTermDictStart(int32_t numPages, int32_t ks) {
+	int64_t offsetsEnd = getOffsetsArrayStart(numPages, ks) + (int64_t)numPages * 2;
+	return (offsetsEnd + 7) & ~7LL;
+}
 
 
 RdbMap::RdbMap() {
@@ -18,6 +38,9 @@ RdbMap::RdbMap() {
 	m_newPagesPerSegment = 0;
 	m_keys = NULL;
 	m_offsets = NULL;
+	m_numMappedSegments = 0;
+	m_mappedTermDict = NULL;
+	m_numMappedTermDictEntries = 0;
 
 	// Coverity	
 	m_fixedDataSize = 0;
@@ -25,6 +48,7 @@ RdbMap::RdbMap() {
 	m_ks = 0;
 	m_pageSize = 0;
 	m_pageSizeBits = 0;
+	m_buildTermDict = false;
 
 	reset();
 }
@@ -95,12 +119,19 @@ void RdbMap::reset ( ) {
 	}
 
 	for ( int32_t i = 0 ; i < m_numSegments; i++ ) {
-		mfree(m_keys[i],m_ks *pps,"RdbMap");
-		mfree(m_offsets[i], 2*pps,"RdbMap");
+		// mmap'd segments go away with the mapping
+		if ( i >= m_numMappedSegments ) {
+			mfree(m_keys[i],m_ks *pps,"RdbMap");
+			mfree(m_offsets[i], 2*pps,"RdbMap");
+		}
 		// set to NULL so we know if accessed illegally
 		m_keys   [i] = NULL;
 		m_offsets[i] = NULL;
 	}
+	m_numMappedSegments = 0;
+	m_mappedTermDict = NULL;
+	m_numMappedTermDictEntries = 0;
+	m_mappedFile.close();
 
 	// the ptrs themselves are now a dynamic array to save mem
 	// when we have thousands of collections
@@ -127,9 +158,85 @@ void RdbMap::reset ( ) {
 	m_badKeys     = 0;
 	m_needVerify  = false;
 
+	m_termDict.clear();
+	m_termDict.shrink_to_fit();
+	// an empty map has a complete (empty) dictionary
+	m_hasTermDict = m_buildTermDict;
+	m_termDictLastDocId = -1;
+
 	m_file.reset();
 }
 
+void RdbMap::setBuildTermDict ( ) {
+	// termlists are posdb termlists
+	if ( m_ks != sizeof(posdbkey_t) ) {
+		log( LOG_LOGIC, "db: rdbmap: term dictionary requested for %s with keysize %d.", m_file.getFilename(), (int)m_ks );
+		return;
+	}
+	m_buildTermDict = true;
+	m_hasTermDict = ( m_offset == 0 );
+}
+
+// . update the dictionary with the record about to be added at m_offset
+// . posdb termlists start with a full 18 byte key, so a new termid is
+//   always on an 18 byte record
+void RdbMap::addTermDictRecord ( const char *key, int32_t recSize ) {
+	// a resumed merge adds to the dictionary it read from the map file
+	if ( m_mappedTermDict && ! unmapTermDict() ) {
+		log( LOG_WARN, "db: Dropping term dictionary of %s: %s.", m_file.getFilename(), mstrerror(g_errno) );
+		g_errno = 0;
+		m_hasTermDict = false;
+		return;
+	}
+
+	int64_t termId = Posdb::getTermId(key);
+	if ( m_termDict.empty() || m_termDict.back().m_termId != termId ) {
+		if ( ! m_termDict.empty() && m_termDict.back().m_termId > termId ) {
+			// out of order keys are logged by addRecord()
+			m_hasTermDict = false;
+			m_termDict.clear();
+			return;
+		}
+		RdbMapTermDictEntry e;
+		memset(&e, 0, sizeof(e));
+		e.m_termId = termId;
+		e.m_offset = m_offset;
+		m_termDict.push_back(e);
+		m_termDictLastDocId = -1;
+	}
+
+	RdbMapTermDictEntry &e = m_termDict.back();
+	e.m_size = m_offset + recSize - e.m_offset;
+
+	if ( KEYNEG(key) ) {
+		return;
+	}
+
+	int64_t docId = Posdb::getDocId(key);
+	if ( docId != m_termDictLastDocId ) {
+		e.m_numDocs++;
+		m_termDictLastDocId = docId;
+	}
+
+	uint8_t siteRank = Posdb::getSiteRank(key);
+	if ( siteRank > e.m_maxSiteRank ) {
+		e.m_maxSiteRank = siteRank;
+	}
+}
+
+// . binary search the dictionary in place, a mmap'd one only faults in
+//   the pages we probe
+const RdbMapTermDictEntry *RdbMap::getTermDictEntry ( int64_t termId ) const {
+	const RdbMapTermDictEntry *begin = m_mappedTermDict ? m_mappedTermDict : m_termDict.data();
+	const RdbMapTermDictEntry *end   = begin + getNumTermDictEntries();
+	const RdbMapTermDictEntry *it = std::lower_bound(begin, end, termId,
+	                                [](const RdbMapTermDictEntry &e, int64_t id) { return e.m_termId < id; });
+	if ( it == end || it->m_termId != termId ) {
+		return NULL;
+	}
+	return it;
+}
+
 
 bool RdbMap::writeMap ( bool allDone ) {
 	logTrace( g_conf.m_logTraceRdbMap, "BEGIN. filename [%s]", m_file.getFilename());
@@ -148,6 +255,13 @@ bool RdbMap::writeMap ( bool allDone ) {
 
 	log(LOG_INFO, "db: Saving %s", m_file.getFilename());
 
+	// we are about to truncate the file the segments are mapped from
+	if ( ! unmapSegments() ) {
+		log(LOG_ERROR, "%s:%s: END. Could not unmap %s before writing: %s. Returning false.",
+		    __FILE__, __func__, m_file.getFilename(), mstrerror(g_errno));
+		return false;
+	}
+
 	// open a new file
 	if ( ! m_file.open ( O_RDWR | O_CREAT | O_TRUNC ) ) {
 		log(LOG_ERROR, "%s:%s: END. Could not open %s for writing: %s. Returning false.",
@@ -178,8 +292,6 @@ bool RdbMap::writeMap ( bool allDone ) {
 bool RdbMap::writeMap2 ( ) {
 	logTrace( g_conf.m_logTraceRdbMap, "BEGIN. filename [%s]", m_file.getFilename());
 	
-	// the current disk offset
-	int64_t offset = 0LL;
 	g_errno = 0;
 
 	if( g_conf.m_logTraceRdbMap ) {
@@ -189,101 +301,102 @@ bool RdbMap::writeMap2 ( ) {
 		log(LOG_DEBUG, " m_numNegativeRecs: %" PRId64, m_numNegativeRecs.load());
 		loghex(LOG_DEBUG, m_lastKey, m_ks, " m_lastKey........: (hexdump)");
 	}
-	
-	// first 8 bytes are the size of the DATA file we're mapping
-	m_file.write ( &m_offset , 8 , offset );
-	if ( g_errno )  {
-		log(LOG_ERROR, "%s:%s: Failed to write to %s (m_offset): %s",
-		    __FILE__, __func__, m_file.getFilename(), mstrerror(g_errno));
-		return false;
-	}
-	
-	offset += 8;
 
-	// when a BigFile gets chopped, keep up a start offset for it
-	m_file.write ( &m_fileStartOffset , 8 , offset );
+	// the header is padded with zeroes up to RDBMAP_HEADER_SIZE
+	char headerBuf[RDBMAP_HEADER_SIZE];
+	memset(headerBuf, 0, sizeof(headerBuf));
 
-	if ( g_errno ) {
-		log(LOG_ERROR, "%s:%s: Failed to write to %s (m_fileStartOffset): %s",
-		    __FILE__, __func__, m_file.getFilename(), mstrerror(g_errno));
-		return false;
+	RdbMapFileHeader *hdr = reinterpret_cast<RdbMapFileHeader*>(headerBuf);
+	memcpy(hdr->m_magic, s_mapMagic, sizeof(hdr->m_magic));
+	hdr->m_version         = RDBMAP_FORMAT_VERSION;
+	hdr->m_keySize         = m_ks;
+	hdr->m_pageSize        = m_pageSize;
+	hdr->m_numPages        = m_numPages;
+	hdr->m_offset          = m_offset;
+	hdr->m_fileStartOffset = m_fileStartOffset;
+	hdr->m_numPositiveRecs = m_numPositiveRecs;
+	hdr->m_numNegativeRecs = m_numNegativeRecs;
+	KEYSET(hdr->m_lastKey, m_lastKey, m_ks);
+	if ( m_hasTermDict ) {
+		hdr->m_flags              = RDBMAP_FLAG_TERMDICT;
+		hdr->m_numTermDictEntries = m_termDict.size();
 	}
-	
-	offset += 8;
 
-	// store total number of non-deleted records
-	m_file.write ( &m_numPositiveRecs , 8 , offset );
-	if ( g_errno ) {
-		log(LOG_ERROR,"%s:%s: Failed to write to %s (m_numPositiveRecs): %s",
-		    __FILE__, __func__, m_file.getFilename(), mstrerror(g_errno));
-		return false;
-	}
-
-	offset += 8;
-
-	// store total number of deleted records
-	m_file.write ( &m_numNegativeRecs , 8 , offset );
-	if ( g_errno ) {
-		log(LOG_ERROR,"%s:%s: Failed to write to %s (m_numNegativeRecs): %s",
-		    __FILE__, __func__, m_file.getFilename(), mstrerror(g_errno));
-		return false;
-	}
-
-	offset += 8;
-
-	// store last key in map
-	m_file.write ( m_lastKey , m_ks , offset );
-	if ( g_errno ) {
-		log(LOG_ERROR,"%s:%s: Failed to write to %s (m_lastKey): %s",
+	m_file.write ( headerBuf , RDBMAP_HEADER_SIZE , 0 );
+	if ( g_errno )  {
+		log(LOG_ERROR, "%s:%s: Failed to write to %s (header): %s",
 		    __FILE__, __func__, m_file.getFilename(), mstrerror(g_errno));
 		return false;
 	}
 
-	offset += m_ks;
-
 	logTrace( g_conf.m_logTraceRdbMap, "Writing %" PRId32" segments", m_numSegments);
 
 	// . now store the map itself
-	// . write the segments (keys/offsets) from the map file
+	// . all keys first, then all offsets, so both are fixed-width arrays
+	int64_t offsetsStart = getOffsetsArrayStart(m_numPages, m_ks);
 	for ( int32_t i = 0 ; i < m_numSegments ; ++i ) {
-		offset = writeSegment ( i , offset );
-		if ( offset<=0 ) {
+		int64_t keysOffset    = RDBMAP_HEADER_SIZE + (int64_t)i * PAGES_PER_SEGMENT * m_ks;
+		int64_t offsetsOffset = offsetsStart + (int64_t)i * PAGES_PER_SEGMENT * 2;
+		if ( ! writeSegment ( i , keysOffset , offsetsOffset ) ) {
 			log(LOG_ERROR, "%s:%s: Failed to write to %s (m_numSegments, segment %" PRId32"): %s",
 			    __FILE__, __func__, m_file.getFilename(), i, mstrerror(g_errno));
 			return false;
 		}
 	}
 
+	// pad the keys array so the file size matches what readMapV2() expects
+	int64_t keysEnd = RDBMAP_HEADER_SIZE + (int64_t)m_numPages * m_ks;
+	if ( keysEnd < offsetsStart && m_numPages > 0 ) {
+		char zeroes[8] = {0};
+		m_file.write ( zeroes , offsetsStart - keysEnd , keysEnd );
+		if ( g_errno ) {
+			log(LOG_ERROR, "%s:%s: Failed to write to %s (padding): %s",
+			    __FILE__, __func__, m_file.getFilename(), mstrerror(g_errno));
+			return false;
+		}
+	}
+
+	// the term dictionary goes last
+	if ( m_hasTermDict && ! m_termDict.empty() ) {
+		int64_t offsetsEnd = offsetsStart + (int64_t)m_numPages * 2;
+		int64_t dictStart  = getTermDictStart(m_numPages, m_ks);
+		if ( offsetsEnd < dictStart ) {
+			char zeroes[8] = {0};
+			m_file.write ( zeroes , dictStart - offsetsEnd , offsetsEnd );
+		}
+		if ( ! g_errno ) {
+			m_file.write ( m_termDict.data() , m_termDict.size() * sizeof(RdbMapTermDictEntry) , dictStart );
+		}
+		if ( g_errno ) {
+			log(LOG_ERROR, "%s:%s: Failed to write to %s (term dictionary): %s",
+			    __FILE__, __func__, m_file.getFilename(), mstrerror(g_errno));
+			return false;
+		}
+	}
+
 	logTrace( g_conf.m_logTraceRdbMap, "END - OK, returning true." );
 
 	return true;
 }
 
 
-int64_t RdbMap::writeSegment( int32_t seg , int64_t offset ) {
+bool RdbMap::writeSegment( int32_t seg , int64_t keysOffset , int64_t offsetsOffset ) {
 	// how many pages have we written?
 	int32_t pagesWritten = seg * PAGES_PER_SEGMENT;
 	// how many pages are left to write?
 	int32_t pagesLeft    = m_numPages - pagesWritten;
-	// if none left to write return offset now
-	if ( pagesLeft <= 0 ) return offset;
+	// if none left to write we are done
+	if ( pagesLeft <= 0 ) return true;
 	// truncate to segment's worth of pages for writing purposes
 	if ( pagesLeft > PAGES_PER_SEGMENT ) pagesLeft = PAGES_PER_SEGMENT;
-	// determine writeSize for keys
-	int32_t writeSize = pagesLeft * m_ks;
 	// write the keys segment
 	g_errno = 0;
-	m_file.write ( (char *)m_keys[seg] , writeSize , offset );
-	if ( g_errno ) return -1;//log("RdbMapFile::writeSegment: failed");
-	offset += writeSize ;
-	// determine writeSize for relative 2-byte offsets
-	writeSize = pagesLeft * 2;
-	// write the offsets of segment
-	m_file.write ( (char *)m_offsets[seg] , writeSize , offset );
-	if ( g_errno ) return -1;//log("RdbMapFile::writeSegment: failed");
-	offset += writeSize ;
-	// return the new offset
-	return offset ;
+	m_file.write ( (char *)m_keys[seg] , pagesLeft * m_ks , keysOffset );
+	if ( g_errno ) return false;
+	// write the relative 2-byte offsets of segment
+	m_file.write ( (char *)m_offsets[seg] , pagesLeft * 2 , offsetsOffset );
+	if ( g_errno ) return false;
+	return true;
 }
 
 
@@ -433,7 +546,8 @@ bool RdbMap::verifyMap ( BigFile *dataFile ) {
 		chopHead ( MAX_PART_SIZE );
 		removed++;
 	}
-	// now fix the map if it had out of order keys in it
+	// . now fix the map if it had out of order keys in it
+	// . a mmap'd map is checked too. verifyMap2() only reads it
 	bool status = verifyMap2 ( );
 	logTrace( g_conf.m_logTraceRdbMap, "END. Returning %s", status?"true":"false" );
 		
@@ -447,7 +561,7 @@ bool RdbMap::verifyMap2 ( ) {
 	char lastKey[MAX_KEY_BYTES];
 	KEYMIN(lastKey,m_ks);
 	for ( int32_t i = 0 ; i < m_numPages ; i++ ) {
-		char *k = getKeyPtr(i);
+		const char *k = getKeyPtr(i);
 		if ( KEYCMP(k,lastKey,m_ks)>=0 ) {
 			KEYSET(lastKey,k,m_ks); continue; }
 		// just bitch for now
@@ -537,6 +651,26 @@ bool RdbMap::readMap2 ( ) {
 	int64_t offset = 0;
 	g_errno = 0;
 
+	// a version 2 map starts with a magic, a legacy map with the data file size
+	int64_t mapFileSize = m_file.getFileSize();
+	if ( mapFileSize >= RDBMAP_HEADER_SIZE ) {
+		char magic[sizeof(s_mapMagic)];
+		m_file.read ( magic , sizeof(magic) , 0 );
+		if ( g_errno ) {
+			log( LOG_WARN, "db: Had error reading %s: %s.", m_file.getFilename(),mstrerror(g_errno));
+			return false;
+		}
+		if ( memcmp(magic, s_mapMagic, sizeof(s_mapMagic)) == 0 ) {
+			return readMapV2 ( mapFileSize );
+		}
+	}
+
+	// legacy maps have no term dictionary
+	m_hasTermDict = false;
+	m_termDict.clear();
+	m_mappedTermDict = NULL;
+	m_numMappedTermDictEntries = 0;
+
 	// first 8 bytes are the size of the DATA file we're mapping
 	m_file.read ( &m_offset , 8 , offset );
 	if ( g_errno ) {
@@ -597,6 +731,213 @@ bool RdbMap::readMap2 ( ) {
 	return true;
 }
 
+bool RdbMap::readMapV2 ( int64_t fileSize ) {
+	g_errno = 0;
+
+	RdbMapFileHeader hdr;
+	m_file.read ( &hdr , sizeof(hdr) , 0 );
+	if ( g_errno ) {
+		log( LOG_WARN, "db: Had error reading %s: %s.", m_file.getFilename(),mstrerror(g_errno));
+		return false;
+	}
+
+	if ( hdr.m_version != RDBMAP_FORMAT_VERSION || hdr.m_keySize != m_ks ||
+	     hdr.m_pageSize != m_pageSize || hdr.m_numPages < 0 ) {
+		log( LOG_WARN, "db: Map file %s has version=%" PRId32" keySize=%" PRId32" pageSize=%" PRId32" numPages=%" PRId32
+		     ", expected version=%d keySize=%d pageSize=%" PRId32".",
+		     m_file.getFilename(), hdr.m_version, hdr.m_keySize, hdr.m_pageSize, hdr.m_numPages,
+		     RDBMAP_FORMAT_VERSION, (int)m_ks, m_pageSize );
+		g_errno = ECORRUPTDATA;
+		return false;
+	}
+
+	int64_t offsetsStart = getOffsetsArrayStart(hdr.m_numPages, m_ks);
+	int64_t expectedSize = offsetsStart + (int64_t)hdr.m_numPages * 2;
+	bool hasTermDict = ( hdr.m_flags & RDBMAP_FLAG_TERMDICT ) && m_ks == sizeof(posdbkey_t);
+	if ( hasTermDict && hdr.m_numTermDictEntries > 0 ) {
+		expectedSize = getTermDictStart(hdr.m_numPages, m_ks) + hdr.m_numTermDictEntries * (int64_t)sizeof(RdbMapTermDictEntry);
+	}
+	if ( fileSize != expectedSize ) {
+		log( LOG_WARN, "db: Had error reading %s: Bad map size %" PRId64" for %" PRId32" pages.",
+		     m_file.getFilename(), fileSize, hdr.m_numPages );
+		g_errno = ECORRUPTDATA;
+		return false;
+	}
+
+	m_offset          = hdr.m_offset;
+	m_fileStartOffset = hdr.m_fileStartOffset;
+	m_numPositiveRecs = hdr.m_numPositiveRecs;
+	m_numNegativeRecs = hdr.m_numNegativeRecs;
+	KEYSET(m_lastKey, hdr.m_lastKey, m_ks);
+
+	// . maps without a term dictionary (legacy or other rdbs) fall back
+	//   to page estimates
+	m_termDict.clear();
+	m_mappedTermDict = NULL;
+	m_numMappedTermDictEntries = 0;
+	m_hasTermDict = hasTermDict;
+	m_termDictLastDocId = -1;
+	bool readTermDict = hasTermDict && hdr.m_numTermDictEntries > 0;
+	if ( readTermDict ) {
+		// a resumed merge keeps counting docids of the last termlist
+		// from its last key
+		m_termDictLastDocId = Posdb::getDocId(m_lastKey);
+	}
+
+	// . full segments are used straight from the mmap'd file so startup
+	//   does not have to copy them and only pages we touch are faulted in
+	// . the last segment is always read into memory since a resumed merge
+	//   may add records to it
+	// . so is the term dictionary. it has an entry per termid in the data
+	//   file so it can be far bigger than the page keys
+	int32_t numMapped = hdr.m_numPages > 0 ? (hdr.m_numPages - 1) / PAGES_PER_SEGMENT : 0;
+	if ( numMapped > 0 || readTermDict ) {
+		char path[1024];
+		snprintf(path, sizeof(path), "%s/%s", m_file.getDir(), m_file.getFilename());
+
+		// the map may span multiple part files. just read it then.
+		if ( ! m_mappedFile.open(path) || (int64_t)m_mappedFile.size() != fileSize ) {
+			log( LOG_DEBUG, "db: Could not mmap %s. Reading it instead.", path );
+			m_mappedFile.close();
+			numMapped = 0;
+		} else if ( numMapped > 0 && ! addSegmentPtr ( numMapped ) ) {
+			m_mappedFile.close();
+			return false;
+		} else {
+			m_mappedFile.advise_random();
+			char *keys = m_mappedFile.start() + RDBMAP_HEADER_SIZE;
+			int16_t *offsets = reinterpret_cast<int16_t*>(m_mappedFile.start() + offsetsStart);
+			for ( int32_t i = 0 ; i < numMapped ; i++ ) {
+				m_keys   [i] = keys + (int64_t)i * PAGES_PER_SEGMENT * m_ks;
+				m_offsets[i] = offsets + (int64_t)i * PAGES_PER_SEGMENT;
+			}
+			m_numSegments       = numMapped;
+			m_numMappedSegments = numMapped;
+			m_maxNumPages       = numMapped * PAGES_PER_SEGMENT;
+			m_numPages          = numMapped * PAGES_PER_SEGMENT;
+
+			if ( readTermDict ) {
+				m_mappedTermDict = reinterpret_cast<const RdbMapTermDictEntry*>(m_mappedFile.start() + getTermDictStart(hdr.m_numPages, m_ks));
+				m_numMappedTermDictEntries = hdr.m_numTermDictEntries;
+				readTermDict = false;
+			}
+		}
+	}
+
+	// could not map the term dictionary
+	if ( readTermDict ) {
+		try {
+			m_termDict.resize(hdr.m_numTermDictEntries);
+		} catch ( std::bad_alloc& ) {
+			log( LOG_WARN, "db: Could not allocate %" PRId64" term dictionary entries for %s.",
+			     hdr.m_numTermDictEntries, m_file.getFilename() );
+			g_errno = ENOMEM;
+			return false;
+		}
+		m_file.read ( m_termDict.data() , m_termDict.size() * sizeof(RdbMapTermDictEntry) ,
+		              getTermDictStart(hdr.m_numPages, m_ks) );
+		if ( g_errno ) {
+			log( LOG_WARN, "db: Had error reading %s: %s.", m_file.getFilename(),mstrerror(g_errno));
+			return false;
+		}
+	}
+
+	// read in the rest
+	for ( int32_t seg = numMapped ; m_numPages < hdr.m_numPages ; seg++ ) {
+		if ( ! addSegment () ) {
+			return false;
+		}
+
+		int32_t numKeys = hdr.m_numPages - m_numPages;
+		if ( numKeys > PAGES_PER_SEGMENT ) numKeys = PAGES_PER_SEGMENT;
+
+		m_file.read ( m_keys[seg] , numKeys * m_ks , RDBMAP_HEADER_SIZE + (int64_t)seg * PAGES_PER_SEGMENT * m_ks );
+		if ( g_errno ) {
+			log( LOG_WARN, "db: Had error reading %s: %s.", m_file.getFilename(),mstrerror(g_errno));
+			return false;
+		}
+
+		m_file.read ( (char *)m_offsets[seg] , numKeys * 2 , offsetsStart + (int64_t)seg * PAGES_PER_SEGMENT * 2 );
+		if ( g_errno ) {
+			log( LOG_WARN, "db: Had error reading %s: %s.", m_file.getFilename(),mstrerror(g_errno));
+			return false;
+		}
+
+		m_numPages += numKeys;
+	}
+
+	logTrace( g_conf.m_logTraceRdbMap, "Read %s: %" PRId32" pages, %" PRId32" segments mmap'd",
+	          m_file.getFilename(), m_numPages, m_numMappedSegments );
+
+	return true;
+}
+
+// . replace the mmap'd segments with heap copies
+// . returns false and sets g_errno on error
+bool RdbMap::unmapSegments ( ) {
+	if ( ! unmapTermDict() ) {
+		return false;
+	}
+
+	if ( m_numMappedSegments == 0 ) {
+		return true;
+	}
+
+	// copy everything first so we either unmap all segments or none
+	std::vector<std::pair<char*,int16_t*>> copies;
+	copies.reserve(m_numMappedSegments);
+	for ( int32_t i = 0 ; i < m_numMappedSegments ; i++ ) {
+		char    *keys    = (char*)    mmalloc ( m_ks * PAGES_PER_SEGMENT , "RdbMap" );
+		int16_t *offsets = (int16_t*) mmalloc ( 2    * PAGES_PER_SEGMENT , "RdbMap" );
+		if ( ! keys || ! offsets ) {
+			if ( keys    ) mfree ( keys    , m_ks * PAGES_PER_SEGMENT , "RdbMap" );
+			if ( offsets ) mfree ( offsets , 2    * PAGES_PER_SEGMENT , "RdbMap" );
+			for ( auto &copy : copies ) {
+				mfree ( copy.first  , m_ks * PAGES_PER_SEGMENT , "RdbMap" );
+				mfree ( copy.second , 2    * PAGES_PER_SEGMENT , "RdbMap" );
+			}
+			log( LOG_WARN, "db: Failed to allocate memory for unmapping map file %s.", m_file.getFilename() );
+			return false;
+		}
+		memcpy ( keys    , m_keys   [i] , m_ks * PAGES_PER_SEGMENT );
+		memcpy ( offsets , m_offsets[i] , 2    * PAGES_PER_SEGMENT );
+		copies.emplace_back(keys, offsets);
+	}
+
+	for ( int32_t i = 0 ; i < m_numMappedSegments ; i++ ) {
+		m_keys   [i] = copies[i].first;
+		m_offsets[i] = copies[i].second;
+	}
+
+	m_numMappedSegments = 0;
+	m_mappedFile.close();
+	return true;
+}
+
+// . replace the mmap'd term dictionary with a heap copy
+// . returns false and sets g_errno on error
+bool RdbMap::unmapTermDict ( ) {
+	if ( ! m_mappedTermDict ) {
+		return true;
+	}
+
+	try {
+		m_termDict.assign(m_mappedTermDict, m_mappedTermDict + m_numMappedTermDictEntries);
+	} catch ( std::bad_alloc& ) {
+		log( LOG_WARN, "db: Could not allocate %" PRId64" term dictionary entries for %s.",
+		     m_numMappedTermDictEntries, m_file.getFilename() );
+		g_errno = ENOMEM;
+		return false;
+	}
+
+	m_mappedTermDict = NULL;
+	m_numMappedTermDictEntries = 0;
+	if ( m_numMappedSegments == 0 ) {
+		m_mappedFile.close();
+	}
+	return true;
+}
+
 int64_t RdbMap::readSegment ( int32_t seg , int64_t offset , int32_t fileSize ) {
 	// . add a new segment for this
 	// . increments m_numSegments and increases m_maxNumPages
@@ -697,6 +1038,10 @@ bool RdbMap::addRecord ( char *key, char *rec , int32_t recSize ) {
 	// remember the lastKey in the whole file
 	KEYSET(m_lastKey,key,m_ks);
 
+	if (m_hasTermDict) {
+		addTermDictRecord(key, recSize);
+	}
+
 	// set m_numPages to the last page num we touch plus one
 	m_numPages = lastPageNum + 1;
 
@@ -739,6 +1084,111 @@ bool RdbMap::addRecord ( char *key, char *rec , int32_t recSize ) {
 	return true;
 }
 
+void RdbMap::setFirstPageOffset ( int32_t offset ) {
+	if ( m_offset != 0 || offset < 0 || offset >= m_pageSize ) {
+		log( LOG_LOGIC, "db: rdbmap: bad first page offset %" PRId32" for %s.", offset, m_file.getFilename() );
+		gbshutdownLogicError();
+	}
+
+	m_offset = offset;
+
+	// the dictionary offsets are shifted by addMap()
+	m_hasTermDict = m_buildTermDict;
+}
+
+// . the pages of "other" follow our last page, its first page is the one
+//   our data ends on. it already has the right in-page offsets
+// . the dictionary offsets are shifted by the bytes before that page
+bool RdbMap::addMap ( const RdbMap *other ) {
+	if ( other->m_ks != m_ks || other->m_pageSize != m_pageSize ) {
+		log( LOG_LOGIC, "db: rdbmap: cannot add map %s to %s.", other->m_file.getFilename(), m_file.getFilename() );
+		gbshutdownLogicError();
+	}
+
+	if ( m_reducedMem ) {
+		gbshutdownAbort(true);
+	}
+
+	if ( other->getNumRecs() == 0 ) {
+		return true;
+	}
+
+	int32_t firstPage = m_offset >> m_pageSizeBits;
+	int64_t shift = (int64_t)firstPage * m_pageSize;
+
+	if ( other->getOffset(0) != ( m_offset & ( m_pageSize - 1 ) ) ) {
+		log( LOG_LOGIC, "db: rdbmap: map %s starts at page offset %" PRId32", not where %s ends (%" PRId64").",
+		     other->m_file.getFilename(), (int32_t)other->getOffset(0), m_file.getFilename(), m_offset );
+		gbshutdownLogicError();
+	}
+
+	if ( KEYCMP(other->getKeyPtr(0), m_lastKey, m_ks) <= 0 && KEYCMP(m_lastKey, KEYMIN(), m_ks) != 0 ) {
+		log( LOG_LOGIC, "db: rdbmap: added map out of order. file=%s k1=%s k2=%s",
+		     m_file.getFilename(), KEYSTR(m_lastKey, m_ks), KEYSTR(other->getKeyPtr(0), m_ks) );
+		g_errno = ECORRUPTDATA;
+		return false;
+	}
+
+	// we change the pages and the dictionary
+	if ( ! unmapSegments() ) {
+		return false;
+	}
+
+	int32_t lastPage = firstPage + other->m_numPages - 1;
+	while ( lastPage + 2 >= m_maxNumPages ) {
+		if ( ! addSegment() ) {
+			log( LOG_WARN, "db: Failed to add segment to map file %s.", m_file.getFilename() );
+			return false;
+		}
+	}
+
+	m_needToWrite = true;
+
+	for ( int32_t i = 0; i < other->m_numPages; i++ ) {
+		// our last record may already be the first one on the shared page
+		if ( i == 0 && firstPage < m_numPages && getOffset(firstPage) >= 0 ) {
+			continue;
+		}
+		setKey(firstPage + i, other->getKeyPtr(i));
+		setOffset(firstPage + i, other->getOffset(i));
+	}
+
+	if ( m_hasTermDict ) {
+		const RdbMapTermDictEntry *begin = other->m_mappedTermDict ? other->m_mappedTermDict : other->m_termDict.data();
+		const RdbMapTermDictEntry *end   = begin + other->getNumTermDictEntries();
+
+		if ( ! other->m_hasTermDict || ( begin != end && ! m_termDict.empty() && m_termDict.back().m_termId > begin->m_termId ) ) {
+			m_hasTermDict = false;
+			m_termDict.clear();
+		} else {
+			for ( const RdbMapTermDictEntry *it = begin; it != end; ++it ) {
+				// a termlist continued by the other map
+				if ( ! m_termDict.empty() && m_termDict.back().m_termId == it->m_termId ) {
+					RdbMapTermDictEntry &e = m_termDict.back();
+					e.m_size = it->m_offset + shift + it->m_size - e.m_offset;
+					e.m_numDocs += it->m_numDocs;
+					if ( it->m_maxSiteRank > e.m_maxSiteRank ) {
+						e.m_maxSiteRank = it->m_maxSiteRank;
+					}
+					continue;
+				}
+				RdbMapTermDictEntry e = *it;
+				e.m_offset += shift;
+				m_termDict.push_back(e);
+			}
+			m_termDictLastDocId = other->m_termDictLastDocId;
+		}
+	}
+
+	m_numPages = firstPage + other->m_numPages;
+	m_offset = shift + other->m_offset;
+	m_numPositiveRecs += other->getNumPositiveRecs();
+	m_numNegativeRecs += other->getNumNegativeRecs();
+	KEYSET(m_lastKey, other->m_lastKey, m_ks);
+
+	return true;
+}
+
 
 // . call addRecord() or addKey() for each record in this list
 bool RdbMap::prealloc ( RdbList *list ) {
@@ -1108,7 +1558,13 @@ int64_t RdbMap::getMemAllocated() const {
 	// . each page has a key and a 2 byte offset
 	int64_t space = PAGES_PER_SEGMENT * (m_ks + 2);
 	// how many segments we use * segment allocation
-	return (int64_t)m_numSegments * space;
+	return (int64_t)(m_numSegments - m_numMappedSegments) * space +
+	       (int64_t)m_termDict.capacity() * sizeof(RdbMapTermDictEntry);
+}
+
+int64_t RdbMap::getMemMapped() const {
+	return (int64_t)m_numMappedSegments * PAGES_PER_SEGMENT * (m_ks + 2) +
+	       m_numMappedTermDictEntries * (int64_t)sizeof(RdbMapTermDictEntry);
 }
 
 bool RdbMap::addSegmentPtr ( int32_t n ) {
@@ -1287,6 +1743,12 @@ bool RdbMap::chopHead ( int32_t fileHeadSize ) {
 	int32_t ks = m_ks;
 	// remove segments before segNum
 	for ( int32_t i = 0 ; i < segNum ; i++ ) {
+		// mmap'd segments are released when the mapping is closed
+		if ( i < m_numMappedSegments ) {
+			m_keys   [i] = NULL;
+			m_offsets[i] = NULL;
+			continue;
+		}
 		mfree ( m_keys   [i] , ks * PAGES_PER_SEGMENT , "RdbMap" );
 		mfree ( m_offsets[i] , 2  * PAGES_PER_SEGMENT , "RdbMap" );
 		// set to NULL so we know if accessed illegally
@@ -1295,6 +1757,15 @@ bool RdbMap::chopHead ( int32_t fileHeadSize ) {
 	}
 	// adjust # of segments down
 	m_numSegments -= segNum;
+	if ( m_numMappedSegments > segNum ) {
+		m_numMappedSegments -= segNum;
+	} else {
+		m_numMappedSegments = 0;
+		// the term dictionary may still be in the mapping
+		if ( ! m_mappedTermDict ) {
+			m_mappedFile.close();
+		}
+	}
 	// same with max # of used pages
 	m_maxNumPages -= PAGES_PER_SEGMENT * segNum ;
 	// same with # of used pages, since the head was ALL used
@@ -1461,6 +1932,9 @@ readLoop:
 		// tell rdbmap where "list" occurs in the big file
 		m_offset = offset + fullKeyOff;
 
+		// the termlists in the missing head are unknown
+		m_hasTermDict = false;
+
 		// set the list special here
 		list.set(buf + fullKeyOff, readSize - fullKeyOff, buf, readSize, startKey, endKey, m_fixedDataSize, false, m_useHalfKeys, m_ks);
 	} else {
@@ -13,7 +13,9 @@
 #define GB_RDBMAP_H
 
 #include <atomic>
+#include <vector>
 #include "BigFile.h"
+#include "MemoryMappedFile.h"
 #include "RdbList.h"
 #include "Sanity.h"
 #include "Log.h"
@@ -72,6 +74,50 @@
 #endif
 #define PAGES_PER_SEG     (PAGES_PER_SEGMENT)
 
+// . on-disk layout of a map file (version 2)
+// . a fixed size header followed by the keys of all pages and then the
+//   relative offsets of all pages, so the file can be mmap'd and the
+//   segments point straight into the page cache
+// . the header is padded to RDBMAP_HEADER_SIZE so the keys start on a disk page
+// . the legacy layout (data file size first, then keys/offsets interleaved
+//   per segment) is still read, but maps are always written in this layout
+// . posdb maps also carry a term dictionary after the offsets, see
+//   RdbMapTermDictEntry. older maps have a zero m_flags and no dictionary
+#define RDBMAP_FORMAT_VERSION 2
+#define RDBMAP_HEADER_SIZE    4096
+
+#define RDBMAP_FLAG_TERMDICT  0x01
+
+struct RdbMapFileHeader {
+	char    m_magic[8];
+	int32_t m_version;
+	int32_t m_keySize;
+	int32_t m_pageSize;
+	int32_t m_numPages;
+	int64_t m_offset;
+	int64_t m_fileStartOffset;
+	int64_t m_numPositiveRecs;
+	int64_t m_numNegativeRecs;
+	char    m_lastKey[MAX_KEY_BYTES];
+	int32_t m_flags;
+	int32_t m_reserved;
+	int64_t m_numTermDictEntries;
+};
+
+// . one entry per termid in a posdb file, sorted by termid
+// . m_offset is the absolute offset of the termlist in the data file, like
+//   getAbsoluteOffset(), and the termlist always starts with a full key
+// . m_numDocs counts the docids with positive keys. negative keys of the
+//   term in newer files are not subtracted
+struct RdbMapTermDictEntry {
+	int64_t  m_termId;
+	int64_t  m_offset;
+	int64_t  m_size;
+	int32_t  m_numDocs;
+	uint8_t  m_maxSiteRank;
+	uint8_t  m_reserved[3];
+};
+
 class RdbMap {
 
  public:
@@ -125,7 +171,7 @@ class RdbMap {
 	// . flushes when done
 	bool writeMap  ( bool allDone );
 	bool writeMap2 ( );
-	int64_t writeSegment ( int32_t segment , int64_t offset );
+	bool writeSegment ( int32_t segment , int64_t keysOffset , int64_t offsetsOffset );
 
 	// . calls addRecord() for each record in the list
 	// . returns false and sets errno on error
@@ -242,6 +288,9 @@ class RdbMap {
 	bool readMap2    ( );
 	int64_t readSegment ( int32_t segment, int64_t offset, int32_t fileSize);
 
+	// are (some of) the segments served from a mmap'd map file?
+	bool isMemoryMapped() const { return m_numMappedSegments > 0; }
+
 	// due to disk corruption keys or offsets can be out of order in map
 	bool verifyMap   ( BigFile *dataFile );
 	bool verifyMap2  ( );
@@ -276,6 +325,8 @@ class RdbMap {
 
 	// how much mem is being used by this map?
 	int64_t getMemAllocated() const;
+	// how much of the map is mmap'd from the map file instead?
+	int64_t getMemMapped() const;
 
 	// . attempts to auto-generate from data file, f
 	// . returns false and sets g_errno on error
@@ -285,15 +336,57 @@ class RdbMap {
 	// . returns false if map size would be exceed by adding this slot
 	bool addRecord ( char *key, char *rec , int32_t recSize );
 
+	// . an empty map for data that will be appended to another map at a
+	//   file offset that is "offset" bytes into a page
+	// . must be called after set() and setBuildTermDict()
+	void setFirstPageOffset ( int32_t offset );
+
+	// . append a map made with setFirstPageOffset(getFileSize() % page size)
+	//   for the data that follows ours in the data file
+	// . returns false and sets g_errno on error
+	bool addMap ( const RdbMap *other );
+
+	int32_t getPageSize() const { return m_pageSize; }
+
 	bool truncateFile ( BigFile *f ) ;
 
 	void printMap ();
+
+	// . keep a dictionary of termlists while records are added (posdb only)
+	// . must be called after set() and before any record is added
+	void setBuildTermDict ( ) ;
+
+	// do we have a dictionary covering the whole data file?
+	bool hasTermDict() const { return m_hasTermDict; }
+
+	// . NULL if the term is not in the data file
+	// . only valid if hasTermDict()
+	const RdbMapTermDictEntry *getTermDictEntry ( int64_t termId ) const;
+
+	int64_t getNumTermDictEntries() const {
+		return m_mappedTermDict ? m_numMappedTermDictEntries : (int64_t)m_termDict.size();
+	}
+
  private:
+	bool readMapV2 ( int64_t fileSize );
+
+	void addTermDictRecord ( const char *key, int32_t recSize );
+
+	// copy mmap'd segments to heap memory before the map file is rewritten
+	bool unmapSegments ( );
 
+	// copy a mmap'd term dictionary to m_termDict so it can be added to
+	bool unmapTermDict ( );
 
 	// the map file
         BigFile m_file;
 
+	// . read-only mapping of a version 2 map file
+	// . the first m_numMappedSegments segments point into it and must
+	//   never be written to or freed
+	MemoryMappedFile m_mappedFile;
+	int32_t          m_numMappedSegments;
+
 	// . we divide the map up into segments now
 	// . this facilitates merges so one map can shrink while another grows
 
@@ -356,6 +449,19 @@ class RdbMap {
 	int64_t m_badKeys     ;
 	bool      m_needVerify  ;
 
+	// . termid -> termlist dictionary, see RdbMapTermDictEntry
+	// . m_buildTermDict survives reset() so a regenerated map gets one too
+	// . a dictionary read from a map file stays in m_mappedFile and
+	//   m_mappedTermDict points into it. m_termDict is only used while
+	//   building one
+	std::vector<RdbMapTermDictEntry> m_termDict;
+	const RdbMapTermDictEntry *m_mappedTermDict;
+	int64_t m_numMappedTermDictEntries;
+	bool m_buildTermDict;
+	bool m_hasTermDict;
+	// docid of the last positive key of the last termlist
+	int64_t m_termDictLastDocId;
+
 };
 
 #endif // GB_RDBMAP_H
@@ -3,31 +3,89 @@
 #include "Process.h"
 #include "Spider.h" //dedupSpiderdbList()
 #include "MergeSpaceCoordinator.h"
+#include "Posdb.h"
 #include "Conf.h"
 #include "Errno.h"
+#include "SafeBuf.h"
+#include "Pages.h"
+#include "Mem.h"
+#include <algorithm>
+#include <string>
+#include <fcntl.h>
 
 
 RdbMerge g_merge;
 
+// don't bother partitioning merges smaller than this per partition
+static const int64_t s_minPartitionSize = 256LL * 1024 * 1024;
+static const int32_t s_maxPartitions = 64;
+
+// segments are copied to the target file in about this big reads
+static const int64_t s_placeChunkSize = 8 * 1024 * 1024;
+
+
+RdbMerge::Partition::Partition(RdbMerge *merge, int32_t partitionNum)
+  : m_merge(merge),
+    m_partitionNum(partitionNum),
+    m_doneReading(false),
+    m_file(NULL),
+    m_dump(),
+    m_map(),
+    m_index(),
+    m_placeOffset(0),
+    m_placedMap(),
+    m_placeErrno(0),
+    m_msg5(),
+    m_readListNum(0),
+    m_dumpListNum(0),
+    m_getListOutstanding(false),
+    m_filterOutstanding(false),
+    m_haveReadList(false),
+    m_dumpOutstanding(false),
+    m_dumpListSize(0)
+{
+	memset(m_rangeStartKey, 0, sizeof(m_rangeStartKey));
+	memset(m_startKey, 0, sizeof(m_startKey));
+	memset(m_endKey, 0, sizeof(m_endKey));
+}
+
+RdbMerge::Partition::~Partition() {
+	// partition 0 writes to the target file which RdbBase owns
+	if (m_partitionNum > 0 && m_file) {
+		mdelete(m_file, sizeof(BigFile), "RdbMergeSeg");
+		delete m_file;
+	}
+}
+
 
 RdbMerge::RdbMerge()
   : m_mergeSpaceCoordinator(NULL),
 	m_isAcquireLockJobSubmited(false),
 	m_isLockAquired(false),
-    m_doneMerging(false),
-    m_getListOutstanding(false),
     m_startFileNum(0),
     m_numFiles(0),
     m_fixedDataSize(0),
+    m_useHalfKeys(false),
     m_targetFile(NULL),
     m_targetMap(NULL),
     m_targetIndex(NULL),
 	m_doneRegenerateFiles(false),
     m_isMerging(false),
     m_isHalted(false),
-    m_dump(),
-    m_msg5(),
-    m_list(),
+    m_partitions(),
+    m_numPartitions(1),
+    m_isSleeping(false),
+    m_isPlacing(false),
+    m_numPlacesOutstanding(0),
+    m_mergeErrno(0),
+    m_mergeStartTime(0),
+    m_bytesRead(0),
+    m_bytesWritten(0),
+    m_numListsDumped(0),
+    m_throttledMs(0),
+    m_startProgress(0),
+    m_ioCredit(0),
+    m_ioCreditTime(0),
     m_niceness(0),
     m_rdbId(RDB_NONE),
     m_collnum(0),
@@ -37,6 +95,7 @@ RdbMerge::RdbMerge()
 }
 
 RdbMerge::~RdbMerge() {
+	deletePartitions();
 	delete m_mergeSpaceCoordinator;
 }
 
@@ -92,9 +151,9 @@ bool RdbMerge::merge(rdbid_t rdbId,
 	m_startFileNum    = startFileNum;
 	m_numFiles        = numFiles;
 	m_fixedDataSize   = base->getFixedDataSize();
+	m_useHalfKeys     = base->useHalfKeys();
 	m_niceness        = niceness;
 	m_doneRegenerateFiles = false;
-	m_doneMerging     = false;
 	m_ks              = rdb->getKeySize();
 
 	// . set the key range we want to retrieve from the files
@@ -102,7 +161,13 @@ bool RdbMerge::merge(rdbid_t rdbId,
 	KEYMIN(m_startKey,m_ks);
 
 	//calculate how much space we need for resulting merged file
-	m_spaceNeededForMerge = base->getSpaceNeededForMerge(m_startFileNum,m_numFiles);
+	uint64_t spaceNeeded = base->getSpaceNeededForMerge(m_startFileNum,m_numFiles);
+
+	// . the segments of partitions 1..n-1 are only removed once they are
+	//   copied into the target file, so reserve for both
+	const RdbMap *map;
+	m_numPartitions = getNumPartitionsToUse(base, spaceNeeded, &map);
+	m_spaceNeededForMerge = spaceNeeded + spaceNeeded * (m_numPartitions - 1) / m_numPartitions;
 
 
 	if(!g_loop.registerSleepCallback(5000, this, getLockWrapper, "RdbMerge::getLockWrapper", 0, true))
@@ -269,28 +334,15 @@ bool RdbMerge::gotLock() {
 		return true;
 	}
 
-	// . set up a a file to dump the records into
+	// . set up the partitions and the files to dump the records into
 	// . returns false and sets g_errno on error
 	// . this will open m_target as O_RDWR ...
-
-	m_dump.set(m_collnum,
-	           m_targetFile,
-	           NULL, // buckets to dump is NULL, we call dumpList
-	           NULL, // tree to dump is NULL, we call dumpList
-	           m_targetMap,
-	           m_targetIndex,
-	           0, // m_maxBufSize. not needed if no tree!
-	           m_niceness, // niceness of dump
-	           this, // state
-	           dumpListWrapper,
-	           base->useHalfKeys(),
-	           startOffset,
-	           prevLastKey,
-	           m_ks,
-	           m_rdbId);
-	// what kind of error?
-	if ( g_errno ) {
+	if (!createPartitions(base, startOffset, prevLastKey)) {
+		if (!g_errno) {
+			g_errno = EBADENGINEER;
+		}
 		log(LOG_WARN, "db: gotLock: merge.set: %s.", mstrerror(g_errno));
+		deletePartitions();
 		relinquishMergespaceLock();
 		m_isMerging = false;
 		base->incorporateMerge();
@@ -302,6 +354,205 @@ bool RdbMerge::gotLock() {
 	return resumeMerge ( );
 }
 
+// . how many key ranges to merge concurrently
+// . only fresh merges are partitioned. a resumed merge continues where the
+//   target file ends, which may be followed by leftovers of the killed merge
+// . each partition gets a merge thread to copy its segment into place
+// . each partition has its own Msg5 reading up to m_mergeBufSize from every
+//   file and two lists, which must fit in "merge partitions max mem"
+// . *map is set to the map of the biggest source file
+int32_t RdbMerge::getNumPartitionsToUse(RdbBase *base, uint64_t spaceNeeded, const RdbMap **map) const {
+	*map = NULL;
+
+	int32_t numPartitions = g_conf.m_mergeNumPartitions;
+	if (numPartitions > s_maxPartitions) {
+		numPartitions = s_maxPartitions;
+	}
+	if (numPartitions > g_conf.m_maxMergeThreads) {
+		numPartitions = g_conf.m_maxMergeThreads;
+	}
+
+	int64_t memPerPartition = (int64_t)(m_numFiles + 2) * g_conf.m_mergeBufSize;
+	if (memPerPartition > 0) {
+		int64_t maxMem = (int64_t)g_conf.m_mergePartitionsMaxMem * 1024 * 1024;
+		if (maxMem / memPerPartition < numPartitions) {
+			numPartitions = (int32_t)(maxMem / memPerPartition);
+		}
+	}
+
+	if (numPartitions <= 1) {
+		return 1;
+	}
+
+	if (m_targetFile->getFileSize() > 0 || m_targetMap->getNumRecs() > 0) {
+		return 1;
+	}
+
+	int64_t maxSize = (int64_t)(spaceNeeded / s_minPartitionSize);
+	if (maxSize < numPartitions) {
+		numPartitions = (int32_t)maxSize;
+	}
+	if (numPartitions <= 1) {
+		return 1;
+	}
+
+	int32_t numFiles = base->getNumFiles();
+	for (int32_t i = m_startFileNum; i < m_startFileNum + m_numFiles && i < numFiles; i++) {
+		const RdbMap *m = base->getMap(i);
+		if (m && (!*map || m->getFileSize() > (*map)->getFileSize())) {
+			*map = m;
+		}
+	}
+
+	// need some pages per partition to pick boundaries from
+	if (!*map || (*map)->getNumPages() < numPartitions * 2) {
+		return 1;
+	}
+
+	return numPartitions;
+}
+
+// . splits [m_startKey, KEYMAX] into key ranges that are read, merged and
+//   dumped concurrently
+// . the boundaries come from the map of the biggest source file so the
+//   partitions hold about the same amount of data
+// . posdb boundaries are moved to the start of a termlist
+// . returns false and sets g_errno on error
+bool RdbMerge::createPartitions(RdbBase *base, int64_t startOffset, const char *prevLastKey) {
+	deletePartitions();
+
+	// no more than we acquired the merge space for
+	const RdbMap *map;
+	int32_t numPartitions = getNumPartitionsToUse(base, m_spaceNeededForMerge, &map);
+	if (numPartitions > m_numPartitions) {
+		numPartitions = m_numPartitions;
+	}
+
+	// boundaries[i] is the first key of partition i
+	std::vector<std::string> boundaries;
+	boundaries.push_back(std::string(m_startKey, m_ks));
+
+	if (numPartitions > 1) {
+		int32_t firstPage = map->getPage(m_startKey);
+		int32_t numPages = map->getNumPages() - firstPage;
+		for (int32_t i = 1; i < numPartitions; i++) {
+			char k[MAX_KEY_BYTES];
+			KEYSET(k, map->getKeyPtr(firstPage + (int32_t)((int64_t)numPages * i / numPartitions)), m_ks);
+			if (m_rdbId == RDB_POSDB || m_rdbId == RDB2_POSDB2) {
+				Posdb::makeStartKey(k, Posdb::getTermId(k));
+			}
+
+			// skip empty and out of order ranges
+			if (KEYCMP(k, boundaries.back().data(), m_ks) <= 0) {
+				continue;
+			}
+			boundaries.push_back(std::string(k, m_ks));
+		}
+	}
+
+	for (size_t i = 0; i < boundaries.size(); i++) {
+		Partition *p = new Partition(this, (int32_t)i);
+		m_partitions.push_back(p);
+
+		KEYSET(p->m_rangeStartKey, boundaries[i].data(), m_ks);
+		KEYSET(p->m_startKey, boundaries[i].data(), m_ks);
+		if (i + 1 < boundaries.size()) {
+			KEYSET(p->m_endKey, boundaries[i + 1].data(), m_ks);
+			KEYDEC(p->m_endKey, m_ks);
+		} else {
+			KEYSET(p->m_endKey, KEYMAX(), m_ks);
+		}
+
+		if (i == 0) {
+			p->m_file = m_targetFile;
+			if (!p->m_dump.set(m_collnum,
+			                   m_targetFile,
+			                   NULL, // buckets to dump is NULL, we call dumpList
+			                   NULL, // tree to dump is NULL, we call dumpList
+			                   m_targetMap,
+			                   m_targetIndex,
+			                   0, // m_maxBufSize. not needed if no tree!
+			                   m_niceness, // niceness of dump
+			                   p, // state
+			                   dumpListWrapper,
+			                   base->useHalfKeys(),
+			                   startOffset,
+			                   prevLastKey,
+			                   m_ks,
+			                   m_rdbId) || g_errno) {
+				return false;
+			}
+			continue;
+		}
+
+		// . segment files don't start with the rdb name so RdbBase never
+		//   picks them up. cleanupAnyChrashedMerges() removes leftovers
+		// . their map and index are only kept in memory. the index is
+		//   added to the target index as is, the map tells where records
+		//   start when the segment is copied into the target file
+		char segmentName[1024];
+		snprintf(segmentName, sizeof(segmentName), "%s%" PRId32".%s",
+		         RDBMERGE_SEGMENT_PREFIX, p->m_partitionNum, m_targetFile->getFilename());
+
+		try {
+			p->m_file = new BigFile;
+		} catch(std::bad_alloc&) {
+			g_errno = ENOMEM;
+			return false;
+		}
+		mnew(p->m_file, sizeof(BigFile), "RdbMergeSeg");
+
+		p->m_file->set(m_targetFile->getDir(), segmentName);
+		if (p->m_file->doesExist()) {
+			p->m_file->unlink();
+		}
+
+		char filename[1100];
+		snprintf(filename, sizeof(filename), "%s.map", segmentName);
+		p->m_map.set(m_targetFile->getDir(), filename, m_fixedDataSize, m_useHalfKeys, m_ks, m_targetMap->getPageSize());
+
+		if (m_targetIndex) {
+			snprintf(filename, sizeof(filename), "%s.idx", segmentName);
+			p->m_index.set(m_targetFile->getDir(), filename, m_fixedDataSize, m_useHalfKeys, m_ks, m_rdbId, false);
+		}
+
+		if (!p->m_dump.set(m_collnum,
+		                   p->m_file,
+		                   NULL,
+		                   NULL,
+		                   &p->m_map,
+		                   m_targetIndex ? &p->m_index : NULL,
+		                   0,
+		                   m_niceness,
+		                   p,
+		                   dumpListWrapper,
+		                   base->useHalfKeys(),
+		                   0,
+		                   KEYMIN(),
+		                   m_ks,
+		                   m_rdbId) || g_errno) {
+			return false;
+		}
+	}
+
+	if (m_partitions.size() > 1) {
+		log(LOG_INFO, "db: merge: Merging %s in %d partitions.", base->getDbName(), (int)m_partitions.size());
+		for (auto p : m_partitions) {
+			log(LOG_DEBUG, "db: merge: partition #%" PRId32" %s - %s", p->m_partitionNum,
+			    KEYSTR(p->m_rangeStartKey, m_ks), KEYSTR(p->m_endKey, m_ks));
+		}
+	}
+
+	return true;
+}
+
+void RdbMerge::deletePartitions() {
+	for (auto p : m_partitions) {
+		delete p;
+	}
+	m_partitions.clear();
+}
+
 void RdbMerge::haltMerge() {
 	if(m_isHalted) {
 		return;
@@ -312,13 +563,17 @@ void RdbMerge::haltMerge() {
 	// . we don't want the dump writing to an RdbMap that has been deleted
 	// . this can happen if the close is delayed because we are dumping
 	//   a tree to disk
-	m_dump.setSuspended();
+	for (auto p : m_partitions) {
+		p->m_dump.setSuspended();
+	}
 }
 
 void RdbMerge::doSleep() {
 	log(LOG_WARN, "db: Merge had error: %s. Sleeping and retrying.", mstrerror(g_errno));
 	g_errno = 0;
-	g_loop.registerSleepCallback(1000, this, tryAgainWrapper, "RdbMerge::tryAgainWrapper");
+	if (g_loop.registerSleepCallback(1000, this, tryAgainWrapper, "RdbMerge::tryAgainWrapper")) {
+		m_isSleeping = true;
+	}
 }
 
 // . return false if blocked, otherwise true
@@ -328,41 +583,89 @@ bool RdbMerge::resumeMerge() {
 		return true;
 	}
 
-	// the usual loop
+	m_isSleeping = false;
+	m_isPlacing = false;
+	m_numPlacesOutstanding = 0;
+	m_mergeErrno = 0;
+
+	m_mergeStartTime = gettimeofdayInMilliseconds();
+	m_bytesRead = 0;
+	m_bytesWritten = 0;
+	m_numListsDumped = 0;
+	m_throttledMs = 0;
+	m_ioCredit = 0;
+	m_ioCreditTime = m_mergeStartTime;
+	m_startProgress = getProgress();
+
+	return advance();
+}
+
+// . drives the read -> filter -> dump pipeline of every partition
+// . the next list of a partition is read from the source files (and merged
+//   by Msg5) while its previous list is being written out
+// . the end key of a list is only known once it is read, so each partition
+//   has at most one read and one dump in flight and dumps in key order
+// . called again whenever a stage completes
+// . once all partitions are done the segments are placed in the target
+//   file, then doneMerging() is called. on error doneMerging() is called
+//   as soon as nothing is in flight anymore
+// . returns true if the merge completed, false if something is in flight
+bool RdbMerge::advance() {
 	for (;;) {
-		// . this returns false if blocked, true otherwise
-		// . sets g_errno on error
-		// . we return true if it blocked
-		if (!getNextList()) {
-			logTrace(g_conf.m_logTraceRdbMerge, "END. getNextList blocked. list=%p", &m_list);
+		if (m_isHalted || m_isPlacing) {
 			return false;
 		}
 
-		// if g_errno is out of memory then msg3 wasn't able to get the lists
-		// so we should sleep and retry...
-		if (g_errno == ENOMEM) {
-			doSleep();
-			logTrace(g_conf.m_logTraceRdbMerge, "END. out of memory. list=%p", &m_list);
-			return false;
+		bool progress = false;
+
+		for (auto p : m_partitions) {
+			// hand the list we read to the dump if it is idle
+			if (p->m_haveReadList && !p->m_dumpOutstanding && !m_mergeErrno) {
+				p->m_haveReadList = false;
+				p->m_dumpListNum = p->m_readListNum;
+				p->m_readListNum ^= 1;
+				progress = true;
+				if (dumpList(p)) {
+					gotDump(p);
+				}
+			}
+
+			// and read the next one meanwhile
+			if (!p->m_getListOutstanding && !p->m_filterOutstanding && !p->m_haveReadList &&
+			    !p->m_doneReading && !m_isSleeping && !m_mergeErrno && !throttle()) {
+				progress = true;
+				if (getNextList(p)) {
+					gotList(p);
+				}
+			}
 		}
 
-		// if list is empty or we had an error then we're done
-		if (g_errno || m_doneMerging) {
-			doneMerging();
-			logTrace(g_conf.m_logTraceRdbMerge, "END. error/done merging. list=%p", &m_list);
-			return true;
+		bool inFlight = m_isSleeping;
+		bool allDone = true;
+		for (auto p : m_partitions) {
+			if (p->m_getListOutstanding || p->m_filterOutstanding || p->m_dumpOutstanding) {
+				inFlight = true;
+			}
+			if (!p->m_doneReading || p->m_haveReadList) {
+				allDone = false;
+			}
 		}
 
-		// return if this blocked
-		if (!filterList()) {
-			logTrace(g_conf.m_logTraceRdbMerge, "END. filterList blocked. list=%p", &m_list);
-			return false;
+		if (!inFlight && (m_mergeErrno || allDone)) {
+			if (!m_mergeErrno && m_partitions.size() > 1) {
+				logTrace(g_conf.m_logTraceRdbMerge, "END. placing segments");
+				placeSegments();
+				return !m_isPlacing;
+			}
+
+			g_errno = m_mergeErrno;
+			doneMerging();
+			logTrace(g_conf.m_logTraceRdbMerge, "END. error/done merging");
+			return true;
 		}
 
-		// . otherwise dump the list we read to our target file
-		// . this returns false if blocked, true otherwise
-		if (!dumpList()) {
-			logTrace(g_conf.m_logTraceRdbMerge, "END. dumpList blocked. list=%p", &m_list);
+		if (!progress) {
+			logTrace(g_conf.m_logTraceRdbMerge, "END. blocked. sleep=%d", m_isSleeping);
 			return false;
 		}
 	}
@@ -370,17 +673,7 @@ bool RdbMerge::resumeMerge() {
 
 // . return false if blocked, true otherwise
 // . sets g_errno on error
-bool RdbMerge::getNextList() {
-	// return true if g_errno is set
-	if (g_errno || m_doneMerging) {
-		return true;
-	}
-
-	// it's suspended so we count this as blocking
-	if(m_isHalted) {
-		return false;
-	}
-
+bool RdbMerge::getNextList(Partition *p) {
 	// get base, returns NULL and sets g_errno to ENOCOLLREC on error
 	RdbBase *base = getRdbBase(m_rdbId, m_collnum);
 	if (!base) {
@@ -392,10 +685,10 @@ bool RdbMerge::getNextList() {
 	}
 
 	// otherwise, get it now
-	return getAnotherList();
+	return getAnotherList(p);
 }
 
-bool RdbMerge::getAnotherList() {
+bool RdbMerge::getAnotherList(Partition *p) {
 	logDebug(g_conf.m_logDebugMerge, "db: Getting another list for merge.");
 
 	// clear it up in case it was already set
@@ -407,8 +700,10 @@ bool RdbMerge::getAnotherList() {
 		return true;
 	}
 
-	logTrace(g_conf.m_logTraceRdbMerge, "list=%p startKey=%s",
-	         &m_list, KEYSTR(m_startKey, m_ks));
+	RdbList *list = &p->m_lists[p->m_readListNum];
+
+	logTrace(g_conf.m_logTraceRdbMerge, "partition=%" PRId32" list=%p startKey=%s",
+	         p->m_partitionNum, list, KEYSTR(p->m_startKey, m_ks));
 
 	// . this returns false if blocked, true otherwise
 	// . sets g_errno on error
@@ -433,73 +728,64 @@ bool RdbMerge::getAnotherList() {
 
 	int32_t bufSize = g_conf.m_mergeBufSize;
 	// get it
-	m_getListOutstanding = true;
-	bool rc = m_msg5.getList(m_rdbId,
+	p->m_getListOutstanding = true;
+	bool rc = p->m_msg5.getList(m_rdbId,
 				 m_collnum,
-				 &m_list,
-				 m_startKey,
-				 KEYMAX(),        // usually is maxed!
+				 list,
+				 p->m_startKey,
+				 p->m_endKey,
 				 bufSize,
 				 false,           // includeTree?
 				 m_startFileNum,  // startFileNum
 				 m_numFiles,
-				 this,            // state
+				 p,               // state
 				 gotListWrapper,  // callback
 				 m_niceness,      // niceness
 				 true,            // do error correction?
 				 nn + 75,         // max retries (mk it high)
 				 true);            // isRealMerge? absolutely!
 	if(rc)
-		m_getListOutstanding = false;
+		p->m_getListOutstanding = false;
 	return rc;
 	
 }
 
 void RdbMerge::gotListWrapper(void *state, RdbList * /*list*/, Msg5 * /*msg5*/) {
-	// get a ptr to ourselves
-	RdbMerge *THIS = (RdbMerge *)state;
+	Partition *p = static_cast<Partition*>(state);
+	RdbMerge *THIS = p->m_merge;
 
-	logTrace(g_conf.m_logTraceRdbMerge, "list=%p startKey=%s",
-	         &(THIS->m_list), KEYSTR(THIS->m_startKey, THIS->m_ks));
+	logTrace(g_conf.m_logTraceRdbMerge, "partition=%" PRId32" list=%p startKey=%s",
+	         p->m_partitionNum, &(p->m_lists[p->m_readListNum]), KEYSTR(p->m_startKey, THIS->m_ks));
 
-	THIS->m_getListOutstanding = false;
+	THIS->gotList(p);
+	THIS->advance();
+}
 
-	for (;;) {
-		// if g_errno is out of memory then msg3 wasn't able to get the lists
-		// so we should sleep and retry
-		if (g_errno == ENOMEM) {
-			THIS->doSleep();
-			logTrace(g_conf.m_logTraceRdbMerge, "END. out of memory. list=%p", &THIS->m_list);
-			return;
-		}
+// . called when the read of p->m_lists[p->m_readListNum] completed, with
+//   g_errno set on error
+void RdbMerge::gotList(Partition *p) {
+	p->m_getListOutstanding = false;
 
-		// if g_errno we're done
-		if (g_errno || THIS->m_doneMerging) {
-			THIS->doneMerging();
-			logTrace(g_conf.m_logTraceRdbMerge, "END. error/done merging. list=%p", &THIS->m_list);
-			return;
-		}
+	// if g_errno is out of memory then msg3 wasn't able to get the lists
+	// so we should sleep and retry. m_startKey was not advanced
+	if (g_errno == ENOMEM) {
+		doSleep();
+		return;
+	}
 
-		// return if this blocked
-		if (!THIS->filterList()) {
-			logTrace(g_conf.m_logTraceRdbMerge, "END. filterList blocked. list=%p", &THIS->m_list);
-			return;
+	if (g_errno) {
+		if (!m_mergeErrno) {
+			m_mergeErrno = g_errno;
 		}
+		g_errno = 0;
+		return;
+	}
 
-		// return if this blocked
-		if (!THIS->dumpList()) {
-			logTrace(g_conf.m_logTraceRdbMerge, "END. dumpList blocked. list=%p", &THIS->m_list);
-			return;
-		}
+	int32_t listSize = p->m_lists[p->m_readListNum].getListSize();
+	m_bytesRead += listSize;
+	m_ioCredit -= listSize;
 
-		// return if this blocked
-		if (!THIS->getNextList()) {
-			logTrace(g_conf.m_logTraceRdbMerge, "END. getNextList blocked. list=%p", &THIS->m_list);
-			return;
-		}
-
-		// otherwise, keep on trucking
-	}
+	filterList(p);
 }
 
 // called after sleeping for 1 sec because of ENOMEM
@@ -513,98 +799,107 @@ void RdbMerge::tryAgainWrapper(int /*fd*/, void *state) {
 	// clear this
 	g_errno = 0;
 
-	// return if this blocked
-	if (!THIS->getNextList()) {
-		logTrace(g_conf.m_logTraceRdbMerge, "END. getNextList blocked. list=%p", &THIS->m_list);
-		return;
-	}
-
-	// if this didn't block do the loop
-	gotListWrapper(THIS, NULL, NULL);
+	THIS->m_isSleeping = false;
+	THIS->advance();
 }
 
-void RdbMerge::filterListWrapper(void *state) {
+// called when we waited long enough for the merge bandwidth ceiling
+void RdbMerge::throttleWrapper(int /*fd*/, void *state) {
 	RdbMerge *THIS = (RdbMerge *)state;
 
-	logTrace(g_conf.m_logTraceRdbMerge, "BEGIN. list=%p m_startKey=%s", &THIS->m_list, KEYSTR(THIS->m_startKey, THIS->m_ks));
+	g_loop.unregisterSleepCallback(THIS, throttleWrapper);
+
+	THIS->m_isSleeping = false;
+	THIS->advance();
+}
+
+// . returns true if reading the next list has to wait because of the
+//   "merge max MB/s" ceiling. throttleWrapper() resumes the merge then
+// . both the bytes read and the bytes written count against the ceiling
+bool RdbMerge::throttle() {
+	int64_t maxBytesPerSec = (int64_t)g_conf.m_mergeMaxMBPerSec * 1024 * 1024;
+	int64_t now = gettimeofdayInMilliseconds();
 
-	if (THIS->m_rdbId == RDB_SPIDERDB_DEPRECATED) {
-		dedupSpiderdbList(&(THIS->m_list));
-	} else if (THIS->m_rdbId == RDB_TITLEDB) {
-//		filterTitledbList(&(THIS->m_list));
+	if (maxBytesPerSec <= 0) {
+		m_ioCredit = 0;
+		m_ioCreditTime = now;
+		return false;
 	}
 
-	logTrace(g_conf.m_logTraceRdbMerge, "END. list=%p", &THIS->m_list);
-}
+	m_ioCredit += (now - m_ioCreditTime) * maxBytesPerSec / 1000;
+	m_ioCreditTime = now;
 
-// similar to gotListWrapper but we call dumpList() before dedupList()
-void RdbMerge::filterDoneWrapper(void *state, job_exit_t exit_type) {
-	// get a ptr to ourselves
-	RdbMerge *THIS = (RdbMerge *)state;
+	// don't let an idle period build up more than a second of burst
+	if (m_ioCredit > maxBytesPerSec) {
+		m_ioCredit = maxBytesPerSec;
+	}
 
-	logTrace(g_conf.m_logTraceRdbMerge, "BEGIN. list=%p m_startKey=%s", &THIS->m_list, KEYSTR(THIS->m_startKey, THIS->m_ks));
+	if (m_ioCredit >= 0) {
+		return false;
+	}
 
-	for (;;) {
-		// return if this blocked
-		if (!THIS->dumpList()) {
-			logTrace(g_conf.m_logTraceRdbMerge, "END. dumpList blocked. list=%p", &THIS->m_list);
-			return;
-		}
+	int32_t waitMs = (int32_t)(-m_ioCredit * 1000 / maxBytesPerSec) + 1;
+	if (!g_loop.registerSleepCallback(waitMs, this, throttleWrapper, "RdbMerge::throttleWrapper", m_niceness)) {
+		return false;
+	}
 
-		// return if this blocked
-		if (!THIS->getNextList()) {
-			logTrace(g_conf.m_logTraceRdbMerge, "END. getNextList blocked. list=%p", &THIS->m_list);
-			return;
-		}
+	logDebug(g_conf.m_logDebugMerge, "db: Merge throttled for %" PRId32" ms.", waitMs);
 
-		// if g_errno is out of memory then msg3 wasn't able to get the lists
-		// so we should sleep and retry
-		if (g_errno == ENOMEM) {
-			THIS->doSleep();
-			logTrace(g_conf.m_logTraceRdbMerge, "END. out of memory. list=%p", &THIS->m_list);
-			return;
-		}
+	m_isSleeping = true;
+	m_throttledMs += waitMs;
+	return true;
+}
 
-		// if g_errno we're done
-		if (g_errno || THIS->m_doneMerging) {
-			THIS->doneMerging();
-			logTrace(g_conf.m_logTraceRdbMerge, "END. error/done merging. list=%p", &THIS->m_list);
-			return;
-		}
+void RdbMerge::filterListWrapper(void *state) {
+	Partition *p = static_cast<Partition*>(state);
+	RdbList *list = &(p->m_lists[p->m_readListNum]);
 
-		// return if this blocked
-		if (!THIS->filterList()) {
-			logTrace(g_conf.m_logTraceRdbMerge, "END. filterList blocked. list=%p", &THIS->m_list);
-			return;
-		}
+	logTrace(g_conf.m_logTraceRdbMerge, "BEGIN. list=%p m_startKey=%s", list, KEYSTR(p->m_startKey, p->m_merge->m_ks));
 
-		// otherwise, keep on trucking
+	if (p->m_merge->m_rdbId == RDB_SPIDERDB_DEPRECATED) {
+		dedupSpiderdbList(list);
+	} else if (p->m_merge->m_rdbId == RDB_TITLEDB) {
+//		filterTitledbList(list);
 	}
+
+	logTrace(g_conf.m_logTraceRdbMerge, "END. list=%p", list);
 }
 
-bool RdbMerge::filterList() {
-	// return true on g_errno
-	if (g_errno) {
-		return true;
-	}
+void RdbMerge::filterDoneWrapper(void *state, job_exit_t exit_type) {
+	Partition *p = static_cast<Partition*>(state);
+	RdbMerge *THIS = p->m_merge;
 
-	// . it's suspended so we count this as blocking
-	// . resumeMerge() will call getNextList() again, not dumpList() so
-	//   don't advance m_startKey
-	if(m_isHalted) {
-		return false;
-	}
+	logTrace(g_conf.m_logTraceRdbMerge, "BEGIN. list=%p m_startKey=%s",
+	         &(p->m_lists[p->m_readListNum]), KEYSTR(p->m_startKey, THIS->m_ks));
+
+	p->m_filterOutstanding = false;
+	p->m_haveReadList = true;
+	THIS->advance();
+}
+
+// . advances the partition's start key past the list we just read and
+//   filters the list
+// . the list is ready for dumping when m_haveReadList is set
+void RdbMerge::filterList(Partition *p) {
+	RdbList *list = &p->m_lists[p->m_readListNum];
 
 	// if we use getLastKey() for this the merge completes but then
 	// tries to merge two empty lists and cores in the merge function
 	// because of that. i guess it relies on endkey rollover only and
 	// not on reading less than minRecSizes to determine when to stop
 	// doing the merge.
-	m_list.getEndKey(m_startKey) ;
-	KEYINC(m_startKey,m_ks);
+	list->getEndKey(p->m_startKey);
+
+	// this is the last list of the partition if we reached its end key.
+	// for the last partition that is where m_startKey would roll over
+	if (KEYCMP(p->m_startKey, p->m_endKey, m_ks) >= 0) {
+		p->m_doneReading = true;
+	} else {
+		KEYINC(p->m_startKey, m_ks);
+	}
 
 	logTrace(g_conf.m_logTraceRdbMerge, "listEndKey=%s startKey=%s",
-	         KEYSTR(m_list.getEndKey(), m_list.getKeySize()), KEYSTR(m_startKey, m_ks));
+	         KEYSTR(list->getEndKey(), list->getKeySize()), KEYSTR(p->m_startKey, m_ks));
 
 	/////
 	//
@@ -612,126 +907,485 @@ bool RdbMerge::filterList() {
 	//
 	/////
 	if (m_rdbId == RDB_SPIDERDB_DEPRECATED || m_rdbId == RDB_TITLEDB) {
-		if (g_jobScheduler.submit(filterListWrapper, filterDoneWrapper, this, thread_type_merge_filter, 0)) {
-			return false;
+		p->m_filterOutstanding = true;
+		if (g_jobScheduler.submit(filterListWrapper, filterDoneWrapper, p, thread_type_merge_filter, 0)) {
+			return;
 		}
+		p->m_filterOutstanding = false;
 
 		log(LOG_WARN, "db: Unable to submit job for merge filter. Will run in main thread");
 
 		// fall back to filter without thread
 		if (m_rdbId == RDB_SPIDERDB_DEPRECATED) {
-			dedupSpiderdbList(&m_list);
+			dedupSpiderdbList(list);
 		} else {
-//			filterTitledbList(&m_list);
+//			filterTitledbList(list);
 		}
 	}
 
-	return true;
+	p->m_haveReadList = true;
 }
 
-// similar to gotListWrapper but we call getNextList() before dumpList()
 void RdbMerge::dumpListWrapper(void *state) {
 	// debug msg
 	logDebug(g_conf.m_logDebugMerge, "db: Dump of list completed: %s.",mstrerror(g_errno));
 
-	// get a ptr to ourselves
-	RdbMerge *THIS = (RdbMerge *)state;
+	Partition *p = static_cast<Partition*>(state);
+	RdbMerge *THIS = p->m_merge;
 
-	logTrace(g_conf.m_logTraceRdbMerge, "list=%p startKey=%s",
-	         &(THIS->m_list), KEYSTR(THIS->m_startKey, THIS->m_ks));
+	logTrace(g_conf.m_logTraceRdbMerge, "partition=%" PRId32" list=%p startKey=%s",
+	         p->m_partitionNum, &(p->m_lists[p->m_dumpListNum]), KEYSTR(p->m_startKey, THIS->m_ks));
 
-	for (;;) {
-		// collection reset or deleted while RdbDump.cpp was writing out?
-		if (g_errno == ENOCOLLREC) {
-			THIS->doneMerging();
-			logTrace(g_conf.m_logTraceRdbMerge, "END. error/done merging. list=%p", &THIS->m_list);
-			return;
+	THIS->gotDump(p);
+	THIS->advance();
+}
+
+// . return false if blocked, true otherwise
+// . set g_errno on error
+// . list should be truncated, possible have all negative keys removed,
+//   and de-duped thanks to RdbList::indexMerge_r() and RdbList::merge_r()
+bool RdbMerge::dumpList(Partition *p) {
+	RdbList *list = &p->m_lists[p->m_dumpListNum];
+
+	logDebug(g_conf.m_logDebugMerge, "db: Dumping list.");
+
+	logTrace(g_conf.m_logTraceRdbMerge, "partition=%" PRId32" list=%p startKey=%s",
+	         p->m_partitionNum, list, KEYSTR(p->m_startKey, m_ks));
+
+	p->m_dumpListSize = list->getListSize();
+	p->m_dumpOutstanding = true;
+	g_errno = 0;
+
+	// . send the whole list to the dump
+	// . it returns false if blocked, true otherwise
+	// . it sets g_errno on error
+	// . it calls dumpListWrapper when done dumping
+	// . return true if m_dump had an error or it did not block
+	// . if it gets a EFILECLOSED error it will keep retrying forever
+	return p->m_dump.dumpList(list);
+}
+
+// called when the dump of p->m_lists[p->m_dumpListNum] completed, with
+// g_errno set on error
+void RdbMerge::gotDump(Partition *p) {
+	p->m_dumpOutstanding = false;
+
+	// . collection reset or deleted while RdbDump.cpp was writing out?
+	// . the list is lost on any other error too, so stop the merge
+	if (g_errno) {
+		if (!m_mergeErrno) {
+			m_mergeErrno = g_errno;
 		}
-		// return if this blocked
-		if (!THIS->getNextList()) {
-			logTrace(g_conf.m_logTraceRdbMerge, "END. getNextList blocked. list=%p", &THIS->m_list);
-			return;
+		g_errno = 0;
+		return;
+	}
+
+	m_bytesWritten += p->m_dumpListSize;
+	m_ioCredit -= p->m_dumpListSize;
+	m_numListsDumped++;
+}
+
+// . copies the segments of partitions 1..n-1 to their place in the target
+//   file after what partition 0 dumped, each in its own job
+// . partition 0 saves the target map and index meanwhile, so a merge killed
+//   while placing resumes after partition 0 instead of mapping the segments
+//   it may have partially copied
+// . joinSegments() adds the maps and indexes of the segments to the target
+//   map and index once all are placed
+void RdbMerge::placeSegments() {
+	int64_t offset = m_targetMap->getFileSize();
+
+	for (auto p : m_partitions) {
+		if (p->m_partitionNum == 0) {
+			continue;
 		}
 
-		// if g_errno is out of memory then msg3 wasn't able to get the lists
-		// so we should sleep and retry
-		if (g_errno == ENOMEM) {
-			// if the dump failed, it should reset m_dump.m_offset of
-			// the file to what it was originally (in case it failed
-			// in adding the list to the map). we do not need to set
-			// m_startKey back to the startkey of this list, because
-			// it is *now* only advanced on successful dump!!
-			THIS->doSleep();
-			logTrace(g_conf.m_logTraceRdbMerge, "END. out of memory. list=%p", &THIS->m_list);
-			return;
+		p->m_placeOffset = offset;
+		p->m_placeErrno = 0;
+		offset += p->m_map.getFileSize();
+
+		p->m_placedMap.set(m_targetFile->getDir(), p->m_map.getFilename(), m_fixedDataSize, m_useHalfKeys, m_ks, m_targetMap->getPageSize());
+		if (m_targetMap->hasTermDict()) {
+			p->m_placedMap.setBuildTermDict();
 		}
+		p->m_placedMap.setFirstPageOffset(p->m_placeOffset % m_targetMap->getPageSize());
+	}
 
-		// . if g_errno we're done
-		// . if list is empty we're done
-		if (g_errno || THIS->m_doneMerging) {
-			THIS->doneMerging();
-			logTrace(g_conf.m_logTraceRdbMerge, "END. error/done merging. list=%p", &THIS->m_list);
-			return;
+	log(LOG_INFO, "db: merge: Placing %d segments in %s, %" PRId64" bytes total.",
+	    (int)m_partitions.size() - 1, m_targetFile->getFilename(), offset);
+
+	m_isPlacing = true;
+	m_numPlacesOutstanding = (int32_t)m_partitions.size();
+
+	// the last done wrapper may finish the merge and delete the partitions
+	std::vector<Partition*> partitions(m_partitions);
+	for (auto p : partitions) {
+		if (g_jobScheduler.submit(placeSegmentWrapper, placeSegmentDoneWrapper, p, thread_type_file_merge, 0)) {
+			continue;
 		}
 
-		// return if this blocked
-		if (!THIS->filterList()) {
-			logTrace(g_conf.m_logTraceRdbMerge, "END. filterList blocked. list=%p", &THIS->m_list);
-			return;
+		log(LOG_WARN, "db: merge: Unable to submit place segment job. Running on main thread!");
+		placeSegmentWrapper(p);
+		placeSegmentDoneWrapper(p, job_exit_normal);
+	}
+}
+
+void RdbMerge::placeSegmentWrapper(void *state) {
+	Partition *p = static_cast<Partition*>(state);
+	RdbMerge *that = p->m_merge;
+
+	g_errno = 0;
+
+	bool status;
+	if (p->m_partitionNum == 0) {
+		status = that->m_targetMap->writeMap(false) && (!that->m_targetIndex || that->m_targetIndex->writeIndex(false));
+	} else {
+		status = that->placeSegment(p);
+	}
+
+	if (!status) {
+		p->m_placeErrno = g_errno ? g_errno : EBADENGINEER;
+		log(LOG_ERROR, "db: merge: Placing partition #%" PRId32" in %s failed: %s",
+		    p->m_partitionNum, that->m_targetFile->getFilename(), mstrerror(p->m_placeErrno));
+	}
+}
+
+void RdbMerge::placeSegmentDoneWrapper(void *state, job_exit_t exit_type) {
+	Partition *p = static_cast<Partition*>(state);
+	RdbMerge *that = p->m_merge;
+
+	if (exit_type != job_exit_normal && !p->m_placeErrno) {
+		p->m_placeErrno = ECANCELED;
+	}
+
+	if (p->m_placeErrno && !that->m_mergeErrno) {
+		that->m_mergeErrno = p->m_placeErrno;
+	}
+
+	if (--that->m_numPlacesOutstanding > 0) {
+		return;
+	}
+
+	if (that->m_isHalted || that->m_mergeErrno == ECANCELED) {
+		that->m_isPlacing = false;
+		return;
+	}
+
+	if (that->m_mergeErrno) {
+		that->m_isPlacing = false;
+		g_errno = that->m_mergeErrno;
+		that->doneMerging();
+		return;
+	}
+
+	if (g_jobScheduler.submit(joinSegmentsWrapper, joinSegmentsDoneWrapper, that, thread_type_file_merge, 0)) {
+		return;
+	}
+
+	log(LOG_WARN, "db: merge: Unable to submit join segments job. Running on main thread!");
+	joinSegmentsWrapper(that);
+	joinSegmentsDoneWrapper(that, job_exit_normal);
+}
+
+void RdbMerge::joinSegmentsWrapper(void *state) {
+	RdbMerge *that = static_cast<RdbMerge*>(state);
+
+	g_errno = 0;
+	if (!that->joinSegments()) {
+		that->m_mergeErrno = g_errno ? g_errno : EBADENGINEER;
+		log(LOG_ERROR, "db: merge: Joining the maps of %s failed: %s",
+		    that->m_targetFile->getFilename(), mstrerror(that->m_mergeErrno));
+	}
+}
+
+void RdbMerge::joinSegmentsDoneWrapper(void *state, job_exit_t exit_type) {
+	RdbMerge *that = static_cast<RdbMerge*>(state);
+
+	that->m_isPlacing = false;
+
+	if (exit_type != job_exit_normal || that->m_isHalted) {
+		return;
+	}
+
+	g_errno = that->m_mergeErrno;
+	that->doneMerging();
+}
+
+// . copies the segment of partition p to p->m_placeOffset in the target file
+//   and maps the records there into p->m_placedMap
+// . the reads end where a record starts according to the segment map, so
+//   no record is cut off
+// . runs in a job thread with other partitions, so it writes through its
+//   own BigFile of the target file
+// . returns false and sets g_errno on error
+bool RdbMerge::placeSegment(Partition *p) {
+	const RdbMap *map = &p->m_map;
+	int64_t size = map->getFileSize();
+
+	log(LOG_INFO, "db: merge: Placing %" PRId64" bytes of partition #%" PRId32" in %s at offset %" PRId64,
+	    size, p->m_partitionNum, m_targetFile->getFilename(), p->m_placeOffset);
+
+	BigFile target;
+	target.set(m_targetFile->getDir(), m_targetFile->getFilename());
+	if (!target.open(O_RDWR | O_CREAT)) {
+		return false;
+	}
+	target.setFlushingIsApplicable();
+
+	int64_t bufSize = s_placeChunkSize;
+	char *buf = (char *)mmalloc(bufSize, "RdbMergeSeg");
+	if (!buf) {
+		return false;
+	}
+
+	// last key of the previous read for the half keys of the next one
+	char key[MAX_KEY_BYTES];
+	KEYMIN(key, m_ks);
+
+	bool status = true;
+	int32_t page = 0;
+	for (int64_t start = 0; start < size; ) {
+		int64_t end = start;
+		while (end - start < s_placeChunkSize && page < map->getNumPages()) {
+			page++;
+			end = map->getAbsoluteOffset(page);
 		}
 
-		// return if this blocked
-		if (!THIS->dumpList()) {
-			logTrace(g_conf.m_logTraceRdbMerge, "END. dumpList blocked. list=%p", &THIS->m_list);
-			return;
+		int64_t n = end - start;
+		if (n > bufSize) {
+			mfree(buf, bufSize, "RdbMergeSeg");
+			bufSize = n;
+			buf = (char *)mmalloc(bufSize, "RdbMergeSeg");
+			if (!buf) {
+				return false;
+			}
+		}
+
+		// no callback so these don't block. g_errno is set on error
+		g_errno = 0;
+		p->m_file->read(buf, n, start);
+		if (!g_errno) {
+			target.write(buf, n, p->m_placeOffset + start);
+		}
+		if (g_errno) {
+			status = false;
+			break;
 		}
 
-		// otherwise, keep on trucking
+		RdbList list;
+		list.set(buf, n, buf, bufSize, KEYMIN(), KEYMAX(), m_fixedDataSize, false, m_useHalfKeys, m_ks);
+
+		// . HACK from RdbMap::generateMap() for a half key at the start
+		if (start > 0) {
+			if (m_ks == 18) {
+				list.setListPtrLo(key + (m_ks - 12));
+			}
+			list.setListPtrHi(key + (m_ks - 6));
+		}
+
+		for (; !list.isExhausted(); list.skipCurrentRecord()) {
+			list.getCurrentKey(key);
+			if (!p->m_placedMap.addRecord(key, list.getCurrentRec(), list.getCurrentRecSize())) {
+				status = false;
+				break;
+			}
+		}
+		if (!status) {
+			break;
+		}
+
+		start = end;
 	}
+
+	mfree(buf, bufSize, "RdbMergeSeg");
+	target.close();
+
+	return status;
 }
 
-// . return false if blocked, true otherwise
-// . set g_errno on error
-// . list should be truncated, possible have all negative keys removed,
-//   and de-duped thanks to RdbList::indexMerge_r() and RdbList::merge_r()
-bool RdbMerge::dumpList() {
-	// if the startKey rolled over we're done
-	if (KEYCMP(m_startKey, KEYMIN(), m_ks) == 0) {
-		m_doneMerging = true;
+// . adds the maps and indexes of the placed segments to the target map and
+//   index in key order
+// . runs in a job thread. returns false and sets g_errno on error
+bool RdbMerge::joinSegments() {
+	for (auto p : m_partitions) {
+		if (p->m_partitionNum == 0) {
+			continue;
+		}
+
+		if (!m_targetMap->addMap(&p->m_placedMap)) {
+			return false;
+		}
+
+		if (m_targetIndex) {
+			m_targetIndex->addIndex(&p->m_index);
+		}
 	}
 
-	logDebug(g_conf.m_logDebugMerge, "db: Dumping list.");
+	m_targetFile->invalidateFileSize();
 
-	logTrace(g_conf.m_logTraceRdbMerge, "list=%p startKey=%s",
-	         &m_list, KEYSTR(m_startKey, m_ks));
+	log(LOG_INFO, "db: merge: Placed segments in %s, %" PRId64" bytes total.",
+	    m_targetFile->getFilename(), m_targetMap->getFileSize());
+	return true;
+}
 
-	// . send the whole list to the dump
-	// . it returns false if blocked, true otherwise
-	// . it sets g_errno on error
-	// . it calls dumpListWrapper when done dumping
-	// . return true if m_dump had an error or it did not block
-	// . if it gets a EFILECLOSED error it will keep retrying forever
-	return m_dump.dumpList(&m_list);
+// . fraction of the source files we have read so far, based on where the
+//   partitions' start keys fall in their maps
+double RdbMerge::getProgress() const {
+	RdbBase *base = getRdbBase(m_rdbId, m_collnum);
+	if (!base || m_partitions.empty()) {
+		return 0;
+	}
+
+	int64_t total = 0;
+	int64_t done = 0;
+	int32_t numFiles = base->getNumFiles();
+	for (int32_t i = m_startFileNum; i < m_startFileNum + m_numFiles && i < numFiles; i++) {
+		const RdbMap *map = base->getMap(i);
+		if (!map) {
+			continue;
+		}
+		total += map->getFileSize();
+
+		// everything before where the merge (re)started
+		done += map->getAbsoluteOffset(map->getPage(m_partitions[0]->m_rangeStartKey));
+
+		for (size_t j = 0; j < m_partitions.size(); j++) {
+			const Partition *p = m_partitions[j];
+			int64_t start = map->getAbsoluteOffset(map->getPage(p->m_rangeStartKey));
+			int64_t cur;
+			if (!p->m_doneReading) {
+				cur = map->getAbsoluteOffset(map->getPage(p->m_startKey));
+			} else if (j + 1 < m_partitions.size()) {
+				cur = map->getAbsoluteOffset(map->getPage(m_partitions[j + 1]->m_rangeStartKey));
+			} else {
+				cur = map->getFileSize();
+			}
+			if (cur > start) {
+				done += cur - start;
+			}
+		}
+	}
+
+	if (total <= 0) {
+		return 0;
+	}
+
+	return (double)done / (double)total;
+}
+
+void RdbMerge::printStatus(SafeBuf *sb) const {
+	sb->safePrintf("<table %s>"
+	               "<tr class=hdrow><td colspan=2><center><b>Merge Status</b></center></td></tr>\n",
+	               TABLE_STYLE);
+
+	if (!m_isMerging) {
+		sb->safePrintf("<tr class=poo><td colspan=2>No merge in progress</td></tr>\n"
+		               "</table><br><br>\n");
+		return;
+	}
+
+	int32_t numReading = 0;
+	int32_t numWriting = 0;
+	int32_t numDone = 0;
+	for (auto p : m_partitions) {
+		if (p->m_getListOutstanding || p->m_filterOutstanding) {
+			numReading++;
+		}
+		if (p->m_dumpOutstanding) {
+			numWriting++;
+		}
+		if (p->m_doneReading && !p->m_haveReadList && !p->m_dumpOutstanding) {
+			numDone++;
+		}
+	}
+
+	const char *state;
+	if (m_isHalted) {
+		state = "halted";
+	} else if (!m_isLockAquired || m_mergeStartTime == 0) {
+		state = "waiting for merge space";
+	} else if (m_isPlacing) {
+		state = "placing segments";
+	} else if (m_isSleeping) {
+		state = "sleeping";
+	} else if (numReading) {
+		state = numWriting ? "reading+writing" : "reading";
+	} else if (numWriting) {
+		state = "writing";
+	} else {
+		state = "idle";
+	}
+
+	double elapsedSecs = m_mergeStartTime ? (gettimeofdayInMilliseconds() - m_mergeStartTime) / 1000.0 : 0;
+	double readMBps = elapsedSecs > 0 ? m_bytesRead / elapsedSecs / (1024 * 1024) : 0;
+	double writeMBps = elapsedSecs > 0 ? m_bytesWritten / elapsedSecs / (1024 * 1024) : 0;
+
+	double progress = m_mergeStartTime ? getProgress() : 0;
+
+	// only count what was done since we (re)started, a killed merge may be resumed
+	char eta[64] = "-";
+	if (progress > m_startProgress && progress < 1.0) {
+		double remainingSecs = elapsedSecs * (1.0 - progress) / (progress - m_startProgress);
+		snprintf(eta, sizeof(eta), "%" PRId64" s", (int64_t)remainingSecs);
+	}
+
+	sb->safePrintf("<tr class=poo><td><b>rdb</b></td><td>%s</td></tr>\n"
+	               "<tr class=poo><td><b>files</b></td><td>%" PRId32" - %" PRId32"</td></tr>\n"
+	               "<tr class=poo><td><b>state</b></td><td>%s</td></tr>\n"
+	               "<tr class=poo><td><b>partitions</b></td><td>%d (%" PRId32" reading, %" PRId32" writing, %" PRId32" done)</td></tr>\n"
+	               "<tr class=poo><td><b>elapsed</b></td><td>%.0f s</td></tr>\n"
+	               "<tr class=poo><td><b>progress</b></td><td>%.1f%%</td></tr>\n"
+	               "<tr class=poo><td><b>ETA</b></td><td>%s</td></tr>\n"
+	               "<tr class=poo><td><b>read</b></td><td>%" PRId64" MB (%.2f MB/s)</td></tr>\n"
+	               "<tr class=poo><td><b>written</b></td><td>%" PRId64" MB (%.2f MB/s)</td></tr>\n"
+	               "<tr class=poo><td><b>lists dumped</b></td><td>%" PRId64"</td></tr>\n"
+	               "<tr class=poo><td><b>throttled</b></td><td>%" PRId64" ms (max %" PRId32" MB/s)</td></tr>\n"
+	               "</table><br><br>\n",
+	               getDbnameFromId(m_rdbId),
+	               m_startFileNum, m_startFileNum + m_numFiles - 1,
+	               state,
+	               (int)m_partitions.size(), numReading, numWriting, numDone,
+	               elapsedSecs,
+	               progress * 100.0,
+	               eta,
+	               m_bytesRead / (1024 * 1024), readMBps,
+	               m_bytesWritten / (1024 * 1024), writeMBps,
+	               m_numListsDumped,
+	               m_throttledMs, g_conf.m_mergeMaxMBPerSec);
 }
 
 void RdbMerge::doneMerging() {
 	// save this
 	int32_t saved_errno = g_errno;
 
-	// let RdbDump free its m_verifyBuf buffer if it existed
-	m_dump.reset();
-
-	// . free the list's memory, reset() doesn't do it
-	// . when merging titledb i'm still seeing 200MB allocs to read from tfndb.
-	m_list.freeList();
+	for (auto p : m_partitions) {
+		// let RdbDump free its m_verifyBuf buffer if it existed
+		p->m_dump.reset();
+
+		// . free the lists' memory, reset() doesn't do it
+		// . when merging titledb i'm still seeing 200MB allocs to read from tfndb.
+		p->m_lists[0].freeList();
+		p->m_lists[1].freeList();
+
+		// . reset our class
+		// . this will free it's cutoff keys buffer, trash buffer, treelist
+		// . TODO: should we not reset to keep the mem handy for next time
+		//   to help avoid out of mem errors?
+		p->m_msg5.reset();
+
+		// segments are copied into the target file or the merge failed
+		if (p->m_partitionNum > 0 && p->m_file->doesExist()) {
+			p->m_file->close();
+			p->m_file->unlink();
+		}
+	}
 
-	log(LOG_INFO,"db: Merge status: %s.",mstrerror(g_errno));
+	int64_t elapsedMs = gettimeofdayInMilliseconds() - m_mergeStartTime;
+	log(LOG_INFO,"db: Merge status: %s. Read %" PRId64" and wrote %" PRId64" bytes in %" PRId64" ms using %d partitions (throttled %" PRId64" ms).",
+	    mstrerror(g_errno), m_bytesRead, m_bytesWritten, elapsedMs, (int)m_partitions.size(), m_throttledMs);
+	m_mergeStartTime = 0;
 
-	// . reset our class
-	// . this will free it's cutoff keys buffer, trash buffer, treelist
-	// . TODO: should we not reset to keep the mem handy for next time
-	//   to help avoid out of mem errors?
-	m_msg5.reset();
+	deletePartitions();
 
 	// if collection rec was deleted while merging files for it
 	// then the rdbbase should be NULL i guess.
@@ -28,11 +28,17 @@
 #define GB_RDBMERGE_H
 
 #include "RdbDump.h"
+#include "RdbMap.h"
+#include "RdbIndex.h"
 #include "Msg5.h"
+#include <vector>
 
-class RdbIndex;
 class MergeSpaceCoordinator;
 class RdbBase;
+class SafeBuf;
+
+// prefix of the files partitions > 0 of a merge dump into
+#define RDBMERGE_SEGMENT_PREFIX "mergeseg"
 
 
 class RdbMerge {
@@ -61,7 +67,58 @@ public:
 
 	void mergeIncorporated(const RdbBase *);
 
+	// progress, throughput and ETA of the current merge for the stats page
+	void printStatus(SafeBuf *sb) const;
+
 private:
+	// . a key range of the merge with its own reader and dump
+	// . partition 0 dumps into the target file, the others dump into
+	//   segment files in the merge directory which are copied to their
+	//   place in the target file once all partitions are done
+	struct Partition {
+		Partition(RdbMerge *merge, int32_t partitionNum);
+		~Partition();
+
+		RdbMerge *m_merge;
+		int32_t m_partitionNum;
+
+		char m_rangeStartKey[MAX_KEY_BYTES];
+		char m_startKey[MAX_KEY_BYTES];     //next key to read
+		char m_endKey[MAX_KEY_BYTES];
+
+		// set when the read reached m_endKey, no more lists to read
+		bool m_doneReading;
+
+		// target file for partition 0, otherwise a segment file we own
+		BigFile *m_file;
+
+		// for writing to m_file
+		RdbDump m_dump;
+
+		// map and index of the segment file
+		RdbMap m_map;
+		RdbIndex m_index;
+
+		// where the segment goes in the target file and its map there
+		int64_t m_placeOffset;
+		RdbMap m_placedMap;
+		int32_t m_placeErrno;
+
+		// a Msg5 for getting RdbLists from disk/cache
+		Msg5 m_msg5;
+
+		// . double buffered. the next list is read into
+		//   m_lists[m_readListNum] while m_lists[m_dumpListNum] is dumped
+		RdbList m_lists[2];
+		int32_t m_readListNum;
+		int32_t m_dumpListNum;
+		bool m_getListOutstanding;
+		bool m_filterOutstanding;
+		bool m_haveReadList;        //read and filtered, waiting for the dump
+		bool m_dumpOutstanding;
+		int32_t m_dumpListSize;
+	};
+
 	static void acquireLockWrapper(void *state);
 	static void acquireLockDoneWrapper(void *state, job_exit_t exit_type);
 
@@ -70,18 +127,36 @@ private:
 	static void regenerateFilesWrapper(void *state);
 	static void regenerateFilesDoneWrapper(void *state, job_exit_t exit_type);
 
+	static void placeSegmentWrapper(void *state);
+	static void placeSegmentDoneWrapper(void *state, job_exit_t exit_type);
+	static void joinSegmentsWrapper(void *state);
+	static void joinSegmentsDoneWrapper(void *state, job_exit_t exit_type);
+
 	void getLock();
 	static void filterListWrapper(void *state);
 	static void filterDoneWrapper(void *state, job_exit_t exit_type);
 	static void dumpListWrapper(void *state);
 	static void gotListWrapper(void *state, RdbList *list, Msg5 *msg5);
 	static void tryAgainWrapper(int fd, void *state);
-
-	bool filterList();
-	bool dumpList();
-	bool getNextList();
-	bool getAnotherList();
+	static void throttleWrapper(int fd, void *state);
+
+	bool createPartitions(RdbBase *base, int64_t startOffset, const char *prevLastKey);
+	int32_t getNumPartitionsToUse(RdbBase *base, uint64_t spaceNeeded, const RdbMap **map) const;
+	void deletePartitions();
+
+	bool advance();
+	void filterList(Partition *p);
+	bool dumpList(Partition *p);
+	void gotDump(Partition *p);
+	bool getNextList(Partition *p);
+	bool getAnotherList(Partition *p);
+	void gotList(Partition *p);
+	bool throttle();
+	void placeSegments();
+	bool placeSegment(Partition *p);
+	bool joinSegments();
 	void doneMerging();
+	double getProgress() const;
 
 	// . return false and sets errno on error merging
 	// . returns true if blocked, or completed successfully
@@ -101,34 +176,43 @@ private:
 	std::atomic<bool> m_isAcquireLockJobSubmited;
 	bool m_isLockAquired;
 
-	// set to true when m_startKey wraps back to 0
-	bool m_doneMerging;
-
-	bool m_getListOutstanding;
-
 	uint64_t m_spaceNeededForMerge;
 	// . we get the units from the master and the mergees from the units
 	int32_t m_startFileNum;
 	int32_t m_numFiles;
 	int32_t m_fixedDataSize;
+	bool m_useHalfKeys;
 
 	BigFile *m_targetFile;
 	RdbMap *m_targetMap;
 	RdbIndex *m_targetIndex;
 	bool m_doneRegenerateFiles;
 
+	// where the merge (re)started
 	char m_startKey[MAX_KEY_BYTES];
 
 	bool m_isMerging;
 	bool m_isHalted;
 
-	// for writing to target file
-	RdbDump m_dump;
-
-	// a Msg5 for getting RdbLists from disk/cache
-	Msg5 m_msg5;
-
-	RdbList m_list;
+	std::vector<Partition*> m_partitions;
+	int32_t m_numPartitions;    //most partitions the merge space was acquired for
+
+	bool m_isSleeping;          //ENOMEM retry or bandwidth ceiling
+	bool m_isPlacing;           //placing the segments in the target file and joining their maps
+	int32_t m_numPlacesOutstanding;
+	int32_t m_mergeErrno;       //first error of any partition
+
+	// metrics of the current merge
+	int64_t m_mergeStartTime;
+	int64_t m_bytesRead;
+	int64_t m_bytesWritten;
+	int64_t m_numListsDumped;
+	int64_t m_throttledMs;
+	double m_startProgress;     //a killed merge may be resumed
+
+	// bytes we may still read/write under the "merge max MB/s" ceiling
+	int64_t m_ioCredit;
+	int64_t m_ioCreditTime;
 
 	int32_t m_niceness;
 
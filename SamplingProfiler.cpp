@@ -0,0 +1,507 @@
+#include "SamplingProfiler.h"
+#include "Profiler.h"
+#include "JobScheduler.h"
+#include "Hostdb.h"
+#include "Pages.h"       //TABLE_STYLE etc.
+#include "Loop.h"        //gbsystem()
+#include "SafeBuf.h"
+#include "Errno.h"
+#include "Log.h"
+#include <execinfo.h>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+
+SamplingProfiler g_samplingProfiler;
+
+// . at most takeSample(), the SIGPROF handler and the signal trampoline
+//   are above the interrupted frame. the handler may be a tail call
+static const int32_t s_skipFrames = 3;
+// give up on a sample if its slot and the next ones are taken
+static const int32_t s_maxProbes = 16;
+
+// . what this thread is working on. plain thread locals of the executable
+//   are read without calls so the signal handler can use them
+static thread_local int32_t s_threadType = -1;
+static thread_local int32_t s_msgType = -1;
+// stack table claimed by this thread and the generation it was claimed in
+static thread_local void *s_threadStacks = NULL;
+static thread_local uint32_t s_threadStacksGeneration = 0;
+
+
+SamplingProfiler::SamplingProfiler()
+	: m_threads(NULL),
+	  m_threadsSize(0),
+	  m_numThreads(0),
+	  m_generation(1),
+	  m_running(false),
+	  m_intervalUS(s_defaultIntervalUS),
+	  m_numSamples(0),
+	  m_numDropped(0) {
+}
+
+SamplingProfiler::~SamplingProfiler() {
+	stop();
+	// a sample may still be in flight in another thread at exit so
+	// leave the mapping alone
+}
+
+int32_t SamplingProfiler::setThreadType(int32_t threadType) {
+	int32_t old = s_threadType;
+	s_threadType = threadType;
+	return old;
+}
+
+int32_t SamplingProfiler::setMsgType(int32_t msgType) {
+	int32_t old = s_msgType;
+	s_msgType = msgType;
+	return old;
+}
+
+int32_t SamplingProfiler::getNumThreads() const {
+	return std::min(m_numThreads.load(), s_maxThreads);
+}
+
+bool SamplingProfiler::start(int32_t intervalUS) {
+	if(isRunning())
+		return true;
+
+	// the old profiler uses the same timer and signal
+	if(g_profiler.m_realTimeProfilerRunning)
+		g_profiler.stopRealTimeProfiler(false);
+
+	if(!m_threads) {
+		// . only the pages of threads that got samples are ever touched
+		size_t size = sizeof(ThreadStacks) * s_maxThreads;
+		void *p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+		if(p == MAP_FAILED) {
+			g_errno = ENOMEM;
+			log(LOG_WARN, "admin: sampling profiler could not map %zu bytes", size);
+			return false;
+		}
+		m_threads = (ThreadStacks *)p;
+		m_threadsSize = size;
+	}
+
+	// backtrace() loads libgcc on the first call, do not do that in
+	// the signal handler
+	void *dummy[4];
+	backtrace(dummy, 4);
+
+	if(intervalUS < 100)
+		intervalUS = 100;
+	m_intervalUS = intervalUS;
+	m_running = true;
+
+	struct itimerval value;
+	value.it_interval.tv_sec = intervalUS / 1000000;
+	value.it_interval.tv_usec = intervalUS % 1000000;
+	value.it_value = value.it_interval;
+	if(setitimer(ITIMER_PROF, &value, NULL) != 0) {
+		g_errno = errno;
+		m_running = false;
+		log(LOG_WARN, "admin: sampling profiler setitimer() failed: %s", mstrerror(g_errno));
+		return false;
+	}
+
+	log(LOG_INFO, "admin: sampling profiler started, interval %" PRId32 "us", m_intervalUS);
+	return true;
+}
+
+void SamplingProfiler::stop() {
+	if(!isRunning())
+		return;
+	m_running = false;
+
+	struct itimerval value;
+	memset(&value, 0, sizeof(value));
+	setitimer(ITIMER_PROF, &value, NULL);
+
+	log(LOG_INFO, "admin: sampling profiler stopped, %" PRIu64 " samples", m_numSamples.load());
+}
+
+void SamplingProfiler::clear() {
+	if(isRunning())
+		return;
+	// threads claim a new table on their next sample
+	m_generation++;
+	m_numThreads = 0;
+	// . zero the pages and give them back. a late sample racing with
+	//   this just lands in a zero page
+	if(m_threads)
+		madvise(m_threads, m_threadsSize, MADV_DONTNEED);
+	m_numSamples = 0;
+	m_numDropped = 0;
+}
+
+SamplingProfiler::ThreadStacks *SamplingProfiler::claimThreadStacks() {
+	uint32_t generation = m_generation.load(std::memory_order_acquire);
+	if(s_threadStacksGeneration != generation) {
+		s_threadStacksGeneration = generation;
+		s_threadStacks = NULL;
+		int32_t i = m_numThreads.fetch_add(1);
+		if(i < s_maxThreads) {
+			ThreadStacks *ts = &m_threads[i];
+			ts->m_tid = (int32_t)syscall(SYS_gettid);
+			ts->m_isMainThread = (ts->m_tid == (int32_t)getpid());
+			s_threadStacks = ts;
+		}
+	}
+	return (ThreadStacks *)s_threadStacks;
+}
+
+// . the frame the signal interrupted, from the signal context
+static int32_t getFirstFrame(void * const *frames, int32_t numFrames, const void *context) {
+#if defined(__x86_64__)
+	if(context) {
+		const ucontext_t *uc = (const ucontext_t *)context;
+		void *pc = (void *)uc->uc_mcontext.gregs[REG_RIP];
+		for(int32_t i = 0; i <= s_skipFrames && i < numFrames; i++) {
+			if(frames[i] == pc)
+				return i;
+		}
+	}
+#endif
+	return s_skipFrames;
+}
+
+// . called from the SIGPROF handler so only async-signal-safe stuff here
+void SamplingProfiler::takeSample(const void *context) {
+	if(!m_running.load(std::memory_order_relaxed))
+		return;
+
+	int savedErrno = errno;
+
+	ThreadStacks *ts = claimThreadStacks();
+	void *allFrames[s_maxDepth + s_skipFrames];
+	int32_t numFrames = ts ? backtrace(allFrames, s_maxDepth + s_skipFrames) : 0;
+	int32_t firstFrame = getFirstFrame(allFrames, numFrames, context);
+	void * const *frames = allFrames + firstFrame;
+	numFrames = std::min(numFrames - firstFrame, s_maxDepth);
+	if(numFrames <= 0) {
+		m_numDropped.fetch_add(1, std::memory_order_relaxed);
+		errno = savedErrno;
+		return;
+	}
+	int16_t threadType = (int16_t)s_threadType;
+	int16_t msgType = (int16_t)s_msgType;
+
+	// fnv-1a of the tags and frames
+	uint64_t h = 14695981039346656037ULL;
+	h = (h ^ (uint16_t)threadType) * 1099511628211ULL;
+	h = (h ^ (uint16_t)msgType) * 1099511628211ULL;
+	for(int32_t i = 0; i < numFrames; i++)
+		h = (h ^ (uintptr_t)frames[i]) * 1099511628211ULL;
+	if(h == 0)
+		h = 1;
+
+	// . open addressing. a 64-bit hash match is taken as the same stack
+	const uint32_t mask = s_stacksPerThread - 1;
+	for(int32_t probe = 0; probe < s_maxProbes; probe++) {
+		Stack *s = &ts->m_stacks[(h + probe) & mask];
+		uint64_t sh = s->m_hash.load(std::memory_order_relaxed);
+		if(sh == h) {
+			s->m_count.fetch_add(1, std::memory_order_relaxed);
+			m_numSamples.fetch_add(1, std::memory_order_relaxed);
+			errno = savedErrno;
+			return;
+		}
+		if(sh == 0) {
+			s->m_threadType = threadType;
+			s->m_msgType = msgType;
+			s->m_depth = numFrames;
+			for(int32_t i = 0; i < numFrames; i++)
+				s->m_frames[i] = (uintptr_t)frames[i];
+			s->m_count.store(1, std::memory_order_relaxed);
+			// publish it to getFoldedStacks()
+			s->m_hash.store(h, std::memory_order_release);
+			m_numSamples.fetch_add(1, std::memory_order_relaxed);
+			errno = savedErrno;
+			return;
+		}
+	}
+
+	m_numDropped.fetch_add(1, std::memory_order_relaxed);
+	errno = savedErrno;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// dumping
+
+namespace {
+
+struct FoldedStack {
+	const char *m_threadTag;
+	int32_t m_msgType;
+	int32_t m_depth;
+	const uintptr_t *m_frames;
+	uint64_t m_count;
+};
+
+struct ObjectLookup {
+	uintptr_t m_addr;
+	bool m_found;
+	bool m_isMain;
+	uintptr_t m_bias;
+};
+
+}
+
+static const char *getThreadTag(int32_t threadType, bool isMainThread) {
+	if(threadType >= 0)
+		return thread_type_name((thread_type_t)threadType);
+	return isMainThread ? "main" : "other";
+}
+
+// . find the loaded object holding lookup->m_addr. the first one is the
+//   executable itself
+static int findObjectCallback(struct dl_phdr_info *info, size_t, void *data) {
+	ObjectLookup *lookup = (ObjectLookup *)data;
+	for(int i = 0; i < info->dlpi_phnum; i++) {
+		const ElfW(Phdr) &ph = info->dlpi_phdr[i];
+		if(ph.p_type != PT_LOAD)
+			continue;
+		uintptr_t start = info->dlpi_addr + ph.p_vaddr;
+		if(lookup->m_addr >= start && lookup->m_addr < start + ph.p_memsz) {
+			lookup->m_found = true;
+			lookup->m_isMain = (info->dlpi_name == NULL || info->dlpi_name[0] == '\0');
+			lookup->m_bias = info->dlpi_addr;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static std::string demangle(const char *name) {
+	int status = 0;
+	char *d = abi::__cxa_demangle(name, NULL, NULL, &status);
+	std::string s(d && status == 0 ? d : name);
+	free(d);
+	return s;
+}
+
+// . symbol names for the addresses. the executable is not linked with
+//   -rdynamic so its functions are looked up with addr2line, the shared
+//   libraries with dladdr()
+static void resolveAddresses(const std::vector<uintptr_t> &addrs, std::map<uintptr_t,std::string> *names) {
+	std::vector<uintptr_t> mainAddrs;
+	SafeBuf addrFile;
+	for(uintptr_t addr : addrs) {
+		ObjectLookup lookup = { addr, false, false, 0 };
+		dl_iterate_phdr(findObjectCallback, &lookup);
+		if(lookup.m_found && lookup.m_isMain) {
+			mainAddrs.push_back(addr);
+			addrFile.safePrintf("0x%" PRIxPTR "\n", addr - lookup.m_bias);
+			continue;
+		}
+		Dl_info info;
+		if(dladdr((void *)addr, &info) && info.dli_sname) {
+			(*names)[addr] = demangle(info.dli_sname);
+		} else if(lookup.m_found && dladdr((void *)addr, &info) && info.dli_fname) {
+			const char *base = strrchr(info.dli_fname, '/');
+			(*names)[addr] = std::string("[") + (base ? base + 1 : info.dli_fname) + "]";
+		}
+	}
+	if(mainAddrs.empty())
+		return;
+
+	char exe[1024];
+	ssize_t exeLen = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	if(exeLen <= 0)
+		return;
+	exe[exeLen] = '\0';
+
+	SafeBuf inName, outName, cmd;
+	inName.safePrintf("%strash/sprof_addrs.txt", g_hostdb.m_dir);
+	outName.safePrintf("%strash/sprof_names.txt", g_hostdb.m_dir);
+	if(addrFile.save(inName.getBufStart()) < 0) {
+		log(LOG_WARN, "admin: could not write %s: %s", inName.getBufStart(), mstrerror(g_errno));
+		return;
+	}
+	// one line with the function name and one with file:line per address
+	cmd.safePrintf("addr2line -f -C -e %s < %s > %s", exe, inName.getBufStart(), outName.getBufStart());
+	gbsystem(cmd.getBufStart());
+
+	SafeBuf out;
+	if(out.load(outName.getBufStart()) <= 0) {
+		log(LOG_WARN, "admin: could not read %s", outName.getBufStart());
+		return;
+	}
+	char *p = out.getBufStart();
+	for(uintptr_t addr : mainAddrs) {
+		if(!p || !*p)
+			break;
+		char *nl = strchr(p, '\n');
+		if(nl) *nl = '\0';
+		if(strcmp(p, "??") != 0)
+			(*names)[addr] = p;
+		// skip the file:line
+		p = nl ? strchr(nl + 1, '\n') : NULL;
+		if(p) p++;
+	}
+	unlink(inName.getBufStart());
+	unlink(outName.getBufStart());
+}
+
+// . return addresses point after the call, look up the call itself
+static uintptr_t getLookupAddress(const uintptr_t *frames, int32_t i) {
+	return i == 0 ? frames[i] : frames[i] - 1;
+}
+
+static void appendFrame(std::string *line, uintptr_t addr, const std::map<uintptr_t,std::string> &names) {
+	auto it = names.find(addr);
+	if(it == names.end()) {
+		char tmp[32];
+		sprintf(tmp, "0x%" PRIxPTR, addr);
+		line->append(tmp);
+		return;
+	}
+	// ';' separates frames in the folded format
+	for(char c : it->second)
+		line->push_back(c == ';' ? ':' : c);
+}
+
+bool SamplingProfiler::getFoldedStacks(SafeBuf *sb, bool resolve) {
+	std::vector<FoldedStack> stacks;
+	int32_t numThreads = getNumThreads();
+	for(int32_t t = 0; t < numThreads; t++) {
+		const ThreadStacks &ts = m_threads[t];
+		for(int32_t i = 0; i < s_stacksPerThread; i++) {
+			const Stack &s = ts.m_stacks[i];
+			if(s.m_hash.load(std::memory_order_acquire) == 0)
+				continue;
+			FoldedStack fs;
+			fs.m_threadTag = getThreadTag(s.m_threadType, ts.m_isMainThread);
+			fs.m_msgType = s.m_msgType;
+			fs.m_depth = std::min(s.m_depth, s_maxDepth);
+			fs.m_frames = s.m_frames;
+			fs.m_count = s.m_count.load(std::memory_order_relaxed);
+			stacks.push_back(fs);
+		}
+	}
+
+	std::map<uintptr_t,std::string> names;
+	if(resolve) {
+		std::vector<uintptr_t> addrs;
+		for(const FoldedStack &fs : stacks)
+			for(int32_t i = 0; i < fs.m_depth; i++)
+				addrs.push_back(getLookupAddress(fs.m_frames, i));
+		std::sort(addrs.begin(), addrs.end());
+		addrs.erase(std::unique(addrs.begin(), addrs.end()), addrs.end());
+		resolveAddresses(addrs, &names);
+	}
+
+	// . the same stack from different threads, or from different
+	//   places in the same function once resolved, is one line
+	std::map<std::string,uint64_t> lines;
+	for(const FoldedStack &fs : stacks) {
+		std::string line(fs.m_threadTag);
+		line.push_back(';');
+		if(fs.m_msgType >= 0) {
+			char tmp[16];
+			sprintf(tmp, "msg0x%02" PRIx32 ";", fs.m_msgType);
+			line.append(tmp);
+		}
+		// outermost first
+		for(int32_t i = fs.m_depth - 1; i >= 0; i--) {
+			appendFrame(&line, getLookupAddress(fs.m_frames, i), names);
+			if(i > 0)
+				line.push_back(';');
+		}
+		lines[line] += fs.m_count;
+	}
+
+	// highest count first
+	std::vector<std::pair<uint64_t,const std::string*>> sorted;
+	for(const auto &e : lines)
+		sorted.push_back(std::make_pair(e.second, &e.first));
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<uint64_t,const std::string*> &a,
+	                                           const std::pair<uint64_t,const std::string*> &b) {
+		return a.first > b.first;
+	});
+	for(const auto &e : sorted) {
+		if(!sb->safeMemcpy(e.second->data(), (int32_t)e.second->size()) ||
+		   !sb->safePrintf(" %" PRIu64 "\n", e.first))
+			return false;
+	}
+	return true;
+}
+
+void SamplingProfiler::printStatus(SafeBuf *sb) {
+	bool running = isRunning();
+	sb->safePrintf("<table %s>\n"
+	               "<tr class=hdrow><td colspan=2><center><b>Sampling Profiler</b> ",
+	               TABLE_STYLE);
+	if(running)
+		sb->safePrintf("<a href=\"/admin/profiler?sstop=1\">(Stop)</a>");
+	else
+		sb->safePrintf("<a href=\"/admin/profiler?sstart=1\">(Start)</a> "
+		               "<a href=\"/admin/profiler?sclear=1\">(Clear)</a>");
+	sb->safePrintf(" <a href=\"/admin/profiler?sfolded=1\">(Folded stacks)</a>"
+	               "</center></td></tr>\n");
+	sb->safePrintf("<tr bgcolor=#%s><td>status</td><td>%s</td></tr>\n"
+	               "<tr bgcolor=#%s><td>interval</td><td>%" PRId32 "us of cpu time</td></tr>\n"
+	               "<tr bgcolor=#%s><td>samples</td><td>%" PRIu64 "</td></tr>\n"
+	               "<tr bgcolor=#%s><td>dropped samples</td><td>%" PRIu64 "</td></tr>\n"
+	               "<tr bgcolor=#%s><td>threads sampled</td><td>%" PRId32 "</td></tr>\n"
+	               "</table><br>\n",
+	               LIGHT_BLUE, running ? "running" : "stopped",
+	               LIGHT_BLUE, m_intervalUS,
+	               LIGHT_BLUE, m_numSamples.load(),
+	               LIGHT_BLUE, m_numDropped.load(),
+	               LIGHT_BLUE, getNumThreads());
+
+	if(running || m_numSamples == 0)
+		return;
+
+	// . top functions by own samples, from the innermost frames
+	SafeBuf folded;
+	if(!getFoldedStacks(&folded, true))
+		return;
+	std::map<std::string,uint64_t> self;
+	uint64_t total = 0;
+	for(char *line = folded.getBufStart(); line && *line; ) {
+		char *nl = strchr(line, '\n');
+		if(nl) *nl = '\0';
+		char *sp = strrchr(line, ' ');
+		if(sp) {
+			*sp = '\0';
+			uint64_t count = strtoull(sp + 1, NULL, 10);
+			const char *leaf = strrchr(line, ';');
+			self[leaf ? leaf + 1 : line] += count;
+			total += count;
+		}
+		line = nl ? nl + 1 : NULL;
+	}
+	std::vector<std::pair<uint64_t,std::string>> top;
+	for(const auto &e : self)
+		top.push_back(std::make_pair(e.second, e.first));
+	std::sort(top.rbegin(), top.rend());
+
+	sb->safePrintf("<table %s>\n"
+	               "<tr class=hdrow><td colspan=3><center><b>Top Functions</b></center></td></tr>\n"
+	               "<tr bgcolor=#%s><td><b>samples</b></td><td><b>%%</b></td><td><b>function</b></td></tr>\n",
+	               TABLE_STYLE, DARK_BLUE);
+	for(size_t i = 0; i < top.size() && i < 50; i++) {
+		sb->safePrintf("<tr bgcolor=#%s><td>%" PRIu64 "</td><td>%.1f</td><td>",
+		               LIGHT_BLUE, top[i].first, total ? top[i].first * 100.0 / total : 0.0);
+		sb->htmlEncode(top[i].second.c_str());
+		sb->safePrintf("</td></tr>\n");
+	}
+	sb->safePrintf("</table><br>\n");
+}
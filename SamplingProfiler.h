@@ -0,0 +1,92 @@
+#ifndef GB_SAMPLINGPROFILER_H
+#define GB_SAMPLINGPROFILER_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <atomic>
+
+class SafeBuf;
+
+
+// . low-overhead sampling profiler driven by SIGPROF (setitimer ITIMER_PROF)
+// . each sample is the call stack of the thread the kernel delivered the
+//   signal to, tagged with the JobScheduler thread type and the UdpSlot
+//   msgType the thread is working on
+// . samples are aggregated into per-thread hash tables of stacks. only the
+//   signal handler of the owning thread writes to a table, so no locks
+// . stacks are only symbolized when dumped, as flamegraph folded lines:
+//     tag;msgtag;outermost;...;innermost count
+// . can be left running in production, unlike the old Profiler
+class SamplingProfiler {
+public:
+	SamplingProfiler();
+	~SamplingProfiler();
+
+	// . returns false and sets g_errno on error
+	// . stops the old real time profiler since they share SIGPROF
+	bool start(int32_t intervalUS = s_defaultIntervalUS);
+	void stop();
+	// forget all samples, must be stopped
+	void clear();
+
+	bool isRunning() const { return m_running.load(std::memory_order_relaxed); }
+
+	// . called from the SIGPROF handler with its ucontext_t
+	void takeSample(const void *context);
+
+	// . what the current thread is working on, -1 for nothing
+	// . return the previous value so callers can restore it
+	static int32_t setThreadType(int32_t threadType);
+	static int32_t setMsgType(int32_t msgType);
+
+	uint64_t getNumSamples() const { return m_numSamples; }
+	uint64_t getNumDroppedSamples() const { return m_numDropped; }
+	int32_t getNumThreads() const;
+	int32_t getIntervalUS() const { return m_intervalUS; }
+
+	// . append the folded stacks to sb, one per line
+	// . if resolve is false frames are printed as hex addresses
+	// . returns false and sets g_errno on error
+	bool getFoldedStacks(SafeBuf *sb, bool resolve);
+
+	// status, start/stop links and the functions with the most samples
+	void printStatus(SafeBuf *sb);
+
+	static const int32_t s_defaultIntervalUS = 2000;
+	static const int32_t s_maxThreads = 256;
+	static const int32_t s_maxDepth = 32;
+	static const int32_t s_stacksPerThread = 2048;  // power of 2
+
+private:
+	struct Stack {
+		std::atomic<uint64_t> m_hash;  // 0 if unused, set last
+		std::atomic<uint32_t> m_count;
+		int16_t m_threadType;
+		int16_t m_msgType;
+		int32_t m_depth;
+		uintptr_t m_frames[s_maxDepth];
+	};
+
+	struct ThreadStacks {
+		int32_t m_tid;
+		bool m_isMainThread;
+		Stack m_stacks[s_stacksPerThread];
+	};
+
+	ThreadStacks *claimThreadStacks();
+
+	ThreadStacks *m_threads;   // s_maxThreads of them, mmap'ed on first start
+	size_t m_threadsSize;
+	std::atomic<int32_t> m_numThreads;
+	// bumped by clear() so threads claim a new table
+	std::atomic<uint32_t> m_generation;
+
+	std::atomic<bool> m_running;
+	int32_t m_intervalUS;
+	std::atomic<uint64_t> m_numSamples;
+	std::atomic<uint64_t> m_numDropped;
+};
+
+extern SamplingProfiler g_samplingProfiler;
+
+#endif // GB_SAMPLINGPROFILER_H
@@ -36,6 +36,12 @@ public:
 		assert(rc==0);
 		locked = false;
 	}
+	void lock() {
+		assert(!locked);
+		int rc = pthread_mutex_lock(&mtx);
+		assert(rc==0);
+		locked = true;
+	}
 };
 
 #endif
@@ -3447,3 +3447,146 @@ bool Sections::verifySections ( ) {
 
 	return true;
 }
+
+
+struct PassageIndexHeader {
+	uint8_t  m_version;
+	uint8_t  m_reserved[3];
+	int32_t  m_numTokens;
+	// to verify the tokens are the same as when it was made
+	uint32_t m_tokenHash;
+	int32_t  m_numRuns;
+	sec_t    m_rootFlags;
+} __attribute__((packed));
+
+struct PassageIndexRun {
+	int32_t  m_firstToken;
+	sec_t    m_flags;
+} __attribute__((packed));
+
+static uint32_t getPassageIndexTokenHash(const TokenizerResult *tr) {
+	uint32_t h = 0;
+	for (size_t i = 0; i < tr->size(); i++) {
+		const auto &token = (*tr)[i];
+		h = hash32h((uint32_t)token.start_pos, h);
+		h = hash32h((uint32_t)token.token_len, h);
+	}
+	return h;
+}
+
+bool Sections::serializePassageIndex(SafeBuf *sb) const {
+	PassageIndexHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.m_version   = PASSAGE_INDEX_VERSION;
+	hdr.m_numTokens = m_tr ? m_tr->size() : 0;
+	hdr.m_tokenHash = m_tr ? getPassageIndexTokenHash(m_tr) : 0;
+	hdr.m_rootFlags = m_sections ? (m_sections[0].m_flags & PASSAGE_INDEX_FLAGS) : 0;
+
+	// . no runs means no sections at all, like for empty or huge docs
+	// . a new run starts wherever the flags change
+	SafeBuf runs;
+	if (m_sectionPtrs && m_sections) {
+		sec_t lastFlags = -1;
+		for (int32_t i = 0; i < m_nw; i++) {
+			sec_t flags = m_sectionPtrs[i]->m_flags & PASSAGE_INDEX_FLAGS;
+			if (i > 0 && flags == lastFlags) {
+				continue;
+			}
+
+			PassageIndexRun run;
+			run.m_firstToken = i;
+			run.m_flags      = flags;
+			if (!runs.safeMemcpy(&run, sizeof(run))) {
+				return false;
+			}
+
+			lastFlags = flags;
+			hdr.m_numRuns++;
+		}
+	}
+
+	return sb->safeMemcpy(&hdr, sizeof(hdr)) && sb->safeMemcpy(&runs);
+}
+
+bool Sections::setFromPassageIndex(const TokenizerResult *tr, const char *buf, int32_t bufSize) {
+	reset();
+
+	PassageIndexHeader hdr;
+	if (bufSize < (int32_t)sizeof(hdr)) {
+		return false;
+	}
+	memcpy(&hdr, buf, sizeof(hdr));
+
+	if (hdr.m_version != PASSAGE_INDEX_VERSION || hdr.m_numRuns < 0 ||
+	    bufSize != (int32_t)(sizeof(hdr) + hdr.m_numRuns * sizeof(PassageIndexRun))) {
+		return false;
+	}
+
+	// the document must tokenize the same as when it was indexed
+	if (hdr.m_numTokens != (int32_t)tr->size() || hdr.m_tokenHash != getPassageIndexTokenHash(tr)) {
+		return false;
+	}
+
+	m_tr = tr;
+
+	if (hdr.m_numRuns == 0) {
+		return true;
+	}
+
+	const char *runs = buf + sizeof(hdr);
+	int32_t nw = tr->size();
+
+	// the root section plus one section per run
+	m_sectionBuf.setLabel("sectbuf");
+	if (!m_sectionBuf.reserve((hdr.m_numRuns + 1) * sizeof(Section))) {
+		reset();
+		return false;
+	}
+	m_sections = (Section *)m_sectionBuf.getBufStart();
+	memset(m_sections, 0, (hdr.m_numRuns + 1) * sizeof(Section));
+
+	m_sectionPtrBuf.setLabel("psectbuf");
+	if (!m_sectionPtrBuf.reserve(nw * sizeof(Section *))) {
+		reset();
+		return false;
+	}
+	m_sectionPtrs = (Section **)m_sectionPtrBuf.getBufStart();
+
+	Section *root = &m_sections[0];
+	root->m_b = nw;
+	root->m_flags = hdr.m_rootFlags;
+	root->m_baseHash = 1;
+	m_rootSection = root;
+	m_numSections = hdr.m_numRuns + 1;
+	m_maxNumSections = m_numSections;
+	m_nw = nw;
+
+	for (int32_t r = 0; r < hdr.m_numRuns; r++) {
+		PassageIndexRun run;
+		memcpy(&run, runs + r * sizeof(run), sizeof(run));
+
+		int32_t end = nw;
+		if (r + 1 < hdr.m_numRuns) {
+			PassageIndexRun next;
+			memcpy(&next, runs + (r + 1) * sizeof(next), sizeof(next));
+			end = next.m_firstToken;
+		}
+
+		// runs must cover all tokens in order
+		if ((r == 0 && run.m_firstToken != 0) || run.m_firstToken < 0 || end <= run.m_firstToken || end > nw) {
+			reset();
+			return false;
+		}
+
+		Section *sn = &m_sections[r + 1];
+		sn->m_parent = root;
+		sn->m_a = run.m_firstToken;
+		sn->m_b = end;
+		sn->m_flags = run.m_flags;
+		for (int32_t i = run.m_firstToken; i < end; i++) {
+			m_sectionPtrs[i] = sn;
+		}
+	}
+
+	return true;
+}
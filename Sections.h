@@ -70,6 +70,11 @@ class Url;
 
 typedef int64_t sec_t;
 
+// the section flags Summary and Matches look at
+#define PASSAGE_INDEX_FLAGS (NOINDEXFLAGS|SEC_IN_TITLE|SEC_IN_HEAD)
+
+#define PASSAGE_INDEX_VERSION 1
+
 class Section {
 public:
 
@@ -181,6 +186,17 @@ public:
 	// . sets m_sections[] array, 1-1 with words array "w"
 	bool set(const TokenizerResult *tr, Bits *bits, const Url *url, uint8_t contentType);
 
+	// . the "passage index" is the section flags the summary code looks
+	//   at, run-length encoded per token. it is stored in the titlerec
+	//   so Msg20 does not have to set the sections to make a summary.
+	// . returns false and sets g_errno on error
+	bool serializePassageIndex(SafeBuf *sb) const;
+
+	// . set from serializePassageIndex() data instead of parsing
+	// . only the PASSAGE_INDEX_FLAGS of Section::m_flags are set then
+	// . returns false if the data is bad or does not match "tr"
+	bool setFromPassageIndex(const TokenizerResult *tr, const char *buf, int32_t bufSize);
+
 private:
 	bool verifySections ( ) ;
 
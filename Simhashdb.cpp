@@ -0,0 +1,76 @@
+#include "Simhashdb.h"
+#include "Conf.h"
+#include <string.h>
+
+Simhashdb g_simhashdb;
+
+void Simhashdb::reset() {
+	m_rdb.reset();
+}
+
+bool Simhashdb::init() {
+	int32_t maxTreeMem = g_conf.m_simhashdbMaxTreeMem;
+	// . what's max # of tree nodes?
+	// . key+left+right+parents+dataPtr = 12+4+4+4+4 = 28
+	// . plus the 8 bytes of data
+	int32_t maxTreeNodes = maxTreeMem / (16 + SIMHASHDB_REC_SIZE);
+
+	// init the rdb
+	return m_rdb.init("simhashdb",
+			  8,         // fixed data size, the simhash
+			  2,         // min files to merge
+			  maxTreeMem,
+			  maxTreeNodes,
+			  false,     // use half keys
+			  sizeof(key96_t),
+			  false);    // useIndexFile
+}
+
+key96_t Simhashdb::makeKey(int64_t docId, bool isDelKey) {
+	key96_t key;
+	// set the docId upper bits
+	key.n1 = (uint32_t)(docId >> 29);
+	key.n1 &= 0x000001ff;
+	// set the docId lower bits
+	key.n0 = docId;
+	key.n0 <<= 35;
+	// set the del bit
+	if ( ! isDelKey ) key.n0 |= 0x0000000000000001ULL;
+	return key;
+}
+
+// . each feature votes on every bit, a bit is set in the simhash if
+//   most of the features have it set
+uint64_t Simhashdb::computeSimHash(const uint64_t *features, int32_t numFeatures) {
+	if ( numFeatures <= 0 ) return 0;
+
+	int32_t votes[64];
+	memset ( votes, 0, sizeof(votes) );
+
+	for ( int32_t i = 0 ; i < numFeatures ; i++ ) {
+		uint64_t h = features[i];
+		for ( int32_t b = 0 ; b < 64 ; b++ ) {
+			if ( (h >> b) & 0x01 ) votes[b]++;
+			else                   votes[b]--;
+		}
+	}
+
+	uint64_t simHash = 0;
+	for ( int32_t b = 0 ; b < 64 ; b++ ) {
+		if ( votes[b] > 0 ) simHash |= (1ULL << b);
+	}
+
+	// 0 means none
+	if ( simHash == 0 ) simHash = 1;
+	return simHash;
+}
+
+bool Simhashdb::isNearDupOfAny(uint64_t simHash, const uint64_t *simHashes, int32_t numSimHashes,
+			       int32_t maxDistance) {
+	if ( ! simHash ) return false;
+	for ( int32_t i = 0 ; i < numSimHashes ; i++ ) {
+		if ( isNearDup ( simHash, simHashes[i], maxDistance ) )
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,68 @@
+// Simhashdb - stores a simhash of the content of each indexed document
+
+// . one record per docid, added when the document is indexed
+// . the key has the docid in the same bits as the clusterdb key, so it is
+//   sharded like clusterdb and titledb and Msg39 reads it locally
+// . the data is the 64 bit simhash of the word shingles of the content.
+//   near-duplicate documents have simhashes that differ in a few bits only
+// . lets Msg39 and Msg3a drop near-duplicate results before Msg40 gets
+//   their summaries, instead of comparing summary vectors afterwards
+//
+//   00000000 00000000 0000000d dddddddd  d = docid
+//   dddddddd dddddddd dddddddd ddddd000
+//   00000000 00000000 00000000 0000000z  z = del bit
+
+#ifndef GB_SIMHASHDB_H
+#define GB_SIMHASHDB_H
+
+#include "Rdb.h"
+#include "types.h"
+
+// key plus the 64 bit simhash
+#define SIMHASHDB_REC_SIZE (sizeof(key96_t)+8)
+
+class Simhashdb {
+public:
+	void reset();
+
+	bool init();
+
+	Rdb *getRdb() { return &m_rdb; }
+
+	static key96_t makeKey(int64_t docId, bool isDelKey);
+
+	static key96_t makeFirstKey(int64_t docId) { return makeKey(docId, true); }
+	static key96_t makeLastKey(int64_t docId) { return makeKey(docId, false); }
+
+	static int64_t getDocId(const key96_t *k) {
+		int64_t docId = (k->n0) >> 35;
+		docId |= ( ((uint64_t)(k->n1)) << 29 );
+		return docId;
+	}
+
+	// . simhash of the "features" (eg. shingle hashes)
+	// . 0 means no simhash, it is never 0 if numFeatures>0
+	static uint64_t computeSimHash(const uint64_t *features, int32_t numFeatures);
+
+	// number of bits that differ
+	static int32_t getDistance(uint64_t h1, uint64_t h2) {
+		return __builtin_popcountll(h1 ^ h2);
+	}
+
+	// . documents without a simhash are never near-duplicates
+	// . maxDistance<0 turns it off
+	static bool isNearDup(uint64_t h1, uint64_t h2, int32_t maxDistance) {
+		return h1 && h2 && getDistance(h1, h2) <= maxDistance;
+	}
+
+	// true if "simHash" is a near-duplicate of any of "simHashes"
+	static bool isNearDupOfAny(uint64_t simHash, const uint64_t *simHashes, int32_t numSimHashes,
+				   int32_t maxDistance);
+
+private:
+	Rdb m_rdb;
+};
+
+extern class Simhashdb g_simhashdb;
+
+#endif // GB_SIMHASHDB_H
@@ -60,12 +60,11 @@ bool Speller::loadUnifiedDict() {
 				       "unifiedDict-buf.txt" ) == 0 ) 
 		needRebuild = true;
 
-	// . give it a million slots
-	// . unified dict currently has 1340223 entries
-	m_unifiedDict.set ( 8,4, 2*1024*1024,NULL,0,false,"udictht");
+	// slots are allocated when rebuilding, otherwise it is mapped
+	m_unifiedDict.set ( 8,4,0,NULL,0,false,"udictht");
 
 	// try to load in the hashtable and the buffer directly
-	if ( ! m_unifiedDict.load(g_hostdb.m_dir,"unifiedDict-map.dat"))
+	if ( ! m_unifiedDict.loadMapped(g_hostdb.m_dir,"unifiedDict-map.dat"))
 		needRebuild = true;
 
 	if ( ! needRebuild ) {
@@ -88,8 +87,10 @@ bool Speller::loadUnifiedDict() {
 
 	log("gb: REBUILDING unifiedDict-buf.txt and unifiedDict-map.dat");
 
-	// just in case that was there and the buf wasn't
-	m_unifiedDict.clear();
+	// . just in case that was there and the buf wasn't
+	// . give it a million slots
+	// . unified dict currently has 1340223 entries
+	m_unifiedDict.set ( 8,4, 2*1024*1024,NULL,0,false,"udictht");
 	// or vice versa
 	m_unifiedBuf.purge();
 
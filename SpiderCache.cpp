@@ -32,13 +32,16 @@ void SpiderCache::save ( bool useThread ) {
 	for ( int32_t i = 0 ; i < g_collectiondb.getNumRecs(); i++ ) {
 		SpiderColl *sc = getSpiderCollIffNonNull(i);//m_spiderColls[i];
 		if ( ! sc ) continue;
+		char dir[1024];
+		sprintf(dir,"%scoll.%s.%" PRId32,g_hostdb.m_dir,
+			sc->m_coll,(int32_t)sc->m_collnum);
+		// the frontier snapshot is small, save it right away
+		if ( sc->useFrontier() && sc->getFrontier()->needsSave() )
+			sc->getFrontier()->save(dir);
 		RdbTree *tree = &sc->m_waitingTree;
 		if ( ! tree->needsSave() ) continue;
 		// if already saving from a thread
 		if ( tree->isSaving() ) continue;
-		char dir[1024];
-		sprintf(dir,"%scoll.%s.%" PRId32,g_hostdb.m_dir,
-			sc->m_coll,(int32_t)sc->m_collnum);
 		// log it for now
 		log("spider: saving waiting tree for cn=%" PRId32,(int32_t)i);
 		// returns false if it blocked, callback will be called
@@ -19,6 +19,9 @@
 #include "ScopedLock.h"
 #include "Sanity.h"
 #include "Errno.h"
+#include "GbDns.h"
+#include "Url.h"
+#include <unistd.h>
 
 
 #define OVERFLOWLISTSIZE 200
@@ -117,6 +120,7 @@ SpiderColl::SpiderColl(CollectionRec *cr) {
 	m_pageNumInlinks = 0;
 	m_lastCBlockIp = 0;
 	m_lastOverflowFirstIp = 0;
+	m_useFrontier = g_conf.m_spiderFrontierEnabled;
 
 	reset();
 
@@ -222,6 +226,27 @@ bool SpiderColl::load ( ) {
 	if ( treeExists && !m_waitingTree.fastLoad(&file, &m_waitingMem) )
 		err = g_errno;
 
+	// . the doled urls are in doledb or in the frontier snapshot. if we
+	//   switched since the last run the ips doled by the other one are
+	//   in neither the waiting tree nor the dole ip table, so rescan
+	//   spiderdb for them
+	char frontierFilename[1024];
+	snprintf(frontierFilename, sizeof(frontierFilename), "%s/spiderfrontier-saved.dat", dir);
+	if ( m_useFrontier ) {
+		if ( ! m_frontier.load(dir) ) err = g_errno;
+
+		RdbTree *doledbTree = g_doledb.getRdb()->getTree();
+		if ( doledbTree && doledbTree->getNumPositiveKeys(m_collnum) > 0 ) {
+			log(LOG_INFO, "spider: frontier enabled, dropping doledb recs of %s", coll);
+			g_doledb.getRdb()->deleteAllRecs(m_collnum);
+			m_waitingTreeNeedsRebuild = true;
+		}
+	} else if ( access(frontierFilename, F_OK) == 0 ) {
+		log(LOG_INFO, "spider: frontier disabled, dropping %s", frontierFilename);
+		unlink(frontierFilename);
+		m_waitingTreeNeedsRebuild = true;
+	}
+
 	// init wait table. scan wait tree and add the ips into table.
 	if ( ! makeWaitingTable() ) err = g_errno;
 	// save it
@@ -252,6 +277,18 @@ bool SpiderColl::load ( ) {
 bool SpiderColl::makeDoledbIPTable() {
 	log(LOG_DEBUG,"spider: making dole ip table for %s",m_coll);
 
+	if ( m_useFrontier ) {
+		bool ok = true;
+		m_frontier.forEachRequest([this,&ok](const SpiderRequest *sreq) {
+			if ( ok && !addToDoledbIpTable(sreq) ) {
+				ok = false;
+			}
+		});
+		log(LOG_DEBUG,"spider: making dole ip table from frontier done.");
+		// return false with g_errno set on error
+		return ok;
+	}
+
 	key96_t startKey ; startKey.setMin();
 	key96_t endKey   ; endKey.setMax();
 	key96_t lastKey  ; lastKey.setMin();
@@ -698,6 +735,14 @@ bool SpiderColl::addSpiderRequest(const SpiderRequest *sreq) {
 	// as long as it can be spidered now
 	bool added = addToWaitingTree(sreq->m_firstIp);
 
+	// resolve the hostname ahead of the spider so msg13 finds it in the
+	// dns cache
+	int32_t hostLen = 0;
+	const char *host = getHostFast(sreq->m_url, &hostLen);
+	if (host && hostLen > 0) {
+		GbDns::prefetchARecord(host, hostLen);
+	}
+
 	// if already doled and we beat the priority/spidertime of what
 	// was doled then we should probably delete the old doledb key
 	// and add the new one. hmm, the waitingtree scan code ...
@@ -3113,15 +3158,25 @@ bool SpiderColl::addDoleBufIntoDoledb ( SafeBuf *doleBuf, bool isFromCache ) {
 		g_spiderLoop.m_winnerListCache.insert(firstIp, doleBuf->getBufStart(), doleBuf->length());
 	}
 
-	// keep it on stack now that doledb is tree-only
-	RdbList tmpList;
-	tmpList.setFromPtr ( doledbRec , doledbRecSize , RDB_DOLEDB );
+	if ( m_useFrontier ) {
+		// in-memory, no tree node churn
+		if ( ! m_frontier.addRequest(*(key96_t *)doledbRec, sreq3) ) {
+			removeFromDoledbIpTable(firstIp);
+			return true;
+		}
 
-	// now that doledb is tree-only and never dumps to disk, just
-	// add it directly
-	g_doledb.getRdb()->addList(m_collnum, &tmpList);
+		logDebug(g_conf.m_logDebugSpider, "spider: adding frontier request size=%" PRId32, doledbRecSize);
+	} else {
+		// keep it on stack now that doledb is tree-only
+		RdbList tmpList;
+		tmpList.setFromPtr ( doledbRec , doledbRecSize , RDB_DOLEDB );
+
+		// now that doledb is tree-only and never dumps to disk, just
+		// add it directly
+		g_doledb.getRdb()->addList(m_collnum, &tmpList);
 
-	logDebug(g_conf.m_logDebugSpider, "spider: adding doledb tree node size=%" PRId32, doledbRecSize);
+		logDebug(g_conf.m_logDebugSpider, "spider: adding doledb tree node size=%" PRId32, doledbRecSize);
+	}
 
 	int32_t storedFirstIp = (m_waitingTreeKey.n0) & 0xffffffff;
 
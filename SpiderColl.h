@@ -12,6 +12,7 @@
 #include "hash.h"
 #include "RdbCache.h"
 #include "Spider.h"  //MAX_SP_REPLY_SIZE
+#include "SpiderFrontier.h"
 #include "types.h"
 #include "max_coll_len.h"
 #include <time.h>
@@ -79,6 +80,10 @@ public:
 	void clearDoledbIpTable();
 	std::vector<uint32_t> getDoledbIpTable() const;
 
+	// doled urls are kept in m_frontier instead of doledb
+	bool useFrontier() const { return m_useFrontier; }
+	SpiderFrontier *getFrontier() { return &m_frontier; }
+
 	HashTableX m_siteIndexedDocumentCount;
 
 	bool printWaitingTree();
@@ -174,6 +179,10 @@ private:
 	HashTableX m_doledbIpTable;
 	mutable GbMutex m_doledbIpTableMtx;
 
+	// set from g_conf.m_spiderFrontierEnabled at construction
+	bool m_useFrontier;
+	SpiderFrontier m_frontier;
+
 	RdbTree m_winnerTree;
 	HashTableX m_winnerTable;
 	int32_t m_tailIp;
@@ -0,0 +1,237 @@
+#include "SpiderFrontier.h"
+#include "Spider.h"
+#include "RdbList.h"
+#include "SafeBuf.h"
+#include "Log.h"
+#include "Errno.h"
+#include <limits.h>
+
+
+static const int32_t s_snapshotMagic   = 0x53465254; //"SFRT"
+static const int32_t s_snapshotVersion = 1;
+static const char    s_snapshotName[]  = "spiderfrontier-saved.dat";
+
+
+SpiderFrontier::SpiderFrontier()
+	: m_ipQueues()
+	, m_ready()
+	, m_numRequests(0)
+	, m_needsSave(false)
+	, m_mtx() {
+}
+
+
+bool SpiderFrontier::addRequest(const key96_t &doledbKey, const SpiderRequest *sreq) {
+	int32_t recSize = sreq->getRecSize();
+	if ( recSize <= 0 || recSize > (int32_t)sizeof(SpiderRequest) ) {
+		log(LOG_WARN, "spider: frontier got bad spider request size=%" PRId32, recSize);
+		g_errno = ECORRUPTDATA;
+		return false;
+	}
+
+	ScopedLock sl(m_mtx);
+
+	IpQueue &q = m_ipQueues[sreq->m_firstIp];
+
+	// . the old head loses its place in the ready set if the new
+	//   request sorts before it
+	if ( !q.empty() && doledbKey < q.begin()->first ) {
+		m_ready.erase(std::make_pair(q.begin()->first, sreq->m_firstIp));
+	}
+
+	std::pair<IpQueue::iterator,bool> ins = q.insert(std::make_pair(doledbKey, std::string()));
+	ins.first->second.assign((const char*)sreq, recSize);
+	if ( ins.second ) {
+		m_numRequests++;
+	}
+
+	m_ready.insert(std::make_pair(q.begin()->first, sreq->m_firstIp));
+	m_needsSave = true;
+	return true;
+}
+
+
+bool SpiderFrontier::removeRequest(const key96_t &doledbKey, int32_t firstIp) {
+	ScopedLock sl(m_mtx);
+
+	auto qit = m_ipQueues.find(firstIp);
+	if ( qit == m_ipQueues.end() ) {
+		return false;
+	}
+
+	IpQueue &q = qit->second;
+	IpQueue::iterator it = q.find(doledbKey);
+	if ( it == q.end() ) {
+		return false;
+	}
+
+	bool wasHead = ( it == q.begin() );
+	if ( wasHead ) {
+		m_ready.erase(std::make_pair(doledbKey, firstIp));
+	}
+
+	q.erase(it);
+	m_numRequests--;
+	m_needsSave = true;
+
+	if ( q.empty() ) {
+		m_ipQueues.erase(qit);
+	} else if ( wasHead ) {
+		m_ready.insert(std::make_pair(q.begin()->first, firstIp));
+	}
+
+	return true;
+}
+
+
+void SpiderFrontier::clear() {
+	ScopedLock sl(m_mtx);
+	if ( m_numRequests ) {
+		m_needsSave = true;
+	}
+	m_ipQueues.clear();
+	m_ready.clear();
+	m_numRequests = 0;
+}
+
+
+void SpiderFrontier::getList(const key96_t &startKey, const key96_t &endKey, int32_t minRecSizes, RdbList *list) const {
+	list->set(NULL, 0, NULL, 0, (const char*)&startKey, (const char*)&endKey, -1, true, false, sizeof(key96_t));
+
+	ScopedLock sl(m_mtx);
+
+	for ( auto it = m_ready.lower_bound(std::make_pair(startKey, INT_MIN)); it != m_ready.end(); ++it ) {
+		if ( it->first > endKey ) {
+			break;
+		}
+
+		const std::string &rec = m_ipQueues.find(it->second)->second.begin()->second;
+		if ( !list->addRecord((const char*)&it->first, (int32_t)rec.size(), rec.data()) ) {
+			log(LOG_WARN, "spider: frontier could not grow list: %s", mstrerror(g_errno));
+			break;
+		}
+
+		// like a Msg5 read, the list ends at its last key if truncated
+		if ( list->getListSize() >= minRecSizes ) {
+			list->setEndKey((const char*)&it->first);
+			break;
+		}
+	}
+}
+
+
+int32_t SpiderFrontier::getNumRequests() const {
+	ScopedLock sl(m_mtx);
+	return m_numRequests;
+}
+
+
+int32_t SpiderFrontier::getNumIps() const {
+	ScopedLock sl(m_mtx);
+	return (int32_t)m_ipQueues.size();
+}
+
+
+// . format is magic, version, record count followed by the records in
+//   doledb format: 12 byte key, 4 byte size, SpiderRequest
+bool SpiderFrontier::save(const char *dir) {
+	SafeBuf sb;
+	int32_t numRecs;
+	{
+		ScopedLock sl(m_mtx);
+		numRecs = m_numRequests;
+
+		int64_t need = 12 + (int64_t)m_numRequests * (sizeof(key96_t) + 4);
+		for ( auto qit = m_ipQueues.begin(); qit != m_ipQueues.end(); ++qit ) {
+			for ( auto it = qit->second.begin(); it != qit->second.end(); ++it ) {
+				need += it->second.size();
+			}
+		}
+
+		if ( !sb.reserve(need, "sfrontsv") ) {
+			return false;
+		}
+
+		sb.pushLong(s_snapshotMagic);
+		sb.pushLong(s_snapshotVersion);
+		sb.pushLong(m_numRequests);
+
+		for ( auto qit = m_ipQueues.begin(); qit != m_ipQueues.end(); ++qit ) {
+			for ( auto it = qit->second.begin(); it != qit->second.end(); ++it ) {
+				sb.safeMemcpy(&it->first, sizeof(key96_t));
+				sb.pushLong((int32_t)it->second.size());
+				sb.safeMemcpy(it->second.data(), (int32_t)it->second.size());
+			}
+		}
+
+		m_needsSave = false;
+	}
+
+	char filename[1024];
+	snprintf(filename, sizeof(filename), "%s/%s", dir, s_snapshotName);
+	if ( sb.safeSave(filename) < 0 ) {
+		log(LOG_WARN, "spider: failed to save frontier to %s: %s", filename, mstrerror(g_errno));
+		ScopedLock sl(m_mtx);
+		m_needsSave = true;
+		return false;
+	}
+
+	log(LOG_INFO, "spider: saved %" PRId32" frontier requests to %s", numRecs, filename);
+	return true;
+}
+
+
+bool SpiderFrontier::load(const char *dir) {
+	clear();
+
+	SafeBuf sb;
+	int32_t size = sb.fillFromFile(dir, s_snapshotName);
+	if ( size < 0 ) {
+		log(LOG_WARN, "spider: failed to read frontier from %s/%s", dir, s_snapshotName);
+		return false;
+	}
+	if ( size == 0 ) {
+		// no snapshot
+		m_needsSave = false;
+		return true;
+	}
+
+	const char *p = sb.getBufStart();
+	const char *pend = p + sb.length();
+
+	if ( pend - p < 12 || *(const int32_t*)p != s_snapshotMagic || *(const int32_t*)(p + 4) != s_snapshotVersion ) {
+		log(LOG_WARN, "spider: frontier snapshot %s/%s has bad header, ignoring it", dir, s_snapshotName);
+		return true;
+	}
+	int32_t numRecs = *(const int32_t*)(p + 8);
+	p += 12;
+
+	for ( int32_t i = 0; i < numRecs; i++ ) {
+		if ( pend - p < (int32_t)(sizeof(key96_t) + 4) ) {
+			break;
+		}
+		key96_t doledbKey;
+		memcpy(&doledbKey, p, sizeof(key96_t));
+		int32_t recSize = *(const int32_t*)(p + sizeof(key96_t));
+		p += sizeof(key96_t) + 4;
+
+		if ( recSize <= 0 || recSize > pend - p ) {
+			log(LOG_WARN, "spider: frontier snapshot %s/%s is truncated at record %" PRId32, dir, s_snapshotName, i);
+			break;
+		}
+
+		const SpiderRequest *sreq = (const SpiderRequest*)p;
+		if ( recSize != sreq->getRecSize() || !addRequest(doledbKey, sreq) ) {
+			log(LOG_WARN, "spider: frontier snapshot %s/%s has corrupt record %" PRId32, dir, s_snapshotName, i);
+			break;
+		}
+		p += recSize;
+	}
+
+	// what we have now matches the snapshot
+	m_needsSave = false;
+
+	log(LOG_INFO, "spider: loaded %" PRId32" frontier requests for %" PRId32" ips from %s/%s",
+	    getNumRequests(), getNumIps(), dir, s_snapshotName);
+	return true;
+}
@@ -0,0 +1,75 @@
+#ifndef GB_SPIDERFRONTIER_H
+#define GB_SPIDERFRONTIER_H
+
+#include "types.h"
+#include "GbMutex.h"
+#include "ScopedLock.h"
+#include <inttypes.h>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+class RdbList;
+class SpiderRequest;
+
+
+// . in-memory replacement for doledb, one per SpiderColl
+// . holds the doled SpiderRequests in per-firstIp queues ordered by doledb
+//   key (priority complement, spider time, uh48), and a global ordered set
+//   of the queue heads so the next ready url is found in O(log n)
+// . lists are handed out in doledb record format (key96, dataSize,
+//   SpiderRequest) so the spider loop treats them like a doledb read
+// . a compact snapshot is saved with the waiting tree so the doled urls
+//   survive a restart
+class SpiderFrontier {
+	SpiderFrontier(const SpiderFrontier&);
+	SpiderFrontier& operator=(const SpiderFrontier&);
+public:
+	SpiderFrontier();
+
+	// add a doled request. returns false and sets g_errno on error
+	bool addRequest(const key96_t &doledbKey, const SpiderRequest *sreq);
+
+	// returns false if the request was not in the frontier
+	bool removeRequest(const key96_t &doledbKey, int32_t firstIp);
+
+	void clear();
+
+	// . the ready requests with keys in [startKey,endKey] in doledb order
+	// . stops after minRecSizes bytes like a Msg5 read
+	void getList(const key96_t &startKey, const key96_t &endKey, int32_t minRecSizes, RdbList *list) const;
+
+	// call f(const SpiderRequest*) for every request in the frontier
+	template<typename F> void forEachRequest(F f) const {
+		ScopedLock sl(m_mtx);
+		for ( auto qit = m_ipQueues.begin(); qit != m_ipQueues.end(); ++qit ) {
+			for ( auto it = qit->second.begin(); it != qit->second.end(); ++it ) {
+				f((const SpiderRequest*)it->second.data());
+			}
+		}
+	}
+
+	int32_t getNumRequests() const;
+	int32_t getNumIps() const;
+
+	bool needsSave() const { return m_needsSave; }
+
+	// snapshot is "spiderfrontier-saved.dat" in dir
+	bool save(const char *dir);
+	bool load(const char *dir);
+
+private:
+	typedef std::map<key96_t, std::string> IpQueue;
+
+	std::unordered_map<int32_t, IpQueue> m_ipQueues;
+	// key of the first request in each queue
+	std::set<std::pair<key96_t, int32_t>> m_ready;
+	int32_t m_numRequests;
+	bool m_needsSave;
+
+	mutable GbMutex m_mtx;
+};
+
+#endif // GB_SPIDERFRONTIER_H
@@ -74,6 +74,11 @@ SpiderLoop::SpiderLoop ( ) {
 	m_recalcTime = 0;
 	m_recalcTimeValid = false;
 	m_doleStart = 0;
+	m_doleReadStartUS = 0;
+	m_doleStatsStartMS = getMonotonicMilliseconds();
+	m_numDoleReads = 0;
+	m_doleReadTimeUS = 0;
+	m_numUrlsDoled = 0;
 }
 
 SpiderLoop::~SpiderLoop ( ) {
@@ -555,10 +560,19 @@ subloopNextPriority:
 	// seems like we need this reset here... strange
 	m_list.reset();
 
-	logTrace( g_conf.m_logTraceSpider, "Getting list (msg5)" );
+	m_doleReadStartUS = getMonotonicMicroseconds();
+
+	// the frontier is in memory, no need to wait for a list
+	if ( m_sc->useFrontier() ) {
+		logTrace( g_conf.m_logTraceSpider, "Getting list (frontier)" );
+		m_sc->getFrontier()->getList(m_sc->m_msg5StartKey, endKey, doleDbRecSizes, &m_list);
+	} else {
+		logTrace( g_conf.m_logTraceSpider, "Getting list (msg5)" );
+	}
 
 	// get a spider rec for us to spider from doledb (mdw)
-	if ( ! m_msg5.getList ( RDB_DOLEDB      ,
+	if ( ! m_sc->useFrontier() &&
+	     ! m_msg5.getList ( RDB_DOLEDB      ,
 				cr->m_collnum, // coll            ,
 				&m_list         ,
 				&m_sc->m_msg5StartKey,//m_sc->m_nextDoledbKey,
@@ -627,6 +641,9 @@ bool SpiderLoop::gotDoledbList2 ( ) {
 	// unlock
 	m_gettingDoledbList = false;
 
+	m_numDoleReads++;
+	m_doleReadTimeUS += getMonotonicMicroseconds() - m_doleReadStartUS;
+
 	// shortcuts
 	CollectionRec *cr = m_sc->getCollectionRec();
 
@@ -1071,8 +1088,13 @@ bool SpiderLoop::spiderUrl(SpiderRequest *sreq, const key96_t *doledbKey, collnu
 	char doledbKeyStr[MAX_KEYSTR_BYTES];
 	logDebug(g_conf.m_logDebugSpider, "spider: deleting doledb tree key=%s", KEYSTR(doledbKey, sizeof(*doledbKey), doledbKeyStr));
 
-	// now we just take it out of doledb instantly
-	bool deleted = g_doledb.getRdb()->deleteTreeNode(collnum, (const char *)doledbKey);
+	// now we just take it out of doledb (or the frontier) instantly
+	bool deleted;
+	if ( m_sc->useFrontier() ) {
+		deleted = m_sc->getFrontier()->removeRequest(*doledbKey, sreq->m_firstIp);
+	} else {
+		deleted = g_doledb.getRdb()->deleteTreeNode(collnum, (const char *)doledbKey);
+	}
 
 	// if url filters rebuilt then doledb gets reset and i've seen us hit
 	// this node == -1 condition here... so maybe ignore it... just log
@@ -1088,6 +1110,8 @@ bool SpiderLoop::spiderUrl(SpiderRequest *sreq, const key96_t *doledbKey, collnu
 	}
 
 
+	m_numUrlsDoled++;
+
 	// now remove from doleiptable since we removed from doledb
 	m_sc->removeFromDoledbIpTable(sreq->m_firstIp);
 
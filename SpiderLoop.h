@@ -63,6 +63,15 @@ public:
 	
 	void nukeWinnerListCache(collnum_t collnum);
 
+	// . dole throughput of the doledb or frontier path, see
+	//   g_conf.m_spiderFrontierEnabled
+	// . read time is from asking for a list of doled urls until
+	//   we got it
+	int64_t m_doleStatsStartMS;
+	int64_t m_numDoleReads;
+	int64_t m_doleReadTimeUS;
+	int64_t m_numUrlsDoled;
+
 private:
 	static void indexedDocWrapper ( void *state ) ;
 	static void doneSleepingWrapperSL ( int fd , void *state ) ;
@@ -116,6 +125,7 @@ private:
 	bool m_recalcTimeValid;
 
 	int64_t m_doleStart;
+	int64_t m_doleReadStartUS;
 };
 
 extern SpiderLoop g_spiderLoop;
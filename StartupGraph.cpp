@@ -0,0 +1,298 @@
+#include "StartupGraph.h"
+#include "ScopedLock.h"
+#include "SafeBuf.h"
+#include "Pages.h"
+#include "Log.h"
+#include "fctypes.h"
+#include "Errno.h"
+#include <algorithm>
+#include <string.h>
+#include <time.h>
+
+
+struct StartupGraph::Component {
+	enum state_t {
+		state_waiting,
+		state_running,
+		state_done,
+		state_failed,
+		state_skipped
+	};
+
+	StartupGraph            *m_graph;
+	std::string              m_name;
+	loader_t                 m_loader;
+	std::vector<std::string> m_dependencies;
+	bool                     m_required;
+	bool                     m_mainThreadOnly;
+	state_t                  m_state;
+	StartupTimelineEntry     m_timing;
+};
+
+
+static GbMutex s_timelineMtx;
+static std::vector<StartupTimelineEntry> s_timeline;
+static int64_t s_timelineTotalMs = 0;
+
+
+StartupGraph::StartupGraph()
+  : m_components()
+  , m_startTime(0)
+  , m_mtx() {
+	pthread_cond_init(&m_cond, NULL);
+}
+
+
+StartupGraph::~StartupGraph() {
+	for (auto c : m_components) {
+		delete c;
+	}
+	pthread_cond_destroy(&m_cond);
+}
+
+
+void StartupGraph::add(const char *name, loader_t loader, const std::vector<std::string> &dependencies, bool required, bool mainThreadOnly) {
+	Component *c = new Component;
+	c->m_graph = this;
+	c->m_name = name;
+	c->m_loader = loader;
+	c->m_dependencies = dependencies;
+	c->m_required = required;
+	c->m_mainThreadOnly = mainThreadOnly;
+	c->m_state = Component::state_waiting;
+	c->m_timing.m_name = name;
+	c->m_timing.m_startMs = 0;
+	c->m_timing.m_endMs = 0;
+	c->m_timing.m_onMainThread = mainThreadOnly;
+	c->m_timing.m_success = false;
+	c->m_timing.m_skipped = false;
+	m_components.push_back(c);
+}
+
+
+std::vector<std::string> StartupGraph::getNames(const char *prefix) const {
+	std::vector<std::string> names;
+	size_t prefixLen = strlen(prefix);
+	for (auto c : m_components) {
+		if (c->m_name.compare(0, prefixLen, prefix) == 0) {
+			names.push_back(c->m_name);
+		}
+	}
+	return names;
+}
+
+
+void StartupGraph::runComponent(Component *c, bool onMainThread) {
+	int64_t start = gettimeofdayInMilliseconds();
+	log(LOG_DEBUG, "startup: Loading %s", c->m_name.c_str());
+
+	bool status = c->m_loader();
+
+	int64_t end = gettimeofdayInMilliseconds();
+	log(status ? LOG_INFO : LOG_WARN, "startup: %s %s in %" PRId64" ms",
+	    c->m_name.c_str(), status ? "loaded" : "failed", end - start);
+
+	ScopedLock sl(m_mtx);
+	c->m_timing.m_startMs = start - m_startTime;
+	c->m_timing.m_endMs = end - m_startTime;
+	c->m_timing.m_onMainThread = onMainThread;
+	c->m_timing.m_success = status;
+	c->m_state = status ? Component::state_done : Component::state_failed;
+	pthread_cond_signal(&m_cond);
+}
+
+
+void StartupGraph::runComponentWrapper(void *state) {
+	Component *c = static_cast<Component*>(state);
+	c->m_graph->runComponent(c, false);
+}
+
+
+// only interesting if the job never ran
+void StartupGraph::componentDoneWrapper(void *state, job_exit_t exit_type) {
+	if (exit_type == job_exit_normal) {
+		return;
+	}
+
+	Component *c = static_cast<Component*>(state);
+	log(LOG_WARN, "startup: Job for %s was cancelled", c->m_name.c_str());
+
+	ScopedLock sl(c->m_graph->m_mtx);
+	c->m_state = Component::state_failed;
+	pthread_cond_signal(&c->m_graph->m_cond);
+}
+
+
+bool StartupGraph::run(bool useJobScheduler) {
+	m_startTime = gettimeofdayInMilliseconds();
+
+	log(LOG_INFO, "startup: Loading %d components%s", (int)m_components.size(),
+	    useJobScheduler ? " in parallel" : "");
+
+	ScopedLock sl(m_mtx);
+	for (;;) {
+		bool progress = false;
+		int numWaiting = 0;
+		int numRunning = 0;
+
+		for (auto c : m_components) {
+			if (c->m_state == Component::state_running) {
+				numRunning++;
+				continue;
+			}
+
+			if (c->m_state != Component::state_waiting) {
+				continue;
+			}
+
+			bool ready = true;
+			bool skip = false;
+			for (const auto &dependency : c->m_dependencies) {
+				auto it = std::find_if(m_components.begin(), m_components.end(),
+				                       [&dependency](const Component *d) { return d->m_name == dependency; });
+				if (it == m_components.end()) {
+					log(LOG_LOGIC, "startup: %s depends on unknown component %s", c->m_name.c_str(), dependency.c_str());
+					skip = true;
+					break;
+				}
+
+				Component::state_t state = (*it)->m_state;
+				if (state == Component::state_failed || state == Component::state_skipped) {
+					skip = true;
+					break;
+				}
+				if (state != Component::state_done) {
+					ready = false;
+				}
+			}
+
+			if (skip) {
+				log(LOG_WARN, "startup: Skipping %s because a dependency failed", c->m_name.c_str());
+				c->m_state = Component::state_skipped;
+				c->m_timing.m_skipped = true;
+				progress = true;
+				continue;
+			}
+
+			if (!ready) {
+				numWaiting++;
+				continue;
+			}
+
+			c->m_state = Component::state_running;
+			progress = true;
+
+			// runComponent() takes the lock itself
+			sl.unlock();
+			if (c->m_mainThreadOnly || !useJobScheduler ||
+			    !g_jobScheduler.submit(runComponentWrapper, componentDoneWrapper, c, thread_type_config_load, 0)) {
+				runComponent(c, true);
+			} else {
+				numRunning++;
+			}
+			sl.lock();
+		}
+
+		if (numRunning == 0 && numWaiting == 0 && !progress) {
+			break;
+		}
+
+		if (!progress) {
+			if (numRunning == 0) {
+				// nothing running and nothing can start: circular dependencies
+				for (auto c : m_components) {
+					if (c->m_state == Component::state_waiting) {
+						log(LOG_LOGIC, "startup: %s has circular dependencies", c->m_name.c_str());
+						c->m_state = Component::state_failed;
+					}
+				}
+				continue;
+			}
+
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += 100 * 1000000;
+			if (ts.tv_nsec >= 1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&m_cond, &m_mtx.mtx, &ts);
+
+			// the loop isn't running yet so reap the finished jobs ourselves
+			sl.unlock();
+			g_jobScheduler.cleanup_finished_jobs();
+			sl.lock();
+		}
+	}
+
+	int64_t totalMs = gettimeofdayInMilliseconds() - m_startTime;
+
+	bool status = true;
+	std::vector<StartupTimelineEntry> timeline;
+	for (auto c : m_components) {
+		timeline.push_back(c->m_timing);
+		if (c->m_required && c->m_state != Component::state_done) {
+			log(LOG_ERROR, "startup: Required component %s failed", c->m_name.c_str());
+			status = false;
+		}
+	}
+	sl.unlock();
+
+	std::stable_sort(timeline.begin(), timeline.end(),
+	                 [](const StartupTimelineEntry &a, const StartupTimelineEntry &b) { return a.m_startMs < b.m_startMs; });
+
+	log(LOG_INFO, "startup: Loaded %d components in %" PRId64" ms", (int)timeline.size(), totalMs);
+
+	ScopedLock tsl(s_timelineMtx);
+	s_timeline.swap(timeline);
+	s_timelineTotalMs = totalMs;
+
+	return status;
+}
+
+
+std::vector<StartupTimelineEntry> getStartupTimeline() {
+	ScopedLock sl(s_timelineMtx);
+	return s_timeline;
+}
+
+
+int64_t getStartupTimelineTotalMs() {
+	ScopedLock sl(s_timelineMtx);
+	return s_timelineTotalMs;
+}
+
+
+void printStartupTimeline(SafeBuf *sb) {
+	std::vector<StartupTimelineEntry> timeline = getStartupTimeline();
+	int64_t totalMs = getStartupTimelineTotalMs();
+
+	sb->safePrintf("<table %s>"
+	               "<tr class=hdrow><td colspan=5><center><b>Startup Timeline</b> (%" PRId64" ms)</center></td></tr>\n"
+	               "<tr class=poo>"
+	               "<td><b>component</b></td>"
+	               "<td><b>thread</b></td>"
+	               "<td><b>start (ms)</b></td>"
+	               "<td><b>wall time (ms)</b></td>"
+	               "<td><b>status</b></td>"
+	               "</tr>\n",
+	               TABLE_STYLE, totalMs);
+
+	for (const auto &entry : timeline) {
+		const char *status = entry.m_skipped ? "skipped" : (entry.m_success ? "ok" : "failed");
+		sb->safePrintf("<tr class=poo>"
+		               "<td>%s</td>"
+		               "<td>%s</td>"
+		               "<td>%" PRId64"</td>"
+		               "<td>%" PRId64"</td>"
+		               "<td>%s</td>"
+		               "</tr>\n",
+		               entry.m_name.c_str(),
+		               entry.m_onMainThread ? "main" : "job",
+		               entry.m_startMs,
+		               entry.m_endMs - entry.m_startMs,
+		               status);
+	}
+
+	sb->safePrintf("</table><br><br>\n");
+}
@@ -0,0 +1,74 @@
+#ifndef GB_STARTUPGRAPH_H
+#define GB_STARTUPGRAPH_H
+
+#include "GbMutex.h"
+#include "JobScheduler.h"
+#include <pthread.h>
+#include <inttypes.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+class SafeBuf;
+
+
+// wall time of one startup component
+struct StartupTimelineEntry {
+	std::string m_name;
+	int64_t     m_startMs;        //relative to when the graph started running
+	int64_t     m_endMs;
+	bool        m_onMainThread;
+	bool        m_success;
+	bool        m_skipped;        //a dependency failed so it never ran
+};
+
+
+// . dependency graph of the startup loaders (dictionaries, rdbs, collections, ...)
+// . components whose dependencies have completed are run concurrently as
+//   thread_type_config_load jobs
+// . components flagged as main-thread-only are run inline on the calling thread
+// . run() blocks until all components have completed, then records the
+//   timeline so it can be shown on the stats page
+class StartupGraph {
+	StartupGraph(const StartupGraph&);
+	StartupGraph& operator=(const StartupGraph&);
+public:
+	typedef std::function<bool()> loader_t;
+
+	StartupGraph();
+	~StartupGraph();
+
+	// . if a required component fails run() returns false
+	// . a component is skipped if any of its dependencies failed or were skipped
+	void add(const char *name, loader_t loader,
+	         const std::vector<std::string> &dependencies = std::vector<std::string>(),
+	         bool required = true, bool mainThreadOnly = false);
+
+	// names of all added components starting with prefix, for depending on a group
+	std::vector<std::string> getNames(const char *prefix) const;
+
+	// . runs everything and blocks until done
+	// . returns false if a required component failed
+	bool run(bool useJobScheduler);
+
+private:
+	struct Component;
+
+	static void runComponentWrapper(void *state);
+	static void componentDoneWrapper(void *state, job_exit_t exit_type);
+	void runComponent(Component *c, bool onMainThread);
+
+	std::vector<Component*> m_components;
+	int64_t m_startTime;
+
+	GbMutex m_mtx;
+	pthread_cond_t m_cond;
+};
+
+
+// timeline of the last StartupGraph::run() of this process
+std::vector<StartupTimelineEntry> getStartupTimeline();
+int64_t getStartupTimelineTotalMs();
+void printStartupTimeline(SafeBuf *sb);
+
+#endif // GB_STARTUPGRAPH_H
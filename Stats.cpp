@@ -22,6 +22,13 @@ Stats::Stats ( ) {
 };
 
 
+template <typename T>
+static void clearCounters(std::atomic<T> *counters, size_t numCounters) {
+	for (size_t i = 0; i < numCounters; i++) {
+		counters[i] = 0;
+	}
+}
+
 void Stats::clearMsgStats() {
 //	char *start = &m_start;
 //	char *end   = &m_end;
@@ -29,25 +36,25 @@ void Stats::clearMsgStats() {
 	// Version understandable by Coverity
 
 	// char      m_start;
-	memset(m_msgTotalOfSendTimes, 0, sizeof(m_msgTotalOfSendTimes));
-	memset(m_msgTotalSent, 0, sizeof(m_msgTotalSent));
-	memset(m_msgTotalSentByTime, 0, sizeof(m_msgTotalSentByTime));
+	clearCounters(&m_msgTotalOfSendTimes[0][0][0], sizeof(m_msgTotalOfSendTimes) / sizeof(m_msgTotalOfSendTimes[0][0][0]));
+	clearCounters(&m_msgTotalSent[0][0][0], sizeof(m_msgTotalSent) / sizeof(m_msgTotalSent[0][0][0]));
+	clearCounters(&m_msgTotalSentByTime[0][0][0][0], sizeof(m_msgTotalSentByTime) / sizeof(m_msgTotalSentByTime[0][0][0][0]));
 	memset(m_msgTotalOfQueuedTimes, 0, sizeof(m_msgTotalOfQueuedTimes));
 	memset(m_msgTotalQueued, 0, sizeof(m_msgTotalQueued));
 	memset(m_msgTotalQueuedByTime, 0, sizeof(m_msgTotalQueuedByTime));
 	memset(m_msgTotalOfHandlerTimes, 0, sizeof(m_msgTotalOfHandlerTimes));
 	memset(m_msgTotalHandlersCalled, 0, sizeof(m_msgTotalHandlersCalled));
 	memset(m_msgTotalHandlersByTime, 0, sizeof(m_msgTotalHandlersByTime));
-	memset(m_packetsIn, 0, sizeof(m_packetsIn));
-	memset(m_packetsOut, 0, sizeof(m_packetsOut));
-	memset(m_acksIn, 0, sizeof(m_acksIn));
-	memset(m_acksOut, 0, sizeof(m_acksOut));
-	memset(m_reroutes, 0, sizeof(m_reroutes));
-	memset(m_errors, 0, sizeof(m_errors));
-	memset(m_timeouts, 0, sizeof(m_timeouts));
-	memset(m_nomem, 0, sizeof(m_nomem));
-	memset(m_dropped, 0, sizeof(m_dropped));
-	memset(m_cancelRead, 0, sizeof(m_cancelRead));
+	clearCounters(&m_packetsIn[0][0], sizeof(m_packetsIn) / sizeof(m_packetsIn[0][0]));
+	clearCounters(&m_packetsOut[0][0], sizeof(m_packetsOut) / sizeof(m_packetsOut[0][0]));
+	clearCounters(&m_acksIn[0][0], sizeof(m_acksIn) / sizeof(m_acksIn[0][0]));
+	clearCounters(&m_acksOut[0][0], sizeof(m_acksOut) / sizeof(m_acksOut[0][0]));
+	clearCounters(&m_reroutes[0][0], sizeof(m_reroutes) / sizeof(m_reroutes[0][0]));
+	clearCounters(&m_errors[0][0], sizeof(m_errors) / sizeof(m_errors[0][0]));
+	clearCounters(&m_timeouts[0][0], sizeof(m_timeouts) / sizeof(m_timeouts[0][0]));
+	clearCounters(&m_nomem[0][0], sizeof(m_nomem) / sizeof(m_nomem[0][0]));
+	clearCounters(&m_dropped[0][0], sizeof(m_dropped) / sizeof(m_dropped[0][0]));
+	clearCounters(&m_cancelRead[0][0], sizeof(m_cancelRead) / sizeof(m_cancelRead[0][0]));
 	m_parsingInconsistencies = 0;
 	m_totalOverflows = 0;
 	m_compressedBytesIn = 0;
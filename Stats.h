@@ -11,6 +11,7 @@
 
 #include "SafeBuf.h"
 #include "UdpProtocol.h" // MAX_MSG_TYPES
+#include <atomic>
 
 class StatPoint {
  public:
@@ -73,9 +74,10 @@ class Stats {
 	// and stats for how long to send a request or reply from
 	// start to finish. the first "2" is the niceness, 0 or 1, and
 	// the second "2" is 0 if sending a reply and 1 if sending a request.
-	int64_t m_msgTotalOfSendTimes    [MAX_MSG_TYPES][2][2];
-	int64_t m_msgTotalSent           [MAX_MSG_TYPES][2][2];
-	int64_t m_msgTotalSentByTime     [MAX_MSG_TYPES][2][2][MAX_BUCKETS];
+	// . the send and dgram counters are atomic, the udp io threads bump them
+	std::atomic<int64_t> m_msgTotalOfSendTimes[MAX_MSG_TYPES][2][2];
+	std::atomic<int64_t> m_msgTotalSent[MAX_MSG_TYPES][2][2];
+	std::atomic<int64_t> m_msgTotalSentByTime[MAX_MSG_TYPES][2][2][MAX_BUCKETS];
 	// how long we wait after receiving the request until handler is called
 	int64_t m_msgTotalOfQueuedTimes  [MAX_MSG_TYPES][2];
 	int64_t m_msgTotalQueued         [MAX_MSG_TYPES][2];
@@ -88,16 +90,16 @@ class Stats {
 	int64_t m_msgTotalHandlersCalled [MAX_MSG_TYPES][2];
 	int64_t m_msgTotalHandlersByTime [MAX_MSG_TYPES][2][MAX_BUCKETS];
 
-	int32_t m_packetsIn  [MAX_MSG_TYPES][2];
-	int32_t m_packetsOut [MAX_MSG_TYPES][2];
-	int32_t m_acksIn     [MAX_MSG_TYPES][2];
-	int32_t m_acksOut    [MAX_MSG_TYPES][2];
-	int32_t m_reroutes   [MAX_MSG_TYPES][2];
-	int32_t m_errors     [MAX_MSG_TYPES][2];
-	int32_t m_timeouts   [MAX_MSG_TYPES][2]; // specific error
-	int32_t m_nomem      [MAX_MSG_TYPES][2]; // specific error
-	int32_t m_dropped    [MAX_MSG_TYPES][2]; // dropped dgram
-	int32_t m_cancelRead [MAX_MSG_TYPES][2]; // dropped dgram
+	std::atomic<int32_t> m_packetsIn  [MAX_MSG_TYPES][2];
+	std::atomic<int32_t> m_packetsOut [MAX_MSG_TYPES][2];
+	std::atomic<int32_t> m_acksIn     [MAX_MSG_TYPES][2];
+	std::atomic<int32_t> m_acksOut    [MAX_MSG_TYPES][2];
+	std::atomic<int32_t> m_reroutes   [MAX_MSG_TYPES][2];
+	std::atomic<int32_t> m_errors     [MAX_MSG_TYPES][2];
+	std::atomic<int32_t> m_timeouts   [MAX_MSG_TYPES][2]; // specific error
+	std::atomic<int32_t> m_nomem      [MAX_MSG_TYPES][2]; // specific error
+	std::atomic<int32_t> m_dropped    [MAX_MSG_TYPES][2]; // dropped dgram
+	std::atomic<int32_t> m_cancelRead [MAX_MSG_TYPES][2]; // dropped dgram
 
 	int32_t m_parsingInconsistencies;
 
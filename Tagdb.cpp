@@ -20,6 +20,8 @@
 #include "Mem.h"
 #include "Errno.h"
 #include "gbmemcpy.h"
+#include "GbCache.h"
+#include <atomic>
 
 
 static HashTableX s_ht;
@@ -920,6 +922,8 @@ bool TagRec::printToBufAsTagVector  ( SafeBuf *sb ) {
 // . TODO: actually use this
 #define TDF_NOINDEX  0x04
 #define TDF_DEPRECATED 0x08
+// . regenerated regularly, cached for a shorter time by Msg8a
+#define TDF_VOLATILE 0x10
 
 class TagDesc {
 public:
@@ -962,7 +966,7 @@ static TagDesc s_tagDesc[] = {
 	// . allow multiple tags of this type from same "user"
 	{"authorityinlink"      ,TDF_STRING|TDF_ARRAY,0},
 
-	{"sitenuminlinks"       ,0x00,0},
+	{"sitenuminlinks"       ,TDF_VOLATILE,0},
 
 	// . the first ip we lookup for this domain
 	// . this is permanent and should never change
@@ -1195,9 +1199,168 @@ key128_t Tagdb::makeDomainEndKey ( Url *u ) {
 //
 ///////////////////////////////////////////////
 
-/// @todo ALC Msg8a RdbCache is currently removed (cache timeout doesn't work;
-/// caching will be bad for numsiteinlinks(which is regenerated when it's stale).
-/// this could cause us to regenerate numsiteinlinks unnecessarily causing load on the system
+// . local cache of the tagdb lists of sites and domains
+// . keyed by collnum + the upper 64 bits of the tagdb key (hash of site or
+//   domain) so adding a tag can invalidate the list it belongs to
+// . lists with volatile tags (sitenuminlinks, which is regenerated when it
+//   is stale) and empty lists expire after m_tagRecCacheVolatileMaxAge,
+//   others after m_tagRecCacheMaxAge
+// . Msg4 invalidates the lists of the tags when they are in tagdb, that is
+//   when the add is acked (Msg4Out) or done (Msg4In), so tags added from
+//   this host are seen right away
+// . a lookup that was in flight when its list was invalidated may have
+//   read the old list, so it is not cached
+struct TagListCacheEntry {
+	std::string m_list;
+	int64_t m_expireTime;
+};
+
+static GbCache<uint64_t, TagListCacheEntry> s_tagListCache;
+static GbMutex s_tagListCacheConfMtx;
+static int64_t s_tagListCacheSize = -1;
+static int64_t s_tagListCacheMaxAge = -1;
+
+static std::atomic<int64_t> s_tagListCacheHits(0);
+static std::atomic<int64_t> s_tagListCacheMisses(0);
+static std::atomic<int64_t> s_tagListCacheExpired(0);
+static std::atomic<int64_t> s_tagListCacheInvalidations(0);
+
+// . invalidation generation, and the generation of the last invalidation
+//   of the lists hashing to each slot
+static std::atomic<int64_t> s_tagListCacheGeneration(0);
+static std::atomic<int64_t> s_tagListCacheInvalidated[1024];
+
+static uint64_t getTagListCacheKey(collnum_t collnum, const key128_t *key) {
+	return hash64h(key->n1, (uint64_t)collnum);
+}
+
+// reconfigure if the parms changed
+static void configureTagListCache() {
+	int64_t maxAge = std::max(g_conf.m_tagRecCacheMaxAge, g_conf.m_tagRecCacheVolatileMaxAge);
+
+	ScopedLock sl(s_tagListCacheConfMtx);
+	if (s_tagListCacheSize == g_conf.m_tagRecCacheSize && s_tagListCacheMaxAge == maxAge) {
+		return;
+	}
+
+	s_tagListCacheSize = g_conf.m_tagRecCacheSize;
+	s_tagListCacheMaxAge = maxAge;
+	s_tagListCache.configure(maxAge * 1000, s_tagListCacheSize, g_conf.m_logDebugTagdb, "tagrec cache");
+}
+
+static bool isVolatileTagType(int32_t tagType) {
+	ScopedLock sl(s_htMutex);
+	TagDesc **ptd = (TagDesc **)s_ht.getValue(&tagType);
+	return ptd && ((*ptd)->m_flags & TDF_VOLATILE);
+}
+
+static std::atomic<int64_t> *getTagListCacheInvalidated(uint64_t cacheKey) {
+	return &s_tagListCacheInvalidated[cacheKey % (sizeof(s_tagListCacheInvalidated) / sizeof(s_tagListCacheInvalidated[0]))];
+}
+
+// . generation is s_tagListCacheGeneration from before the list was looked up
+static void addTagListToCache(collnum_t collnum, const key128_t *startKey, RdbList *list, int64_t generation) {
+	if (g_conf.m_tagRecCacheSize <= 0) {
+		return;
+	}
+
+	// invalidated while we looked it up, it may be stale
+	uint64_t cacheKey = getTagListCacheKey(collnum, startKey);
+	if (*getTagListCacheInvalidated(cacheKey) > generation) {
+		return;
+	}
+
+	// expire with the most volatile tag. empty lists are volatile too,
+	// the site may be tagged soon
+	bool isVolatile = (list->getListSize() <= 0);
+	for (Tag *tag = (Tag *)list->getList(); !isVolatile && (char *)tag < list->getListEnd(); ) {
+		if (isVolatileTagType(tag->m_type)) {
+			isVolatile = true;
+		}
+
+		int32_t recSize = tag->getRecSize();
+		if (recSize < 12) {
+			return;
+		}
+		tag = (Tag *)((char *)tag + recSize);
+	}
+
+	TagListCacheEntry entry;
+	entry.m_list.assign(list->getList(), list->getListSize());
+	entry.m_expireTime = gettimeofdayInMilliseconds() +
+		(isVolatile ? g_conf.m_tagRecCacheVolatileMaxAge : g_conf.m_tagRecCacheMaxAge) * 1000;
+
+	s_tagListCache.insert(cacheKey, entry);
+}
+
+static bool getTagListFromCache(collnum_t collnum, const key128_t *startKey, const key128_t *endKey, RdbList *list) {
+	if (g_conf.m_tagRecCacheSize <= 0) {
+		return false;
+	}
+
+	configureTagListCache();
+
+	TagListCacheEntry entry;
+	if (!s_tagListCache.lookup(getTagListCacheKey(collnum, startKey), &entry)) {
+		++s_tagListCacheMisses;
+		return false;
+	}
+
+	if (entry.m_expireTime < gettimeofdayInMilliseconds()) {
+		++s_tagListCacheExpired;
+		return false;
+	}
+
+	char *buf = NULL;
+	int32_t bufSize = entry.m_list.size();
+	if (bufSize > 0) {
+		buf = (char *)mmalloc(bufSize, "RdbList");
+		if (!buf) {
+			return false;
+		}
+		memcpy(buf, entry.m_list.data(), bufSize);
+	}
+
+	list->set(buf, bufSize, buf, bufSize, (const char *)startKey, (const char *)endKey, -1, true, false, sizeof(key128_t));
+
+	++s_tagListCacheHits;
+	return true;
+}
+
+void Msg8a::invalidateCache(collnum_t collnum, const key128_t *key) {
+	if (g_conf.m_tagRecCacheSize <= 0) {
+		return;
+	}
+
+	++s_tagListCacheInvalidations;
+	uint64_t cacheKey = getTagListCacheKey(collnum, key);
+	*getTagListCacheInvalidated(cacheKey) = ++s_tagListCacheGeneration;
+	s_tagListCache.remove(cacheKey);
+}
+
+void Msg8a::printCacheStats(SafeBuf *sb) {
+	int64_t hits = s_tagListCacheHits;
+	int64_t misses = s_tagListCacheMisses;
+	int64_t expired = s_tagListCacheExpired;
+	int64_t lookups = hits + misses + expired;
+
+	sb->safePrintf("<table %s>"
+	               "<tr class=hdrow><td colspan=2><center><b>TagRec Cache</b>"
+	               "</center></td></tr>\n"
+	               "<tr class=poo><td><b>cached lists</b></td><td>%" PRIu64"</td></tr>\n"
+	               "<tr class=poo><td><b>lookups</b></td><td>%" PRId64"</td></tr>\n"
+	               "<tr class=poo><td><b>hits</b></td><td>%" PRId64"</td></tr>\n"
+	               "<tr class=poo><td><b>misses</b></td><td>%" PRId64"</td></tr>\n"
+	               "<tr class=poo><td><b>expired</b></td><td>%" PRId64"</td></tr>\n"
+	               "<tr class=poo><td><b>hit ratio</b></td><td>%.1f%%</td></tr>\n"
+	               "<tr class=poo><td><b>invalidations</b></td><td>%" PRId64"</td></tr>\n"
+	               "</table><br><br>\n",
+	               TABLE_STYLE,
+	               (uint64_t)s_tagListCache.size(),
+	               lookups, hits, misses, expired,
+	               lookups ? 100.0 * hits / lookups : 0.0,
+	               (int64_t)s_tagListCacheInvalidations);
+}
 
 Msg8a::Msg8a()
   : m_url(NULL),
@@ -1359,17 +1522,19 @@ bool Msg8a::getTagRec( Url *url, collnum_t collnum, int32_t niceness, void *stat
 }
 
 struct Msg8aState {
-	Msg8aState(Msg8a *msg8a, key128_t startKey, key128_t endKey, int32_t requestNum)
+	Msg8aState(Msg8a *msg8a, key128_t startKey, key128_t endKey, int32_t requestNum, int64_t cacheGeneration)
 	  : m_msg8a(msg8a)
 	  , m_startKey(startKey)
 	  , m_endKey(endKey)
-	  , m_requestNum(requestNum) {
+	  , m_requestNum(requestNum)
+	  , m_cacheGeneration(cacheGeneration) {
 	}
 
 	Msg8a *m_msg8a;
 	key128_t m_startKey;
 	key128_t m_endKey;
 	int32_t m_requestNum;
+	int64_t m_cacheGeneration;
 };
 
 // . returns false if blocked, true otherwise
@@ -1403,6 +1568,13 @@ bool Msg8a::launchGetRequests ( ) {
 		// and the list
 		RdbList *listPtr = &m_tagRec->m_lists[m_requests];
 
+		if (getTagListFromCache(m_collnum, &startKey, &endKey, listPtr)) {
+			ScopedLock sl(m_mtx);
+			m_requests++;
+			m_replies++;
+			continue;
+		}
+
 		// bias based on the top 64 bits which is the hash of the "site" now
 		int32_t shardNum = getShardNum ( RDB_TAGDB , &startKey );
 		Host *firstHost ;
@@ -1412,9 +1584,11 @@ bool Msg8a::launchGetRequests ( ) {
 		firstHost = g_hostdb.getLeastLoadedInShard ( shardNum , m_niceness );
 		int32_t firstHostId = firstHost->m_hostId;
 
+		int64_t cacheGeneration = s_tagListCacheGeneration;
+
 		Msg8aState *state = NULL;
 		try {
-			state = new Msg8aState(this, startKey, endKey, m_requests);
+			state = new Msg8aState(this, startKey, endKey, m_requests, cacheGeneration);
 		} catch(std::bad_alloc&) {
 			g_errno = m_errno = ENOMEM;
 			log(LOG_WARN, "tagdb: unable to allocate memory for Msg8aState");
@@ -1453,6 +1627,8 @@ bool Msg8a::launchGetRequests ( ) {
 				m_errno = g_errno;
 				break;
 			}
+
+			addTagListToCache(m_collnum, &startKey, listPtr, cacheGeneration);
 		}
 
 		ScopedLock sl(m_mtx);
@@ -1481,6 +1657,12 @@ void Msg8a::gotMsg0ReplyWrapper ( void *state ) {
 	Msg8aState *msg8aState = (Msg8aState*)state;
 
 	Msg8a *msg8a = msg8aState->m_msg8a;
+
+	// cache it before gotAllReplies() marks the dups
+	if ( ! g_errno ) {
+		addTagListToCache(msg8a->m_collnum, &msg8aState->m_startKey, &msg8a->m_tagRec->m_lists[msg8aState->m_requestNum], msg8aState->m_cacheGeneration);
+	}
+
 	mdelete( msg8aState, sizeof(*msg8aState), "msg8astate" );
 	delete msg8aState;
 
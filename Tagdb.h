@@ -226,6 +226,13 @@ class Msg8a {
 	// . stores the tagRec in your "tagRec"
 	bool getTagRec( Url *url, collnum_t collnum, int32_t niceness, void *state, void (*callback)( void * ),
 	                TagRec *tagRec );
+
+	// . the tagdb lists are cached locally, see Tagdb.cpp
+	// . drop the cached list of the site/domain of this tagdb key
+	static void invalidateCache(collnum_t collnum, const key128_t *key);
+
+	// hit ratio for the stats page
+	static void printCacheStats(SafeBuf *sb);
 	
 private:
 	bool launchGetRequests();
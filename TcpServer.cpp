@@ -78,7 +78,14 @@ TcpServer::TcpServer() {
 	m_ready = false;
 	m_numOpen = 0;
 	m_numClosed = 0;
-	
+	m_numKeepAliveNew = 0;
+	m_numKeepAliveReused = 0;
+	m_numKeepAlivePooled = 0;
+	m_numKeepAliveIdleClosed = 0;
+	m_numKeepAliveRemoteClosed = 0;
+	m_numKeepAliveResent = 0;
+	m_numSslHandshakes = 0;
+	m_numSslResumed = 0;
 }
 
 
@@ -93,6 +100,9 @@ void TcpServer::reset() {
 		if ( ! s ) continue;
 		destroySocket ( s );
 	}
+	for ( auto it = m_sslSessions.begin(); it != m_sslSessions.end(); ++it )
+		SSL_SESSION_free ( it->second );
+	m_sslSessions.clear();
 	// do we got a valid listen socket?
 	if ( m_sock < 0 ) return;
 	// if so, stop listening, may block
@@ -514,14 +524,18 @@ bool TcpServer::gotTcpServerIp ( TcpState *tst , int32_t ip ) {
 bool TcpServer::sendMsg( const char *hostname, int32_t hostnameLen, int32_t ip, int16_t port, char *sendBuf,
 			 int32_t sendBufSize, int32_t sendBufUsed, int32_t msgTotalSize, void *state,
 			 void ( *callback )( void *state, TcpSocket *s ), int32_t timeout,
-			 int32_t maxTextDocLen, int32_t maxOtherDocLen, bool useHttpTunnel ) {
+			 int32_t maxTextDocLen, int32_t maxOtherDocLen, bool useHttpTunnel, bool keepAlive ) {
 	// debug
 	char ipbuf[16];
 	log(LOG_DEBUG,"tcp: Getting doc for ip=%s.", iptoa(ip,ipbuf));
 
+	// no keep-alive through a tunnel, the connection is to the proxy
+	if ( useHttpTunnel ) keepAlive = false;
+
 	// . get an unused socket that's pre-connected to this ip/port
 	// . returns NULL if it can't
-	TcpSocket *s = getAvailableSocket ( ip , port );
+	TcpSocket *s = NULL;
+	if ( keepAlive ) s = getAvailableSocket ( ip , port , hostname , hostnameLen );
 
 	// . sendMsg(...) returns false if blocked, true otherwise
 	// . it also sets g_errno on error
@@ -559,6 +573,11 @@ bool TcpServer::sendMsg( const char *hostname, int32_t hostnameLen, int32_t ip,
 			s->m_hostname[hostnameLen] = '\0';
 		}
 
+		s->m_keepAlive = true;
+		s->m_keepAliveReply = false;
+		s->m_numReuses++;
+		m_numKeepAliveReused++;
+
 		return sendMsg( s, sendBuf, sendBufSize, sendBufUsed, msgTotalSize, state, callback, timeout,
 						maxTextDocLen, maxOtherDocLen );
 	}
@@ -617,6 +636,11 @@ bool TcpServer::sendMsg( const char *hostname, int32_t hostnameLen, int32_t ip,
 	s->m_tunnelMode       = 0;
 	s->m_truncated        = false;
 	s->m_blockedContentType = false;
+	s->m_keepAlive        = keepAlive;
+	s->m_keepAliveReply   = false;
+	s->m_numReuses        = 0;
+
+	if ( keepAlive ) m_numKeepAliveNew++;
 
 	// if http request starts with "CONNECT ..." then enter tunnel mode
 	if ( useHttpTunnel ) {
@@ -731,7 +755,8 @@ bool TcpServer::sendMsg( TcpSocket *s, char *sendBuf, int32_t sendBufSize, int32
 
 // . TcpSockets are 1-1 with socket descriptors
 // . returns NULL if no available sockets w/ this ip/port were found
-TcpSocket *TcpServer::getAvailableSocket ( int32_t ip, int16_t port ) {
+// . these are the keep-alive connections put there by recycleSocket()
+TcpSocket *TcpServer::getAvailableSocket ( int32_t ip, int16_t port, const char *hostname, int32_t hostnameLen ) {
 	// . search for an available socket already connected to our ip/port
 	for ( int32_t i = 0 ; i <= m_lastFilled ; i++ ) {
 		TcpSocket *s = m_tcpSockets[i];
@@ -739,6 +764,27 @@ TcpSocket *TcpServer::getAvailableSocket ( int32_t ip, int16_t port ) {
 		if ( s->m_ip   != ip   ) continue;
 		if ( s->m_port != port ) continue;
 		if ( ! s->isAvailable()) continue;
+		if ( s->m_isIncoming   ) continue;
+		if ( ! s->m_keepAlive  ) continue;
+		// the tls connection was made for a certain host name
+		if ( s->m_ssl &&
+		     ( ! hostname || ! s->m_hostname ||
+		       s->m_hostnameSize != hostnameLen + 1 ||
+		       strncasecmp ( s->m_hostname , hostname , hostnameLen ) != 0 ) )
+			continue;
+		// . make sure the server did not close it while it was idle.
+		//   there should be nothing to read
+		// . it can still close it before it gets our request, see
+		//   resendOnNewSocket()
+		char c;
+		int n = ::recv ( s->m_sd , &c , 1 , MSG_PEEK | MSG_DONTWAIT );
+		if ( n >= 0 || ( errno != EAGAIN && errno != EWOULDBLOCK ) ) {
+			if ( g_conf.m_logDebugTcp )
+				log("tcp: keep-alive sd=%i was closed while idle", s->m_sd);
+			m_numKeepAliveRemoteClosed++;
+			destroySocket ( s );
+			continue;
+		}
 		// reset the start time
 		s->m_startTime      = gettimeofdayInMilliseconds();
 		s->m_lastActionTime = gettimeofdayInMilliseconds();
@@ -1220,6 +1266,18 @@ static void readSocketWrapper2(int sd, void *state) {
 		// now try to read the reply
 		//log("calling readSocket now");
 	}
+
+	// . an idle keep-alive connection became readable. the server closed
+	//   it or sent something we did not ask for, we are done with it
+	//   either way
+	if ( s->isAvailable() && s->m_keepAlive && ! s->m_isIncoming ) {
+		if ( g_conf.m_logDebugTcp )
+			log("tcp: keep-alive sd=%i was closed while idle", s->m_sd);
+		THIS->m_numKeepAliveRemoteClosed++;
+		THIS->destroySocket ( s );
+		return;
+	}
+
 	// . readSocket() returns -1 on error and sets g_errno
 	// . if socket was closed on the other end this returns -1 but does 
 	//   NOT set g_errno
@@ -1229,6 +1287,13 @@ static void readSocketWrapper2(int sd, void *state) {
 	// . this will also unregister all our callbacks for the socket
 	// . TODO: deleting nodes from under Loop::callCallbacks is dangerous!!
 	if ( status == -1 ) {
+		// . a re-used keep-alive connection that the server closed
+		//   before it got our request?
+		if ( s->m_numReuses > 0 && s->m_totalRead == 0 && s->m_sendBuf &&
+		     ! s->m_isIncoming ) {
+			THIS->resendOnNewSocket ( s );
+			return;
+		}
 		// g_errno is not set if it just read 0 bytes
 		//if ( ! g_errno ) { g_process.shutdownAbort(true); }
 		THIS->makeCallback  ( s );
@@ -1246,6 +1311,16 @@ static void readSocketWrapper2(int sd, void *state) {
 	if ( s->m_sendBuf && s->m_tunnelMode != 1 ) {
 		// i guess ok
 		g_errno = 0;
+		// . the reply must end exactly where Content-Length: says for
+		//   the connection to be re-used. check before the callback
+		//   since it may take or unzip m_readBuf
+		if ( s->m_totalToRead <= 0 ||
+		     s->m_readOffset != s->m_totalToRead ||
+		     s->m_truncated )
+			s->m_keepAliveReply = false;
+		// next connection to this host can resume the tls session
+		if ( s->m_ssl && s->m_keepAlive )
+			THIS->saveSslSession ( s );
 		// callback must free all m_sendBuf/m_readBuf in TcpSocket
 		THIS->makeCallback ( s );
 		// . if the socket was closed by remote side we destroy it
@@ -1259,7 +1334,8 @@ static void readSocketWrapper2(int sd, void *state) {
 		//	THIS->destroySocket ( s );
 		//else    
 		//	THIS->recycleSocket ( s );
-		THIS->destroySocket ( s );		
+		// . keeps it open if it is a keep-alive connection
+		THIS->recycleSocket ( s );
 		return;
 	}
 
@@ -1596,6 +1672,12 @@ void writeSocketWrapper ( int sd , void *state ) {
 			g_errno = 0;
 		else 
 			log("tcp: socket closed while streaming");
+		// a re-used keep-alive connection closed before the reply?
+		if ( s->m_numReuses > 0 && s->m_totalRead == 0 && s->m_sendBuf &&
+		     ! s->m_isIncoming && ! s->isAvailable() ) {
+			THIS->resendOnNewSocket ( s );
+			return;
+		}
 		THIS->makeCallback ( s );
 		THIS->destroySocket ( s ); 
 		return; 
@@ -2227,14 +2309,112 @@ void TcpServer::destroySocket ( TcpSocket *s ) {
 }
 
 // . try to make the socket available for another transaction
-// . if the socket was initiated by remote host then this makes us seem like
-//   a keep alive server, and we're open for reading...
-// . if the socket was connected by us then we're hoping the remote host
-//   supports keep alives...
+// . sockets initiated by the remote host are just destroyed, we are not a
+//   keep alive server
+// . if the socket was connected by us, we asked for keep-alive and the reply
+//   allows it then we keep it open for the next request to this ip/port,
+//   see getAvailableSocket()
 void TcpServer::recycleSocket ( TcpSocket *s ) {
-	// mdw... this now just destroys, baby, no more keep-alives
+	if ( s->m_sockState == ST_CLOSE_CALLED ||
+	     s->m_isIncoming ||
+	     ! s->m_keepAlive ||
+	     ! s->m_keepAliveReply ||
+	     s->m_tunnelMode ||
+	     s->m_streamingMode ||
+	     s->m_udpSlot ||
+	     ! g_conf.m_httpKeepAlive ||
+	     s->m_numReuses + 1 >= g_conf.m_httpKeepAliveMaxRequests ) {
+		destroySocket ( s );
+		return;
+	}
+
+	// do not keep too many idle connections to one ip
+	int32_t numIdle = 0;
+	for ( int32_t i = 0 ; i <= m_lastFilled ; i++ ) {
+		TcpSocket *t = m_tcpSockets[i];
+		if ( ! t || t == s ) continue;
+		if ( ! t->isAvailable() || ! t->m_keepAlive ) continue;
+		if ( t->m_ip != s->m_ip || t->m_port != s->m_port ) continue;
+		numIdle++;
+	}
+	if ( numIdle >= g_conf.m_httpKeepAliveMaxPerIp ) {
+		destroySocket ( s );
+		return;
+	}
+
+	if ( g_conf.m_logDebugTcp ) {
+		char ipbuf[16];
+		log("tcp: keeping sd=%i (%s:%u) open, %" PRId32" requests",
+		    s->m_sd, iptoa(s->m_ip,ipbuf), (unsigned)(uint16_t)s->m_port, s->m_numReuses + 1);
+	}
+
+	// free read/send buffers like destroySocket() does
+	if ( s->m_readBuf ) mfree (s->m_readBuf, s->m_readBufSize,"TcpServer");
+	if ( s->m_sendBuf ) mfree (s->m_sendBuf, s->m_sendBufSize,"TcpServer");
+	s->m_readBuf        = NULL;
+	s->m_readBufSize    = 0;
+	s->m_readOffset     = 0;
+	s->m_totalRead      = 0;
+	s->m_totalToRead    = 0;
+	s->m_sendBuf        = NULL;
+	s->m_sendBufSize    = 0;
+	s->m_sendBufUsed    = 0;
+	s->m_sendOffset     = 0;
+	s->m_totalSent      = 0;
+	s->m_totalToSend    = 0;
+	s->m_truncated      = false;
+	s->m_blockedContentType = false;
+	s->m_keepAliveReply = false;
+	s->m_callback       = NULL;
+	s->m_state          = NULL;
+	s->m_lastActionTime = gettimeofdayInMilliseconds();
+	s->m_sockState      = ST_AVAILABLE;
+
+	m_numKeepAlivePooled++;
+}
+
+void TcpServer::resendOnNewSocket ( TcpSocket *s ) {
+	if ( g_conf.m_logDebugTcp )
+		log("tcp: keep-alive sd=%i was closed before the reply, resending", s->m_sd);
+
+	// we own the send buffer now, not "s"
+	char *sendBuf         = s->m_sendBuf;
+	int32_t sendBufSize   = s->m_sendBufSize;
+	int32_t sendBufUsed   = s->m_sendBufUsed;
+	int32_t totalToSend   = s->m_totalToSend;
+	void *state           = s->m_state;
+	void (*callback)(void *state, TcpSocket *s) = s->m_callback;
+	int32_t timeout       = s->m_timeout;
+	int32_t maxTextDocLen = s->m_maxTextDocLen;
+	int32_t maxOtherDocLen = s->m_maxOtherDocLen;
+	int32_t ip            = s->m_ip;
+	int16_t port          = s->m_port;
+	std::string hostname;
+	if ( s->m_hostname ) hostname = s->m_hostname;
+	s->m_sendBuf = NULL;
+
+	g_errno = 0;
 	destroySocket ( s );
-	return;
+
+	// the other idle connections to it are probably closed as well
+	for ( int32_t i = 0 ; i <= m_lastFilled ; i++ ) {
+		TcpSocket *t = m_tcpSockets[i];
+		if ( ! t || ! t->isAvailable() || ! t->m_keepAlive ) continue;
+		if ( t->m_ip != ip || t->m_port != port ) continue;
+		destroySocket ( t );
+	}
+
+	m_numKeepAliveResent++;
+
+	// . returns false if blocked, true otherwise with g_errno set
+	// . uses a new connection since we closed the idle ones above
+	if ( ! sendMsg ( hostname.empty() ? NULL : hostname.c_str(), hostname.length(), ip, port, sendBuf,
+			 sendBufSize, sendBufUsed, totalToSend, state, callback, timeout, maxTextDocLen,
+			 maxOtherDocLen, false, true ) )
+		return;
+
+	// we have no TcpSocket here, like gotTcpServerIpWrapper()
+	if ( callback ) callback ( state , NULL );
 }
 
 // . called by Loop::runLoop() every one second
@@ -2255,6 +2435,13 @@ void TcpServer::readTimeoutPoll ( ) {
 		// get the TcpSocket for socket descriptor #i
 		TcpSocket *s = m_tcpSockets[i];
 		if ( ! s ) continue;
+		// close idle keep-alive connections before the server does
+		if ( s->isAvailable() && s->m_keepAlive && ! s->m_isIncoming &&
+		     now - s->m_lastActionTime >= g_conf.m_httpKeepAliveIdleTimeout ) {
+			m_numKeepAliveIdleClosed++;
+			destroySocket ( s );
+			continue;
+		}
 		// if in a high niceness callback we can only serve 
 		// low niceness (0) sockets at this point. because we might
 		// do a double callback on a socket that have niceness 1...
@@ -2668,6 +2855,15 @@ int TcpServer::sslHandshake ( TcpSocket *s ) {
 
 		SSL_set_fd(s->m_ssl, s->m_sd);
 		SSL_set_connect_state(s->m_ssl);
+
+		// resume the tls session of the last connection to this host
+		if ( s->m_keepAlive && s->m_hostname ) {
+			char key[300];
+			snprintf(key, sizeof(key), "%s:%u", s->m_hostname, (unsigned)(uint16_t)s->m_port);
+			auto it = m_sslSessions.find(key);
+			if ( it != m_sslSessions.end() )
+				SSL_set_session(s->m_ssl, it->second);
+		}
 	}
 
 	// set hostname for SNI
@@ -2689,6 +2885,9 @@ int TcpServer::sslHandshake ( TcpSocket *s ) {
 			log("tcp: ssl handshake done. entering writing mode sd=%i (%s:%u)",
 			    s->m_sd, iptoa(s->m_ip,ipbuf), (unsigned)(uint16_t)s->m_port);
 		}
+		m_numSslHandshakes++;
+		if ( SSL_session_reused(s->m_ssl) )
+			m_numSslResumed++;
 		// ok, it completed, go into writing mode
 		s->m_sockState = ST_WRITING;
 		return r;
@@ -2759,3 +2958,28 @@ int TcpServer::sslHandshake ( TcpSocket *s ) {
 	// we would block
 	return 0;
 }
+
+#define MAX_SSL_SESSIONS 10000
+
+void TcpServer::saveSslSession ( TcpSocket *s ) {
+	if ( ! s->m_ssl || ! s->m_hostname ) return;
+	SSL_SESSION *session = SSL_get1_session ( s->m_ssl );
+	if ( ! session ) return;
+
+	char key[300];
+	snprintf(key, sizeof(key), "%s:%u", s->m_hostname, (unsigned)(uint16_t)s->m_port);
+
+	auto it = m_sslSessions.find(key);
+	if ( it != m_sslSessions.end() ) {
+		SSL_SESSION_free ( it->second );
+		it->second = session;
+		return;
+	}
+
+	// keep it bounded, just forget any one of them
+	if ( m_sslSessions.size() >= MAX_SSL_SESSIONS ) {
+		SSL_SESSION_free ( m_sslSessions.begin()->second );
+		m_sslSessions.erase ( m_sslSessions.begin() );
+	}
+	m_sslSessions[key] = session;
+}
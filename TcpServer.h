@@ -22,6 +22,8 @@
 #include <openssl/crypto.h>
 #include <openssl/err.h>
 #include <atomic>
+#include <string>
+#include <unordered_map>
 #include "TcpSocket.h"            
 
 // raised from 5k to 15k in case we are a spider compression proxy
@@ -87,7 +89,7 @@ class TcpServer {
 	bool sendMsg( const char *hostname, int32_t hostnameLen, int32_t ip, int16_t port, char *sendBuf,
 				  int32_t sendBufSize, int32_t sendBufUsed, int32_t msgTotalSize, void *state,
 				  void ( *callback )( void *state, TcpSocket *s ), int32_t timeout, int32_t maxTextDocLen,
-				  int32_t maxOtherDocLen, bool useHttpTunnel = false );
+				  int32_t maxOtherDocLen, bool useHttpTunnel = false, bool keepAlive = false );
 
 	// . send request over an available (pre-connected) TcpSocket
 	// . destroys the socket on error
@@ -123,6 +125,10 @@ class TcpServer {
 
 	void       recycleSocket      ( TcpSocket *s ) ;
 
+	// the server closed a re-used connection before replying, so
+	// send the request again on a new one
+	void       resendOnNewSocket  ( TcpSocket *s ) ;
+
 	// only wrappers should call this 
 	int32_t       connectSocket      ( TcpSocket *s ) ;
 
@@ -135,7 +141,7 @@ class TcpServer {
 
 	// private:
 
-	TcpSocket *getAvailableSocket ( int32_t ip, int16_t port ) ;
+	TcpSocket *getAvailableSocket ( int32_t ip, int16_t port, const char *hostname, int32_t hostnameLen ) ;
 	TcpSocket *getNewSocket       ( ) ;
 	TcpSocket *wrapSocket         ( int sd , int32_t niceness, bool incoming);
 	bool       closeLeastUsed     ( int32_t maxIdleTime = -1 ) ;
@@ -143,6 +149,10 @@ class TcpServer {
 
 	int sslHandshake ( TcpSocket *s ) ;
 
+	// remember the tls session of "s" so the next connection to the same
+	// host can resume it
+	void saveSslSession ( TcpSocket *s ) ;
+
 	// . we call this to try to figure out the size of the WHOLE msg
 	//   being read so that we might pre-allocate memory for it
 	// . overriden for different protocols
@@ -192,6 +202,19 @@ class TcpServer {
 
 	int32_t m_numOpen;
 	int32_t m_numClosed;
+
+	// tls sessions by "hostname:port" for resuming
+	std::unordered_map<std::string,SSL_SESSION*> m_sslSessions;
+
+	// keep-alive stats
+	int64_t m_numKeepAliveNew;          // keep-alive requests on a new connection
+	int64_t m_numKeepAliveReused;       // keep-alive requests on a pooled connection
+	int64_t m_numKeepAlivePooled;       // connections kept open after a reply
+	int64_t m_numKeepAliveIdleClosed;   // closed by us after the idle timeout
+	int64_t m_numKeepAliveRemoteClosed; // closed by the server while idle
+	int64_t m_numKeepAliveResent;       // requests sent again on a new connection
+	int64_t m_numSslHandshakes;
+	int64_t m_numSslResumed;
 };
 
 #endif // GB_TCPSERVER_H
@@ -71,6 +71,14 @@ class TcpSocket {
 
 	int m_tunnelMode;
 
+	// . keep-alive for connections we make. m_keepAlive is set if we
+	//   asked the server to keep the connection open, m_keepAliveReply
+	//   if the reply lets us re-use it. see TcpServer::recycleSocket()
+	bool m_keepAlive;
+	bool m_keepAliveReply;
+	// # of requests sent on this connection before the current one
+	int32_t m_numReuses;
+
 	// . getMsgPiece() is called when we need more to send
 	char       *m_sendBuf;
 	int32_t        m_sendBufSize;
@@ -0,0 +1,194 @@
+#include "TimerWheel.h"
+
+
+TimerWheel::TimerWheel()
+	: m_now(0)
+	, m_size(0) {
+	for (int i = 0; i < s_level0Size; ++i) {
+		initList(&m_level0[i]);
+	}
+	for (int level = 0; level < s_numLevels - 1; ++level) {
+		for (int i = 0; i < s_levelNSize; ++i) {
+			initList(&m_levelN[level][i]);
+		}
+	}
+	initList(&m_due);
+}
+
+void TimerWheel::initList(Timer *head) {
+	head->m_next = head;
+	head->m_prev = head;
+	head->m_expires = 0;
+	head->m_data = NULL;
+}
+
+void TimerWheel::linkTail(Timer *head, Timer *t) {
+	t->m_prev = head->m_prev;
+	t->m_next = head;
+	head->m_prev->m_next = t;
+	head->m_prev = t;
+}
+
+void TimerWheel::unlink(Timer *t) {
+	t->m_prev->m_next = t->m_next;
+	t->m_next->m_prev = t->m_prev;
+	t->m_next = NULL;
+	t->m_prev = NULL;
+}
+
+// . the bucket of a timer relative to m_now
+// . NULL if it has already expired
+TimerWheel::Timer *TimerWheel::getBucket(int64_t expires) {
+	if (expires < m_now) {
+		return NULL;
+	}
+
+	int64_t delta = expires - m_now;
+	if (delta < s_level0Size) {
+		return &m_level0[expires & (s_level0Size - 1)];
+	}
+
+	int shift = s_level0Bits;
+	for (int level = 0; level < s_numLevels - 1; ++level) {
+		int64_t range = (int64_t)1 << (shift + s_levelNBits);
+		if (delta < range || level == s_numLevels - 2) {
+			// too far away for the wheel. file it in the last bucket
+			// and re-file it when that is cascaded
+			if (delta >= range) {
+				expires = m_now + range - 1;
+			}
+			return &m_levelN[level][(expires >> shift) & (s_levelNSize - 1)];
+		}
+		shift += s_levelNBits;
+	}
+
+	return NULL;
+}
+
+void TimerWheel::add(Timer *t, int64_t expires) {
+	t->m_expires = expires;
+
+	Timer *bucket = getBucket(expires);
+	linkTail(bucket ? bucket : &m_due, t);
+	++m_size;
+}
+
+void TimerWheel::remove(Timer *t) {
+	if (!isScheduled(t)) {
+		return;
+	}
+
+	unlink(t);
+	--m_size;
+}
+
+// re-file the timers of the current bucket of the level
+void TimerWheel::cascade(int level) {
+	int shift = s_level0Bits + level * s_levelNBits;
+	Timer *head = &m_levelN[level][(m_now >> shift) & (s_levelNSize - 1)];
+
+	Timer list;
+	initList(&list);
+	if (head->m_next != head) {
+		list.m_next = head->m_next;
+		list.m_prev = head->m_prev;
+		list.m_next->m_prev = &list;
+		list.m_prev->m_next = &list;
+		initList(head);
+	}
+
+	while (list.m_next != &list) {
+		Timer *t = list.m_next;
+		unlink(t);
+
+		Timer *bucket = getBucket(t->m_expires);
+		linkTail(bucket ? bucket : &m_due, t);
+	}
+}
+
+// . re-file all timers relative to now
+// . used when advancing tick by tick would take too long
+void TimerWheel::rebuild(int64_t now) {
+	Timer list;
+	initList(&list);
+
+	for (int i = 0; i < s_level0Size; ++i) {
+		while (m_level0[i].m_next != &m_level0[i]) {
+			Timer *t = m_level0[i].m_next;
+			unlink(t);
+			linkTail(&list, t);
+		}
+	}
+	for (int level = 0; level < s_numLevels - 1; ++level) {
+		for (int i = 0; i < s_levelNSize; ++i) {
+			Timer *head = &m_levelN[level][i];
+			while (head->m_next != head) {
+				Timer *t = head->m_next;
+				unlink(t);
+				linkTail(&list, t);
+			}
+		}
+	}
+
+	m_now = now + 1;
+
+	while (list.m_next != &list) {
+		Timer *t = list.m_next;
+		unlink(t);
+
+		Timer *bucket = getBucket(t->m_expires);
+		linkTail(bucket ? bucket : &m_due, t);
+	}
+}
+
+void TimerWheel::advance(int64_t now) {
+	if (now < m_now) {
+		return;
+	}
+
+	// . nothing scheduled in the wheel, skip ahead
+	// . more ticks than timers (like on the first call), cheaper to
+	//   re-file them all
+	if (m_size == 0) {
+		m_now = now + 1;
+		return;
+	}
+	if (now - m_now > s_level0Size && (uint64_t)(now - m_now) > m_size * 4) {
+		rebuild(now);
+		return;
+	}
+
+	for (; m_now <= now; ++m_now) {
+		int index = m_now & (s_level0Size - 1);
+
+		// cascade down the levels when a lower level wraps
+		if (index == 0) {
+			int shift = s_level0Bits;
+			for (int level = 0; level < s_numLevels - 1; ++level) {
+				cascade(level);
+				if (((m_now >> shift) & (s_levelNSize - 1)) != 0) {
+					break;
+				}
+				shift += s_levelNBits;
+			}
+		}
+
+		Timer *head = &m_level0[index];
+		while (head->m_next != head) {
+			Timer *t = head->m_next;
+			unlink(t);
+			linkTail(&m_due, t);
+		}
+	}
+}
+
+TimerWheel::Timer *TimerWheel::popDue() {
+	if (m_due.m_next == &m_due) {
+		return NULL;
+	}
+
+	Timer *t = m_due.m_next;
+	unlink(t);
+	--m_size;
+	return t;
+}
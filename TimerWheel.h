@@ -0,0 +1,81 @@
+#ifndef GB_TIMERWHEEL_H
+#define GB_TIMERWHEEL_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+
+// . hierarchical timer wheel with 1ms resolution
+// . 256 1ms slots, then 3 levels of 64 slots covering 256ms, 16s and 17min
+//   each. timers further away are filed at the far end of the last level
+//   and are re-filed when that is reached
+// . add()/remove() are O(1). advance() moves the expired timers to a due
+//   list that the caller drains with popDue(), so a timer can be removed
+//   (or the whole thing destroyed) while the caller is handling expired ones
+// . timers are embedded in the caller's objects, no allocation is done
+// . not thread safe
+class TimerWheel {
+	TimerWheel(const TimerWheel&);
+	TimerWheel& operator=(const TimerWheel&);
+public:
+	struct Timer {
+		Timer *m_next;
+		Timer *m_prev;
+		int64_t m_expires;
+		void *m_data;
+	};
+
+	static void initTimer(Timer *t, void *data) {
+		t->m_next = NULL;
+		t->m_prev = NULL;
+		t->m_expires = 0;
+		t->m_data = data;
+	}
+
+	static bool isScheduled(const Timer *t) { return t->m_next != NULL; }
+
+	TimerWheel();
+
+	// . schedule t to expire at "expires" (ms). t must not be scheduled
+	// . expires in the past means it is due at the next advance()
+	void add(Timer *t, int64_t expires);
+
+	// unschedule t if it is scheduled
+	void remove(Timer *t);
+
+	// move the timers that expired at or before "now" to the due list
+	void advance(int64_t now);
+
+	// next due timer or NULL. the timer is no longer scheduled
+	Timer *popDue();
+
+	size_t size() const { return m_size; }
+
+	// start of the next tick to process
+	int64_t getNow() const { return m_now; }
+
+private:
+	static const int s_level0Bits = 8;
+	static const int s_levelNBits = 6;
+	static const int s_numLevels = 4;
+	static const int s_level0Size = 1 << s_level0Bits;
+	static const int s_levelNSize = 1 << s_levelNBits;
+
+	Timer *getBucket(int64_t expires);
+	void cascade(int level);
+	void rebuild(int64_t now);
+
+	static void initList(Timer *head);
+	static void linkTail(Timer *head, Timer *t);
+	static void unlink(Timer *t);
+
+	Timer m_level0[s_level0Size];
+	Timer m_levelN[s_numLevels - 1][s_levelNSize];
+	Timer m_due;
+
+	// every tick before this has been processed
+	int64_t m_now;
+	size_t m_size;
+};
+
+#endif // GB_TIMERWHEEL_H
@@ -7,29 +7,37 @@
 #ifndef GB_TOPTREE_H
 #define GB_TOPTREE_H
 
-#include "RdbTree.h"
+#include "types.h"
 
 
 class TopNode {
  public:
-	char           m_depth    ;
-
 	// Msg39 now looks up the cluster recs so we can do clustering
 	// really quick on each machine, assuming we have a full split and the
 	// entire clusterdb is in our local disk page cache.
 	char     m_clusterLevel;
 	key96_t    m_clusterRec;
+	// content simhash from simhashdb, 0 if none
+	uint64_t   m_simHash;
 
 	float          m_score    ;
 	int64_t      m_docId;
 	unsigned     m_flags; //from Docid2FlagsAndSiteMap
 
-	// tree info, indexes into m_nodes array
-	int32_t m_parent;
-	int32_t m_left;   // kid
-	int32_t m_right;  // kid
+	// position in TopTree::m_heap, -1 if not in use
+	int32_t m_heapPos;
+	// position in TopTree::m_sorted, valid after getHighNode()
+	int32_t m_rank;
 };
 
+// . bounded min-heap of the "m_docsWanted" best nodes. the root is the
+//   lowest scoring node so a full heap rejects a loser with one compare
+//   and evicts its root in O(log n)
+// . ties in score are broken by docid, lower docids win
+// . at most "m_ridiculousMax" nodes per domHash are kept when site
+//   clustering, the lowest of that domain is evicted to make room
+// . nodes are in a flat array. the heap entries carry the score and
+//   docid with the node number so sifting does not touch the nodes
 class TopTree {
  public:
 	TopTree();
@@ -40,23 +48,31 @@ class TopTree {
 	bool setNumNodes ( int32_t docsWanted , bool doSiteClustering );
 	// . add a node
 	// . get an empty first, fill it in and call addNode(t)
-	int32_t getEmptyNode ( ) { return m_emptyNode; }
+	int32_t getEmptyNode ( ) { return m_numFree > 0 ? m_free[m_numFree-1] : -1; }
 	// . you can add a new node
-	// . it will NOT overwrite a node with same bscore/score/docid
-	// . it will NOT add if bscore/score/docid < m_tail node
-	//   otherwise it will remove m_tail node if 
-	//   m_numNodes == m_numUsedNodes
+	// . it will NOT add if score/docid < m_lowNode when full
+	//   otherwise it will remove m_lowNode if we got more than
+	//   m_docsWanted nodes
+	// . returns true if added
 	bool addNode ( TopNode *t , int32_t tnn );
 
-	int32_t getLowNode  ( ) { return m_lowNode ; }
-	// . this is computed and stored on demand
+	int32_t getLowNode  ( ) const { return m_numUsedNodes > 0 ? m_heap[0].m_node : -1; }
+
+	// . score a node must beat to get in, -1.0 if we are not full yet
+	// . lets the scorer skip docids that cannot make it
+	float getMinWinningScore() const {
+		return ( m_numUsedNodes >= m_docsWanted && m_numUsedNodes > 0 ) ? m_heap[0].m_score : -1.0;
+	}
+
+	// . highest scoring node. sorts the nodes so getPrev() can walk
+	//   them from highest to lowest
 	// . WARNING: only call after all nodes have been added!
 	int32_t getHighNode ( ) ;
 
-	int32_t getPrev ( int32_t i );
-	int32_t getNext ( int32_t i );
+	// next lower scoring node after getHighNode(), -1 at the end
+	int32_t getPrev ( int32_t i ) const;
 
-	bool hasDocId ( int64_t d );
+	bool hasDocId ( int64_t d ) const;
 	void logTreeData(int32_t loglevel);
 
 	TopNode *getNode ( int32_t i ) { return &m_nodes[i]; }
@@ -65,51 +81,52 @@ class TopTree {
 	int32_t getNumUsedNodes() const { return m_numUsedNodes; }
 	int32_t getNumDocsWanted() const { return m_docsWanted; }
 
+	// true if a node was rejected or evicted since setNumNodes()
+	bool kickedOutDocIds() const { return m_kickedOutDocIds; }
+
 private:
-	int32_t  m_docsWanted;
-	bool checkTree ( bool printMsgs ) ;
-	int32_t computeDepth ( int32_t i ) ;
+	struct HeapEntry {
+		float   m_score;
+		int32_t m_node;
+		int64_t m_docId;
+	};
+
+	// true if a should be ranked below b
+	static bool isLower ( float aScore , int64_t aDocId , float bScore , int64_t bDocId ) {
+		if ( aScore != bScore ) return aScore < bScore;
+		return aDocId > bDocId;
+	}
+	static bool isLower ( const HeapEntry &a , const HeapEntry &b ) {
+		return isLower ( a.m_score , a.m_docId , b.m_score , b.m_docId );
+	}
+
+	void setHeapEntry ( int32_t pos , const HeapEntry &e ) {
+		m_heap[pos] = e;
+		m_nodes[e.m_node].m_heapPos = pos;
+	}
+	void siftUp   ( int32_t pos ) ;
+	void siftDown ( int32_t pos ) ;
+	void deleteNode ( int32_t i ) ;
+	int32_t getDomLowNode ( uint8_t domHash ) const;
 
+	int32_t  m_docsWanted;
 	bool  m_doSiteClustering;
 
-	// ptr to the mem block
+	// ptr to the mem block, m_nodes then m_heap, m_free and m_sorted
 	TopNode *m_nodes;
-	int32_t     m_allocSize;
+	HeapEntry *m_heap;
+	int32_t *m_free;
+	int32_t *m_sorted;
+	int32_t  m_allocSize;
 	int32_t m_numUsedNodes;
+	int32_t m_numFree;
 	// total count
 	int32_t m_numNodes;
-	// the top of the tree
-	int32_t m_headNode;
+	bool m_sortedValid;
 
-	// . always keep track of the high and low nodes
-	// . IndexTable.cpp likes to replace the low-scoring tail often 
-	// . Msg39.cpp likes to print out starting at the high-scorer
-	// . these are indices into m_nodes[] array
-	int32_t m_lowNode;
-	int32_t m_highNode;
-
-	// use this to set "t" in call to addNode(t)
-	int32_t m_emptyNode;
-
-	bool m_pickRight;
-
-	int32_t  m_cap;
-	float m_vcount;
-	float m_partial;
 	int64_t  m_ridiculousMax;
 	bool  m_kickedOutDocIds;
 	int32_t  m_domCount[256];
-	// the node with the minimum "score" for that domHash
-	int32_t  m_domMinNode[256];
-
-	// an embedded RdbTree for limiting the storing of keys to X
-	// keys per domHash, where X is usually "m_ridiculousMax"
-	RdbTree m_t2;
-
-	void deleteNode  ( int32_t i , uint8_t domHash ) ;
-	void setDepths   ( int32_t i ) ;
-	int32_t rotateLeft  ( int32_t i ) ;
-	int32_t rotateRight ( int32_t i ) ;
 };
 
 #endif // GB_TOPTREE_H
@@ -3,6 +3,8 @@
 #include "UdpSlot.h"
 #include "Hostdb.h"
 #include "Profiler.h"
+#include "SamplingProfiler.h"
+#include "Metrics.h"
 #include "Stats.h"
 #include "Proxy.h"
 #include "Process.h"
@@ -21,6 +23,8 @@
 #include "Errno.h"
 #include <assert.h>
 #include <unistd.h>
+#include <poll.h>
+#include <algorithm>
 
 
 // . any changes made to the slots should only be done without risk of
@@ -31,6 +35,12 @@
 int32_t g_dropped = 0;
 static int32_t g_consecutiveOOMErrors = 0;
 
+// reply stats by msg type for the metrics registry
+static MetricCounter    s_replies[MAX_MSG_TYPES];
+static MetricCounter    s_errorReplies[MAX_MSG_TYPES];
+static LatencyHistogram s_replyTimes[MAX_MSG_TYPES];
+static bool             s_replyMetricsRegistered[MAX_MSG_TYPES];
+
 // . making a hot udp server (realtime signal based)
 // . caller calls to sendRequest() or sendReply() should turn off interrupts
 //   before messing with our data
@@ -47,6 +57,7 @@ static void defaultCallbackWrapper(void * /*state*/, UdpSlot * /*slot*/) {
 
 // free send/readBufs
 void UdpServer::reset() {
+	stopIoThreads();
 
 	// clear our slots
 	if ( ! m_slots ) return;
@@ -60,6 +71,9 @@ void UdpServer::reset() {
 
 UdpServer::UdpServer ( ) {
 	m_sock = -1;
+	m_stopIoThreads = false;
+	m_callbacksPending = false;
+	m_writeRegistrationPending = false;
 	m_slots = NULL;
 	m_maxSlots = 0;
 	m_buf = NULL;
@@ -87,6 +101,7 @@ UdpServer::UdpServer ( ) {
 	m_availableListHead = NULL;
 	m_activeListHead = NULL;
 	m_activeListTail = NULL;
+	m_numTimeoutChecks = 0;
 	m_callbackListHead = NULL;
 	m_callbackListTail = NULL;
 	m_numUsedSlots = 0;
@@ -145,13 +160,72 @@ static void enlargeUdpSocketBufffer(int fd, const char *bufname, int optname, in
 }           
 
 
+// . returns -1 and sets g_errno on error
+// . with reusePort more sockets can be bound to the same port
+static int openUdpSocket(uint16_t port, int32_t readBufSize, int32_t writeBufSize, bool reusePort) {
+	int sock = socket ( AF_INET, SOCK_DGRAM , 0 );
+
+	if ( sock < 0 ) {
+		// copy errno to g_errno
+		g_errno = errno;
+		log(LOG_WARN, "udp: Failed to create socket: %s.", mstrerror(g_errno));
+		return -1;
+	}
+	// sockaddr_in provides interface to sockaddr
+	struct sockaddr_in name;
+	// reset it all just to be safe
+	memset(&name,0,sizeof(name));
+	name.sin_family      = AF_INET;
+	name.sin_addr.s_addr = INADDR_ANY;
+	name.sin_port        = htons(port);
+	// we want to re-use port it if we need to restart
+	int options  = 1;
+	if ( setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &options,sizeof(options)) < 0 ) {
+		// copy errno to g_errno
+		g_errno = errno;
+		log( LOG_WARN, "udp: Call to  setsockopt: %s.",mstrerror(g_errno));
+		close ( sock );
+		return -1;
+	}
+	if ( reusePort && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &options,sizeof(options)) < 0 ) {
+		g_errno = errno;
+		log( LOG_WARN, "udp: Call to setsockopt(SO_REUSEPORT): %s.",mstrerror(g_errno));
+		close ( sock );
+		return -1;
+	}
+
+	// . set the read buffer size to 256k for high priority socket
+	//   so our indexlists don't have to be re-transmitted so much in case
+	//   we delay a bit
+	// . set after calling socket() but before calling bind() for tcp
+	//   because of http://jes.home.cern.ch/jes/gige/acenic.html
+	// . do these cmds on the cmd line as root for gigabit ethernet
+	// . echo 262144 > /proc/sys/net/core/rmem_max
+	// . echo 262144 > /proc/sys/net/core/wmem_max
+	// print the size of the buffers
+	enlargeUdpSocketBufffer(sock, "Receive", SO_RCVBUF, readBufSize);
+	enlargeUdpSocketBufffer(sock, "Send", SO_SNDBUF, writeBufSize);
+
+	// bind this name to the socket
+	if ( bind ( sock, (struct sockaddr *)(void*)&name, sizeof(name)) < 0) {
+		// copy errno to g_errno
+		g_errno = errno;
+		close ( sock );
+		log( LOG_WARN, "udp: Failed to bind to port %hu: %s.", port,strerror(g_errno));
+		return -1;
+	}
+
+	return sock;
+}
+
 // . returns false and sets g_errno on error
 // . use 1 socket for recving and sending
 // . pollTime is how often to call timePollWrapper() (in milliseconds)
 // . it should be at least the minimal slot timeout
 bool UdpServer::init ( uint16_t port, UdpProtocol *proto,
 		       int32_t readBufSize , int32_t writeBufSize , 
-		       int32_t pollTime , int32_t maxSlots , bool isDns ){
+		       int32_t pollTime , int32_t maxSlots , bool isDns,
+		       int32_t numIoThreads ){
 
 	// save this
 	m_isDns = isDns;
@@ -236,38 +310,39 @@ bool UdpServer::init ( uint16_t port, UdpProtocol *proto,
 	}
 
 	// set up our socket
-	m_sock  = socket ( AF_INET, SOCK_DGRAM , 0 );
-
+	m_sock = openUdpSocket(port, readBufSize, writeBufSize, numIoThreads > 0);
 	if ( m_sock < 0 ) {
-		// copy errno to g_errno
-		g_errno = errno;
-		log(LOG_WARN, "udp: Failed to create socket: %s.", mstrerror(g_errno));
-		return false;
-	}
-	// sockaddr_in provides interface to sockaddr
-	struct sockaddr_in name;
-	// reset it all just to be safe
-	memset(&name,0,sizeof(name));
-	name.sin_family      = AF_INET;
-	name.sin_addr.s_addr = INADDR_ANY;
-	name.sin_port        = htons(port);
-	// we want to re-use port it if we need to restart
-	int options  = 1;
-	if ( setsockopt(m_sock, SOL_SOCKET, SO_REUSEADDR, &options,sizeof(options)) < 0 ) {
-		// copy errno to g_errno
-		g_errno = errno;
-		log( LOG_WARN, "udp: Call to  setsockopt: %s.",mstrerror(g_errno));
 		return false;
 	}
 
-	// the lower the RT signal we use, the higher our priority
-
-	// . before we start getting signals on this socket let's make sure
-	//   we have a handler registered with the Loop class
-	// . this makes m_sock non-blocking, too
-	// . use the original niceness for this
-	if (!g_loop.registerReadCallback(m_sock, this, readPollWrapper, "UdpServer::readPollWrapper", 0)) {
-		return false;
+	if ( numIoThreads > 0 ) {
+		// . the io threads read the port, the first one m_sock
+		// . reserve so the thread args do not move
+		m_ioThreads.reserve(numIoThreads);
+		for ( int32_t i = 0; i < numIoThreads; i++ ) {
+			IoThread t;
+			t.m_server = this;
+			t.m_sock = (i == 0) ? m_sock : openUdpSocket(port, readBufSize, writeBufSize, true);
+			if ( t.m_sock >= 0 ) {
+				m_ioThreads.push_back(t);
+			}
+			// no threads are running yet
+			if ( t.m_sock < 0 || !g_loop.setNonBlocking(t.m_sock) ) {
+				for ( size_t j = 1; j < m_ioThreads.size(); j++ ) {
+					close(m_ioThreads[j].m_sock);
+				}
+				m_ioThreads.clear();
+				return false;
+			}
+		}
+	} else {
+		// . before we start getting signals on this socket let's make sure
+		//   we have a handler registered with the Loop class
+		// . this makes m_sock non-blocking, too
+		// . use the original niceness for this
+		if (!g_loop.registerReadCallback(m_sock, this, readPollWrapper, "UdpServer::readPollWrapper", 0)) {
+			return false;
+		}
 	}
 
 	// . also register for 30 ms tix (was 15ms)
@@ -279,27 +354,6 @@ bool UdpServer::init ( uint16_t port, UdpProtocol *proto,
 		return false;
 	}
 
-	// . set the read buffer size to 256k for high priority socket
-	//   so our indexlists don't have to be re-transmitted so much in case
-	//   we delay a bit
-	// . set after calling socket() but before calling bind() for tcp
-	//   because of http://jes.home.cern.ch/jes/gige/acenic.html
-	// . do these cmds on the cmd line as root for gigabit ethernet
-	// . echo 262144 > /proc/sys/net/core/rmem_max
-	// . echo 262144 > /proc/sys/net/core/wmem_max
-	// print the size of the buffers
-	enlargeUdpSocketBufffer(m_sock, "Receive", SO_RCVBUF, readBufSize);
-	enlargeUdpSocketBufffer(m_sock, "Send", SO_SNDBUF, writeBufSize);
-
-	// bind this name to the socket
-	if ( bind ( m_sock, (struct sockaddr *)(void*)&name, sizeof(name)) < 0) {
-		// copy errno to g_errno
-		g_errno = errno;
-		close ( m_sock );
-		log( LOG_WARN, "udp: Failed to bind to port %hu: %s.", port,strerror(g_errno));
-		return false;
-	}
-
 	// init stats
 	m_eth0BytesIn    = 0LL;
 	m_eth0BytesOut   = 0LL;
@@ -317,10 +371,113 @@ bool UdpServer::init ( uint16_t port, UdpProtocol *proto,
 	m_outsiderPacketsOut = 0LL;
 	m_outsiderBytesOut   = 0LL;
 
-	log ( LOG_INIT, "udp: Listening on UDP port %hu with fd=%i.", m_port, m_sock );
+	// start reading once everything is set up
+	for ( size_t i = 0; i < m_ioThreads.size(); i++ ) {
+		int rc = pthread_create(&m_ioThreads[i].m_thread, NULL, ioThreadWrapper, &m_ioThreads[i]);
+		if ( rc != 0 ) {
+			log(LOG_ERROR, "udp: pthread_create() failed with rc=%d (%s)", rc, strerror(rc));
+			// only join the threads that were started
+			for ( size_t j = i; j < m_ioThreads.size(); j++ ) {
+				if ( m_ioThreads[j].m_sock != m_sock ) {
+					close(m_ioThreads[j].m_sock);
+				}
+			}
+			m_ioThreads.resize(i);
+			stopIoThreads();
+			g_errno = rc;
+			return false;
+		}
+	}
+
+	log ( LOG_INIT, "udp: Listening on UDP port %hu with fd=%i and %d io threads.", m_port, m_sock, (int)m_ioThreads.size() );
 	return true;
 }
 
+// . Loop's fd tables are only touched by the main thread, so the io threads
+//   leave registering the write callback to it
+static thread_local bool s_isIoThread = false;
+
+void *UdpServer::ioThreadWrapper(void *args) {
+	IoThread *t = static_cast<IoThread*>(args);
+	pthread_setname_np(pthread_self(), "udpio");
+	s_isIoThread = true;
+	t->m_server->ioThreadLoop(t->m_sock);
+	return NULL;
+}
+
+// . read, reassemble and ACK dgrams until stopped
+// . completed slots are left in the callback list for the main thread so
+//   handlers and callbacks are called there in niceness order as before
+void UdpServer::ioThreadLoop(int fd) {
+	while ( !m_stopIoThreads ) {
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		// wake up now and then to notice that we are stopping
+		if ( poll(&pfd, 1, 100) <= 0 ) {
+			continue;
+		}
+
+		bool something = false;
+		for (;;) {
+			UdpSlot *slot;
+			int32_t status = readSock(fd, &slot, gettimeofdayInMilliseconds());
+			// blocked, or a read error without a slot
+			if ( status == 0 || ( status < 0 && !slot ) ) {
+				break;
+			}
+			g_errno = 0;
+			something = true;
+		}
+
+		if ( something ) {
+			bool needCallback;
+			{
+				ScopedLock sl(m_mtx);
+				needCallback = ( m_callbackListHead != NULL );
+			}
+			if ( needCallback ) {
+				m_callbacksPending = true;
+				g_loop.wakeupPollLoop();
+			}
+		}
+	}
+}
+
+void UdpServer::stopIoThreads() {
+	if ( m_ioThreads.empty() ) {
+		return;
+	}
+
+	m_stopIoThreads = true;
+	for ( size_t i = 0; i < m_ioThreads.size(); i++ ) {
+		pthread_join(m_ioThreads[i].m_thread, NULL);
+		// m_sock is closed by shutdown()
+		if ( m_ioThreads[i].m_sock != m_sock ) {
+			close(m_ioThreads[i].m_sock);
+		}
+	}
+	m_ioThreads.clear();
+}
+
+void UdpServer::makePendingCallbacks() {
+	if ( m_writeRegistrationPending.exchange(false) ) {
+		ScopedLock sl(m_mtx);
+		if ( m_needToSend && !m_writeRegistered ) {
+			if ( g_loop.registerWriteCallback(m_sock, this, sendPollWrapper, "UdpServer::sendPollWrapper", 0) ) {
+				m_writeRegistered = true;
+			} else {
+				logError("registerWriteCallback failed");
+			}
+		}
+	}
+
+	if ( m_callbacksPending.exchange(false) ) {
+		process(gettimeofdayInMilliseconds());
+	}
+}
+
 // . use a backoff of -1 for the default
 // . use maxWait of -1 for the default
 // . returns false and sets g_errno on error
@@ -499,6 +656,8 @@ void UdpServer::sendErrorReply_unlocked(UdpSlot *slot, int32_t errnum) {
 	// set the m_localErrno in "slot" so it will set the dgrams error bit
 	slot->m_localErrno = errnum;
 
+	s_errorReplies[slot->getMsgType()].add();
+
 	sendReply_unlocked(msg, 4, msg, 4, slot);
 }
 
@@ -542,6 +701,8 @@ void UdpServer::sendReply_unlocked(char *msg, int32_t msgSize, char *alloc, int3
 	// MAX_BUCKETS is probably 16 and #define'd in Stats.h
 	if ( bucket >= MAX_BUCKETS ) bucket = MAX_BUCKETS-1;
 	g_stats.m_msgTotalHandlersByTime [slot->getMsgType()][n][bucket]++;
+	s_replies[slot->getMsgType()].add();
+	s_replyTimes[slot->getMsgType()].add ( (uint64_t)(now - slot->m_queuedTime) * 1000 );
 	// we have to use a different clock for measuring how long to
 	// send the reply now
 	slot->m_queuedTime = now;
@@ -618,6 +779,10 @@ bool UdpServer::doSending_unlocked(UdpSlot *slot, bool allowResends, int64_t now
 		return true;
 	}
 
+	// a reply or new request may need a resend sooner than the slot is
+	// checked now
+	scheduleTimeoutCheck_unlocked(slot, now);
+
 	for(;;) {
 		if ( slot->getScore(now) < 0 ) {
 			//enough or all sent
@@ -647,8 +812,11 @@ bool UdpServer::doSending_unlocked(UdpSlot *slot, bool allowResends, int64_t now
 			// but Loop should call us again asap because I don't think
 			// we'll get a ready to write signal... don't count on it
 			m_needToSend = true;
-			// ok, now it should
-			if ( ! m_writeRegistered ) {
+			// ok, now it should. the main thread registers it for io threads
+			if ( ! m_writeRegistered && s_isIoThread ) {
+				m_writeRegistrationPending = true;
+				g_loop.wakeupPollLoop();
+			} else if ( ! m_writeRegistered ) {
 				if (!g_loop.registerWriteCallback(m_sock, this, sendPollWrapper,
 				                                  "UdpServer::sendPollWrapper", 0)) {
 					logError("registerWriteCallback failed");
@@ -771,6 +939,16 @@ bool UdpServer::registerHandler( msg_type_t msgType, void (* handler)(UdpSlot *,
 	}
 
 	m_handlers[msgType] = handler;
+
+	// publish the reply stats of this msg type, once for all servers
+	if ( ! s_replyMetricsRegistered[msgType] ) {
+		s_replyMetricsRegistered[msgType] = true;
+		char labels[32];
+		sprintf(labels, "msgtype=\"0x%02x\"", (int)msgType);
+		g_metrics.addCounter("gb_udp_replies_total", "Replies sent to udp requests", labels, &s_replies[msgType]);
+		g_metrics.addCounter("gb_udp_error_replies_total", "Error replies sent to udp requests", labels, &s_errorReplies[msgType]);
+		g_metrics.addHistogram("gb_udp_reply_generation_us", "Time from calling the udp handler until the reply is sent", labels, &s_replyTimes[msgType]);
+	}
 	return true;
 }
 
@@ -786,7 +964,8 @@ void UdpServer::process(int64_t now, int32_t maxNiceness) {
 	// gettimeofdayInMilliseconds() is not async safe
 	int64_t startTimer = gettimeofdayInMilliseconds();
  bigloop:
-	bool needCallback = false;
+	// the io threads did the reading, we are only here for the callbacks
+	bool needCallback = !m_ioThreads.empty();
  loop:
 	// did we read or send something?
 	bool something = false;
@@ -801,31 +980,13 @@ void UdpServer::process(int64_t now, int32_t maxNiceness) {
 	// . *slot will be NULL on some errors (read errors or alloc errors)
 	// . *slot will be NULL if we read and processed a slotless ACK
 	// . *slot will be NULL if we read nothing (0 bytes read & 0 returned)
-	int32_t status = readSock(&slot, now);
+	int32_t status = m_ioThreads.empty() ? readSock(m_sock, &slot, now) : 0;
 	// if we read something
 	if ( status != 0 ) {
 		// if no slot was set, it was a slotless read so keep looping
 		if ( ! slot ) { g_errno = 0; goto readAgain; }
-		// if there was a read error let makeCallback() know about it
-		if ( status == -1 ) {
-			slot->m_errno = g_errno;
-			// prepare to call the callback by adding it to this
-			// special linked list
-			if ( g_errno ) {
-				ScopedLock sl(m_mtx);
-				addToCallbackLinkedList_unlocked(slot);
-			}
-			// sanity
-			if ( ! g_errno )
-				log("udp: missing g_errno from read error");
-		}
 		// we read something
 		something = true;
-		{
-			ScopedLock sl(m_mtx);
-			// try sending an ACK on the slot we read something from
-			doSending_unlocked(slot, false, now);
-		}
 	}
 	// if we read something, try for more
 	if ( something ) {
@@ -882,22 +1043,20 @@ void UdpServer::readPollWrapper(int fd, void *state) {
 
 
 // . returns -1 on error, 0 if blocked, 1 if completed reading dgram
-int32_t UdpServer::readSock(UdpSlot **slotPtr, int64_t now) {
-	ScopedLock sl(m_mtx);
-
+int32_t UdpServer::readSock(int fd, UdpSlot **slotPtr, int64_t now) {
 	// NULLify slot
 	*slotPtr = NULL;
 	sockaddr_in from;
 	socklen_t fromLen = sizeof ( struct sockaddr );
 	char readBuffer[64*1024];
-	int readSize = recvfrom ( m_sock,
+	int readSize = recvfrom ( fd,
 				  readBuffer,
 				  sizeof(readBuffer),
 				  0,                        //flags
 				  (sockaddr *)(void*)&from,
 				  &fromLen);
 
-	logDebug(g_conf.m_logDebugLoop, "loop: readsock: readSize=%i m_sock/fd=%i", readSize,m_sock);
+	logDebug(g_conf.m_logDebugLoop, "loop: readsock: readSize=%i fd=%i", readSize,fd);
 
 	// cancel silly g_errnos and return 0 since we blocked
 	if ( readSize < 0 ) {
@@ -913,6 +1072,34 @@ int32_t UdpServer::readSock(UdpSlot **slotPtr, int64_t now) {
 		return -1;
 	}
 
+	ScopedLock sl(m_mtx);
+
+	int32_t status = readDgram_unlocked(readBuffer, readSize, from, slotPtr, now);
+
+	UdpSlot *slot = *slotPtr;
+	if ( slot ) {
+		// if there was a read error let makeCallback() know about it
+		if ( status == -1 ) {
+			slot->m_errno = g_errno;
+			// prepare to call the callback by adding it to this
+			// special linked list
+			if ( g_errno )
+				addToCallbackLinkedList_unlocked(slot);
+			// sanity
+			else
+				log("udp: missing g_errno from read error");
+		}
+		// try sending an ACK on the slot we read something from
+		doSending_unlocked(slot, false, now);
+	}
+
+	return status;
+}
+
+// . returns -1 on error, 1 if completed reading dgram
+int32_t UdpServer::readDgram_unlocked(char *readBuffer, int readSize, sockaddr_in &from, UdpSlot **slotPtr, int64_t now) {
+	m_mtx.verify_is_locked();
+
 	uint32_t ip2;
 	Host *h;
 	key96_t key;
@@ -1526,7 +1713,9 @@ bool UdpServer::makeCallback(UdpSlot *slot) {
 			g_process.shutdownAbort(true);
 		}
 
+		int32_t oldMsgType = SamplingProfiler::setMsgType(slot->getMsgType());
 		slot->m_callback(slot->m_state, slot);
+		SamplingProfiler::setMsgType(oldMsgType);
 
 		if ( g_conf.m_logDebugLoop )
 			log(LOG_DEBUG,"loop: exit callback for 0x%" PRIx32" "
@@ -1736,7 +1925,9 @@ bool UdpServer::makeCallback(UdpSlot *slot) {
 		if ( slot->getNiceness() == 99 ) { g_process.shutdownAbort(true); }
 		// . this is the niceness of the server, not the slot
 		// . NO, now it is the slot's niceness. that makes sense.
+		int32_t oldMsgType = SamplingProfiler::setMsgType(slot->getMsgType());
 		m_handlers [ slot->getMsgType() ] ( slot , slot->getNiceness() ) ;
+		SamplingProfiler::setMsgType(oldMsgType);
 	}
 
 	if ( g_conf.m_logDebugLoop )
@@ -1816,17 +2007,61 @@ void UdpServer::timePoll ( ) {
 }
 
 
-// . this is called once per second
+// . when a slot could time out or need a resend, at the latest after
+//   1 second (to notice dead hosts)
+// . checking early is harmless, the slot is just checked again. so reading
+//   dgrams (which pushes the timeout back) does not re-schedule it
+// . a slot waiting for its reply whose request was fully acked is resent
+//   after 30 seconds, see readTimeoutPoll()
+void UdpServer::scheduleTimeoutCheck_unlocked(UdpSlot *slot, int64_t now) {
+	m_mtx.verify_is_locked();
+
+	int64_t next = now + 1000;
+
+	if ( ! ( slot->isDoneReading() && slot->getDatagramsToSend() <= 0 ) ) {
+		next = std::min(next, slot->getLastReadTime() + slot->getTimeout());
+
+		if ( slot->getDatagramsToSend() > 0 ) {
+			if ( slot->m_sentBitsOn == slot->m_readAckBitsOn ) {
+				next = std::min(next, slot->getLastReadTime() + 30000);
+			} else {
+				next = std::min(next, slot->getLastSendTime() + slot->getResendTime());
+			}
+		}
+	}
+
+	// at the earliest on the next poll
+	int64_t delay = std::max(next - now, (int64_t)1);
+
+	m_timeoutTimers.remove(&slot->m_timeoutTimer);
+	m_timeoutTimers.add(&slot->m_timeoutTimer, getMonotonicMilliseconds() + delay);
+}
+
+void UdpServer::getTimeoutTimerStats(size_t *numScheduled, int64_t *numChecks) const {
+	ScopedLock sl(m_mtx);
+	*numScheduled = m_timeoutTimers.size();
+	*numChecks = m_numTimeoutChecks;
+}
+
+// . this is called every pollTime ms
 // . return false and sets g_errno on error
 // . calls the callback of REPLY-reception slots that have timed out
 // . just nuke the REQUEST-reception slots that have timed out
 // . returns true if we timed one out OR reset one for resending
+// . only the slots whose timeout check is due are looked at
 bool UdpServer::readTimeoutPoll ( int64_t now ) {
 	// did we do something? assume not.
 	bool something = false;
-	// loop over occupied slots
 	ScopedLock sl(m_mtx);
-	for ( UdpSlot *slot = m_activeListHead ; slot ; slot = slot->m_activeListNext ) {
+	m_timeoutTimers.advance(getMonotonicMilliseconds());
+	while ( TimerWheel::Timer *timer = m_timeoutTimers.popDue() ) {
+		UdpSlot *slot = (UdpSlot *)timer->m_data;
+		m_numTimeoutChecks++;
+
+		// check it again later. resending re-schedules it and
+		// destroying the slot unschedules it
+		scheduleTimeoutCheck_unlocked(slot, now);
+
 		// clear g_errno
 		g_errno = 0;
 		// debug msg
@@ -2142,6 +2377,14 @@ bool UdpServer::shutdown ( bool urgent ) {
 	else
 		log(LOG_INFO,"gb: Closing udp server socket port %hu.",m_port);
 
+	// . stop reading before the socket goes away
+	// . the io threads may be waiting for the lock
+	if ( !m_ioThreads.empty() ) {
+		sl.unlock();
+		stopIoThreads();
+		sl.lock();
+	}
+
 	// close our socket descriptor, may block to finish sending
 	int s = m_sock;
 	// . make it -1 so thread exits
@@ -2352,6 +2595,10 @@ void UdpServer::addToActiveLinkedList_unlocked(UdpSlot *slot) {
 	slot->m_activeListNext = NULL;
 	slot->m_activeListPrev = NULL;
 
+	// check it on the next poll, it is scheduled properly then
+	TimerWheel::initTimer(&slot->m_timeoutTimer, slot);
+	m_timeoutTimers.add(&slot->m_timeoutTimer, getMonotonicMilliseconds());
+
 	if (m_activeListTail) {
 		// insert at end of linked list otherwise
 		m_activeListTail->m_activeListNext = slot;
@@ -2373,6 +2620,8 @@ void UdpServer::removeFromActiveLinkedList_unlocked(UdpSlot *slot) {
 		return;
 	}
 
+	m_timeoutTimers.remove(&slot->m_timeoutTimer);
+
 	// excise from linked list otherwise
 	if ( m_activeListHead == slot ) {
 		m_activeListHead = slot->m_activeListNext;
@@ -26,6 +26,9 @@
 //   of the first dgram we sent's ACK
 // . this ACK window helps highPing/highBandwidth connections (distant hosts)
 // . readPoll(), sendAckPoll(), readTimeoutPoll() can call callbacks/handlers
+// . optionally the port is read by io threads, each with its own
+//   SO_REUSEPORT socket. they do the dgram reassembly and ACKing and leave
+//   the handlers and callbacks to the main thread
 
 #ifndef GB_UDPSERVER_H
 #define GB_UDPSERVER_H
@@ -33,8 +36,12 @@
 #include "UdpStatistic.h"
 #include "UdpProtocol.h"
 #include "GbMutex.h"
+#include "TimerWheel.h"
 #include <inttypes.h>
 #include <atomic>
+#include <vector>
+#include <pthread.h>
+#include <netinet/in.h>
 
 
 static const int64_t udpserver_sendrequest_infinite_timeout = 999999999999;
@@ -58,8 +65,10 @@ public:
 	// . read/writeBufSize are the socket buf's size
 	// . pollTime is how often to call timePollWrapper() (in milliseconds)
 	// . it should be at least the minimal slot timeout
+	// . if numIoThreads is > 0 that many threads read the port instead
+	//   of the main loop
 	bool init(uint16_t port, UdpProtocol *proto, int32_t readBufSize, int32_t writeBufSize, int32_t pollTime,
-	          int32_t maxSlots, bool isDns);
+	          int32_t maxSlots, bool isDns, int32_t numIoThreads = 0);
 
 	// . sends a request
 	// . returns false and sets g_errno on error, true on success
@@ -148,6 +157,11 @@ public:
 	// try calling makeCallback() on all slots
 	bool makeCallbacks(int32_t niceness);
 
+	// . called by Loop when woken up. calls the handlers and callbacks of
+	//   the slots the io threads completed, and registers the write
+	//   callback if an io thread blocked sending
+	void makePendingCallbacks();
+
 	// cancel a transaction
 	void cancel(void *state, msg_type_t msgType);
 
@@ -157,6 +171,9 @@ public:
 	int32_t getNumUsedSlots() const;
 	int32_t getNumUsedSlotsIncoming() const;
 
+	// scheduled timeout checks and how many slots were checked so far
+	void getTimeoutTimerStats(size_t *numScheduled, int64_t *numChecks) const;
+
 	bool needBottom() const { return m_needBottom; }
 
 	bool getWriteRegistered() const { return m_writeRegistered; }
@@ -181,6 +198,7 @@ private:
 	static void readPollWrapper(int fd, void *state);
 	static void timePollWrapper(int fd, void *state);
 	static void sendPollWrapper(int fd, void *state);
+	static void *ioThreadWrapper(void *args);
 
 	// these *Poll() routines must be public so wrappers can call them
 
@@ -218,6 +236,10 @@ private:
 	void addToActiveLinkedList_unlocked(UdpSlot *slot);
 	void removeFromActiveLinkedList_unlocked(UdpSlot *slot);
 
+	// . (re)schedule the timeout/resend check of an active slot
+	// . "now" is gettimeofdayInMilliseconds() like the slot's times
+	void scheduleTimeoutCheck_unlocked(UdpSlot *slot, int64_t now);
+
 	// . we maintain a sequential list of transaction ids to guarantee
 	//   uniquness to a point
 	// . if server is restarted this will go back to 0 though 
@@ -242,10 +264,18 @@ private:
 	// . then we send a dgram from that slot
 	UdpSlot *getBestSlotToSend_unlocked(int64_t now);
 
-	// . reads a pending dgram on the udp stack
+	// . reads a pending dgram on the udp stack of "fd"
 	// . returns -1 on error, 0 if blocked, 1 if completed reading dgram
-	// . called by readPoll()
-	int32_t readSock(UdpSlot **slot, int64_t now);
+	// . sends the ACK if needed
+	// . called by process() and the io threads
+	int32_t readSock(int fd, UdpSlot **slot, int64_t now);
+
+	// handles a dgram read by readSock()
+	int32_t readDgram_unlocked(char *readBuffer, int readSize, sockaddr_in &from, UdpSlot **slot, int64_t now);
+
+	// read loop of an io thread
+	void ioThreadLoop(int fd);
+	void stopIoThreads();
 
 	void sendReply_unlocked(char *msg, int32_t msgSize, char *alloc, int32_t allocSize, UdpSlot *slot, void *state = NULL,
 	                        void (*callback2)(void *state, UdpSlot *slot) = NULL);
@@ -268,6 +298,22 @@ private:
 	int m_sock;
 	uint16_t m_port;
 
+	// . io threads reading the port. the first one reads m_sock, the
+	//   others their own socket bound to the same port
+	// . the kernel hashes each peer to one of the sockets
+	struct IoThread {
+		UdpServer *m_server;
+		int m_sock;
+		pthread_t m_thread;
+	};
+	std::vector<IoThread> m_ioThreads;
+	std::atomic<bool> m_stopIoThreads;
+	// io threads completed slots the main thread has to call back
+	std::atomic<bool> m_callbacksPending;
+	// an io thread blocked sending and the main thread has to register
+	// the write callback
+	std::atomic<bool> m_writeRegistrationPending;
+
 	// for defining your own protocol on top of udp
 	UdpProtocol *m_proto;
 
@@ -321,6 +367,12 @@ private:
 	UdpSlot *m_activeListHead;
 	UdpSlot *m_activeListTail;
 
+	// . active slots by when they may time out or need a resend, so
+	//   readTimeoutPoll() does not have to look at all of them
+	// . in getMonotonicMilliseconds() time
+	TimerWheel m_timeoutTimers;
+	int64_t m_numTimeoutChecks;
+
 	// linked list of callback candidates
 	UdpSlot *m_callbackListHead;
 	UdpSlot *m_callbackListTail;
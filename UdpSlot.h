@@ -8,6 +8,7 @@
 
 #include "UdpProtocol.h"
 #include "msgtype_t.h"
+#include "TimerWheel.h"
 
 #define SMALLDGRAMS
 
@@ -422,6 +423,9 @@ protected:
 	UdpSlot *m_activeListNext;
 	UdpSlot *m_activeListPrev;
 
+	// when UdpServer::readTimeoutPoll() checks this slot for timeout/resend
+	TimerWheel::Timer m_timeoutTimer;
+
 	// store the key so when returning slot we can remove from hash table
 	key96_t m_key;
 
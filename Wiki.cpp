@@ -58,7 +58,7 @@ bool Wiki::load() {
 	if ( ! errno2 ) {
 		log(LOG_INFO,"wiki: Loading %s",ff2);
 		// "dir" is NULL since already included in ff2
-		return m_ht.load ( NULL , ff2 );
+		return m_ht.loadMapped ( NULL , ff2 );
 	}
 
 	// if no text file that is bad
@@ -199,7 +199,7 @@ bool Wiktionary::load() {
 	     //&& ( errno2 || stats3.st_mtime > stats2.st_mtime ) 
 	     ) {
 		log(LOG_INFO,"wikt: Loading %s",ff3);
-		if ( ! m_synTable .load ( NULL , ff3 ) )
+		if ( ! m_synTable .loadMapped ( NULL , ff3 ) )
 			return false;
 		log(LOG_INFO,"wikt: Loading %s",ff4);
 		if ( m_synBuf.fillFromFile ( NULL , ff4 ) <= 0 )
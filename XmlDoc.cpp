@@ -2,6 +2,7 @@
 #include "XmlDoc.h"
 #include "Conf.h"
 #include "Clusterdb.h" // g_clusterdb
+#include "Simhashdb.h"
 #include "Collectiondb.h"
 #include "iana_charset.h"
 #include "Stats.h"
@@ -58,6 +59,7 @@
 #include "ip.h"
 #include "Errno.h"
 #include "Docid.h"
+#include "DocConverterPool.h"
 #include <iostream>
 #include <fstream>
 #include <sysexits.h>
@@ -317,6 +319,7 @@ void XmlDoc::reset ( ) {
 	m_phrases.reset();
 	m_bits.reset();
 	m_sections.reset();
+	m_passageSections.reset();
 	m_countTable.reset();
 
 	// other crap
@@ -2950,6 +2953,11 @@ char *XmlDoc::prepareToMakeTitleRec ( ) {
 		return (char *)tph;
 	}
 
+	SafeBuf *pib = getPassageIndexBuf();
+	if (!pib || pib == (void *)-1) {
+		return (char *)pib;
+	}
+
 	m_prepared = true;
 	return (char *)1;
 }
@@ -4073,6 +4081,82 @@ Sections *XmlDoc::getSections ( ) {
 	return &m_sections;
 }
 
+// . the sections Msg20 needs for the summary
+// . set from the passage index in the titlerec if it has one, that is a lot
+//   cheaper than setting the real sections
+// . only the flags Summary and Matches look at are valid in those
+Sections *XmlDoc::getSectionsForSummary ( ) {
+	if ( m_passageSectionsValid ) return &m_passageSections;
+
+	if ( m_setFromTitleRec && ptr_passageIndex && size_passageIndex > 0 && ! m_tokenizerResultValid2 ) {
+		TokenizerResult *tr = getTokenizerResult();
+		if ( ! tr || tr == (TokenizerResult*)-1 ) return (Sections *)tr;
+
+		int64_t start = logQueryTimingStart();
+
+		if ( m_passageSections.setFromPassageIndex ( tr, ptr_passageIndex, size_passageIndex ) ) {
+			logQueryTimingEnd( __func__, start );
+			m_passageSectionsValid = true;
+			return &m_passageSections;
+		}
+
+		// tokenizer changed since it was indexed? use the real ones
+		log(LOG_DEBUG, "query: passage index does not match docid=%" PRId64". setting sections.", m_docId);
+	}
+
+	return getSections();
+}
+
+// . make the passage index we store in the titlerec, see
+//   Sections::serializePassageIndex()
+// . made from the phase-1 tokens, like Msg20 sees the document
+SafeBuf *XmlDoc::getPassageIndexBuf ( ) {
+	if ( m_passageIndexBufValid ) return &m_passageIndexBuf;
+
+	m_passageIndexBuf.purge();
+	ptr_passageIndex  = NULL;
+	size_passageIndex = 0;
+
+	if ( ! g_conf.m_storePassageIndex ) {
+		m_passageIndexBufValid = true;
+		return &m_passageIndexBuf;
+	}
+
+	uint8_t *ct = getContentType();
+	if ( ! ct || ct == (void *)-1 ) return (SafeBuf *)ct;
+
+	// xml and json docs have empty summaries
+	if ( *ct == CT_JSON || *ct == CT_XML ) {
+		m_passageIndexBufValid = true;
+		return &m_passageIndexBuf;
+	}
+
+	Xml *xml = getXml();
+	if ( ! xml || xml == (Xml *)-1 ) return (SafeBuf *)xml;
+
+	setStatus ( "getting passage index" );
+
+	// the phase-2 tokenizer may already have changed m_tokenizerResult
+	TokenizerResult tr;
+	xml_tokenizer_phase_1 ( xml, &tr );
+	calculate_tokens_hashes ( &tr );
+
+	Bits bits;
+	if ( ! bits.set ( &tr ) ) return NULL;
+
+	Sections sections;
+	g_errno = 0;
+	sections.set ( &tr, &bits, getFirstUrl(), *ct );
+	if ( g_errno ) return NULL;
+
+	if ( ! sections.serializePassageIndex ( &m_passageIndexBuf ) ) return NULL;
+
+	ptr_passageIndex  = m_passageIndexBuf.getBufStart();
+	size_passageIndex = m_passageIndexBuf.length();
+	m_passageIndexBufValid = true;
+	return &m_passageIndexBuf;
+}
+
 int32_t *XmlDoc::getLinkSiteHashes ( ) {
 	logTrace( g_conf.m_logTraceXmlDoc, "BEGIN" );
 
@@ -4721,6 +4805,20 @@ int32_t *XmlDoc::getPostLinkTextVector ( int32_t linkNode ) {
 	TokenizerResult *tr = getTokenizerResult();
 	if ( ! tr || tr == (TokenizerResult*)-1 ) return (int32_t *)tr;
 
+	int32_t tokenHint = 0;
+	m_postVecSize = computePostLinkTextVector ( xml, tr, linkNode, &tokenHint, (uint32_t *)m_postVec );
+
+	// return what we got
+	return m_postVec;
+}
+
+// . returns the size of the vector stored in "vec" in bytes
+// . "vec" must have room for POST_VECTOR_SIZE bytes
+int32_t XmlDoc::computePostLinkTextVector ( Xml *xml, const TokenizerResult *tr, int32_t linkNode,
+					    int32_t *tokenHint, uint32_t *vec ) {
+	// assume none
+	vec[0] = 0;
+
 	// sanity check
 	if ( linkNode < 0 ) { g_process.shutdownAbort(true); }
 
@@ -4741,19 +4839,22 @@ int32_t *XmlDoc::getPostLinkTextVector ( int32_t linkNode ) {
 		break;
 	}
 	// if we hit end of the doc, we got not vector then
-	if ( linkNode >= nn ) return m_postVec;
+	if ( linkNode >= nn ) return 0;
 
 	// now convert the linkNode # to a word #, "start"
 	int32_t          nw   = tr->size();
-	int32_t       i    = 0;
+	int32_t       i    = *tokenHint;
+	// start over if the hint is past our node
+	if ( i > nw || ( i > 0 && (*tr)[i-1].xml_node_index >= linkNode ) ) i = 0;
 	for ( ; i < nw ; i++ ) {
 		// stop when we got the first word in this node #
 		if ( (*tr)[i].xml_node_index == linkNode ) break;
 	}
 	// if none, bail now, size is 0
-	if ( i >= nw ) return m_postVec;
+	if ( i >= nw ) return 0;
 	// save that
 	int32_t start = i;
+	*tokenHint = start;
 
 	// likewise, set the end of it
 	int32_t end = nw;
@@ -4776,10 +4877,59 @@ int32_t *XmlDoc::getPostLinkTextVector ( int32_t linkNode ) {
 	end = i;
 
 	// specify starting node # now
-	m_postVecSize = computeVector( tr, (uint32_t *)m_postVec, start, end );
+	return computeVector( tr, vec, start, end );
+}
 
-	// return what we got
-	return m_postVec;
+// . store the text around the link at "linkNode" into "buf", \0 terminated
+// . returns the length of the text, 0 if it did not fit
+// . returns -1 if the link node has no token
+int32_t XmlDoc::getSurroundingText ( Xml *xml, const TokenizerResult *tr, Pos *pos, int32_t linkNode,
+				     int32_t *tokenHint, char *buf, int32_t bufSize ) {
+	// convert "linkNode" into a string ptr into the document
+	const char *node = xml->getNodePtr(linkNode)->m_node;
+	// . find the word index, "n" for this node
+	// . start from the hint, all tokens before it are before the node
+	int32_t   nw = tr->size();
+	int32_t   n  = *tokenHint;
+	if ( n > nw || ( n > 0 && (*tr)[n-1].token_start >= node ) ) n = 0;
+
+	for ( ; n < nw && (*tr)[n].token_start < node ; n++ ) {
+	}
+
+	if ( n >= nw ) {
+		return -1;
+	}
+	*tokenHint = n;
+
+	// radius of 80 characters around n
+	int32_t  radius = 80;
+	char *p      = buf;
+	char *pend   = buf + bufSize;
+	// . make a neighborhood in the "words" space [a,b]
+	// . radius is in characters, so "convert" into words by dividing by 5
+	int32_t a = n - radius / 5;
+	int32_t b = n + radius / 5;
+	if ( a <     0 ) a =     0;
+	if ( b >    nw ) b =    nw;
+	int32_t *pp  = pos->m_pos;
+	int32_t  len;
+	// if too big shring the biggest, a or b?
+	while ( (len=pp[b]-pp[a]) >= 2 * radius + 1 ) {
+		// decrease the largest, a or b
+		if ( a<n && (pp[n]-pp[a])>(pp[b]-pp[n])) a++;
+		else if ( b>n )                          b--;
+	}
+	// only store it if we can
+	if ( p + len + 1 >= pend ) {
+		return 0;
+	}
+
+	// FILTER the html entities!!
+	int32_t len2 = pos->filter( tr, a, b, false, p, pend, m_version );
+
+	// ensure NULL terminated
+	p[len2] = '\0';
+	return len2;
 }
 
 // . was kinda like "m_tagVector.setTagPairHashes(&m_xml, niceness);"
@@ -5134,6 +5284,37 @@ int64_t *XmlDoc::getExactContentHash64 ( ) {
 	return &m_exactContentHash64;
 }
 
+// . simhash of the 3-word shingles of the content for simhashdb
+// . 0 if the doc has less than 3 words
+uint64_t *XmlDoc::getContentSimHash64 ( ) {
+
+	if ( m_contentSimHash64Valid )
+		return &m_contentSimHash64;
+
+	TokenizerResult *tr = getTokenizerResult();
+	if ( ! tr || tr == (TokenizerResult *)-1 ) return (uint64_t *)tr;
+
+	setStatus ( "getting content simhash" );
+
+	// the phase-2 tokens are alternatives of the primary ones, skip them
+	std::vector<uint64_t> wids;
+	for ( const auto &t : tr->tokens ) {
+		if ( t.is_primary && t.is_alfanum )
+			wids.push_back ( t.token_hash );
+	}
+
+	std::vector<uint64_t> shingles;
+	if ( wids.size() >= 3 ) {
+		shingles.reserve ( wids.size() - 2 );
+		for ( size_t i = 2 ; i < wids.size() ; i++ )
+			shingles.push_back ( hash64 ( hash64 ( wids[i-2] , wids[i-1] ) , wids[i] ) );
+	}
+
+	m_contentSimHash64 = Simhashdb::computeSimHash ( shingles.data() , (int32_t)shingles.size() );
+	m_contentSimHash64Valid = true;
+	return &m_contentSimHash64;
+}
+
 
 
 RdbList *XmlDoc::getDupList ( ) {
@@ -9707,14 +9888,6 @@ void XmlDoc::filterStart_r(bool amThread) {
 	// ignore errno from those unlinks
 	errno = 0;
 
-	// open the input file
-	int fd = open(in, O_WRONLY | O_CREAT, getFileCreationFlags());
-	if (fd < 0) {
-		m_errno = errno;
-		log(LOG_WARN, "build: Could not open file %s for writing: %s.", in, mstrerror(m_errno));
-		return;
-	}
-
 	static const int bufLen = MAX_URL_LEN + 200;
 	char buf[bufLen];
 	const char *inputContent = nullptr;
@@ -9729,6 +9902,43 @@ void XmlDoc::filterStart_r(bool amThread) {
 		inputContentLen = m_contentLen;
 	}
 
+	// . use a converter worker if we can. no temp files and no fork of gb
+	// . falls back to running gbconvert.sh below if all workers are busy
+	std::string output;
+	int exitStatus;
+	if (g_docConverterPool.convert(m_contentType, inputContent, inputContentLen, &output, &exitStatus)) {
+		log(LOG_INFO, "gbfilter: converted url=%s from %s to html exitstatus=%d", m_currentUrl.getUrl(), g_contentTypeStrings[m_contentType], exitStatus);
+		if (exitStatus != 0) {
+			// . keep the input in an error file like below so we have a chance
+			//   to figure out what's wrong, unless the converter doesn't exist
+			if (exitStatus != EX_UNAVAILABLE) {
+				char new_in[max_filename_len + 6];
+				snprintf(new_in, sizeof(new_in) - 1, "%sin.error.%" PRId64, g_hostdb.m_dir, (int64_t)id);
+				int fd = open(new_in, O_WRONLY | O_CREAT | O_TRUNC, getFileCreationFlags());
+				if (fd >= 0) {
+					if (write(fd, inputContent, inputContentLen) != static_cast<ssize_t>(inputContentLen)) {
+						log(LOG_WARN, "gbfilter: Error writing to %s: %s.", new_in, mstrerror(errno));
+					}
+					close(fd);
+				}
+				errno = 0;
+			}
+			m_errno = m_indexCode = EDOCCONVERTFAILED;
+			m_indexCodeValid = true;
+			return;
+		}
+		setFilteredContent_r(output.data(), output.size());
+		return;
+	}
+
+	// open the input file
+	int fd = open(in, O_WRONLY | O_CREAT, getFileCreationFlags());
+	if (fd < 0) {
+		m_errno = errno;
+		log(LOG_WARN, "build: Could not open file %s for writing: %s.", in, mstrerror(m_errno));
+		return;
+	}
+
 	// write the content into the input file
 	ssize_t w = write(fd, inputContent, inputContentLen);
 	// did we get an error
@@ -9900,6 +10110,66 @@ void XmlDoc::filterStart_r(bool amThread) {
 }
 
 
+// . same as the end of filterStart_r() but for the output of a converter worker
+// . sets m_errno on error
+void XmlDoc::setFilteredContent_r(const char *output, size_t outputLen) {
+	CollectionRec *cr = getCollRec();
+	if (!cr) {
+		return;
+	}
+
+	if (m_contentType == CT_HTML) {
+		const char *nl = (const char *)memchr(output, '\n', outputLen);
+		if (!nl) {
+			log(LOG_DEBUG, "gbfilter: Could not read first line of converter output. url=%s", m_firstUrl.getUrl());
+			m_errno = m_indexCode = EDOCCONVERTFAILED;
+			m_indexCodeValid = true;
+			return;
+		}
+
+		// cater for javascript redirect
+		std::string line(output, nl - output);
+		if (strcmp(m_currentUrl.getUrl(), line.c_str()) != 0) {
+			m_tagRecValid = false;
+			m_currentUrl.set(line.c_str());
+		}
+
+		outputLen -= nl + 1 - output;
+		output = nl + 1;
+	}
+
+	// if not text/html or text/plain, use the other max
+	int32_t max = m_contentType == CT_HTML ? cr->m_maxTextDocLen : cr->m_maxOtherDocLen;
+	if (max != -1 && outputLen > (size_t)max) {
+		log(LOG_DEBUG, "gbfilter: truncating output from %d to %d", static_cast<int>(outputLen), max);
+		outputLen = max;
+	}
+
+	if (outputLen == 0) {
+		log(LOG_DEBUG, "gbfilter: Empty content after conversion. url=%s", m_firstUrl.getUrl());
+		m_errno = m_indexCode = EDOCCONVERTFAILED;
+		m_indexCodeValid = true;
+		return;
+	}
+
+	// make a buf to hold filtered reply
+	m_filteredContentAllocSize = outputLen + 1;
+	m_filteredContent = (char *)mmalloc(m_filteredContentAllocSize, "xdfc");
+	if (!m_filteredContent) {
+		m_errno = ENOMEM;
+		log(LOG_WARN, "gbfilter: Could not allocate %" PRId32" bytes for call to content filter.", m_filteredContentAllocSize);
+		return;
+	}
+
+	memcpy(m_filteredContent, output, outputLen);
+	m_filteredContentLen = outputLen;
+	m_filteredContent[m_filteredContentLen] = '\0';
+
+	// validate now
+	m_filteredContentValid = true;
+}
+
+
 // return downloaded content as utf8
 char **XmlDoc::getRawUtf8Content ( ) {
 	logTrace( g_conf.m_logTraceXmlDoc, "BEGIN");
@@ -13184,6 +13454,37 @@ char *XmlDoc::getMetaList(bool forDelete) {
 		}
 	}
 
+	// anchordb records need these and they may block
+	if (m_useLinkdb && g_conf.m_useAnchordb && !m_useSecondaryRdbs && !m_deleteFromIndex && !forDelete) {
+		int32_t *tphv = getTagPairHashVector();
+		if (!tphv || tphv == (void *)-1) {
+			logTrace(g_conf.m_logTraceXmlDoc, "END, getTagPairHashVector failed");
+			return (char *)tphv;
+		}
+
+		int32_t *fip = getFirstIp();
+		if (!fip || fip == (void *)-1) {
+			logTrace(g_conf.m_logTraceXmlDoc, "END, getFirstIp returned -1");
+			return (char *)fip;
+		}
+
+		uint16_t *cid = getCountryId();
+		if (!cid || cid == (void *)-1) {
+			logTrace(g_conf.m_logTraceXmlDoc, "END, getCountryId failed");
+			return (char *)cid;
+		}
+	}
+
+	// simhashdb record goes with the clusterdb record, not kept in the secondary rdbs
+	bool addSimhashRec = (m_useClusterdb && addClusterRec && g_conf.m_useSimhashdb && !m_useSecondaryRdbs);
+	if (addSimhashRec && !forDelete) {
+		uint64_t *sh64 = getContentSimHash64();
+		if (!sh64 || sh64 == (void *)-1) {
+			logTrace(g_conf.m_logTraceXmlDoc, "END, getContentSimHash64 failed");
+			return (char *)sh64;
+		}
+	}
+
 	//
 	// CAUTION
 	//
@@ -13268,6 +13569,10 @@ char *XmlDoc::getMetaList(bool forDelete) {
 	int32_t needClusterdb = addClusterRec ? 13 : 0;
 	need += needClusterdb;
 
+	// simhashdb record. plus one for rdbId
+	int32_t needSimhashdb = addSimhashRec ? SIMHASHDB_REC_SIZE + 1 : 0;
+	need += needSimhashdb;
+
 	// . LINKDB
 	// . linkdb records. assume one per outlink
 	// . we may index 2 16-byte keys for each outlink
@@ -13316,6 +13621,16 @@ char *XmlDoc::getMetaList(bool forDelete) {
 	int32_t needLinkdb = kt1.getNumUsedSlots() * (sizeof(key224_t)+1);
 	need += needLinkdb;
 
+	// anchor text of our outlinks for Msg25, not kept in the secondary rdbs
+	SafeBuf anchorBuf;
+	if (m_useLinkdb && nl2 && g_conf.m_useAnchordb && !m_useSecondaryRdbs && !hashLinksForAnchordb(&anchorBuf, forDelete)) {
+		logTrace(g_conf.m_logTraceXmlDoc, "END, hashLinksForAnchordb failed");
+		return NULL;
+	}
+
+	int32_t needAnchordb = anchorBuf.length();
+	need += needAnchordb;
+
 	// we add a negative key to doledb usually (include datasize now)
 	int32_t needDoledb = forDelete ? 0 : (sizeof(key96_t) + 1);
 	need += needDoledb;
@@ -13613,6 +13928,36 @@ char *XmlDoc::getMetaList(bool forDelete) {
 	verifyMetaList(m_metaList, m_p, forDelete);
 
 
+	//
+	// ADD SIMHASHDB RECORD
+	//
+	setStatus("adding simhashdb record");
+
+	// checkpoint
+	saved = m_p;
+
+	if (addSimhashRec) {
+		*m_p++ = RDB_SIMHASHDB;
+
+		*(key96_t *)m_p = Simhashdb::makeKey(*getDocId(), false);
+		m_p += sizeof(key96_t);
+
+		// the old meta list only has the keys
+		if (!forDelete) {
+			memcpy(m_p, &m_contentSimHash64, 8);
+			m_p += 8;
+		}
+	}
+
+	// sanity check
+	if (m_p - saved > needSimhashdb) {
+		g_process.shutdownAbort(true);
+	}
+
+	// sanity check
+	verifyMetaList(m_metaList, m_p, forDelete);
+
+
 	//
 	// ADD LINKDB KEYS
 	//
@@ -13638,6 +13983,19 @@ char *XmlDoc::getMetaList(bool forDelete) {
 	// sanity check
 	verifyMetaList(m_metaList, m_p, forDelete);
 
+	//
+	// ADD ANCHORDB RECORDS
+	//
+	setStatus("adding anchordb records");
+
+	if (addLinkInfo && anchorBuf.length() > 0) {
+		gbmemcpy(m_p, anchorBuf.getBufStart(), anchorBuf.length());
+		m_p += anchorBuf.length();
+	}
+
+	// sanity check
+	verifyMetaList(m_metaList, m_p, forDelete);
+
 	// if we are injecting we must add the spider request
 	// we are injecting from so the url can be scheduled to be
 	// spidered again.
@@ -15941,54 +16299,22 @@ Msg20Reply *XmlDoc::getMsg20ReplyStepwise() {
 		}
 	}
 
-	// convert "linkNode" into a string ptr into the document
-	const char *node = xml->getNodePtr(linkNode)->m_node;
-	// . find the word index, "n" for this node
-	// . this is INEFFICIENT!!
-	int32_t   nw = tr->size();
-	int32_t   n;
-
-	for ( n = 0; n < nw && (*tr)[n].token_start < node ; n++ ) {
-	}
-
+	//
+	// get the surrounding link text, around "linkNode"
+	//
+	int32_t tokenHint = 0;
+	int32_t len2 = getSurroundingText ( xml, tr, pos, linkNode, &tokenHint,
+					    m_surroundingTextBuf,
+					    sizeof(m_surroundingTextBuf)/2 );
 	// sanity check
-	if ( n >= nw ) {
+	if ( len2 < 0 ) {
 		log("links: crazy! could not get word before linknode");
 		g_errno = EBADENGINEER;
 		return NULL;
 	}
-
-	//
-	// get the surrounding link text, around "linkNode"
-	//
-	// radius of 80 characters around n
-	int32_t  radius = 80;
-	char *p      = m_surroundingTextBuf;
-	char *pend   = m_surroundingTextBuf + sizeof(m_surroundingTextBuf)/2;
-	// . make a neighborhood in the "words" space [a,b]
-	// . radius is in characters, so "convert" into words by dividing by 5
-	int32_t a = n - radius / 5;
-	int32_t b = n + radius / 5;
-	if ( a <     0 ) a =     0;
-	if ( b >    nw ) b =    nw;
-	int32_t *pp  = pos->m_pos;
-	int32_t  len;
-	// if too big shring the biggest, a or b?
-	while ( (len=pp[b]-pp[a]) >= 2 * radius + 1 ) {
-		// decrease the largest, a or b
-		if ( a<n && (pp[n]-pp[a])>(pp[b]-pp[n])) a++;
-		else if ( b>n )                          b--;
-	}
-	// only store it if we can
-	if ( p + len + 1 < pend ) {
-		// store it
-		// FILTER the html entities!!
-		int32_t len2 = pos->filter( tr, a, b, false, p, pend, m_version );
-
-		// ensure NULL terminated
-		p[len2] = '\0';
+	if ( len2 > 0 ) {
 		// store in reply. it will be serialized when sent.
-		m_reply.ptr_surroundingText  = p;
+		m_reply.ptr_surroundingText  = m_surroundingTextBuf;
 		m_reply.size_surroundingText = len2 + 1;
 	}
 
@@ -16065,7 +16391,7 @@ Matches *XmlDoc::getMatches () {
 	if ( ! xml || xml == (Xml *)-1 ) return (Matches *)xml;
 	Bits *bits = getBitsForSummary();
 	if ( ! bits || bits == (Bits *)-1 ) return (Matches *)bits;
-	Sections *ss = getSections();
+	Sections *ss = getSectionsForSummary();
 	if ( ! ss || ss == (void *)-1) return (Matches *)ss;
 	Pos *pos = getPos();
 	if ( ! pos || pos == (Pos *)-1 ) return (Matches *)pos;
@@ -16343,7 +16669,7 @@ Summary *XmlDoc::getSummary () {
 		return (Summary *)tr;
 	}
 
-	Sections *sections = getSections();
+	Sections *sections = getSectionsForSummary();
 	if ( ! sections ||sections==(Sections *)-1) {
 		checkPointerError(sections);
 		return (Summary *)sections;
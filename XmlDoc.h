@@ -241,7 +241,7 @@ public:
 	char      *ptr_site;
 	LinkInfo  *ptr_linkInfo1;
 	char      *ptr_linkdbData;
-	char      *ptr_unused14;
+	char      *ptr_passageIndex;
 	char      *ptr_tagRecData;
 	LinkInfo  *ptr_unused9;
 
@@ -264,7 +264,7 @@ public:
 	int32_t       size_site;
 	int32_t       size_linkInfo1;
 	int32_t       size_linkdbData;
-	int32_t       size_unused14;
+	int32_t       size_passageIndex;
 	int32_t       size_tagRecData;
 	int32_t       size_unused9;
 
@@ -362,6 +362,8 @@ public:
 	class Pos *getPos ( );
 	class Phrases *getPhrases ( ) ;
 	class Sections *getSections ( ) ;
+	class Sections *getSectionsForSummary ( ) ;
+	SafeBuf *getPassageIndexBuf ( ) ;
 	int32_t *getLinkSiteHashes ( );
 	class Links *getLinks ( bool doQuickSet = false ) ;
 	class HashTableX *getCountTable ( ) ;
@@ -370,9 +372,17 @@ public:
 	int32_t *getPageSampleVector ( ) ;
 	int32_t *getPostLinkTextVector ( int32_t linkNode ) ;
 	int32_t computeVector ( const TokenizerResult *tr, uint32_t *vec , int32_t start = 0 , int32_t end = -1 );
+	// . link text helpers used by getMsg20Reply() and hashLinksForAnchordb()
+	// . "tokenHint" is the token # to start scanning from. links are in
+	//   document order so callers doing all links can keep a running one
+	int32_t computePostLinkTextVector ( Xml *xml, const TokenizerResult *tr, int32_t linkNode,
+	                                    int32_t *tokenHint, uint32_t *vec );
+	int32_t getSurroundingText ( Xml *xml, const TokenizerResult *tr, class Pos *pos, int32_t linkNode,
+	                             int32_t *tokenHint, char *buf, int32_t bufSize );
 	float *getPageSimilarity ( class XmlDoc *xd2 ) ;
 	float *getPercentChanged ( );
 	int64_t *getExactContentHash64();
+	uint64_t *getContentSimHash64();
 	class RdbList *getDupList ( ) ;
 	char *getIsDup ( ) ;
 	char *getMetaDescription( int32_t *mdlen ) ;
@@ -433,6 +443,7 @@ public:
 	uint16_t *getCharset ( ) ;
 	char **getFilteredContent ( ) ;
 	void filterStart_r ( bool amThread ) ;
+	void setFilteredContent_r(const char *output, size_t outputLen);
 	char **getRawUtf8Content ( ) ;
 	char **getExpandedUtf8Content ( ) ;
 	char **getUtf8Content ( ) ;
@@ -514,6 +525,7 @@ public:
 	bool hashUrl ( class HashTableX *table, bool urlOnly );
 	bool hashIncomingLinkText(HashTableX *table);
 	bool hashLinksForLinkdb ( class HashTableX *table ) ;
+	bool hashLinksForAnchordb ( class SafeBuf *metaList, bool forDelete ) ;
 	bool hashNeighborhoods ( class HashTableX *table ) ;
 	bool hashTitle ( class HashTableX *table );
 	bool hashBody2 ( class HashTableX *table );
@@ -659,6 +671,8 @@ public:
 	Pos        m_pos;
 	Phrases    m_phrases;
 	Sections   m_sections;
+	// set from ptr_passageIndex, only good for the summary
+	Sections   m_passageSections;
 
 	// . for rebuild logging of what's changed
 	// . Repair.cpp sets these based on titlerec
@@ -734,6 +748,8 @@ public:
 	bool m_posValid;
 	bool m_phrasesValid;
 	bool m_sectionsValid;
+	bool m_passageSectionsValid;
+	bool m_passageIndexBufValid;
 
 	bool m_imageDataValid;
 	bool m_imagesValid;
@@ -828,6 +844,7 @@ public:
 	bool m_isLinkSpamValid;
 	bool m_isErrorPageValid;
 	bool m_exactContentHash64Valid;
+	bool m_contentSimHash64Valid;
 	bool m_jpValid;
 	bool m_blockedDocValid;
 	bool m_defaultSitePageTemperatureValid;
@@ -862,6 +879,7 @@ public:
 	// what docids are similar to us? docids are in this list
 	RdbList m_dupList;
 	int64_t m_exactContentHash64;
+	uint64_t m_contentSimHash64;
 	Msg0 m_msg0;
 	char m_isDup;	// may be -1
 	int64_t m_docIdWeAreADupOf;
@@ -927,6 +945,7 @@ public:
 	SafeBuf m_explicitKeywordsBuf;
 	SafeBuf m_linkSiteHashBuf;
 	SafeBuf m_linkdbDataBuf;
+	SafeBuf m_passageIndexBuf;
 	SafeBuf m_langVec;
 
 	SiteGetter m_siteGetter;
@@ -18,6 +18,7 @@
 #include <string>
 #include "Errno.h"
 #include "gbmemcpy.h"
+#include "Anchordb.h"
 
 
 #ifdef _VALGRIND_
@@ -843,6 +844,214 @@ bool XmlDoc::hashLinksForLinkdb ( HashTableX *dt ) {
 	return true;
 }
 
+// . add an anchordb record for every outlink we add to linkdb
+// . the data is what a Msg20 link text request for that outlink would return,
+//   so Msg25 does not have to fetch our titlerec to get it
+// . the records are appended to "metaList" as rdbId/key/dataSize/data, or
+//   just rdbId/key if "forDelete" is true
+// . returns false and sets g_errno on error
+bool XmlDoc::hashLinksForAnchordb ( SafeBuf *metaList, bool forDelete ) {
+
+	if ( ! m_linksValid ) { g_process.shutdownAbort(true); }
+	if ( ! forDelete && ! m_xmlValid ) { g_process.shutdownAbort(true); }
+
+	int32_t *linkSiteHashes = getLinkSiteHashes();
+	if ( ! linkSiteHashes || linkSiteHashes == (void *)-1 ) {
+		g_process.shutdownAbort(true);
+	}
+
+	uint32_t linkerSiteHash32 = *getSiteHash32();
+	char siteRank = getSiteRank();
+	int64_t docId = *getDocId();
+	int32_t *ipptr = getIp();
+	int32_t ip = ipptr ? *ipptr : 0;
+
+	// first occurrence of a link wins, like Links::getLinkText()
+	HashTableX dedup;
+	if ( ! dedup.set ( sizeof(key224_t), 0, m_links.getNumLinks() * 2 + 16, NULL, 0, false, "anchdedup" ) ) {
+		return false;
+	}
+
+	// . Msg20 gets the link text from the phase-1 tokens of the titlerec, but
+	//   the phase-2 tokenizer may have changed m_tokenizerResult since then
+	// . so tokenize again, Pos and the vectors must match what Msg20 sees
+	TokenizerResult tr1;
+	Pos pos1;
+	if ( ! forDelete ) {
+		xml_tokenizer_phase_1 ( &m_xml, &tr1 );
+		calculate_tokens_hashes ( &tr1 );
+		if ( ! pos1.set ( &tr1 ) ) {
+			return false;
+		}
+	}
+
+	// . the page sample vector is the same for all outlinks
+	// . the tag pair vector too, Msg20 sorts it before using it
+	uint32_t pageVec [ SAMPLE_VECTOR_SIZE/4 ];
+	int32_t  pageVecSize = 0;
+	int32_t  tagVec [ MAX_TAG_PAIR_HASHES ];
+	int32_t  tagVecSize = 0;
+	if ( ! forDelete ) {
+		pageVecSize = computeVector ( &tr1, pageVec );
+
+		int32_t *tpv = getTagPairHashVector();
+		if ( ! tpv || tpv == (int32_t *)-1 ) { g_process.shutdownAbort(true); }
+		tagVecSize = m_tagPairHashVecSize;
+		memcpy ( tagVec, tpv, tagVecSize );
+		// exclude the terminating 0
+		int32_t nd = tagVecSize / 4 - 1;
+		if ( nd > 1 ) {
+			std::sort ( (uint32_t *)tagVec, (uint32_t *)tagVec + nd );
+		}
+	}
+
+	// the mid domain hash is of the redirect url if we have one
+	Url redir;
+	Url *linker = getFirstUrl();
+	if ( ptr_redirUrl ) {
+		redir.set ( ptr_redirUrl );
+		linker = &redir;
+	}
+	int32_t midDomHash = hash32 ( linker->getMidDomain(), linker->getMidDomainLen() );
+
+	// the token scans in computePostLinkTextVector() and
+	// getSurroundingText() continue from the previous link
+	int32_t postHint = 0;
+	int32_t surroundHint = 0;
+
+	for ( int32_t i = 0 ; i < m_links.m_numLinks ; i++ ) {
+		// skip if empty
+		if ( m_links.m_linkLens[i] == 0 ) {
+			continue;
+		}
+
+		bool spam = m_links.isLinkSpam(i);
+
+		// same as the linkdb key but without the dates
+		key224_t k = Linkdb::makeKey_uk ( linkSiteHashes[i],
+						  m_links.getLinkHash64(i),
+						  spam,
+						  siteRank,
+						  ip,
+						  docId,
+						  0,
+						  0,
+						  false,
+						  linkerSiteHash32,
+						  false );
+
+		if ( dedup.isInTable ( &k ) ) {
+			continue;
+		}
+		if ( ! dedup.addKey ( &k ) ) {
+			return false;
+		}
+
+		if ( forDelete ) {
+			if ( ! metaList->pushChar ( RDB_ANCHORDB ) ||
+			     ! metaList->safeMemcpy ( &k, sizeof(k) ) ) {
+				return false;
+			}
+			continue;
+		}
+
+		// leave room for the \0 and the utf8 truncation workaround
+		char linkText [ MAX_LINK_TEXT_LEN ];
+		memset ( linkText + sizeof(linkText) - 3, 0, 3 );
+		char *rssItem = NULL;
+		int32_t rssItemLen = 0;
+		int32_t linkNode = -1;
+		int32_t errcode = 0;
+		int32_t blen = m_links.getLinkText2 ( i, linkText, sizeof(linkText) - 2, &rssItem, &rssItemLen,
+						      &linkNode, &errcode );
+		// . area tags have no link text
+		// . Msg25 asks the linker itself if there is no record
+		if ( linkNode < 0 ) {
+			continue;
+		}
+
+		if ( ! verifyUtf8 ( linkText, blen ) ) {
+			linkText[0] = '\0';
+			blen = 0;
+		}
+		if ( ! verifyUtf8 ( rssItem, rssItemLen ) ) {
+			rssItemLen = 0;
+		}
+
+		Msg20Reply reply;
+		reply.reset();
+		reply.m_isPermalink      = m_isPermalink;
+		reply.m_ip               = m_ip;
+		reply.m_firstIp          = *getFirstIp();
+		reply.m_midDomHash       = midDomHash;
+		reply.m_siteRank         = siteRank;
+		reply.m_language         = m_langId;
+		reply.m_country          = *getCountryId();
+		reply.m_siteNumInlinks   = m_siteNumInlinks;
+		reply.m_firstIndexedDate = m_firstIndexedDate;
+		reply.m_lastSpidered     = getSpideredTime();
+
+		reply.ptr_ubuf  = const_cast<char*>(getFirstUrl()->getUrl());
+		reply.size_ubuf = getFirstUrl()->getUrlLen() + 1;
+
+		if ( blen > 0 ) {
+			reply.ptr_linkText  = linkText;
+			reply.size_linkText = blen + 1;
+		}
+
+		char rssItemBuf [ MAX_RSSITEM_SIZE ];
+		if ( (size_t)rssItemLen > sizeof(rssItemBuf) - 2 ) {
+			rssItemLen = sizeof(rssItemBuf) - 2;
+		}
+		if ( rssItemLen > 0 ) {
+			memcpy ( rssItemBuf, rssItem, rssItemLen );
+			rssItemBuf[rssItemLen] = '\0';
+			reply.ptr_rssItem  = rssItemBuf;
+			reply.size_rssItem = rssItemLen + 1;
+		}
+
+		// Msg25 clears it if it is not doing the link spam check
+		reply.m_isLinkSpam = spam;
+		const char *note = m_links.getSpamNote(i);
+		reply.ptr_note  = note;
+		reply.size_note = strlen(note) + 1;
+
+		// . stored even for link spam, Msg25 drops them if it does the
+		//   link spam check, like Msg20 does
+		uint32_t postVec [ POST_VECTOR_SIZE/4 ];
+		char surroundingText [ MAX_SURROUNDING_TEXT_WIDTH ];
+		reply.ptr_vector1  = (int32_t *)pageVec;
+		reply.size_vector1 = pageVecSize;
+		reply.ptr_vector2  = (int32_t *)postVec;
+		reply.size_vector2 = computePostLinkTextVector ( &m_xml, &tr1, linkNode, &postHint, postVec );
+		reply.ptr_vector3  = tagVec;
+		reply.size_vector3 = tagVecSize;
+
+		int32_t len2 = getSurroundingText ( &m_xml, &tr1, &pos1, linkNode, &surroundHint,
+						    surroundingText, sizeof(surroundingText)/2 );
+		if ( len2 > 0 ) {
+			reply.ptr_surroundingText  = surroundingText;
+			reply.size_surroundingText = len2 + 1;
+		}
+
+		if ( ! metaList->pushChar ( RDB_ANCHORDB ) ||
+		     ! metaList->safeMemcpy ( &k, sizeof(k) ) ) {
+			return false;
+		}
+		// reserve the data size and fill it in after
+		int32_t sizeOffset = metaList->length();
+		if ( ! metaList->pushLong ( 0 ) ) {
+			return false;
+		}
+		if ( ! Anchordb::serialize ( &reply, metaList ) ) {
+			return false;
+		}
+		int32_t dataSize = metaList->length() - sizeOffset - 4;
+		memcpy ( metaList->getBufStart() + sizeOffset, &dataSize, 4 );
+	}
+	return true;
+}
+
 // . returns false and sets g_errno on error
 // . copied Url2.cpp into here basically, so we can now dump Url2.cpp
 bool XmlDoc::hashUrl ( HashTableX *tt, bool urlOnly ) { // , bool isStatusDoc ) {
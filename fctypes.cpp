@@ -7,6 +7,7 @@
 #include "Errno.h"
 #include <fcntl.h>
 #include <sys/time.h>
+#include <time.h>
 #include "gbmemcpy.h"
 
 
@@ -523,6 +524,18 @@ int64_t gettimeofdayInMilliseconds() {
 	return ((int64_t)(tv.tv_usec/1000)+((int64_t)tv.tv_sec)*1000);
 }
 
+int64_t getMonotonicMilliseconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec)*1000 + ts.tv_nsec/1000000;
+}
+
+int64_t getMonotonicMicroseconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec)*1000000 + ts.tv_nsec/1000;
+}
+
 time_t getTime () {
 	uint32_t now = gettimeofdayInMilliseconds() / 1000;
 	return (time_t)now;
@@ -105,6 +105,8 @@ const char *strnstrn(const char *haystack, int32_t haystackLen, const char *need
 
 
 int64_t gettimeofdayInMilliseconds();  //milliseconds since 1970
+int64_t getMonotonicMilliseconds();    //milliseconds since boot, not affected by clock changes
+int64_t getMonotonicMicroseconds();    //microseconds since boot, not affected by clock changes
 time_t  getTime();                     //seconds since 1970
 
 
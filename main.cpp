@@ -23,6 +23,8 @@
 #include "SpiderCache.h"
 #include "Doledb.h"
 #include "Clusterdb.h"
+#include "Anchordb.h"
+#include "Simhashdb.h"
 #include "Collectiondb.h"
 #include "Sections.h"
 #include "UdpServer.h"
@@ -113,6 +115,8 @@
 #include "CountryLanguage.h"
 #include "Errno.h"
 #include "Docid.h"
+#include "StartupGraph.h"
+#include "DocConverterPool.h"
 
 
 #include <sys/stat.h> //umask()
@@ -298,6 +302,16 @@ int main2 ( int argc , char *argv[] ) {
 		return 0; 
 	}
 
+	// document converter worker started by g_docConverterPool, it only
+	// talks to its parent over stdin/stdout so skip all the init
+	if ( strcmp ( cmd , "convertworker" ) == 0 ) {
+		if ( cmdarg+1 >= argc ) {
+			printHelp();
+			return 1;
+		}
+		return DocConverterPool::runWorker ( argv[cmdarg+1] );
+	}
+
 	//send an email on startup for -r, like if we are recovering from an
 	//unclean shutdown.
 	g_recoveryMode = false;
@@ -1113,11 +1127,6 @@ int main2 ( int argc , char *argv[] ) {
 		return 0;
 	}
 	
-	if(!load_lemma_lexicon()) {
-		log(LOG_WARN,"db: could not load lemma lexicon");
-		//but not fatal
-	}
-
 	// file creation test, make sure we have dir control
 	if ( checkDirPerms ( g_hostdb.m_dir ) < 0 ) {
 		return 1;
@@ -1167,6 +1176,10 @@ int main2 ( int argc , char *argv[] ) {
 	//
 	//fprintf(stderr,"running as daemon\n");
 	if ( g_conf.m_runAsDaemon ) {
+		// . the job threads do not survive the fork(), so stop them
+		//   here and start them again in the child
+		g_jobScheduler.finalize();
+
 		pid_t pid, sid;
 		pid = fork();
 		if ( pid < 0 ) exit(EXIT_FAILURE);
@@ -1184,6 +1197,11 @@ int main2 ( int argc , char *argv[] ) {
 		// if we do not do this we don't get sigalarms or quickpolls
 		// when running as 'gb -d'
 		g_loop.init();
+
+		if ( ! g_jobScheduler.initialize(g_conf.m_maxCoordinatorThreads, g_conf.m_maxCpuThreads, g_conf.m_maxSummaryThreads, g_conf.m_maxIOThreads, g_conf.m_maxExternalThreads, g_conf.m_maxFileMetaThreads, g_conf.m_maxMergeThreads, wakeupPollLoop)) {
+			log( LOG_ERROR, "db: JobScheduler init failed." );
+			return 1;
+		}
 	}
 
 	// we register log rotation here because it's after g_loop is initialized
@@ -1227,32 +1245,6 @@ int main2 ( int argc , char *argv[] ) {
 		return 1;
 	}
 
-	// the wiktionary for lang identification and alternate word forms/
-	// synonyms
-	if ( ! g_wiktionary.load() ) {
-		log( LOG_ERROR, "Wiktionary initialization failed!" );
-		return 1;
-	}
-
-	if ( ! g_wiktionary.test() ) {
-		log( LOG_ERROR, "Wiktionary test failed!" );
-		return 1;
-	}
-
-	WordVariationGenerator::set_log_function(wvg_log_function);
-	log(LOG_DEBUG,"main: initializing word variations: Danish");
-	if(!initializeWordVariationGenerator_Danish()) {
-		log(LOG_WARN, "word-variation-danish initialization failed" );
-		//but not fatal
-	}
-	log(LOG_DEBUG,"main: initialized word variations: Danish");
-
-	// the wiki titles
-	if ( ! g_wiki.load() ) {
-		log( LOG_ERROR, "Wiki initialization failed!" );
-		return 1;
-	}
-	
 	// shout out if we're in read only mode
 	if ( g_conf.m_readOnlyMode )
 		log("db: -- Read Only Mode Set. Can Not Add New Data. --");
@@ -1270,22 +1262,158 @@ int main2 ( int argc , char *argv[] ) {
 		return 1;
 	}
 
-	if(!initialiseAllPrimaryRdbs())
-		return 1;
+	// . load dictionaries, rdbs and collections
+	// . independent loaders run in parallel as jobs
+	{
+		StartupGraph startup;
+
+		// the wiktionary for lang identification and alternate word forms/
+		// synonyms
+		startup.add("wiktionary", []() {
+			if ( ! g_wiktionary.load() ) {
+				log( LOG_ERROR, "Wiktionary initialization failed!" );
+				return false;
+			}
+			if ( ! g_wiktionary.test() ) {
+				log( LOG_ERROR, "Wiktionary test failed!" );
+				return false;
+			}
+			return true;
+		});
+
+		startup.add("word variations", []() {
+			WordVariationGenerator::set_log_function(wvg_log_function);
+			log(LOG_DEBUG,"main: initializing word variations: Danish");
+			if(!initializeWordVariationGenerator_Danish()) {
+				log(LOG_WARN, "word-variation-danish initialization failed" );
+				return false;
+			}
+			log(LOG_DEBUG,"main: initialized word variations: Danish");
+			return true;
+		}, {}, false);
+
+		// the wiki titles
+		startup.add("wiki", []() {
+			if ( ! g_wiki.load() ) {
+				log( LOG_ERROR, "Wiki initialization failed!" );
+				return false;
+			}
+			return true;
+		});
 
-	// the spider cache used by SpiderLoop
-	if ( ! g_spiderCache.init() ) {
-		log( LOG_ERROR, "db: SpiderCache init failed." );
-		return 1;
-	}
+		startup.add("lemma lexicon", []() {
+			if(!load_lemma_lexicon()) {
+				log(LOG_WARN,"db: could not load lemma lexicon");
+				return false;
+			}
+			return true;
+		}, {}, false);
+
+		// the rdbs load their saved trees/buckets
+		startup.add("rdb.posdb",     []() { return g_posdb.init(); });
+		startup.add("rdb.titledb",   []() { return g_titledb.init(); });
+		startup.add("rdb.tagdb",     []() { return g_tagdb.init(); });
+		startup.add("rdb.spiderdb",  []() { return g_spiderdb.init(); });
+		startup.add("rdb.doledb",    []() { return g_doledb.init(); });
+		startup.add("rdb.clusterdb", []() { return g_clusterdb.init(); });
+		startup.add("rdb.linkdb",    []() { return g_linkdb.init(); });
+		startup.add("rdb.anchordb",  []() { return g_anchordb.init(); });
+		startup.add("rdb.simhashdb", []() { return g_simhashdb.init(); });
+		std::vector<std::string> rdbs = startup.getNames("rdb.");
+
+		// the spider cache used by SpiderLoop
+		startup.add("spidercache", []() { return g_spiderCache.init(); }, rdbs, true, true);
+
+		// . each collection adds its RdbBase (maps, indexes) to every rdb
+		// . a failing collection is logged but does not stop startup
+		for ( int32_t i = 0 ; i < g_collectiondb.getNumRecs() ; i++ ) {
+			CollectionRec *cr = g_collectiondb.getRec(i);
+			if ( ! cr ) continue;
+			char name[MAX_COLL_LEN + 16];
+			snprintf(name, sizeof(name), "coll.%s", cr->m_coll);
+			startup.add(name, [cr]() { return g_collectiondb.addRdbBasesForCollRec(cr); }, rdbs, false);
+		}
 
-	// now clean the trees since all rdbs have loaded their rdb trees
-	// from disk, we need to remove bogus collection data from teh trees
-	// like if a collection was delete but tree never saved right it'll
-	// still have the collection's data in it
-	if ( ! g_collectiondb.addRdbBaseToAllRdbsForEachCollRec ( ) ) {
-		log("db: Collectiondb init failed." );
-		_exit(1);
+		// now clean the trees since all rdbs have loaded their rdb trees
+		// from disk, we need to remove bogus collection data from teh trees
+		// like if a collection was delete but tree never saved right it'll
+		// still have the collection's data in it
+		std::vector<std::string> colls = startup.getNames("coll.");
+		colls.insert(colls.end(), rdbs.begin(), rdbs.end());
+		startup.add("cleantrees", []() { return g_collectiondb.cleanTrees(); }, colls, true, true);
+
+		//Load the high-frequency term shortcuts (if they exist)
+		startup.add("hfts", []() { return g_hfts.load(); }, {}, false);
+
+		//Load the page temperature
+		startup.add("page temperature", []() { return g_pageTemperatureRegistry.load(); }, {}, false);
+
+		//load docid->flags/sitehash map
+		startup.add("docid2siteflags", []() { return g_d2fasm.load(); }, {}, false);
+
+		//load sitehash32->default page temperature
+		startup.add("site median page temperature", []() { return g_smptr.open(); }, {}, false);
+
+		// load block lists. they register sleep callbacks so keep them on the main thread
+		startup.add("block lists", []() {
+			g_dnsBlockList.init();
+			g_contentTypeBlockList.init();
+			g_ipBlockList.init();
+			g_contentRetryProxyList.init();
+
+			g_urlBlackList.init();
+			g_urlWhiteList.init();
+			g_urlProxyList.init();
+			g_urlRetryProxyList.init();
+
+			g_robotsCheckList.init();
+
+			g_robotsBlockedResultOverride.init();
+			g_urlResultOverride.init();
+			return true;
+		}, {}, false, true);
+
+		startup.add("term check lists", []() {
+			// Initialize adult detection
+			g_checkAdultList.init("adultwords.txt", "adultphrases.txt");
+
+			// Initialize spam detection
+			g_checkSpamList.init("spamphrases.txt");
+			return true;
+		}, {}, false);
+
+		startup.add("explicit keywords", []() {
+			if(!ExplicitKeywords::initialize()) {
+				log(LOG_ERROR,"Could not initialize explicit keywords file");
+				//but otherwise carry on
+				return false;
+			}
+			return true;
+		}, {}, false);
+
+		//
+		// NOTE: ANYTHING THAT USES THE PARSER SHOULD GO BELOW HERE, UCINIT!
+		//
+
+		// load the appropriate dictionaries
+		startup.add("speller", []() { return g_speller.init(); }, {}, g_conf.m_isLive);
+
+		// Load the category language table
+		startup.add("country codes", []() { return g_countryCode.loadHashTable(); }, {}, false);
+
+		// init minsitenuminlinks buffer
+		startup.add("sitelinks", []() {
+			if ( ! g_tagdb.loadMinSiteInlinksBuffer() ) {
+				log("db: failed to load sitelinks.txt data");
+				return false;
+			}
+			return true;
+		}, { "rdb.tagdb" });
+
+		if ( ! startup.run( true ) ) {
+			log( LOG_ERROR, "db: Startup failed." );
+			_exit(1);
+		}
 	}
 
 	// make sure the we have spiderdb sqlite if we still have spiderdb rdb files
@@ -1305,45 +1433,6 @@ int main2 ( int argc , char *argv[] ) {
 	// initialize country languages
 	CountryLanguage::init();
 
-	//Load the high-frequency term shortcuts (if they exist)
-	g_hfts.load();
-
-	//Load the page temperature
-	g_pageTemperatureRegistry.load();
-	
-	//load docid->flags/sitehash map
-	g_d2fasm.load();
-
-	//load sitehash32->default page temperature
-	g_smptr.open();
-	
-	// load block lists
-	g_dnsBlockList.init();
-	g_contentTypeBlockList.init();
-	g_ipBlockList.init();
-	g_contentRetryProxyList.init();
-
-	g_urlBlackList.init();
-	g_urlWhiteList.init();
-	g_urlProxyList.init();
-	g_urlRetryProxyList.init();
-
-	g_robotsCheckList.init();
-
-	g_robotsBlockedResultOverride.init();
-	g_urlResultOverride.init();
-
-	// Initialize adult detection
-	g_checkAdultList.init("adultwords.txt", "adultphrases.txt");
-
-	// Initialize spam detection
-	g_checkSpamList.init("spamphrases.txt");
-
-	if(!ExplicitKeywords::initialize()) {
-		log(LOG_ERROR,"Could not initialize explicit keywords file");
-		//but otherwise carry on
-	}
-
 	// initialize generate global index thread
 	if (!RdbBase::initializeGlobalIndexThread()) {
 		logError("Unable to initialize global index thread");
@@ -1369,24 +1458,6 @@ int main2 ( int argc , char *argv[] ) {
 		checkDirPerms ( tt ) ;
 	}
 
-	//
-	// NOTE: ANYTHING THAT USES THE PARSER SHOULD GO BELOW HERE, UCINIT!
-	//
-
-	// load the appropriate dictionaries
-	if ( ! g_speller.init() && g_conf.m_isLive ) {
-		_exit(1);
-	}
-
-	// Load the category language table
-	g_countryCode.loadHashTable();
-
-	// init minsitenuminlinks buffer
-	if ( ! g_tagdb.loadMinSiteInlinksBuffer() ) {
-		log("db: failed to load sitelinks.txt data");
-		_exit(1);
-	}
-
 	// . then our main udp server
 	// . must pass defaults since g_dns uses it's own port/instance of it
 	// . server should listen to a socket and register with g_loop
@@ -1401,7 +1472,8 @@ int main2 ( int argc , char *argv[] ) {
 				 20000000 ,   // writeBufSize
 				 20       ,   // pollTime in ms
 				 g_conf.m_udpMaxSockets     ,   // max udp slots
-				 false    )){ // is dns?
+				 false    ,   // is dns?
+				 g_conf.m_udpIoThreads )){
 		log("db: UdpServer init failed." ); return 1; }
 
 	// start up repair loop
@@ -46,6 +46,8 @@ enum rdbid_t {
 	RDB_SPIDERDB_SQLITE = 34,
 	RDB2_SPIDERDB2_SQLITE = 35,
 	RDB_SITEDEFAULTPAGETEMPERATURE = 36, //Not an Rdb
+	RDB_ANCHORDB = 37,
+	RDB_SIMHASHDB = 38,
 	RDB_END
 };
 
@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+#include "Anchordb.h"
+#include "Msg20.h"
+#include "SafeBuf.h"
+#include "Mem.h"
+#include "Errno.h"
+#include <string.h>
+
+static char s_ubuf[] = "http://www.example.com/linker.html";
+static char s_linkText[] = "example anchor text";
+static char s_surroundingText[] = "text around the anchor";
+static char s_rssItem[] = "<item>rss</item>";
+static int32_t s_vector1[] = { 11, 22, 33, 0 };
+static int32_t s_vector2[] = { 44, 55, 0 };
+static int32_t s_vector3[] = { 66, 77, 88, 0 };
+
+static void makeReply(Msg20Reply *reply) {
+	reply->reset();
+	reply->m_isLinkSpam       = 0;
+	reply->m_isPermalink      = 1;
+	reply->m_siteRank         = 7;
+	reply->m_language         = 2;
+	reply->m_country          = 12;
+	reply->m_ip               = 0x01020304;
+	reply->m_firstIp          = 0x05060708;
+	reply->m_midDomHash       = 1234567;
+	reply->m_siteNumInlinks   = 42;
+	reply->m_firstIndexedDate = 1500000000;
+	reply->m_lastSpidered     = 1600000000;
+	reply->m_numOutlinks      = 99;
+
+	reply->ptr_ubuf             = s_ubuf;
+	reply->size_ubuf            = sizeof(s_ubuf);
+	reply->ptr_linkText         = s_linkText;
+	reply->size_linkText        = sizeof(s_linkText);
+	reply->ptr_surroundingText  = s_surroundingText;
+	reply->size_surroundingText = sizeof(s_surroundingText);
+	reply->ptr_rssItem          = s_rssItem;
+	reply->size_rssItem         = sizeof(s_rssItem);
+	reply->ptr_vector1          = s_vector1;
+	reply->size_vector1         = sizeof(s_vector1);
+	reply->ptr_vector2          = s_vector2;
+	reply->size_vector2         = sizeof(s_vector2);
+	reply->ptr_vector3          = s_vector3;
+	reply->size_vector3         = sizeof(s_vector3);
+}
+
+TEST(AnchordbTest, RoundTrip) {
+	Msg20Reply reply;
+	makeReply(&reply);
+
+	SafeBuf sb;
+	ASSERT_TRUE(Anchordb::serialize(&reply, &sb));
+
+	int32_t replySize = 0;
+	Msg20Reply *r = Anchordb::makeMsg20Reply(sb.getBufStart(), sb.length(), 123456789, &replySize);
+	ASSERT_TRUE(r != NULL);
+	EXPECT_LT((int32_t)sizeof(Msg20Reply), replySize);
+
+	EXPECT_EQ(123456789, r->m_docId);
+	EXPECT_EQ(0, r->m_isLinkSpam);
+	EXPECT_EQ(1, r->m_isPermalink);
+	EXPECT_EQ(7, r->m_siteRank);
+	EXPECT_EQ(2, r->m_language);
+	EXPECT_EQ(12, r->m_country);
+	EXPECT_EQ(0x01020304, r->m_ip);
+	EXPECT_EQ(0x05060708, r->m_firstIp);
+	EXPECT_EQ(1234567, r->m_midDomHash);
+	EXPECT_EQ(42, r->m_siteNumInlinks);
+	EXPECT_EQ(1500000000, r->m_firstIndexedDate);
+	EXPECT_EQ(1500000000, r->m_firstSpidered);
+	EXPECT_EQ(1600000000, r->m_lastSpidered);
+	EXPECT_EQ(99, r->m_numOutlinks);
+
+	EXPECT_STREQ(s_ubuf, r->ptr_ubuf);
+	EXPECT_EQ((int32_t)sizeof(s_ubuf), r->size_ubuf);
+	EXPECT_STREQ(s_linkText, r->ptr_linkText);
+	EXPECT_EQ((int32_t)sizeof(s_linkText), r->size_linkText);
+	EXPECT_STREQ(s_surroundingText, r->ptr_surroundingText);
+	EXPECT_STREQ(s_rssItem, r->ptr_rssItem);
+	EXPECT_TRUE(r->ptr_note == NULL);
+	EXPECT_EQ(0, r->size_note);
+
+	ASSERT_EQ((int32_t)sizeof(s_vector1), r->size_vector1);
+	EXPECT_EQ(0, memcmp(s_vector1, r->ptr_vector1, sizeof(s_vector1)));
+	ASSERT_EQ((int32_t)sizeof(s_vector2), r->size_vector2);
+	EXPECT_EQ(0, memcmp(s_vector2, r->ptr_vector2, sizeof(s_vector2)));
+
+	// the tag pair vector is stored as its hash, a vector of one component
+	ASSERT_EQ(8, r->size_vector3);
+	EXPECT_NE(0, r->ptr_vector3[0]);
+	EXPECT_EQ(0, r->ptr_vector3[1]);
+
+	// the same tag pairs give the same hash
+	SafeBuf sb2;
+	ASSERT_TRUE(Anchordb::serialize(&reply, &sb2));
+	int32_t replySize2 = 0;
+	Msg20Reply *r2 = Anchordb::makeMsg20Reply(sb2.getBufStart(), sb2.length(), 1, &replySize2);
+	ASSERT_TRUE(r2 != NULL);
+	EXPECT_EQ(r->ptr_vector3[0], r2->ptr_vector3[0]);
+
+	mfree(r, replySize, "Msg20b");
+	mfree(r2, replySize2, "Msg20b");
+}
+
+TEST(AnchordbTest, EmptyFields) {
+	Msg20Reply reply;
+	reply.reset();
+	reply.m_isLinkSpam = 1;
+
+	SafeBuf sb;
+	ASSERT_TRUE(Anchordb::serialize(&reply, &sb));
+
+	int32_t replySize = 0;
+	Msg20Reply *r = Anchordb::makeMsg20Reply(sb.getBufStart(), sb.length(), 5, &replySize);
+	ASSERT_TRUE(r != NULL);
+	EXPECT_EQ((int32_t)sizeof(Msg20Reply), replySize);
+	EXPECT_EQ(1, r->m_isLinkSpam);
+	EXPECT_TRUE(r->ptr_ubuf == NULL);
+	EXPECT_TRUE(r->ptr_linkText == NULL);
+	EXPECT_TRUE(r->ptr_vector1 == NULL);
+	EXPECT_TRUE(r->ptr_vector3 == NULL);
+	EXPECT_EQ(0, r->size_vector3);
+
+	mfree(r, replySize, "Msg20b");
+}
+
+TEST(AnchordbTest, CorruptData) {
+	Msg20Reply reply;
+	makeReply(&reply);
+
+	SafeBuf sb;
+	ASSERT_TRUE(Anchordb::serialize(&reply, &sb));
+
+	int32_t replySize = 0;
+
+	// truncated header
+	g_errno = 0;
+	EXPECT_TRUE(Anchordb::makeMsg20Reply(sb.getBufStart(), 4, 1, &replySize) == NULL);
+	EXPECT_EQ(ECORRUPTDATA, g_errno);
+
+	// truncated strings
+	g_errno = 0;
+	EXPECT_TRUE(Anchordb::makeMsg20Reply(sb.getBufStart(), sb.length() - 1, 1, &replySize) == NULL);
+	EXPECT_EQ(ECORRUPTDATA, g_errno);
+
+	// unknown version
+	SafeBuf badVersion;
+	badVersion.safeMemcpy(&sb);
+	badVersion.getBufStart()[0] = ANCHORDB_VERSION + 1;
+	g_errno = 0;
+	EXPECT_TRUE(Anchordb::makeMsg20Reply(badVersion.getBufStart(), badVersion.length(), 1, &replySize) == NULL);
+	EXPECT_EQ(ECORRUPTDATA, g_errno);
+
+	// a string that is not \0 terminated
+	reply.ptr_vector1 = NULL;
+	reply.ptr_vector2 = NULL;
+	reply.ptr_vector3 = NULL;
+	reply.ptr_surroundingText = NULL;
+	reply.ptr_rssItem = NULL;
+	reply.size_linkText = sizeof(s_linkText) - 1;
+	SafeBuf unterminated;
+	ASSERT_TRUE(Anchordb::serialize(&reply, &unterminated));
+	g_errno = 0;
+	EXPECT_TRUE(Anchordb::makeMsg20Reply(unterminated.getBufStart(), unterminated.length(), 1, &replySize) == NULL);
+	EXPECT_EQ(ECORRUPTDATA, g_errno);
+}
+
+TEST(AnchordbTest, FreedByMsg20) {
+	Msg20Reply reply;
+	makeReply(&reply);
+
+	SafeBuf sb;
+	ASSERT_TRUE(Anchordb::serialize(&reply, &sb));
+
+	size_t usedMem = g_mem.getUsedMem();
+
+	// what Msg25 does with a reply made from an anchordb record
+	int32_t replySize = 0;
+	Msg20Reply *r = Anchordb::makeMsg20Reply(sb.getBufStart(), sb.length(), 1, &replySize);
+	ASSERT_TRUE(r != NULL);
+	EXPECT_EQ(usedMem + replySize, g_mem.getUsedMem());
+
+	Msg20 msg20;
+	msg20.m_r            = r;
+	msg20.m_replySize    = replySize;
+	msg20.m_replyMaxSize = replySize;
+	msg20.freeReply();
+
+	EXPECT_TRUE(msg20.m_r == NULL);
+	EXPECT_EQ(usedMem, g_mem.getUsedMem());
+}
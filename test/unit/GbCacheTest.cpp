@@ -44,3 +44,45 @@ TEST(GbCacheTest, InsertLookupMaxed) {
 		EXPECT_STREQ(std::to_string(key).c_str(), stored_data.c_str());
 	}
 }
+
+TEST(GbCacheTest, Remove) {
+	GbCache<int64_t, std::string> cache;
+	cache.configure(60000, 10, false, "test");
+
+	for (int64_t key = 1; key <= 3; ++key) {
+		cache.insert(key, std::to_string(key));
+	}
+
+	cache.remove(2);
+	cache.remove(4);
+	EXPECT_EQ(2, cache.size());
+
+	std::string stored_data;
+	EXPECT_TRUE(cache.lookup(1, &stored_data));
+	EXPECT_FALSE(cache.lookup(2, &stored_data));
+	EXPECT_TRUE(cache.lookup(3, &stored_data));
+}
+
+TEST(GbCacheTest, ReinsertRemove) {
+	GbCache<int64_t, std::string> cache;
+	cache.configure(60000, 3, false, "test");
+
+	for (int64_t key = 1; key <= 3; ++key) {
+		cache.insert(key, std::to_string(key));
+	}
+
+	// reinserting moves the key to the end of the queue
+	cache.insert(1, "one");
+	cache.remove(2);
+	cache.insert(4, "4");
+	cache.insert(5, "5");
+	EXPECT_EQ(3, cache.size());
+
+	std::string stored_data;
+	EXPECT_TRUE(cache.lookup(1, &stored_data));
+	EXPECT_STREQ("one", stored_data.c_str());
+	EXPECT_FALSE(cache.lookup(2, &stored_data));
+	EXPECT_FALSE(cache.lookup(3, &stored_data));
+	EXPECT_TRUE(cache.lookup(4, &stored_data));
+	EXPECT_TRUE(cache.lookup(5, &stored_data));
+}
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include "HttpServer.h"
+#include "TcpSocket.h"
+#include <string.h>
+
+static void initClientSocket(TcpSocket *s, bool keepAlive) {
+	s->m_tunnelMode = 0;
+	s->m_maxTextDocLen = -1;
+	s->m_maxOtherDocLen = -1;
+	s->m_sendBuf = NULL;
+	s->m_sendBufSize = 0;
+	s->m_truncated = false;
+	s->m_blockedContentType = false;
+	s->m_keepAlive = keepAlive;
+	s->m_keepAliveReply = false;
+}
+
+static int32_t getReplySize(TcpSocket *s, const char *reply) {
+	return getMsgSize(reply, strlen(reply), s);
+}
+
+TEST(HttpServerTest, KeepAliveReply) {
+	TcpSocket s;
+
+	// http/1.0 needs connection: keep-alive
+	initClientSocket(&s, true);
+	const char *reply1 = "HTTP/1.0 200 OK\r\nContent-Length: 5\r\nConnection: Keep-Alive\r\n\r\nabcde";
+	EXPECT_EQ((int32_t)strlen(reply1), getReplySize(&s, reply1));
+	EXPECT_TRUE(s.m_keepAliveReply);
+
+	initClientSocket(&s, true);
+	const char *reply2 = "HTTP/1.0 200 OK\r\nContent-Length: 5\r\n\r\nabcde";
+	EXPECT_EQ((int32_t)strlen(reply2), getReplySize(&s, reply2));
+	EXPECT_FALSE(s.m_keepAliveReply);
+
+	// http/1.1 is keep-alive unless connection: close
+	initClientSocket(&s, true);
+	const char *reply3 = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nabcde";
+	EXPECT_EQ((int32_t)strlen(reply3), getReplySize(&s, reply3));
+	EXPECT_TRUE(s.m_keepAliveReply);
+
+	initClientSocket(&s, true);
+	const char *reply4 = "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 5\r\n\r\nabcde";
+	EXPECT_EQ((int32_t)strlen(reply4), getReplySize(&s, reply4));
+	EXPECT_FALSE(s.m_keepAliveReply);
+
+	// we did not ask for it
+	initClientSocket(&s, false);
+	EXPECT_EQ((int32_t)strlen(reply3), getReplySize(&s, reply3));
+	EXPECT_FALSE(s.m_keepAliveReply);
+}
+
+TEST(HttpServerTest, KeepAliveNoContent) {
+	TcpSocket s;
+
+	// no content, so no need to wait for the server to close
+	initClientSocket(&s, true);
+	const char *reply1 = "HTTP/1.1 304 Not Modified\r\nDate: Tue, 15 Nov 1994 08:12:31 GMT\r\n\r\n";
+	EXPECT_EQ((int32_t)strlen(reply1), getReplySize(&s, reply1));
+	EXPECT_TRUE(s.m_keepAliveReply);
+
+	// without keep-alive the server closes the connection
+	initClientSocket(&s, false);
+	EXPECT_EQ(-1, getReplySize(&s, reply1));
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include "ImageThumbnail.h"
+#include "SafeBuf.h"
+#include "Errno.h"
+#include <png.h>
+#include <vector>
+
+TEST(ImageThumbnailTest, ResampleHalf) {
+	uint8_t src[16];
+	for (int i = 0; i < 16; i++) {
+		src[i] = i * 10;
+	}
+
+	AreaResampler resampler(4, 4, 2, 2, 1);
+	for (int y = 0; y < 4; y++) {
+		resampler.addRow(src + y * 4);
+	}
+
+	const uint8_t *dst = resampler.getOutput();
+	EXPECT_EQ(25, dst[0]);
+	EXPECT_EQ(45, dst[1]);
+	EXPECT_EQ(105, dst[2]);
+	EXPECT_EQ(125, dst[3]);
+}
+
+TEST(ImageThumbnailTest, ResamplePartialPixels) {
+	// the middle pixel is split between the two destination pixels
+	uint8_t src[3] = { 0, 90, 180 };
+
+	AreaResampler resampler(3, 1, 2, 1, 1);
+	resampler.addRow(src);
+
+	const uint8_t *dst = resampler.getOutput();
+	EXPECT_EQ(30, dst[0]);
+	EXPECT_EQ(150, dst[1]);
+}
+
+TEST(ImageThumbnailTest, ResampleChannels) {
+	// a solid color stays the same
+	std::vector<uint8_t> row;
+	for (int x = 0; x < 7; x++) {
+		row.push_back(200);
+		row.push_back(100);
+		row.push_back(3);
+	}
+
+	AreaResampler resampler(7, 5, 3, 2, 3);
+	for (int y = 0; y < 5; y++) {
+		resampler.addRow(&row[0]);
+	}
+
+	const uint8_t *dst = resampler.getOutput();
+	for (int i = 0; i < 3 * 2; i++) {
+		EXPECT_EQ(200, dst[i * 3]);
+		EXPECT_EQ(100, dst[i * 3 + 1]);
+		EXPECT_EQ(3, dst[i * 3 + 2]);
+	}
+}
+
+static void pngWrite(png_structp png, png_bytep data, png_size_t len) {
+	SafeBuf *sb = (SafeBuf *)png_get_io_ptr(png);
+	sb->safeMemcpy((const char *)data, len);
+}
+
+static void pngFlush(png_structp) {
+}
+
+static void makePng(int32_t width, int32_t height, SafeBuf *sb) {
+	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info = png_create_info_struct(png);
+	png_set_write_fn(png, sb, pngWrite, pngFlush);
+	png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+	             PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png, info);
+
+	std::vector<uint8_t> row(width * 3);
+	for (int32_t y = 0; y < height; y++) {
+		for (int32_t x = 0; x < width; x++) {
+			row[x * 3] = x * 255 / width;
+			row[x * 3 + 1] = y * 255 / height;
+			row[x * 3 + 2] = 128;
+		}
+		png_write_row(png, &row[0]);
+	}
+
+	png_write_end(png, info);
+	png_destroy_write_struct(&png, &info);
+}
+
+TEST(ImageThumbnailTest, PngToJpeg) {
+	SafeBuf png;
+	makePng(1000, 600, &png);
+	ASSERT_TRUE(canMakeThumbnail(png.getBufStart(), png.length()));
+
+	SafeBuf thumb;
+	int32_t dx = 0;
+	int32_t dy = 0;
+	ASSERT_TRUE(makeThumbnail(png.getBufStart(), png.length(), 250, 25000000, &thumb, &dx, &dy));
+	EXPECT_EQ(250, dx);
+	EXPECT_EQ(150, dy);
+	ASSERT_TRUE(canMakeThumbnail(thumb.getBufStart(), thumb.length()));
+
+	// thumbnail of the jpeg is the jpeg itself
+	SafeBuf thumb2;
+	ASSERT_TRUE(makeThumbnail(thumb.getBufStart(), thumb.length(), 250, 25000000, &thumb2, &dx, &dy));
+	EXPECT_EQ(250, dx);
+	EXPECT_EQ(150, dy);
+	EXPECT_EQ(thumb.length(), thumb2.length());
+
+	// smaller thumbnail of the jpeg
+	SafeBuf thumb3;
+	ASSERT_TRUE(makeThumbnail(thumb.getBufStart(), thumb.length(), 50, 25000000, &thumb3, &dx, &dy));
+	EXPECT_EQ(50, dx);
+	EXPECT_EQ(30, dy);
+}
+
+TEST(ImageThumbnailTest, MaxPixels) {
+	SafeBuf png;
+	makePng(1000, 600, &png);
+
+	SafeBuf thumb;
+	int32_t dx = 0;
+	int32_t dy = 0;
+	EXPECT_FALSE(makeThumbnail(png.getBufStart(), png.length(), 250, 1000 * 599, &thumb, &dx, &dy));
+	EXPECT_EQ(EBADIMG, g_errno);
+}
+
+TEST(ImageThumbnailTest, Truncated) {
+	SafeBuf png;
+	makePng(1000, 600, &png);
+
+	SafeBuf thumb;
+	int32_t dx = 0;
+	int32_t dy = 0;
+	EXPECT_FALSE(makeThumbnail(png.getBufStart(), png.length() / 2, 250, 25000000, &thumb, &dx, &dy));
+	EXPECT_EQ(EBADIMG, g_errno);
+}
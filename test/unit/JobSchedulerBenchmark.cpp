@@ -0,0 +1,96 @@
+#include "JobScheduler.h"
+#include "Conf.h"
+#include "Mem.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+
+//Microbenchmark of submitting and running many short jobs, like the
+//intersection/summary/read jobs of a busy query load
+
+static std::atomic<unsigned> jobs_run(0);
+static std::atomic<unsigned> jobs_finished(0);
+
+static uint64_t now_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1000000ULL + ts.tv_nsec/1000;
+}
+
+static void msleep(int msecs) {
+	struct timespec ts;
+	ts.tv_sec = msecs/1000;
+	ts.tv_nsec = (msecs%1000)*1000000;
+	nanosleep(&ts,NULL);
+}
+
+static void start_routine(void *state) {
+	//a few microseconds of work
+	volatile unsigned x = 0;
+	unsigned n = (unsigned)(uintptr_t)state;
+	for(unsigned i=0; i<n; i++)
+		x += i;
+	jobs_run++;
+}
+
+static void finish_routine(void *, job_exit_t exit_type) {
+	assert(exit_type==job_exit_normal);
+	jobs_finished++;
+}
+
+static void run(unsigned num_threads, unsigned num_jobs, unsigned work) {
+	static const thread_type_t thread_types[] = {
+		thread_type_query_read,
+		thread_type_query_intersect,
+		thread_type_query_summary,
+	};
+
+	JobScheduler js;
+	js.initialize(1,num_threads,num_threads,1,1,1,1);
+
+	jobs_run = 0;
+	jobs_finished = 0;
+
+	uint64_t start = now_us();
+	for(unsigned i=0; i<num_jobs; i++) {
+		bool b = js.submit(start_routine,
+		                   finish_routine,
+		                   (void*)(uintptr_t)work,
+		                   thread_types[i%3],
+		                   i%2, //priority/niceness
+		                   0  //start_deadline
+		                  );
+		assert(b);
+		if(i%1024==0)
+			js.cleanup_finished_jobs();
+	}
+	uint64_t submitted = now_us();
+	while(jobs_finished<num_jobs) {
+		js.cleanup_finished_jobs();
+		msleep(1);
+	}
+	uint64_t end = now_us();
+
+	js.finalize();
+
+	printf("threads=%-3u jobs=%-8u work=%-6u submit=%8.0f jobs/s  total=%8.0f jobs/s\n",
+	       num_threads, num_jobs, work,
+	       num_jobs*1e6/(submitted-start+1),
+	       num_jobs*1e6/(end-start+1));
+}
+
+int main(int argc, char **argv) {
+	g_conf.m_maxMem = 1000000000LL;
+	g_mem.init();
+
+	unsigned num_jobs = argc>1 ? atoi(argv[1]) : 20000;
+
+	for(unsigned num_threads : {1, 4, 16})
+		for(unsigned work : {0, 1000})
+			run(num_threads, num_jobs, work);
+
+	printf("success\n");
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include "Metrics.h"
+#include "SafeBuf.h"
+#include "GbFormat.h"
+#include <string.h>
+
+static void testCollector(MetricsWriter *w) {
+	w->printGauge("test_collected", "A collected gauge", "a=\"1\"", -5);
+}
+
+TEST(MetricsTest, TextFormat) {
+	MetricsRegistry registry;
+	MetricCounter c1, c2;
+	MetricGauge g;
+	LatencyHistogram h;
+
+	// registered interleaved, printed grouped by name
+	EXPECT_TRUE(registry.addCounter("test_total", "A counter", "type=\"x\"", &c1));
+	EXPECT_TRUE(registry.addGauge("test_gauge", "A gauge", NULL, &g));
+	EXPECT_TRUE(registry.addCounter("test_total", "A counter", "type=\"y\"", &c2));
+	EXPECT_TRUE(registry.addHistogram("test_time_us", "A histogram", "type=\"x\"", &h));
+	EXPECT_TRUE(registry.addCollector(testCollector));
+	EXPECT_EQ(5, registry.getNumEntries());
+
+	c1.add();
+	c2.add(7);
+	g.set(42);
+	for(uint64_t us = 1; us <= 100; us++)
+		h.add(us);
+
+	SafeBuf sb;
+	registry.print(&sb, FORMAT_TXT);
+	sb.nullTerm();
+	const char *out = sb.getBufStart();
+
+	EXPECT_TRUE(strstr(out, "# TYPE test_collected gauge\ntest_collected{a=\"1\"} -5\n"));
+	EXPECT_TRUE(strstr(out, "# HELP test_total A counter\n# TYPE test_total counter\n"
+	                        "test_total{type=\"x\"} 1\ntest_total{type=\"y\"} 7\n"));
+	EXPECT_TRUE(strstr(out, "test_gauge 42\n"));
+	EXPECT_TRUE(strstr(out, "test_time_us{type=\"x\",quantile=\"0.5\"} "));
+	EXPECT_TRUE(strstr(out, "test_time_us_sum{type=\"x\"} 5050\n"));
+	EXPECT_TRUE(strstr(out, "test_time_us_count{type=\"x\"} 100\n"));
+
+	// only one TYPE line per name
+	const char *first = strstr(out, "# TYPE test_total");
+	ASSERT_TRUE(first != NULL);
+	EXPECT_EQ(NULL, strstr(first + 1, "# TYPE test_total"));
+}
+
+TEST(MetricsTest, JsonFormat) {
+	MetricsRegistry registry;
+	MetricCounter c;
+	c.add(3);
+	registry.addCounter("test_total", "A counter", "type=\"x\",niceness=\"0\"", &c);
+
+	SafeBuf sb;
+	registry.print(&sb, FORMAT_JSON);
+	sb.nullTerm();
+
+	EXPECT_TRUE(strstr(sb.getBufStart(), "{\"name\":\"test_total\", \"type\":\"counter\", "
+	                                     "\"labels\":{\"type\":\"x\",\"niceness\":\"0\"}, \"value\":3}"));
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include "Msg3a.h"
+#include "Conf.h"
+
+static const uint64_t s_simHash1 = 0x0123456789abcdefULL;
+// 2 bits from s_simHash1
+static const uint64_t s_simHash1b = s_simHash1 ^ 0x0000000000010001ULL;
+// far away from s_simHash1
+static const uint64_t s_simHash2 = ~s_simHash1;
+
+class Msg3aTest : public ::testing::Test {
+protected:
+	void SetUp() {
+		m_reply.reset();
+		m_reply.m_numDocIds  = 4;
+		m_reply.ptr_docIds   = (char *)m_docIds;
+		m_reply.size_docIds  = sizeof(m_docIds);
+		m_reply.ptr_scores   = (char *)m_scores;
+		m_reply.size_scores  = sizeof(m_scores);
+		m_reply.ptr_flags    = (char *)m_flags;
+		m_reply.size_flags   = sizeof(m_flags);
+		m_reply.ptr_clusterRecs  = (char *)m_clusterRecs;
+		m_reply.size_clusterRecs = sizeof(m_clusterRecs);
+		m_reply.ptr_simHashes  = (char *)m_simHashes;
+		m_reply.size_simHashes = sizeof(m_simHashes);
+
+		// in score order, like a shard sends them
+		for (int32_t i = 0; i < 4; i++) {
+			m_docIds[i] = 100 + i;
+			m_scores[i] = 10.0 - i;
+			m_flags[i] = 0;
+			m_clusterRecs[i].setMin();
+		}
+		m_simHashes[0] = s_simHash1;
+		m_simHashes[1] = s_simHash1b;
+		m_simHashes[2] = 0;
+		m_simHashes[3] = s_simHash2;
+
+		m_msg3a.m_msg39req.m_doSiteClustering = false;
+		m_msg3a.m_msg39req.m_familyFilter = false;
+		m_msg3a.m_msg39req.m_getDocIdScoringInfo = false;
+		m_msg3a.m_docsToGet = 10;
+		m_msg3a.m_reply[0] = &m_reply;
+
+		m_savedMaxDistance = g_conf.m_simhashDupMaxDistance;
+		g_conf.m_simhashDupMaxDistance = 3;
+	}
+
+	void TearDown() {
+		// not ours to free
+		m_msg3a.m_reply[0] = NULL;
+		g_conf.m_simhashDupMaxDistance = m_savedMaxDistance;
+	}
+
+	Msg3a m_msg3a;
+	Msg39Reply m_reply;
+	int64_t m_docIds[4];
+	double m_scores[4];
+	unsigned m_flags[4];
+	key96_t m_clusterRecs[4];
+	uint64_t m_simHashes[4];
+	int32_t m_savedMaxDistance;
+};
+
+TEST_F(Msg3aTest, MergeListsNearDup) {
+	m_msg3a.m_msg39req.m_doDupContentRemoval = true;
+	ASSERT_TRUE(m_msg3a.mergeLists());
+
+	// the lower scoring near-duplicate is dropped, no simhash is kept
+	ASSERT_EQ(3, m_msg3a.getNumDocIds());
+	EXPECT_EQ(100, m_msg3a.getDocIds()[0]);
+	EXPECT_EQ(102, m_msg3a.getDocIds()[1]);
+	EXPECT_EQ(103, m_msg3a.getDocIds()[2]);
+}
+
+TEST_F(Msg3aTest, MergeListsNoDupContentRemoval) {
+	m_msg3a.m_msg39req.m_doDupContentRemoval = false;
+	ASSERT_TRUE(m_msg3a.mergeLists());
+
+	ASSERT_EQ(4, m_msg3a.getNumDocIds());
+	for (int32_t i = 0; i < 4; i++) {
+		EXPECT_EQ(100 + i, m_msg3a.getDocIds()[i]);
+	}
+}
+
+TEST_F(Msg3aTest, MergeListsNoSimHashes) {
+	// the shard did not send simhashes
+	m_reply.ptr_simHashes = NULL;
+	m_reply.size_simHashes = 0;
+	m_msg3a.m_msg39req.m_doDupContentRemoval = true;
+	ASSERT_TRUE(m_msg3a.mergeLists());
+
+	EXPECT_EQ(4, m_msg3a.getNumDocIds());
+}
@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+#include "Msg40.h"
+
+class Msg40Test : public ::testing::Test {
+protected:
+	void SetUp() {
+		// the destructor frees the msg3as of the other collections
+		m_msg3aPtrs[0] = &m_msg40.m_msg3a;
+		m_msg40.m_msg3aPtrs = m_msg3aPtrs;
+		m_msg40.m_numCollsToSearch = 1;
+
+		m_msg40.m_docsToGetVisible = 11;
+		m_msg40.m_docsToGet = 11;
+		m_msg40.m_msg3a.m_moreDocIdsAvail = true;
+	}
+
+	Msg40 m_msg40;
+	Msg3a *m_msg3aPtrs[1];
+};
+
+TEST_F(Msg40Test, NeedMoreDocIds) {
+	EXPECT_TRUE(m_msg40.needMoreDocIds(5));
+	EXPECT_FALSE(m_msg40.needMoreDocIds(11));
+
+	m_msg40.m_msg3a.m_moreDocIdsAvail = false;
+	EXPECT_FALSE(m_msg40.needMoreDocIds(5));
+}
+
+TEST_F(Msg40Test, DegradedQueryColdSummaryCache) {
+	// . every summary missed the cache and became CR_ERROR_SUMMARY
+	// . a degraded query shows the short page instead of getting more docids
+	m_msg40.m_degraded = true;
+	EXPECT_FALSE(m_msg40.needMoreDocIds(0));
+
+	m_msg40.m_degraded = false;
+	EXPECT_TRUE(m_msg40.needMoreDocIds(0));
+}
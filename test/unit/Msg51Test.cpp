@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include "Msg51.h"
+#include "Simhashdb.h"
+#include "Conf.h"
+
+static const uint64_t s_simHash1 = 0x0123456789abcdefULL;
+// 2 bits from s_simHash1
+static const uint64_t s_simHash1b = s_simHash1 ^ 0x0000000000010001ULL;
+// far away from s_simHash1
+static const uint64_t s_simHash2 = ~s_simHash1;
+
+TEST(Msg51Test, NearDupLevelsScoreOrder) {
+	int64_t docIds[]          = { 1, 2, 3, 4 };
+	uint64_t simHashes[]      = { s_simHash1, s_simHash2, s_simHash1b, s_simHash1 };
+	char clusterLevels[]      = { CR_OK, CR_OK, CR_OK, CR_OK };
+
+	ASSERT_TRUE(setNearDupLevels(simHashes, docIds, 4, 3, false, clusterLevels));
+
+	// the highest scoring one stays, the later near-duplicates go
+	EXPECT_EQ(CR_OK, clusterLevels[0]);
+	EXPECT_EQ(CR_OK, clusterLevels[1]);
+	EXPECT_EQ(CR_DUP_CONTENT, clusterLevels[2]);
+	EXPECT_EQ(CR_DUP_CONTENT, clusterLevels[3]);
+}
+
+TEST(Msg51Test, NearDupLevelsMaxDistance) {
+	int64_t docIds[]          = { 1, 2 };
+	uint64_t simHashes[]      = { s_simHash1, s_simHash1b };
+	char clusterLevels[]      = { CR_OK, CR_OK };
+
+	// 2 bits differ
+	ASSERT_TRUE(setNearDupLevels(simHashes, docIds, 2, 1, false, clusterLevels));
+	EXPECT_EQ(CR_OK, clusterLevels[1]);
+
+	// turned off
+	ASSERT_TRUE(setNearDupLevels(simHashes, docIds, 2, -1, false, clusterLevels));
+	EXPECT_EQ(CR_OK, clusterLevels[1]);
+}
+
+TEST(Msg51Test, NearDupLevelsOnlyVisible) {
+	int64_t docIds[]          = { 1, 2, 3, 4 };
+	uint64_t simHashes[]      = { s_simHash1, s_simHash1b, s_simHash2, s_simHash2 };
+	char clusterLevels[]      = { CR_CLUSTERED, CR_OK, CR_DIRTY, CR_OK };
+
+	ASSERT_TRUE(setNearDupLevels(simHashes, docIds, 4, 3, false, clusterLevels));
+
+	// results that are not visible are left alone and nothing is a
+	// near-duplicate of them
+	EXPECT_EQ(CR_CLUSTERED, clusterLevels[0]);
+	EXPECT_EQ(CR_OK, clusterLevels[1]);
+	EXPECT_EQ(CR_DIRTY, clusterLevels[2]);
+	EXPECT_EQ(CR_OK, clusterLevels[3]);
+}
+
+TEST(Msg51Test, NearDupLevelsNoSimHash) {
+	int64_t docIds[]          = { 1, 2, 3, 4 };
+	uint64_t simHashes[]      = { 0, 0, s_simHash1, 0 };
+	char clusterLevels[]      = { CR_OK, CR_OK, CR_OK, CR_OK };
+
+	ASSERT_TRUE(setNearDupLevels(simHashes, docIds, 4, 3, false, clusterLevels));
+
+	// 0 means no simhash, those are never near-duplicates
+	EXPECT_EQ(CR_OK, clusterLevels[0]);
+	EXPECT_EQ(CR_OK, clusterLevels[1]);
+	EXPECT_EQ(CR_OK, clusterLevels[2]);
+	EXPECT_EQ(CR_OK, clusterLevels[3]);
+}
+
+static void makeSimHashList(RdbList *list, int64_t docId, bool isDelKey, uint64_t simHash) {
+	list->set(nullptr, 0, nullptr, 0, 8, true, false, sizeof(key96_t));
+	key96_t k = Simhashdb::makeKey(docId, isDelKey);
+	list->addRecord((const char *)&k, isDelKey ? 0 : 8, (const char *)&simHash);
+}
+
+TEST(Msg51Test, SimHashFromList) {
+	RdbList list;
+	makeSimHashList(&list, 1000, false, s_simHash1);
+	EXPECT_EQ(s_simHash1, Msg51::getSimHashFromList(1000, &list));
+
+	// rec of another docid
+	EXPECT_EQ(0U, Msg51::getSimHashFromList(1001, &list));
+
+	// deleted
+	RdbList delList;
+	makeSimHashList(&delList, 1000, true, s_simHash1);
+	EXPECT_EQ(0U, Msg51::getSimHashFromList(1000, &delList));
+
+	// not found
+	RdbList emptyList;
+	emptyList.set(nullptr, 0, nullptr, 0, 8, true, false, sizeof(key96_t));
+	EXPECT_EQ(0U, Msg51::getSimHashFromList(1000, &emptyList));
+}
+
+TEST(Msg51Test, QuickCacheWithSimHash) {
+	key96_t clusterRec = Clusterdb::makeClusterRecKey(2000, false, 0, 0x1234, false);
+	Msg51::addToQuickCache(0, 2000, &clusterRec, s_simHash1, true);
+
+	key96_t cachedRec;
+	uint64_t cachedSimHash = 0;
+	ASSERT_TRUE(Msg51::getFromQuickCache(0, 2000, true, &cachedRec, &cachedSimHash));
+	EXPECT_EQ(clusterRec, cachedRec);
+	EXPECT_EQ(s_simHash1, cachedSimHash);
+
+	// also without asking for the simhash
+	ASSERT_TRUE(Msg51::getFromQuickCache(0, 2000, false, &cachedRec, NULL));
+	EXPECT_EQ(clusterRec, cachedRec);
+
+	// looked up in simhashdb, but the docid has none
+	Msg51::addToQuickCache(0, 2001, &clusterRec, 0, true);
+	cachedSimHash = s_simHash2;
+	ASSERT_TRUE(Msg51::getFromQuickCache(0, 2001, true, &cachedRec, &cachedSimHash));
+	EXPECT_EQ(0U, cachedSimHash);
+}
+
+TEST(Msg51Test, QuickCacheWithoutSimHash) {
+	key96_t clusterRec = Clusterdb::makeClusterRecKey(3000, false, 0, 0x5678, false);
+	Msg51::addToQuickCache(0, 3000, &clusterRec, 0, false);
+
+	// the cluster rec is there
+	key96_t cachedRec;
+	ASSERT_TRUE(Msg51::getFromQuickCache(0, 3000, false, &cachedRec, NULL));
+	EXPECT_EQ(clusterRec, cachedRec);
+
+	// but simhashdb has to be looked up for dup content removal
+	uint64_t cachedSimHash = 0;
+	EXPECT_FALSE(Msg51::getFromQuickCache(0, 3000, true, &cachedRec, &cachedSimHash));
+
+	// until it is cached with the simhash
+	Msg51::addToQuickCache(0, 3000, &clusterRec, s_simHash2, true);
+	ASSERT_TRUE(Msg51::getFromQuickCache(0, 3000, true, &cachedRec, &cachedSimHash));
+	EXPECT_EQ(s_simHash2, cachedSimHash);
+
+	// other collection
+	EXPECT_FALSE(Msg51::getFromQuickCache(1, 3000, false, &cachedRec, NULL));
+}
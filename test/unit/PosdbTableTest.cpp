@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include "PosdbTable.h"
+#include "Posdb.h"
+#include "Msg2.h"
+#include "Msg39.h"
+#include "Query.h"
+#include "TopTree.h"
+#include "DocumentIndexChecker.h"
+#include "GigablastTestUtils.h"
+#include "Conf.h"
+#include "Errno.h"
+#include <vector>
+
+class PosdbTableTest : public ::testing::Test {
+protected:
+	void SetUp() {
+		GbTest::initializeRdbs();
+		m_rdb = g_posdb.getRdb();
+	}
+
+	void TearDown() {
+		GbTest::resetRdbs();
+	}
+
+	Rdb *m_rdb;
+};
+
+struct TopResult {
+	int64_t m_docId;
+	float   m_score;
+};
+
+static void dumpPosdb() {
+	g_posdb.getRdb()->submitRdbDumpJob(true);
+	while (g_posdb.getRdb()->hasPendingRdbDumpJob()) {
+		usleep(100000); //sleep 100ms
+	}
+	g_posdb.getRdb()->getBase(0)->markNewFileReadable();
+	g_posdb.getRdb()->getBase(0)->generateGlobalIndex();
+}
+
+// . both words in every doc. the distance between them only depends on
+//   docId%5 so there are many docs with the same score
+static void addDocs(Rdb *rdb, const Query &q, int64_t firstDocId, int64_t lastDocId) {
+	for (int64_t docId = firstDocId; docId <= lastDocId; docId++) {
+		int32_t wordPos = 2;
+		for (int32_t i = 0; i < q.getNumTerms(); i++) {
+			if (q.isPhrase(i)) {
+				continue;
+			}
+			GbTest::addPosdbKey(rdb, q.getTermId(i), docId, wordPos);
+			wordPos += 2 + 4 * (docId % 5);
+		}
+	}
+}
+
+// intersect every posdb file and then the buckets into one top tree, like Msg39::controlLoop()
+static void getTopResults(Query *q, bool doMaxScoreAlgo, std::vector<TopResult> *results) {
+	Msg39Request req;
+	req.m_collnum = 0;
+	req.m_docsToGet = 10;
+	req.m_doSiteClustering = false;
+	req.m_getDocIdScoringInfo = false;
+	req.m_doMaxScoreAlgo = doMaxScoreAlgo;
+	req.m_baseScoringParameters = g_conf.m_baseScoringParameters;
+
+	RdbBase *base = g_posdb.getRdb()->getBase(0);
+	DocumentIndexChecker documentIndexChecker(base);
+	TopTree topTree;
+
+	int32_t numFiles = base->getNumFiles();
+	for (int32_t fileNum = 0; fileNum < numFiles + 1; fileNum++) {
+		std::vector<RdbList> lists(q->getNumTerms());
+		Msg2 msg2;
+		ASSERT_TRUE(msg2.getLists(0, false, q->m_qterms, q->getNumTerms(), NULL, fileNum < numFiles ? fileNum : -1,
+		                          0, MAX_DOCID, &lists[0], NULL, NULL, false));
+
+		documentIndexChecker.setFileNum(fileNum);
+		PosdbTable posdbTable;
+		posdbTable.init(q, false, &topTree, documentIndexChecker, &msg2, &req);
+		posdbTable.intersectLists();
+		ASSERT_EQ(0, g_errno);
+	}
+
+	for (int32_t ti = topTree.getHighNode(); ti >= 0; ti = topTree.getPrev(ti)) {
+		const TopNode *t = topTree.getNode(ti);
+		results->push_back({t->m_docId, t->m_score});
+	}
+}
+
+TEST_F(PosdbTableTest, MinWinningScoreKeepsRanking) {
+	Query q;
+	ASSERT_TRUE(q.set("alpha beta", langEnglish, 1.0, 1.0, nullptr, false, true, ABS_MAX_QUERY_TERMS));
+	for (int32_t i = 0; i < q.getNumTerms(); i++) {
+		q.m_qterms[i].m_termFreqWeight = 1.0;
+	}
+
+	// . the file is intersected first and fills the top tree
+	// . the buckets have lower docids with the same scores, which win
+	//   the ties, so a docid scoring the same as the lowest result in
+	//   the top tree must not be skipped
+	addDocs(m_rdb, q, 101, 200);
+	dumpPosdb();
+	addDocs(m_rdb, q, 1, 100);
+	m_rdb->getBase(0)->generateGlobalIndex();
+
+	std::vector<TopResult> withPrefilter;
+	getTopResults(&q, true, &withPrefilter);
+
+	std::vector<TopResult> withoutPrefilter;
+	getTopResults(&q, false, &withoutPrefilter);
+
+	ASSERT_EQ(10U, withoutPrefilter.size());
+	ASSERT_EQ(withoutPrefilter.size(), withPrefilter.size());
+	for (size_t i = 0; i < withoutPrefilter.size(); i++) {
+		EXPECT_EQ(withoutPrefilter[i].m_docId, withPrefilter[i].m_docId);
+		EXPECT_EQ(withoutPrefilter[i].m_score, withPrefilter[i].m_score);
+	}
+
+	// the ties went to the buckets
+	EXPECT_LE(withoutPrefilter.back().m_docId, 100);
+}
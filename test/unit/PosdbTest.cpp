@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <Msg5.h>
+#include <Msg3.h>
 #include "Posdb.h"
 #include "GigablastTestUtils.h"
 #include "Conf.h"
@@ -539,4 +540,49 @@ TEST_F(PosdbNoMergeTest, SingleDocSpiderDumpDeleteDumpSpiderMerging) {
 	expectRecord(&list, 'y', docId, false, true);
 
 	EXPECT_TRUE(list.isExhausted());
-}
\ No newline at end of file
+}
+
+TEST_F(PosdbNoMergeTest, Msg3ReadsTermListFromTermDict) {
+	// three termlists spanning several map pages
+	for (int64_t docId = 1; docId <= 50; docId++) {
+		GbTest::addPosdbKey(m_rdb, 'a', docId, 0);
+		GbTest::addPosdbKey(m_rdb, 'b', docId, 0);
+		GbTest::addPosdbKey(m_rdb, 'c', docId, 0);
+	}
+	dumpPosdb();
+
+	char startKey[MAX_KEY_BYTES];
+	char endKey[MAX_KEY_BYTES];
+	Posdb::makeStartKey(startKey, 'b');
+	Posdb::makeEndKey(endKey, 'b');
+
+	Msg3 msg3;
+	ASSERT_TRUE(msg3.readList(RDB_POSDB, 0, startKey, endKey, -1, 0, -1, NULL, NULL, 0, 0, -1, false));
+	ASSERT_EQ(1, msg3.getNumLists());
+
+	const RdbMap *map = m_rdb->getBase(0)->getMapById(msg3.getFileId(0));
+	ASSERT_TRUE(map->hasTermDict());
+	const RdbMapTermDictEntry *e = map->getTermDictEntry('b');
+	ASSERT_TRUE(e != NULL);
+
+	// exactly the termlist is read, not the pages around it
+	RdbList *list = msg3.getList(0);
+	EXPECT_EQ(e->m_size, list->getListSize());
+	int32_t numRecs = 0;
+	for (list->resetListPtr(); !list->isExhausted(); list->skipCurrentRecord()) {
+		char key[MAX_KEY_BYTES];
+		list->getCurrentKey(key);
+		EXPECT_EQ('b', Posdb::getTermId(key));
+		numRecs++;
+	}
+	EXPECT_EQ(50, numRecs);
+
+	// a term that is not in the file is not read at all
+	Posdb::makeStartKey(startKey, 'd');
+	Posdb::makeEndKey(endKey, 'd');
+
+	Msg3 msg3b;
+	ASSERT_TRUE(msg3b.readList(RDB_POSDB, 0, startKey, endKey, -1, 0, -1, NULL, NULL, 0, 0, -1, false));
+	ASSERT_EQ(1, msg3b.getNumLists());
+	EXPECT_TRUE(msg3b.getList(0)->isEmpty());
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include "QueryAdmission.h"
+#include "Conf.h"
+
+class QueryAdmissionTest : public ::testing::Test {
+protected:
+	void SetUp() {
+		m_savedEnabled = g_conf.m_queryAdmissionControl;
+		m_savedPercent = g_conf.m_queryDegradePercent;
+		m_savedTimeout = g_conf.m_msg40_msg39_timeout;
+		g_conf.m_queryAdmissionControl = true;
+		g_conf.m_queryDegradePercent = 50;
+		g_conf.m_msg40_msg39_timeout = 1000;
+	}
+	void TearDown() {
+		g_conf.m_queryAdmissionControl = m_savedEnabled;
+		g_conf.m_queryDegradePercent = m_savedPercent;
+		g_conf.m_msg40_msg39_timeout = m_savedTimeout;
+	}
+
+	bool m_savedEnabled;
+	int32_t m_savedPercent;
+	int64_t m_savedTimeout;
+};
+
+TEST_F(QueryAdmissionTest, AdmitsWhenIdle) {
+	QueryAdmission qa;
+	EXPECT_EQ(0, qa.getPredictedMS());
+	EXPECT_EQ(query_admit, qa.admit(qadmit_msg40, 0, 0));
+	EXPECT_EQ(query_admit, qa.admit(qadmit_msg39, 200, 0));
+	EXPECT_EQ(1U, qa.getCounter(qadmit_msg40, query_admit)->get());
+	EXPECT_EQ(1U, qa.getCounter(qadmit_msg39, query_admit)->get());
+}
+
+TEST_F(QueryAdmissionTest, DegradesThenSheds) {
+	QueryAdmission qa;
+	// converge on ~600ms of queueing
+	for(int i = 0; i < 1000; i++)
+		qa.addJobQueueTime(600000);
+	EXPECT_NEAR(600, qa.getPredictedMS(), 1);
+
+	EXPECT_EQ(query_degrade, qa.admit(qadmit_msg40, 1000, 0));
+	EXPECT_EQ(query_shed, qa.admit(qadmit_msg40, 500, 0));
+	// low priority queries get half the budget
+	EXPECT_EQ(query_shed, qa.admit(qadmit_msg39, 1000, 1));
+	// generous budget
+	EXPECT_EQ(query_admit, qa.admit(qadmit_msg39, 5000, 0));
+
+	EXPECT_EQ(1U, qa.getCounter(qadmit_msg40, query_degrade)->get());
+	EXPECT_EQ(1U, qa.getCounter(qadmit_msg40, query_shed)->get());
+	EXPECT_EQ(1U, qa.getCounter(qadmit_msg39, query_shed)->get());
+	EXPECT_EQ(1U, qa.getCounter(qadmit_msg39, query_admit)->get());
+}
+
+TEST_F(QueryAdmissionTest, ServiceTimeAddsUp) {
+	QueryAdmission qa;
+	for(int i = 0; i < 1000; i++) {
+		qa.addJobQueueTime(300000);
+		qa.addServiceTime(900000);
+	}
+	EXPECT_NEAR(1200, qa.getPredictedMS(), 2);
+	// default budget is the msg40->msg39 timeout
+	EXPECT_EQ(query_shed, qa.admit(qadmit_msg40, 0, 0));
+}
+
+TEST_F(QueryAdmissionTest, Disabled) {
+	g_conf.m_queryAdmissionControl = false;
+	QueryAdmission qa;
+	for(int i = 0; i < 1000; i++)
+		qa.addJobQueueTime(10000000);
+	EXPECT_EQ(query_admit, qa.admit(qadmit_msg40, 100, 1));
+}
+
+TEST_F(QueryAdmissionTest, QueryJobs) {
+	EXPECT_TRUE(QueryAdmission::isQueryJob(thread_type_query_intersect));
+	EXPECT_TRUE(QueryAdmission::isQueryJob(thread_type_query_summary));
+	EXPECT_FALSE(QueryAdmission::isQueryJob(thread_type_spider_read));
+	EXPECT_FALSE(QueryAdmission::isQueryJob(thread_type_file_merge));
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include "QueryTrace.h"
+
+TEST(QueryTraceTest, HistogramBuckets) {
+	// every value falls in the bucket whose bounds surround it
+	for (uint64_t us : {0ULL, 1ULL, 7ULL, 8ULL, 9ULL, 15ULL, 16ULL, 17ULL, 100ULL, 1000ULL, 123456ULL, 1ULL << 30}) {
+		int32_t b = LatencyHistogram::getBucket(us);
+		EXPECT_LE(LatencyHistogram::getBucketLowerBound(b), us);
+		EXPECT_GT(LatencyHistogram::getBucketLowerBound(b + 1), us);
+	}
+
+	// buckets are at most 12.5% wide
+	for (int32_t b = 8; b + 1 < LatencyHistogram::s_numBuckets; b++) {
+		uint64_t lo = LatencyHistogram::getBucketLowerBound(b);
+		uint64_t hi = LatencyHistogram::getBucketLowerBound(b + 1);
+		EXPECT_GT(hi, lo);
+		EXPECT_LE((hi - lo) * 8, lo);
+	}
+
+	// huge values go in the last bucket
+	EXPECT_EQ(LatencyHistogram::s_numBuckets - 1, LatencyHistogram::getBucket(~0ULL));
+}
+
+TEST(QueryTraceTest, HistogramPercentiles) {
+	LatencyHistogram h;
+	EXPECT_EQ(0U, h.getPercentile(50));
+
+	for (uint64_t us = 1; us <= 10000; us++) {
+		h.add(us);
+	}
+	EXPECT_EQ(10000U, h.getCount());
+	EXPECT_EQ(10000U, h.getMax());
+	EXPECT_EQ(10000ULL * 10001 / 2, h.getSum());
+
+	uint64_t p50 = h.getPercentile(50);
+	EXPECT_GE(p50, 5000U);
+	EXPECT_LE(p50, 5000U * 9 / 8);
+	uint64_t p99 = h.getPercentile(99);
+	EXPECT_GE(p99, 9900U);
+	EXPECT_LE(p99, 10000U);
+	EXPECT_EQ(10000U, h.getPercentile(100));
+
+	h.reset();
+	EXPECT_EQ(0U, h.getCount());
+	EXPECT_EQ(0U, h.getMax());
+}
+
+TEST(QueryTraceTest, RemoteStageTimes) {
+	QueryTrace trace;
+	trace.start("hello world");
+	EXPECT_TRUE(trace.isStarted());
+
+	uint32_t shard1[qstage_end] = {};
+	shard1[qstage_msg39_total] = 5000;
+	shard1[qstage_msg39_lists] = 4000;
+	uint32_t shard2[qstage_end] = {};
+	shard2[qstage_msg39_total] = 3000;
+	shard2[qstage_msg39_intersect] = 2500;
+
+	trace.addRemoteStageTimes(shard1, 1);
+	trace.addRemoteStageTimes(shard2, 2);
+	EXPECT_EQ(1, trace.m_slowestHostId);
+	EXPECT_EQ(5000U, trace.getStageTime(qstage_msg39_total));
+	EXPECT_EQ(4000U, trace.getStageTime(qstage_msg39_lists));
+	EXPECT_EQ(2500U, trace.getStageTime(qstage_msg39_intersect));
+
+	// local stages add up over re-calls
+	trace.addStageTime(qstage_msg20_summaries, 100);
+	trace.addStageTime(qstage_msg20_summaries, 50);
+	EXPECT_EQ(150U, trace.getStageTime(qstage_msg20_summaries));
+}
@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+#include "RdbMap.h"
+#include "Posdb.h"
+#include "Lang.h"
+
+static const char* makePosdbKey(char *key, int64_t termId, uint64_t docId, int32_t wordPos, char siteRank, bool isDelKey) {
+	Posdb::makeKey(key, termId, docId, wordPos, 0, 0, 0, siteRank, 0, langUnknown, 0, false, isDelKey, false);
+	return key;
+}
+
+static void makePosdbList(RdbList *list) {
+	char key[MAX_KEY_BYTES];
+	list->set(nullptr, 0, nullptr, 0, Posdb::getFixedDataSize(), true, Posdb::getUseHalfKeys(), Posdb::getKeySize());
+	list->addRecord(makePosdbKey(key, 0x01, 0x01, 0x01, 2, false), 0, nullptr);
+	list->addRecord(makePosdbKey(key, 0x01, 0x01, 0x02, 2, false), 0, nullptr);
+	list->addRecord(makePosdbKey(key, 0x01, 0x02, 0x01, 5, false), 0, nullptr);
+	list->addRecord(makePosdbKey(key, 0x01, 0x03, 0x01, 9, true), 0, nullptr);
+	list->addRecord(makePosdbKey(key, 0x03, 0x01, 0x01, 1, false), 0, nullptr);
+	list->addRecord(makePosdbKey(key, 0x03, 0x02, 0x01, 1, false), 0, nullptr);
+	list->addRecord(makePosdbKey(key, 0x03, 0x02, 0x05, 1, false), 0, nullptr);
+	list->resetListPtr();
+}
+
+static void checkTermDict(const RdbMap &map, int64_t listSize) {
+	ASSERT_TRUE(map.hasTermDict());
+	EXPECT_EQ(2, map.getNumTermDictEntries());
+
+	// full key, 6 byte key, 12 byte key, 12 byte negative key
+	const RdbMapTermDictEntry *e1 = map.getTermDictEntry(0x01);
+	ASSERT_TRUE(e1 != NULL);
+	EXPECT_EQ(0, e1->m_offset);
+	EXPECT_EQ(18 + 6 + 12 + 12, e1->m_size);
+	EXPECT_EQ(2, e1->m_numDocs);
+	EXPECT_EQ(5, e1->m_maxSiteRank);
+
+	const RdbMapTermDictEntry *e3 = map.getTermDictEntry(0x03);
+	ASSERT_TRUE(e3 != NULL);
+	EXPECT_EQ(e1->m_size, e3->m_offset);
+	EXPECT_EQ(listSize, e3->m_offset + e3->m_size);
+	EXPECT_EQ(2, e3->m_numDocs);
+	EXPECT_EQ(1, e3->m_maxSiteRank);
+
+	EXPECT_TRUE(map.getTermDictEntry(0x02) == NULL);
+	EXPECT_TRUE(map.getTermDictEntry(0x04) == NULL);
+}
+
+TEST(RdbMapTest, PosdbTermDict) {
+	RdbList list;
+	makePosdbList(&list);
+
+	RdbMap map;
+	map.set(".", "posdbtest0001.map", Posdb::getFixedDataSize(), Posdb::getUseHalfKeys(), Posdb::getKeySize(), GB_INDEXDB_PAGE_SIZE);
+	map.setBuildTermDict();
+	ASSERT_TRUE(map.addList(&list));
+	checkTermDict(map, list.getListSize());
+
+	// survives a save and load
+	ASSERT_TRUE(map.writeMap(false));
+
+	RdbMap map2;
+	map2.set(".", "posdbtest0001.map", Posdb::getFixedDataSize(), Posdb::getUseHalfKeys(), Posdb::getKeySize(), GB_INDEXDB_PAGE_SIZE);
+	map2.setBuildTermDict();
+	ASSERT_TRUE(map2.readMap2());
+	checkTermDict(map2, list.getListSize());
+
+	// the loaded dictionary is mmap'd, not copied
+	EXPECT_EQ(2 * (int64_t)sizeof(RdbMapTermDictEntry), map2.getMemMapped());
+
+	// a resumed merge adds to it
+	char key[MAX_KEY_BYTES];
+	ASSERT_TRUE(map2.addRecord(const_cast<char*>(makePosdbKey(key, 0x05, 0x01, 0x01, 3, false)), nullptr, 18));
+	EXPECT_EQ(0, map2.getMemMapped());
+	EXPECT_EQ(3, map2.getNumTermDictEntries());
+	const RdbMapTermDictEntry *e5 = map2.getTermDictEntry(0x05);
+	ASSERT_TRUE(e5 != NULL);
+	EXPECT_EQ(list.getListSize(), e5->m_offset);
+	EXPECT_EQ(18, e5->m_size);
+	EXPECT_EQ(1, e5->m_numDocs);
+	ASSERT_TRUE(map2.getTermDictEntry(0x03) != NULL);
+	EXPECT_EQ(2, map2.getTermDictEntry(0x03)->m_numDocs);
+
+	map.unlink();
+}
+
+TEST(RdbMapTest, NoTermDict) {
+	RdbList list;
+	makePosdbList(&list);
+
+	// maps of other rdbs and maps saved without a dictionary have none
+	RdbMap map;
+	map.set(".", "posdbtest0003.map", Posdb::getFixedDataSize(), Posdb::getUseHalfKeys(), Posdb::getKeySize(), GB_INDEXDB_PAGE_SIZE);
+	ASSERT_TRUE(map.addList(&list));
+	EXPECT_FALSE(map.hasTermDict());
+	ASSERT_TRUE(map.writeMap(false));
+
+	RdbMap map2;
+	map2.set(".", "posdbtest0003.map", Posdb::getFixedDataSize(), Posdb::getUseHalfKeys(), Posdb::getKeySize(), GB_INDEXDB_PAGE_SIZE);
+	map2.setBuildTermDict();
+	ASSERT_TRUE(map2.readMap2());
+	EXPECT_FALSE(map2.hasTermDict());
+	EXPECT_TRUE(map2.getTermDictEntry(0x01) == NULL);
+
+	map.unlink();
+}
+
+TEST(RdbMapTest, WriteReadRoundTrip) {
+	// enough full keys for more than one segment of pages
+	RdbList list;
+	list.set(nullptr, 0, nullptr, 0, Posdb::getFixedDataSize(), true, Posdb::getUseHalfKeys(), Posdb::getKeySize());
+	char key[MAX_KEY_BYTES];
+	for (int64_t termId = 1; termId <= PAGES_PER_SEG * GB_INDEXDB_PAGE_SIZE / 18 + 1000; termId++) {
+		list.addRecord(makePosdbKey(key, termId, 0x01, 0x01, 1, (termId % 7) == 0), 0, nullptr);
+	}
+	list.resetListPtr();
+
+	RdbMap map;
+	map.set(".", "posdbtest0004.map", Posdb::getFixedDataSize(), Posdb::getUseHalfKeys(), Posdb::getKeySize(), GB_INDEXDB_PAGE_SIZE);
+	ASSERT_TRUE(map.addList(&list));
+	ASSERT_GT(map.getNumPages(), PAGES_PER_SEG);
+	ASSERT_TRUE(map.writeMap(false));
+
+	RdbMap map2;
+	map2.set(".", "posdbtest0004.map", Posdb::getFixedDataSize(), Posdb::getUseHalfKeys(), Posdb::getKeySize(), GB_INDEXDB_PAGE_SIZE);
+	ASSERT_TRUE(map2.readMap2());
+	EXPECT_TRUE(map2.isMemoryMapped());
+
+	EXPECT_EQ(map.getNumPages(), map2.getNumPages());
+	EXPECT_EQ(map.getFileSize(), map2.getFileSize());
+	EXPECT_EQ(map.getNumPositiveRecs(), map2.getNumPositiveRecs());
+	EXPECT_EQ(map.getNumNegativeRecs(), map2.getNumNegativeRecs());
+	for (int32_t page = 0; page <= map.getNumPages(); page++) {
+		EXPECT_EQ(0, KEYCMP(map.getKeyPtr(page), map2.getKeyPtr(page), Posdb::getKeySize())) << "page " << page;
+		if (page < map.getNumPages()) {
+			EXPECT_EQ(map.getOffset(page), map2.getOffset(page)) << "page " << page;
+		}
+	}
+
+	// the mapped keys are in order
+	EXPECT_TRUE(map2.verifyMap2());
+
+	map.unlink();
+}
+
+static void makeTermlists(RdbList *list, int64_t firstTermId, int64_t lastTermId) {
+	char key[MAX_KEY_BYTES];
+	list->set(nullptr, 0, nullptr, 0, Posdb::getFixedDataSize(), true, Posdb::getUseHalfKeys(), Posdb::getKeySize());
+	for (int64_t termId = firstTermId; termId <= lastTermId; termId++) {
+		for (uint64_t docId = 1; docId <= 3; docId++) {
+			for (int32_t wordPos = 1; wordPos <= 4; wordPos++) {
+				list->addRecord(makePosdbKey(key, termId, docId, wordPos, (char)docId, docId == 2 && wordPos == 4), 0, nullptr);
+			}
+		}
+	}
+	list->resetListPtr();
+}
+
+TEST(RdbMapTest, AddMap) {
+	// all termlists in one map
+	RdbMap whole;
+	whole.set(".", "posdbtest0005.map", Posdb::getFixedDataSize(), Posdb::getUseHalfKeys(), Posdb::getKeySize(), GB_INDEXDB_PAGE_SIZE);
+	whole.setBuildTermDict();
+	RdbList list1;
+	makeTermlists(&list1, 1, 1000);
+	ASSERT_TRUE(whole.addList(&list1));
+	RdbList list2;
+	makeTermlists(&list2, 1001, 3000);
+	ASSERT_TRUE(whole.addList(&list2));
+
+	// the first ones and a map of the rest made where they follow them
+	RdbMap map;
+	map.set(".", "posdbtest0006.map", Posdb::getFixedDataSize(), Posdb::getUseHalfKeys(), Posdb::getKeySize(), GB_INDEXDB_PAGE_SIZE);
+	map.setBuildTermDict();
+	makeTermlists(&list1, 1, 1000);
+	ASSERT_TRUE(map.addList(&list1));
+	ASSERT_NE(0, map.getFileSize() % GB_INDEXDB_PAGE_SIZE);
+
+	RdbMap rest;
+	rest.set(".", "posdbtest0007.map", Posdb::getFixedDataSize(), Posdb::getUseHalfKeys(), Posdb::getKeySize(), GB_INDEXDB_PAGE_SIZE);
+	rest.setBuildTermDict();
+	rest.setFirstPageOffset(map.getFileSize() % GB_INDEXDB_PAGE_SIZE);
+	makeTermlists(&list2, 1001, 3000);
+	ASSERT_TRUE(rest.addList(&list2));
+
+	ASSERT_TRUE(map.addMap(&rest));
+
+	EXPECT_EQ(whole.getNumPages(), map.getNumPages());
+	EXPECT_EQ(whole.getFileSize(), map.getFileSize());
+	EXPECT_EQ(whole.getNumPositiveRecs(), map.getNumPositiveRecs());
+	EXPECT_EQ(whole.getNumNegativeRecs(), map.getNumNegativeRecs());
+	for (int32_t page = 0; page <= whole.getNumPages(); page++) {
+		EXPECT_EQ(0, KEYCMP(whole.getKeyPtr(page), map.getKeyPtr(page), Posdb::getKeySize())) << "page " << page;
+		if (page < whole.getNumPages()) {
+			EXPECT_EQ(whole.getOffset(page), map.getOffset(page)) << "page " << page;
+		}
+	}
+
+	ASSERT_TRUE(map.hasTermDict());
+	ASSERT_EQ(whole.getNumTermDictEntries(), map.getNumTermDictEntries());
+	for (int64_t termId = 1; termId <= 3000; termId++) {
+		const RdbMapTermDictEntry *e1 = whole.getTermDictEntry(termId);
+		const RdbMapTermDictEntry *e2 = map.getTermDictEntry(termId);
+		ASSERT_TRUE(e1 != NULL && e2 != NULL);
+		EXPECT_EQ(e1->m_offset, e2->m_offset) << "termId " << termId;
+		EXPECT_EQ(e1->m_size, e2->m_size) << "termId " << termId;
+		EXPECT_EQ(e1->m_numDocs, e2->m_numDocs) << "termId " << termId;
+		EXPECT_EQ(e1->m_maxSiteRank, e2->m_maxSiteRank) << "termId " << termId;
+	}
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include "SamplingProfiler.h"
+#include "JobScheduler.h"
+#include "SafeBuf.h"
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+static void sigprofHandler(int, siginfo_t *, void *context) {
+	g_samplingProfiler.takeSample(context);
+}
+
+static volatile uint64_t s_sink;
+
+static void burnCpu(int64_t ms) {
+	struct timespec start, now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+	do {
+		for(int i = 0; i < 100000; i++)
+			s_sink = s_sink * 31 + i;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	} while((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 < ms);
+}
+
+TEST(SamplingProfilerTest, TagsAndFoldsSamples) {
+	struct sigaction sa, old;
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sa.sa_sigaction = sigprofHandler;
+	ASSERT_EQ(0, sigaction(SIGPROF, &sa, &old));
+
+	g_samplingProfiler.clear();
+	ASSERT_TRUE(g_samplingProfiler.start(1000));
+	EXPECT_TRUE(g_samplingProfiler.isRunning());
+
+	int32_t oldThreadType = SamplingProfiler::setThreadType(thread_type_query_intersect);
+	int32_t oldMsgType = SamplingProfiler::setMsgType(0x39);
+	EXPECT_EQ(-1, oldThreadType);
+	EXPECT_EQ(-1, oldMsgType);
+	burnCpu(200);
+	SamplingProfiler::setMsgType(oldMsgType);
+	SamplingProfiler::setThreadType(oldThreadType);
+
+	g_samplingProfiler.stop();
+	EXPECT_FALSE(g_samplingProfiler.isRunning());
+	sigaction(SIGPROF, &old, NULL);
+
+	uint64_t numSamples = g_samplingProfiler.getNumSamples();
+	EXPECT_GT(numSamples, 0U);
+	EXPECT_EQ(1, g_samplingProfiler.getNumThreads());
+
+	SafeBuf sb;
+	ASSERT_TRUE(g_samplingProfiler.getFoldedStacks(&sb, false));
+	sb.nullTerm();
+
+	// every line is "tags;frames count" and the counts add up
+	uint64_t total = 0;
+	uint64_t tagged = 0;
+	for(char *line = sb.getBufStart(); line && *line; ) {
+		char *nl = strchr(line, '\n');
+		ASSERT_TRUE(nl != NULL);
+		*nl = '\0';
+		char *sp = strrchr(line, ' ');
+		ASSERT_TRUE(sp != NULL);
+		uint64_t count = strtoull(sp + 1, NULL, 10);
+		EXPECT_GT(count, 0U);
+		total += count;
+		if(strncmp(line, "query-intersect;msg0x39;0x", 26) == 0)
+			tagged += count;
+		line = nl + 1;
+	}
+	EXPECT_EQ(numSamples, total);
+	EXPECT_GT(tagged, 0U);
+
+	g_samplingProfiler.clear();
+	EXPECT_EQ(0U, g_samplingProfiler.getNumSamples());
+	EXPECT_EQ(0, g_samplingProfiler.getNumThreads());
+}
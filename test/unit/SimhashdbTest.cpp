@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include "Simhashdb.h"
+#include <vector>
+
+static uint64_t mix(uint64_t x) {
+	// splitmix64 finalizer, good enough as a feature hash
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static std::vector<uint64_t> makeFeatures(uint64_t first, int32_t count) {
+	std::vector<uint64_t> v;
+	for(int32_t i = 0; i < count; i++)
+		v.push_back(mix(first + i));
+	return v;
+}
+
+TEST(SimhashdbTest, Key) {
+	int64_t docId = 0x2a5b3c4d5eLL;
+	key96_t k = Simhashdb::makeKey(docId, false);
+	EXPECT_EQ(docId, Simhashdb::getDocId(&k));
+	EXPECT_EQ(1U, k.n0 & 0x01);
+
+	key96_t sk = Simhashdb::makeFirstKey(docId);
+	key96_t ek = Simhashdb::makeLastKey(docId);
+	EXPECT_EQ(docId, Simhashdb::getDocId(&sk));
+	EXPECT_EQ(0U, sk.n0 & 0x01);
+	EXPECT_TRUE(sk < ek);
+
+	// next docid sorts after
+	key96_t k2 = Simhashdb::makeFirstKey(docId + 1);
+	EXPECT_TRUE(ek < k2);
+}
+
+TEST(SimhashdbTest, Empty) {
+	EXPECT_EQ(0U, Simhashdb::computeSimHash(NULL, 0));
+	EXPECT_FALSE(Simhashdb::isNearDup(0, 0, 3));
+	EXPECT_FALSE(Simhashdb::isNearDup(0, 1, 3));
+}
+
+TEST(SimhashdbTest, NearDuplicates) {
+	std::vector<uint64_t> a = makeFeatures(1000, 500);
+	uint64_t ha = Simhashdb::computeSimHash(a.data(), a.size());
+	EXPECT_NE(0U, ha);
+
+	// same features in another order
+	std::vector<uint64_t> b(a.rbegin(), a.rend());
+	EXPECT_EQ(ha, Simhashdb::computeSimHash(b.data(), b.size()));
+
+	// a few changed features move a few bits at most
+	std::vector<uint64_t> c = a;
+	c[10] = mix(99999);
+	c[200] = mix(99998);
+	uint64_t hc = Simhashdb::computeSimHash(c.data(), c.size());
+	EXPECT_LE(Simhashdb::getDistance(ha, hc), 3);
+	EXPECT_TRUE(Simhashdb::isNearDup(ha, hc, 3));
+
+	// different content is far away
+	std::vector<uint64_t> d = makeFeatures(50000, 500);
+	uint64_t hd = Simhashdb::computeSimHash(d.data(), d.size());
+	EXPECT_GT(Simhashdb::getDistance(ha, hd), 10);
+	EXPECT_FALSE(Simhashdb::isNearDup(ha, hd, 3));
+
+	// a negative distance turns it off
+	EXPECT_FALSE(Simhashdb::isNearDup(ha, ha, -1));
+}
+
+TEST(SimhashdbTest, NearDupOfAny) {
+	uint64_t hashes[] = { 0xff00ff00ff00ff00ULL, 0x0123456789abcdefULL };
+	EXPECT_TRUE(Simhashdb::isNearDupOfAny(0x0123456789abcdeeULL, hashes, 2, 3));
+	EXPECT_TRUE(Simhashdb::isNearDupOfAny(0xff00ff00ff00ff07ULL, hashes, 2, 3));
+	EXPECT_FALSE(Simhashdb::isNearDupOfAny(0xff00ff00ff00ff0fULL, hashes, 2, 3));
+	EXPECT_FALSE(Simhashdb::isNearDupOfAny(0x0123456789abcdefULL, hashes, 1, 3));
+	EXPECT_FALSE(Simhashdb::isNearDupOfAny(0, hashes, 2, 3));
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include "SpiderFrontier.h"
+#include "Spider.h"
+#include "Doledb.h"
+#include "RdbList.h"
+#include <unistd.h>
+
+static void makeRequest(SpiderRequest *sreq, int32_t firstIp, const char *url) {
+	sreq->reset();
+	strcpy(sreq->m_url, url);
+	sreq->setKey(firstIp, 0, false);
+	sreq->setDataSize();
+}
+
+static int32_t getListIps(const SpiderFrontier &frontier, int32_t *ips, int32_t maxIps) {
+	key96_t startKey = Doledb::makeFirstKey2(MAX_SPIDER_PRIORITIES - 1);
+	key96_t endKey;
+	endKey.setMax();
+
+	RdbList list;
+	frontier.getList(startKey, endKey, 1000000, &list);
+
+	int32_t n = 0;
+	for (list.resetListPtr(); !list.isExhausted() && n < maxIps; list.skipCurrentRecord()) {
+		EXPECT_GT(list.getCurrentRecSize(), 16);
+		const SpiderRequest *sreq = (const SpiderRequest *)(list.getCurrentRec() + sizeof(key96_t) + 4);
+		ips[n++] = sreq->m_firstIp;
+	}
+	return n;
+}
+
+TEST(SpiderFrontierTest, ReadyOrder) {
+	SpiderFrontier frontier;
+	SpiderRequest sreq;
+
+	// higher priority sorts first, then earlier spider time
+	makeRequest(&sreq, 1, "http://www.example.com/1");
+	key96_t k1 = Doledb::makeKey(10, 2000, 1, false);
+	ASSERT_TRUE(frontier.addRequest(k1, &sreq));
+
+	makeRequest(&sreq, 2, "http://www.example.com/2");
+	key96_t k2 = Doledb::makeKey(20, 3000, 2, false);
+	ASSERT_TRUE(frontier.addRequest(k2, &sreq));
+
+	makeRequest(&sreq, 3, "http://www.example.com/3");
+	key96_t k3 = Doledb::makeKey(10, 1000, 3, false);
+	ASSERT_TRUE(frontier.addRequest(k3, &sreq));
+
+	// only the head of each ip queue is ready
+	makeRequest(&sreq, 3, "http://www.example.com/4");
+	key96_t k4 = Doledb::makeKey(10, 1500, 4, false);
+	ASSERT_TRUE(frontier.addRequest(k4, &sreq));
+
+	EXPECT_EQ(4, frontier.getNumRequests());
+	EXPECT_EQ(3, frontier.getNumIps());
+
+	int32_t ips[10];
+	ASSERT_EQ(3, getListIps(frontier, ips, 10));
+	EXPECT_EQ(2, ips[0]);
+	EXPECT_EQ(3, ips[1]);
+	EXPECT_EQ(1, ips[2]);
+
+	// removing the head of ip 3 makes its next request ready
+	EXPECT_FALSE(frontier.removeRequest(k4, 1));
+	EXPECT_TRUE(frontier.removeRequest(k3, 3));
+	EXPECT_FALSE(frontier.removeRequest(k3, 3));
+	ASSERT_EQ(3, getListIps(frontier, ips, 10));
+	EXPECT_EQ(2, ips[0]);
+	EXPECT_EQ(1, ips[1]);
+	EXPECT_EQ(3, ips[2]);
+
+	frontier.clear();
+	EXPECT_EQ(0, frontier.getNumRequests());
+	EXPECT_EQ(0, getListIps(frontier, ips, 10));
+}
+
+TEST(SpiderFrontierTest, SaveLoad) {
+	SpiderFrontier frontier;
+	SpiderRequest sreq;
+
+	makeRequest(&sreq, 1, "http://www.example.com/1");
+	ASSERT_TRUE(frontier.addRequest(Doledb::makeKey(10, 2000, 1, false), &sreq));
+	makeRequest(&sreq, 2, "http://www.example.com/2");
+	ASSERT_TRUE(frontier.addRequest(Doledb::makeKey(20, 3000, 2, false), &sreq));
+	EXPECT_TRUE(frontier.needsSave());
+
+	ASSERT_TRUE(frontier.save("."));
+	EXPECT_FALSE(frontier.needsSave());
+
+	SpiderFrontier frontier2;
+	ASSERT_TRUE(frontier2.load("."));
+	EXPECT_EQ(2, frontier2.getNumRequests());
+	EXPECT_FALSE(frontier2.needsSave());
+
+	int32_t ips[10];
+	ASSERT_EQ(2, getListIps(frontier2, ips, 10));
+	EXPECT_EQ(2, ips[0]);
+	EXPECT_EQ(1, ips[1]);
+
+	bool found = false;
+	frontier2.forEachRequest([&found](const SpiderRequest *r) {
+		if (strcmp(r->m_url, "http://www.example.com/2") == 0) {
+			found = true;
+		}
+	});
+	EXPECT_TRUE(found);
+
+	unlink("./spiderfrontier-saved.dat");
+}
@@ -137,3 +137,58 @@ TEST( SummaryTest, DefaultSummary ) {
 
 	EXPECT_STREQ( "cucumber. snegl snegl", summary.getSummary() );
 }
+
+TEST( SummaryTest, PassageIndex ) {
+	const char *head = "<title>Instrument prices by Acme Inc.</title>";
+	const char *body = "<h1>Unusual saxophone valuation</h1>\n"
+	                   "<script>var saxophone = 1;</script>\n"
+	                   "<p>Looking for knowing how much your saxophone is worth?</p>\n"
+	                   "<select><option>saxophone</option></select>\n";
+
+	char input[MAX_BUF_SIZE];
+	std::sprintf(input, HTML_FORMAT, head, body);
+
+	Xml xml;
+	ASSERT_TRUE(xml.set(input, strlen(input), 0, CT_HTML));
+
+	TokenizerResult tr;
+	xml_tokenizer_phase_1(&xml,&tr);
+
+	Bits bits;
+	ASSERT_TRUE(bits.set(&tr));
+
+	Url url;
+	url.set("http://www.example.com/");
+
+	Sections sections;
+	ASSERT_TRUE(sections.set(&tr, &bits, &url, CT_HTML));
+
+	SafeBuf sb;
+	ASSERT_TRUE(sections.serializePassageIndex(&sb));
+
+	Sections passageSections;
+	ASSERT_TRUE(passageSections.setFromPassageIndex(&tr, sb.getBufStart(), sb.length()));
+	ASSERT_EQ(sections.m_numSections > 0, passageSections.m_numSections > 0);
+
+	// same flags for every token
+	for (unsigned i = 0; i < tr.size(); i++) {
+		sec_t flags = sections.m_sectionPtrs[i] ? sections.m_sectionPtrs[i]->m_flags : 0;
+		sec_t passageFlags = passageSections.m_sectionPtrs[i] ? passageSections.m_sectionPtrs[i]->m_flags : 0;
+		EXPECT_EQ(flags & PASSAGE_INDEX_FLAGS, passageFlags & PASSAGE_INDEX_FLAGS);
+	}
+	EXPECT_EQ(sections.m_sections[0].m_flags & PASSAGE_INDEX_FLAGS, passageSections.m_sections[0].m_flags & PASSAGE_INDEX_FLAGS);
+
+	// must not be used for other tokens
+	char input2[MAX_BUF_SIZE];
+	std::sprintf(input2, HTML_FORMAT, "", body);
+
+	Xml xml2;
+	ASSERT_TRUE(xml2.set(input2, strlen(input2), 0, CT_HTML));
+
+	TokenizerResult tr2;
+	xml_tokenizer_phase_1(&xml2,&tr2);
+
+	Sections badSections;
+	EXPECT_FALSE(badSections.setFromPassageIndex(&tr2, sb.getBufStart(), sb.length()));
+	EXPECT_FALSE(badSections.setFromPassageIndex(&tr, sb.getBufStart(), sb.length() - 1));
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include "TimerWheel.h"
+#include <vector>
+#include <stdlib.h>
+
+// advance in steps and check that every timer pops in the step it expires
+static void checkExpiry(TimerWheel *wheel, std::vector<TimerWheel::Timer> *timers, int64_t start, int64_t end, int64_t step) {
+	size_t popped = 0;
+	for (int64_t now = start; now <= end; now += step) {
+		wheel->advance(now);
+		while (TimerWheel::Timer *t = wheel->popDue()) {
+			EXPECT_LE(t->m_expires, now);
+			EXPECT_GT(t->m_expires, now - step);
+			EXPECT_FALSE(TimerWheel::isScheduled(t));
+			++popped;
+		}
+	}
+	EXPECT_EQ(timers->size(), popped);
+	EXPECT_EQ(0U, wheel->size());
+}
+
+TEST(TimerWheelTest, Expiry) {
+	TimerWheel wheel;
+	std::vector<TimerWheel::Timer> timers(2000);
+
+	srand(1);
+	int64_t start = 1000000;
+	for (size_t i = 0; i < timers.size(); ++i) {
+		TimerWheel::initTimer(&timers[i], NULL);
+		// from 1ms to ~20 minutes
+		int64_t delay = 1 + rand() % (i % 2 ? 1000 : 1200000);
+		wheel.add(&timers[i], start + delay);
+	}
+	EXPECT_EQ(timers.size(), wheel.size());
+
+	checkExpiry(&wheel, &timers, start, start + 1200000, 7);
+}
+
+TEST(TimerWheelTest, FarAway) {
+	TimerWheel wheel;
+	std::vector<TimerWheel::Timer> timers(3);
+
+	int64_t start = 5000;
+	for (size_t i = 0; i < timers.size(); ++i) {
+		TimerWheel::initTimer(&timers[i], NULL);
+	}
+	wheel.add(&timers[0], start);
+	// beyond the range of the wheel
+	wheel.add(&timers[1], start + 30 * 3600 * 1000LL);
+	wheel.add(&timers[2], start + 90 * 3600 * 1000LL);
+
+	checkExpiry(&wheel, &timers, start, start + 100 * 3600 * 1000LL, 1000);
+}
+
+TEST(TimerWheelTest, LargeStep) {
+	TimerWheel wheel;
+	std::vector<TimerWheel::Timer> timers(100);
+
+	int64_t start = 123456;
+	for (size_t i = 0; i < timers.size(); ++i) {
+		TimerWheel::initTimer(&timers[i], NULL);
+		wheel.add(&timers[i], start + i * 1000);
+	}
+
+	// skips ahead by re-filing instead of ticking
+	checkExpiry(&wheel, &timers, start, start + 100000, 50000);
+}
+
+TEST(TimerWheelTest, Remove) {
+	TimerWheel wheel;
+	TimerWheel::Timer t1;
+	TimerWheel::Timer t2;
+	TimerWheel::initTimer(&t1, &t1);
+	TimerWheel::initTimer(&t2, &t2);
+
+	wheel.add(&t1, 100);
+	wheel.add(&t2, 20000);
+	EXPECT_TRUE(TimerWheel::isScheduled(&t2));
+
+	wheel.remove(&t2);
+	EXPECT_FALSE(TimerWheel::isScheduled(&t2));
+	EXPECT_EQ(1U, wheel.size());
+
+	// removing twice is fine
+	wheel.remove(&t2);
+
+	wheel.advance(100);
+	TimerWheel::Timer *t = wheel.popDue();
+	ASSERT_TRUE(t != NULL);
+	EXPECT_EQ(&t1, t->m_data);
+	EXPECT_TRUE(wheel.popDue() == NULL);
+
+	// removed from the due list
+	wheel.add(&t1, 50);
+	wheel.advance(200);
+	wheel.remove(&t1);
+	EXPECT_TRUE(wheel.popDue() == NULL);
+	EXPECT_EQ(0U, wheel.size());
+}
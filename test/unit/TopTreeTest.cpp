@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include "TopTree.h"
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+
+struct ScoredDoc {
+	float m_score;
+	int64_t m_docId;
+};
+
+// higher score first, lower docid first on ties
+static bool isBetter(const ScoredDoc &a, const ScoredDoc &b) {
+	if (a.m_score != b.m_score) return a.m_score > b.m_score;
+	return a.m_docId < b.m_docId;
+}
+
+static void addDocs(TopTree *tree, const std::vector<ScoredDoc> &docs) {
+	for (size_t i = 0; i < docs.size(); i++) {
+		int32_t tn = tree->getEmptyNode();
+		ASSERT_GE(tn, 0);
+		TopNode *t = tree->getNode(tn);
+		t->m_score = docs[i].m_score;
+		t->m_docId = docs[i].m_docId;
+		t->m_flags = 0;
+		tree->addNode(t, tn);
+		ASSERT_LE(tree->getNumUsedNodes(), tree->getNumDocsWanted());
+	}
+}
+
+static void checkTopDocs(TopTree *tree, std::vector<ScoredDoc> docs, int32_t docsWanted) {
+	std::sort(docs.begin(), docs.end(), isBetter);
+	if ((int32_t)docs.size() > docsWanted) docs.resize(docsWanted);
+
+	ASSERT_EQ((int32_t)docs.size(), tree->getNumUsedNodes());
+
+	size_t n = 0;
+	for (int32_t ti = tree->getHighNode(); ti >= 0; ti = tree->getPrev(ti), n++) {
+		ASSERT_LT(n, docs.size());
+		EXPECT_EQ(docs[n].m_docId, tree->getNode(ti)->m_docId);
+		EXPECT_EQ(docs[n].m_score, tree->getNode(ti)->m_score);
+	}
+	EXPECT_EQ(docs.size(), n);
+
+	if (!docs.empty()) {
+		EXPECT_EQ(docs.back().m_docId, tree->getNode(tree->getLowNode())->m_docId);
+	}
+}
+
+TEST(TopTreeTest, RandomScores) {
+	for (int32_t docsWanted : {1, 10, 100, 1000}) {
+		std::vector<ScoredDoc> docs;
+		srand(docsWanted);
+		// few distinct scores so there are plenty of ties
+		for (int64_t d = 1; d <= 5000; d++) {
+			ScoredDoc sd;
+			sd.m_score = (float)(rand() % 200);
+			sd.m_docId = d;
+			docs.push_back(sd);
+		}
+
+		TopTree tree;
+		ASSERT_TRUE(tree.setNumNodes(docsWanted, false));
+		addDocs(&tree, docs);
+		checkTopDocs(&tree, docs, docsWanted);
+
+		TopTree tree2;
+		ASSERT_TRUE(tree2.setNumNodes(docsWanted, true));
+		addDocs(&tree2, docs);
+		checkTopDocs(&tree2, docs, docsWanted);
+	}
+}
+
+TEST(TopTreeTest, MinWinningScore) {
+	TopTree tree;
+	ASSERT_TRUE(tree.setNumNodes(3, false));
+	EXPECT_EQ(-1.0, tree.getMinWinningScore());
+
+	std::vector<ScoredDoc> docs = {{5.0, 10}, {7.0, 11}, {6.0, 12}};
+	addDocs(&tree, docs);
+	EXPECT_EQ(5.0, tree.getMinWinningScore());
+	EXPECT_FALSE(tree.kickedOutDocIds());
+
+	// a tie with a higher docid does not get in, a lower docid does
+	std::vector<ScoredDoc> more = {{5.0, 20}, {5.0, 1}, {8.0, 30}};
+	addDocs(&tree, more);
+	EXPECT_TRUE(tree.kickedOutDocIds());
+	EXPECT_EQ(6.0, tree.getMinWinningScore());
+	EXPECT_TRUE(tree.hasDocId(30));
+	EXPECT_FALSE(tree.hasDocId(1));
+	EXPECT_FALSE(tree.hasDocId(10));
+
+	docs.insert(docs.end(), more.begin(), more.end());
+	checkTopDocs(&tree, docs, 3);
+}
+
+TEST(TopTreeTest, Resize) {
+	std::vector<ScoredDoc> docs;
+	for (int64_t d = 1; d <= 100; d++) {
+		docs.push_back({(float)((d * 37) % 101), d});
+	}
+
+	TopTree tree;
+	ASSERT_TRUE(tree.setNumNodes(50, false));
+	addDocs(&tree, docs);
+
+	// shrinking keeps the best ones
+	ASSERT_TRUE(tree.setNumNodes(20, false));
+	checkTopDocs(&tree, docs, 20);
+
+	ASSERT_TRUE(tree.setNumNodes(40, false));
+	std::vector<ScoredDoc> more;
+	for (int64_t d = 101; d <= 200; d++) {
+		more.push_back({(float)((d * 53) % 103), d});
+	}
+	addDocs(&tree, more);
+
+	// the docs dropped by the shrink are gone for good
+	std::sort(docs.begin(), docs.end(), isBetter);
+	docs.resize(20);
+	docs.insert(docs.end(), more.begin(), more.end());
+	checkTopDocs(&tree, docs, 40);
+}
@@ -0,0 +1,77 @@
+#include "TopTree.h"
+#include "Conf.h"
+#include "Mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+// Feed synthetic score streams through TopTree and print the adds per second.
+// Only uses the TopTree interface that the scorer uses so it can be built
+// against older revisions too.
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, const std::vector<float> &scores, int32_t docsWanted, bool doSiteClustering) {
+	TopTree tree;
+	if(!tree.setNumNodes(docsWanted, doSiteClustering)) {
+		printf("setNumNodes(%d) failed\n", docsWanted);
+		exit(1);
+	}
+
+	double start = now();
+	for(size_t i = 0; i < scores.size(); i++) {
+		int32_t tn = tree.getEmptyNode();
+		TopNode *t = tree.getNode(tn);
+		t->m_score = scores[i];
+		// docids are scored in ascending order, spread over the domain hash bits
+		t->m_docId = (int64_t)(i + 1) << 6;
+		t->m_flags = 0;
+		tree.addNode(t, tn);
+	}
+	double took = now() - start;
+
+	// and walk the winners like Msg39 does
+	int64_t sum = 0;
+	for(int32_t ti = tree.getHighNode(); ti >= 0; ti = tree.getPrev(ti))
+		sum += tree.getNode(ti)->m_docId;
+
+	printf("%-10s docsWanted=%-6d clustering=%d  %8.1f Madds/sec  (%d kept, checksum %lld)\n",
+	       name, docsWanted, doSiteClustering ? 1 : 0, scores.size() / took / 1e6,
+	       tree.getNumUsedNodes(), (long long)sum);
+}
+
+int main(void) {
+	g_conf.m_maxMem = 1000000000LL;
+	g_mem.setMemTableSize(8194*1024);
+	g_mem.init();
+
+	const size_t numDocs = 5000000;
+
+	std::vector<float> randomScores(numDocs);
+	std::vector<float> risingScores(numDocs);
+	std::vector<float> fallingScores(numDocs);
+	srand(1);
+	for(size_t i = 0; i < numDocs; i++) {
+		randomScores[i]  = (float)(rand() % 100000) / 7.0f;
+		risingScores[i]  = (float)i;
+		fallingScores[i] = (float)(numDocs - i);
+	}
+
+	for(int32_t docsWanted : {10, 100, 1000, 10000}) {
+		for(bool doSiteClustering : {false, true}) {
+			// most docids fall out right away
+			run("random", randomScores, docsWanted, doSiteClustering);
+			// every docid gets in and evicts the lowest
+			run("rising", risingScores, docsWanted, doSiteClustering);
+			// every docid after the first few is rejected
+			run("falling", fallingScores, docsWanted, doSiteClustering);
+		}
+	}
+
+	return 0;
+}